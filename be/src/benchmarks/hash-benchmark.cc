@@ -8,9 +8,13 @@
 #include <boost/functional/hash.hpp>
 
 #include "codegen/llvm-codegen.h"
+#include "exec/hash-table.inline.h"
 #include "experiments/data-provider.h"
+#include "exprs/expr.h"
+#include "runtime/mem-pool.h"
 #include "runtime/raw-value.h"
 #include "runtime/string-value.h"
+#include "runtime/tuple-row.h"
 #include "util/benchmark.h"
 #include "util/cpu-info.h"
 #include "util/hash-util.h"
@@ -59,6 +63,12 @@ using namespace std;
 //  Boost Mixed Collisions: 374
 //  Crc Mixed Collisions: 376
 //  Codegen Mixed Collisions: 376
+//
+// The HashTable benchmarks build a table on a single int key with HASH_TABLE_ROWS
+// rows (each key appearing twice) and probe it with the same number of rows, half
+// of which have a match, either one row at a time or in batches with the buckets
+// prefetched.  The rates are in tables built/probed per ms, so they are
+// only comparable between runs of this benchmark.
 typedef uint32_t (*CodegenHashFn)(int rows, char* data, int32_t* results);
 
 struct TestData {
@@ -223,6 +233,72 @@ void TestBoostMixedHash(int batch, void* d) {
   }
 }
 
+struct HashTableData {
+  vector<Expr*> build_exprs;
+  vector<Expr*> probe_exprs;
+  vector<TupleRow*> build_rows;
+  vector<TupleRow*> probe_rows;
+  HashTable* table;
+  int64_t num_matches;
+};
+
+TupleRow* CreateIntRow(MemPool* pool, int32_t val) {
+  TupleRow* row = reinterpret_cast<TupleRow*>(pool->Allocate(sizeof(Tuple*)));
+  int32_t* tuple = reinterpret_cast<int32_t*>(pool->Allocate(sizeof(int32_t)));
+  *tuple = val;
+  row->SetTuple(0, reinterpret_cast<Tuple*>(tuple));
+  return row;
+}
+
+void TestHashTableBuild(int batch, void* d) {
+  HashTableData* data = reinterpret_cast<HashTableData*>(d);
+  for (int i = 0; i < batch; ++i) {
+    HashTable table(data->build_exprs, data->probe_exprs, 1, false);
+    for (int j = 0; j < data->build_rows.size(); ++j) {
+      table.Insert(data->build_rows[j]);
+    }
+  }
+}
+
+void TestHashTableProbe(int batch, void* d) {
+  HashTableData* data = reinterpret_cast<HashTableData*>(d);
+  for (int i = 0; i < batch; ++i) {
+    data->num_matches = 0;
+    for (int j = 0; j < data->probe_rows.size(); ++j) {
+      HashTable::Iterator it = data->table->Find(data->probe_rows[j]);
+      while (it.HasNext()) {
+        ++data->num_matches;
+        it.Next<true>();
+      }
+    }
+  }
+}
+
+// Same as TestHashTableProbe, but hashes and prefetches each batch of 1024 probe rows
+// before looking them up, like HashJoinNode::ProcessProbeBatch().
+void TestHashTableBatchedProbe(int batch, void* d) {
+  HashTableData* data = reinterpret_cast<HashTableData*>(d);
+  const int PROBE_BATCH_SIZE = 1024;
+  uint32_t hashes[PROBE_BATCH_SIZE];
+  for (int i = 0; i < batch; ++i) {
+    data->num_matches = 0;
+    for (int j = 0; j < data->probe_rows.size(); j += PROBE_BATCH_SIZE) {
+      int num_rows = min<int>(PROBE_BATCH_SIZE, data->probe_rows.size() - j);
+      TupleRow** rows = &data->probe_rows[j];
+      for (int k = 0; k < num_rows; ++k) {
+        data->table->HashAndPrefetch(rows[k], &hashes[k]);
+      }
+      for (int k = 0; k < num_rows; ++k) {
+        HashTable::Iterator it = data->table->FindHashed(rows[k], hashes[k]);
+        while (it.HasNext()) {
+          ++data->num_matches;
+          it.Next<true>();
+        }
+      }
+    }
+  }
+}
+
 int NumCollisions(TestData* data, int num_buckets) {
   vector<bool> buckets;
   buckets.resize(num_buckets);
@@ -450,6 +526,36 @@ int main(int argc, char **argv) {
   cout << "Boost Mixed Collisions: " << boost_mixed_collisions << endl;
   cout << "Crc Mixed Collisions: " << crc_mixed_collisions << endl;
   cout << "Codegen Mixed Collisions: " << codegen_mixed_collisions << endl;
+  cout << endl;
+
+  const int HASH_TABLE_ROWS = 1024 * 1024;
+  HashTableData table_data;
+  RowDescriptor desc;
+  table_data.build_exprs.push_back(obj_pool.Add(new SlotRef(TYPE_INT, 0)));
+  table_data.probe_exprs.push_back(obj_pool.Add(new SlotRef(TYPE_INT, 0)));
+  status = Expr::Prepare(table_data.build_exprs, NULL, desc);
+  DCHECK(status.ok());
+  status = Expr::Prepare(table_data.probe_exprs, NULL, desc);
+  DCHECK(status.ok());
+  for (int i = 0; i < HASH_TABLE_ROWS; ++i) {
+    table_data.build_rows.push_back(CreateIntRow(&mem_pool, i / 2));
+    table_data.probe_rows.push_back(CreateIntRow(&mem_pool, rand() % HASH_TABLE_ROWS));
+  }
+  HashTable table(table_data.build_exprs, table_data.probe_exprs, 1, false);
+  for (int i = 0; i < table_data.build_rows.size(); ++i) {
+    table.Insert(table_data.build_rows[i]);
+  }
+  table_data.table = &table;
+
+  double build_rate = Benchmark::Measure(TestHashTableBuild, &table_data, 5000, 1);
+  double probe_rate = Benchmark::Measure(TestHashTableProbe, &table_data, 5000, 1);
+  double batched_probe_rate =
+      Benchmark::Measure(TestHashTableBatchedProbe, &table_data, 5000, 1);
+
+  cout << "HashTable Build Rate: " << build_rate << endl;
+  cout << "HashTable Probe Rate: " << probe_rate << endl;
+  cout << "HashTable Batched Probe Rate: " << batched_probe_rate << endl;
+  cout << "HashTable Probe Matches: " << table_data.num_matches << endl;
 
   return 0;
 }
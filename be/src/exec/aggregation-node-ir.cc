@@ -3,10 +3,13 @@
 #include "exec/aggregation-node.h"
 
 #include "exec/hash-table.inline.h"
+#include "runtime/raw-value.h"
 #include "runtime/row-batch.h"
 #include "runtime/runtime-state.h"
+#include "runtime/string-value.h"
 #include "runtime/tuple.h"
 #include "runtime/tuple-row.h"
+#include "util/hyperloglog.h"
 
 using namespace impala;
 
@@ -14,14 +17,14 @@ using namespace impala;
 // are modified at runtime with a query specific codegen'd UpdateAggTuple
 
 void AggregationNode::ProcessRowBatchNoGrouping(RowBatch* batch) {
-  for (int i = 0; i < batch->num_rows(); ++i) {
-    UpdateAggTuple(singleton_output_tuple_, batch->GetRow(i));
+  for (int i = 0; i < batch->num_active_rows(); ++i) {
+    UpdateAggTuple(singleton_output_tuple_, batch->GetActiveRow(i));
   }
 }
 
 void AggregationNode::ProcessRowBatchWithGrouping(RowBatch* batch) {
-  for (int i = 0; i < batch->num_rows(); ++i) {
-    TupleRow* row = batch->GetRow(i);
+  for (int i = 0; i < batch->num_active_rows(); ++i) {
+    TupleRow* row = batch->GetActiveRow(i);
     AggregationTuple* agg_tuple = NULL; 
     HashTable::Iterator entry = hash_tbl_->Find(row);
     if (!entry.HasNext()) {
@@ -34,3 +37,18 @@ void AggregationNode::ProcessRowBatchWithGrouping(RowBatch* batch) {
   }
 }
 
+void AggregationNode::UpdateHllSlot(AggregationTuple* agg_tuple, int string_slot_idx,
+    void* slot, void* value, PrimitiveType type) {
+  DCHECK(value != NULL);
+  StringValue* dst_value = static_cast<StringValue*>(slot);
+  // 'type' is a constant in the codegen'd UpdateAggTuple, so the hash is specialized
+  // for the type when this is inlined.
+  uint64_t hash = RawValue::GetHashValue64(value, type);
+  int max_size = HyperLogLog::MaxSizeAfterInsert(
+      reinterpret_cast<uint8_t*>(dst_value->ptr), dst_value->len);
+  if (max_size > dst_value->len) {
+    ReserveHllSlot(agg_tuple, string_slot_idx, dst_value, max_size);
+  }
+  dst_value->len = HyperLogLog::Insert(reinterpret_cast<uint8_t*>(dst_value->ptr),
+      dst_value->len, hash);
+}
@@ -4,12 +4,14 @@
 
 #include <math.h>
 #include <sstream>
+#include <boost/bind.hpp>
 #include <boost/functional/hash.hpp>
 
 #include <x86intrin.h>
 
 #include "codegen/llvm-codegen.h"
 #include "exec/hash-table.inline.h"
+#include "exec/hdfs-scan-node.h"
 #include "exprs/agg-expr.h"
 #include "exprs/expr.h"
 #include "runtime/descriptors.h"
@@ -17,10 +19,12 @@
 #include "runtime/raw-value.h"
 #include "runtime/row-batch.h"
 #include "runtime/runtime-state.h"
+#include "runtime/spill-stream.h"
 #include "runtime/string-value.inline.h"
 #include "runtime/tuple.h"
 #include "runtime/tuple-row.h"
 #include "util/debug-util.h"
+#include "util/hyperloglog.h"
 #include "util/runtime-profile.h"
 
 #include "gen-cpp/Exprs_types.h"
@@ -31,6 +35,16 @@ using namespace std;
 using namespace boost;
 using namespace llvm;
 
+DEFINE_int64(agg_buffer_size, 256L * 1024L * 1024L,
+    "Number of bytes an aggregation node may use for its hash table before it spills "
+    "partial aggregates to disk.");
+DEFINE_bool(enable_scan_preaggregation, true,
+    "If true, the GROUP BY of an aggregation over an hdfs scan is partially computed "
+    "by each scanner thread before the rows are passed to the aggregation node.");
+DEFINE_int32(scan_preagg_buffer_size, 256 * 1024,
+    "Number of bytes a scanner thread may use to pre-aggregate rows before it flushes "
+    "the partial aggregates to the aggregation node.  Should fit in the L2 cache.");
+
 // This object appends n-int32s to the end of a normal tuple object to maintain the
 // lengths of the string buffers in the tuple.
 namespace impala {
@@ -39,6 +53,9 @@ const char* AggregationNode::LLVM_CLASS_NAME = "class.impala::AggregationNode";
 const int AggregationNode::NUM_PC_BITMAPS = 64;
 const int AggregationNode::PC_BITMAP_LENGTH = 32;
 const float AggregationNode::PC_THETA = 0.77351;
+// Header and 8 sparse registers.  Also large enough for the finalized estimate.
+const int AggregationNode::HLL_INITIAL_BUFFER_SIZE =
+    HyperLogLog::EMPTY_SIZE + 8 * sizeof(uint32_t);
 
 class AggregationTuple {
  public:
@@ -69,7 +86,6 @@ class AggregationTuple {
 
 const char* AggregationTuple::LLVM_CLASS_NAME = "class.impala::AggregationTuple";
 
-// TODO: pass in maximum size; enforce by setting limit in mempool
 // TODO: have a Status ExecNode::Init(const TPlanNode&) member function
 // that does initialization outside of c'tor, so we can indicate errors
 AggregationNode::AggregationNode(ObjectPool* pool, const TPlanNode& tnode,
@@ -79,10 +95,12 @@ AggregationNode::AggregationNode(ObjectPool* pool, const TPlanNode& tnode,
     agg_tuple_desc_(NULL),
     singleton_output_tuple_(NULL),
     num_string_slots_(0),
-    tuple_pool_(new MemPool()),
     codegen_process_row_batch_fn_(NULL),
     process_row_batch_fn_(NULL),
-    needs_finalize_(tnode.agg_node.need_finalize) {
+    needs_finalize_(tnode.agg_node.need_finalize),
+    build_level_(0),
+    thrift_plan_node_(new TPlanNode(tnode)),
+    preaggregated_input_(false) {
   // ignore return status for now
   Expr::CreateExprTrees(pool, tnode.agg_node.grouping_exprs, &probe_exprs_);
   Expr::CreateExprTrees(pool, tnode.agg_node.aggregate_exprs, &aggregate_exprs_);
@@ -97,12 +115,38 @@ Status AggregationNode::Prepare(RuntimeState* state) {
       ADD_COUNTER(runtime_profile(), "GetResultsTime", TCounterType::CPU_TICKS);
   hash_table_buckets_counter_ = 
       ADD_COUNTER(runtime_profile(), "BuildBuckets", TCounterType::UNIT);
+  num_spills_counter_ =
+      ADD_COUNTER(runtime_profile(), "Spills", TCounterType::UNIT);
+  spilled_bytes_counter_ =
+      ADD_COUNTER(runtime_profile(), "SpilledBytes", TCounterType::BYTES);
 
   SCOPED_TIMER(runtime_profile_->total_time_counter());
+
+  RETURN_IF_ERROR(PrepareAggregation(state, child(0)->row_desc(), false));
   
+  if (probe_exprs_.empty()) {
+    // create single output tuple now; we need to output something
+    // even if our input is empty
+    singleton_output_tuple_ = ConstructAggTuple();
+  }
+
+  LlvmCodeGen* codegen = state->llvm_codegen();
+  if (codegen != NULL) {
+    Function* update_tuple_fn = CodegenUpdateAggTuple(codegen);
+    if (update_tuple_fn != NULL) {
+      codegen_process_row_batch_fn_ = CodegenProcessRowBatch(codegen, update_tuple_fn);
+    }
+  }
+  return Status::OK;
+}
+
+Status AggregationNode::PrepareAggregation(RuntimeState* state,
+    const RowDescriptor& input_row_desc, bool disable_codegen) {
+  tuple_pool_.reset(new MemPool(mem_tracker()));
   agg_tuple_desc_ = state->desc_tbl().GetTupleDescriptor(agg_tuple_id_);
-  RETURN_IF_ERROR(Expr::Prepare(probe_exprs_, state, child(0)->row_desc()));
-  RETURN_IF_ERROR(Expr::Prepare(aggregate_exprs_, state, child(0)->row_desc()));
+  RETURN_IF_ERROR(Expr::Prepare(probe_exprs_, state, input_row_desc, disable_codegen));
+  RETURN_IF_ERROR(
+      Expr::Prepare(aggregate_exprs_, state, input_row_desc, disable_codegen));
 
   // Construct build exprs from agg_tuple_desc_
   for (int i = 0; i < probe_exprs_.size(); ++i) {
@@ -111,10 +155,11 @@ Status AggregationNode::Prepare(RuntimeState* state) {
     state->obj_pool()->Add(expr);
     build_exprs_.push_back(expr);
   }
-  RETURN_IF_ERROR(Expr::Prepare(build_exprs_, state, row_desc()));
+  RETURN_IF_ERROR(Expr::Prepare(build_exprs_, state, row_desc(), disable_codegen));
 
   // TODO: how many buckets?
-  hash_tbl_.reset(new HashTable(build_exprs_, probe_exprs_, 1, true));
+  hash_tbl_.reset(new HashTable(build_exprs_, probe_exprs_, 1, true,
+      HashTable::DEFAULT_INITIAL_BUCKETS, mem_tracker()));
   
   // Determine the number of string slots in the output
   for (vector<Expr*>::const_iterator expr = aggregate_exprs_.begin();
@@ -122,20 +167,6 @@ Status AggregationNode::Prepare(RuntimeState* state) {
     AggregateExpr* agg_expr = static_cast<AggregateExpr*>(*expr);
     if (agg_expr->type() == TYPE_STRING) ++num_string_slots_;
   }
-  
-  if (probe_exprs_.empty()) {
-    // create single output tuple now; we need to output something
-    // even if our input is empty
-    singleton_output_tuple_ = ConstructAggTuple();
-  }
-
-  LlvmCodeGen* codegen = state->llvm_codegen();
-  if (codegen != NULL) {
-    Function* update_tuple_fn = CodegenUpdateAggTuple(codegen);
-    if (update_tuple_fn != NULL) {
-      codegen_process_row_batch_fn_ = CodegenProcessRowBatch(codegen, update_tuple_fn);
-    }
-  }
   return Status::OK;
 }
 
@@ -152,9 +183,14 @@ Status AggregationNode::Open(RuntimeState* state) {
               << ") using llvm codegend functions.";
   }
 
+  if (FLAGS_enable_scan_preaggregation && !probe_exprs_.empty() &&
+      children_[0]->type() == TPlanNodeType::HDFS_SCAN_NODE) {
+    InitScanPreAggregation(state, static_cast<HdfsScanNode*>(children_[0]));
+  }
   RETURN_IF_ERROR(children_[0]->Open(state));
 
-  RowBatch batch(children_[0]->row_desc(), state->batch_size());
+  RowBatch batch(children_[0]->row_desc(), state->batch_size(), mem_tracker());
+  batch.set_selection_enabled(true);
   int64_t num_input_rows = 0;
   int64_t num_agg_rows = 0;
   while (true) {
@@ -163,14 +199,16 @@ Status AggregationNode::Open(RuntimeState* state) {
     RETURN_IF_ERROR(children_[0]->GetNext(state, &batch, &eos));
     SCOPED_TIMER(build_timer_);
 
-    if (VLOG_ROW_IS_ON) {
-      for (int i = 0; i < batch.num_rows(); ++i) {
-        TupleRow* row = batch.GetRow(i);
+    if (VLOG_ROW_IS_ON && !preaggregated_input_) {
+      for (int i = 0; i < batch.num_active_rows(); ++i) {
+        TupleRow* row = batch.GetActiveRow(i);
         VLOG_ROW << "input row: " << PrintRow(row, children_[0]->row_desc());
       }
     }
     int64_t agg_rows_before = hash_tbl_->size();
-    if (process_row_batch_fn_ != NULL) {
+    if (preaggregated_input_) {
+      MergeRowBatch(&batch);
+    } else if (process_row_batch_fn_ != NULL) {
       process_row_batch_fn_(this, &batch);
     } else if (singleton_output_tuple_ != NULL) {
       ProcessRowBatchNoGrouping(&batch);
@@ -178,12 +216,12 @@ Status AggregationNode::Open(RuntimeState* state) {
       ProcessRowBatchWithGrouping(&batch);
     }
     COUNTER_SET(hash_table_buckets_counter_, hash_tbl_->num_buckets());
-    COUNTER_SET(memory_used_counter(), 
-        tuple_pool_->peak_allocated_bytes() + hash_tbl_->byte_size());
     num_agg_rows += (hash_tbl_->size() - agg_rows_before);
-    num_input_rows += batch.num_rows();
+    num_input_rows += batch.num_active_rows();
 
     batch.Reset();
+    if (ShouldSpill()) RETURN_IF_ERROR(SpillHashTable(state));
+    RETURN_IF_ERROR(state->CheckMemLimit());
     if (eos) break;
   }
   
@@ -193,6 +231,13 @@ Status AggregationNode::Open(RuntimeState* state) {
   }
   VLOG_FILE << "aggregated " << num_input_rows << " input rows into "
             << num_agg_rows << " output rows";
+
+  if (!build_partitions_.empty()) {
+    // The table was spilled; spill the rest and aggregate the partitions one by one.
+    RETURN_IF_ERROR(SpillHashTable(state));
+    FinishBuildPartitions();
+    RETURN_IF_ERROR(AggregateSpilledPartition(state));
+  }
   output_iterator_ = hash_tbl_->Begin();
   return Status::OK;
 }
@@ -209,31 +254,49 @@ Status AggregationNode::GetNext(RuntimeState* state, RowBatch* row_batch, bool*
   Expr** conjuncts = &conjuncts_[0];
   int num_conjuncts = conjuncts_.size();
 
-  while (output_iterator_.HasNext() && !row_batch->IsFull()) {
-    int row_idx = row_batch->AddRow();
-    TupleRow* row = row_batch->GetRow(row_idx);
-    Tuple* agg_tuple = output_iterator_.GetRow()->GetTuple(0);
-    if (needs_finalize_) {
-      FinalizeAggTuple(reinterpret_cast<AggregationTuple*>(agg_tuple));
+  while (true) {
+    while (output_iterator_.HasNext() && !row_batch->IsFull()) {
+      int row_idx = row_batch->AddRow();
+      TupleRow* row = row_batch->GetRow(row_idx);
+      Tuple* agg_tuple = output_iterator_.GetRow()->GetTuple(0);
+      if (needs_finalize_) {
+        FinalizeAggTuple(reinterpret_cast<AggregationTuple*>(agg_tuple));
+      }
+      row->SetTuple(0, agg_tuple);
+      if (ExecNode::EvalConjuncts(conjuncts, num_conjuncts, row)) {
+        VLOG_ROW << "output row: " << PrintRow(row, row_desc());
+        row_batch->CommitLastRow();
+        ++num_rows_returned_;
+        if (ReachedLimit()) break;
+      }
+      output_iterator_.Next<false>();
     }
-    row->SetTuple(0, agg_tuple);
-    if (ExecNode::EvalConjuncts(conjuncts, num_conjuncts, row)) {
-      VLOG_ROW << "output row: " << PrintRow(row, row_desc());
-      row_batch->CommitLastRow();
-      ++num_rows_returned_;
-      if (ReachedLimit()) break;
+    if (output_iterator_.HasNext() || ReachedLimit() || spilled_partitions_.empty()) {
+      break;
     }
-    output_iterator_.Next<false>();
+    // The current table has been returned.  The returned rows reference tuple_pool_,
+    // so hand its memory to row_batch before aggregating the next spilled partition.
+    RETURN_IF_CANCELLED(state);
+    row_batch->tuple_data_pool()->AcquireData(tuple_pool_.get(), false);
+    RETURN_IF_ERROR(AggregateSpilledPartition(state));
+    output_iterator_ = hash_tbl_->Begin();
   }
-  *eos = !output_iterator_.HasNext() || ReachedLimit();
+  *eos = (!output_iterator_.HasNext() && spilled_partitions_.empty()) || ReachedLimit();
   COUNTER_SET(rows_returned_counter_, num_rows_returned_);
   return Status::OK;
 }
 
 Status AggregationNode::Close(RuntimeState* state) {
-  COUNTER_SET(memory_used_counter(), 
-      tuple_pool_->peak_allocated_bytes() + hash_tbl_->byte_size());
   COUNTER_SET(hash_table_buckets_counter_, hash_tbl_->num_buckets());
+  for (int i = 0; i < build_partitions_.size(); ++i) {
+    delete build_partitions_[i];
+  }
+  build_partitions_.clear();
+  for (list<SpilledPartition>::iterator it = spilled_partitions_.begin();
+      it != spilled_partitions_.end(); ++it) {
+    delete it->stream;
+  }
+  spilled_partitions_.clear();
   return ExecNode::Close(state);
 }
 
@@ -303,6 +366,10 @@ AggregationTuple* AggregationNode::ConstructAggTuple() {
         agg_expr->agg_op() == TAggregationOp::MERGE_PCSA) {
       ConstructDistinctEstimateSlot(agg_out_tuple,
           (*slot_desc)->null_indicator_offset(), string_slot_idx, slot);
+    } else if (agg_expr->agg_op() == TAggregationOp::HLL ||
+        agg_expr->agg_op() == TAggregationOp::MERGE_HLL) {
+      ConstructHllSlot(agg_out_tuple, (*slot_desc)->null_indicator_offset(),
+          string_slot_idx, slot);
     }
   }
 
@@ -554,12 +621,361 @@ void AggregationNode::UpdateAggTuple(AggregationTuple* agg_out_tuple, TupleRow*
         UpdateMergeEstimateSlot(agg_out_tuple, string_slot_idx, slot, value);
         break;
 
+      case TAggregationOp::HLL:
+        UpdateHllSlot(agg_out_tuple, string_slot_idx, slot, value,
+            agg_expr->GetChild(0)->type());
+        break;
+
+      case TAggregationOp::MERGE_HLL:
+        DCHECK_EQ(agg_expr->GetChild(0)->type(), TYPE_STRING);
+        MergeHllSlot(agg_out_tuple, string_slot_idx, slot, value);
+        break;
+
+      default:
+        DCHECK(false) << "bad aggregate operator: " << agg_expr->agg_op();
+    }
+  }
+}
+
+template <typename T>
+static void MergeNumericSlot(TAggregationOp::type op, Tuple* tuple,
+    const NullIndicatorOffset& null_indicator_offset, void* slot, void* value) {
+  switch (op) {
+    case TAggregationOp::MIN:
+      UpdateMinSlot<T>(tuple, null_indicator_offset, slot, value);
+      break;
+    case TAggregationOp::MAX:
+      UpdateMaxSlot<T>(tuple, null_indicator_offset, slot, value);
+      break;
+    case TAggregationOp::SUM:
+      UpdateSumSlot<T>(tuple, null_indicator_offset, slot, value);
+      break;
+    default:
+      DCHECK(false) << "bad aggregate operator: " << op;
+  }
+}
+
+void AggregationNode::MergeAggTuple(AggregationTuple* agg_out_tuple, Tuple* src) {
+  DCHECK(agg_out_tuple != NULL);
+  Tuple* tuple = agg_out_tuple->tuple();
+  int string_slot_idx = -1;
+  vector<SlotDescriptor*>::const_iterator slot_desc =
+      agg_tuple_desc_->slots().begin() + probe_exprs_.size();
+  for (vector<Expr*>::const_iterator expr = aggregate_exprs_.begin();
+      expr != aggregate_exprs_.end(); ++expr, ++slot_desc) {
+    AggregateExpr* agg_expr = static_cast<AggregateExpr*>(*expr);
+    if (agg_expr->type() == TYPE_STRING) ++string_slot_idx;
+
+    // A NULL partial aggregate means no values were aggregated.
+    const NullIndicatorOffset& null_indicator_offset =
+        (*slot_desc)->null_indicator_offset();
+    if (src->IsNull(null_indicator_offset)) continue;
+    void* slot = tuple->GetSlot((*slot_desc)->tuple_offset());
+    void* value = src->GetSlot((*slot_desc)->tuple_offset());
+
+    switch (agg_expr->agg_op()) {
+      case TAggregationOp::COUNT:
+        // Partial counts are summed
+        *reinterpret_cast<int64_t*>(slot) += *reinterpret_cast<int64_t*>(value);
+        break;
+
+      case TAggregationOp::MIN:
+      case TAggregationOp::MAX:
+      case TAggregationOp::SUM:
+        switch (agg_expr->type()) {
+          case TYPE_BOOLEAN:
+            MergeNumericSlot<bool>(agg_expr->agg_op(), tuple, null_indicator_offset,
+                slot, value);
+            break;
+          case TYPE_TINYINT:
+            MergeNumericSlot<int8_t>(agg_expr->agg_op(), tuple, null_indicator_offset,
+                slot, value);
+            break;
+          case TYPE_SMALLINT:
+            MergeNumericSlot<int16_t>(agg_expr->agg_op(), tuple, null_indicator_offset,
+                slot, value);
+            break;
+          case TYPE_INT:
+            MergeNumericSlot<int32_t>(agg_expr->agg_op(), tuple, null_indicator_offset,
+                slot, value);
+            break;
+          case TYPE_BIGINT:
+            MergeNumericSlot<int64_t>(agg_expr->agg_op(), tuple, null_indicator_offset,
+                slot, value);
+            break;
+          case TYPE_FLOAT:
+            MergeNumericSlot<float>(agg_expr->agg_op(), tuple, null_indicator_offset,
+                slot, value);
+            break;
+          case TYPE_DOUBLE:
+            MergeNumericSlot<double>(agg_expr->agg_op(), tuple, null_indicator_offset,
+                slot, value);
+            break;
+          case TYPE_TIMESTAMP:
+            DCHECK_NE(agg_expr->agg_op(), TAggregationOp::SUM);
+            if (agg_expr->agg_op() == TAggregationOp::MIN) {
+              UpdateMinSlot<TimestampValue>(tuple, null_indicator_offset, slot, value);
+            } else {
+              UpdateMaxSlot<TimestampValue>(tuple, null_indicator_offset, slot, value);
+            }
+            break;
+          case TYPE_STRING:
+            DCHECK_NE(agg_expr->agg_op(), TAggregationOp::SUM);
+            if (agg_expr->agg_op() == TAggregationOp::MIN) {
+              UpdateMinStringSlot(agg_out_tuple, null_indicator_offset,
+                  string_slot_idx, slot, value);
+            } else {
+              UpdateMaxStringSlot(agg_out_tuple, null_indicator_offset,
+                  string_slot_idx, slot, value);
+            }
+            break;
+          default:
+            DCHECK(false) << "invalid type: " << TypeToString(agg_expr->type());
+        };
+        break;
+
+      case TAggregationOp::DISTINCT_PC:
+      case TAggregationOp::DISTINCT_PCSA:
+      case TAggregationOp::MERGE_PC:
+      case TAggregationOp::MERGE_PCSA:
+        // Partial bitmaps are or'ed together
+        UpdateMergeEstimateSlot(agg_out_tuple, string_slot_idx, slot, value);
+        break;
+
+      case TAggregationOp::HLL:
+      case TAggregationOp::MERGE_HLL:
+        MergeHllSlot(agg_out_tuple, string_slot_idx, slot, value);
+        break;
+
       default:
         DCHECK(false) << "bad aggregate operator: " << agg_expr->agg_op();
     }
   }
 }
 
+int64_t AggregationNode::hash_table_bytes() const {
+  return tuple_pool_->total_allocated_bytes() + hash_tbl_->byte_size();
+}
+
+bool AggregationNode::ShouldSpill() const {
+  // Aggregation without grouping only has a single tuple.
+  if (singleton_output_tuple_ != NULL) return false;
+  if (build_level_ > MAX_PARTITION_LEVEL) return false;
+  return hash_table_bytes() > FLAGS_agg_buffer_size;
+}
+
+void AggregationNode::ResetHashTable(bool merge) {
+  hash_tbl_.reset(new HashTable(build_exprs_, merge ? build_exprs_ : probe_exprs_, 1,
+      true, HashTable::DEFAULT_INITIAL_BUCKETS, mem_tracker()));
+  // The free list points into tuple_pool_
+  string_buffer_free_list_.Reset();
+  tuple_pool_->Clear();
+}
+
+int AggregationNode::GetPartition(TupleRow* row, int level) {
+  // Use a different seed per level so that repartitioning a partition splits it.
+  // This is a different hash function from the one used by the hash table, so the
+  // rows within a partition are still spread over all buckets.
+  uint32_t hash = HashUtil::FVN_SEED + level;
+  for (int i = 0; i < build_exprs_.size(); ++i) {
+    hash = RawValue::GetHashValue(
+        build_exprs_[i]->GetValue(row), build_exprs_[i]->type(), hash);
+  }
+  return hash % NUM_PARTITIONS;
+}
+
+Status AggregationNode::SpillHashTable(RuntimeState* state) {
+  DCHECK(singleton_output_tuple_ == NULL);
+  if (build_partitions_.empty()) {
+    for (int i = 0; i < NUM_PARTITIONS; ++i) {
+      build_partitions_.push_back(new SpillStream(row_desc()));
+      RETURN_IF_ERROR(build_partitions_.back()->Init());
+    }
+  }
+
+  vector<RowBatch*> batches;
+  for (int i = 0; i < NUM_PARTITIONS; ++i) {
+    batches.push_back(new RowBatch(row_desc(), state->batch_size(), mem_tracker()));
+  }
+  int64_t bytes_before = 0;
+  for (int i = 0; i < NUM_PARTITIONS; ++i) {
+    bytes_before += build_partitions_[i]->bytes_written();
+  }
+
+  Status status;
+  for (HashTable::Iterator it = hash_tbl_->Begin(); it.HasNext() && status.ok();
+      it.Next<false>()) {
+    TupleRow* row = it.GetRow();
+    int partition = GetPartition(row, build_level_);
+    RowBatch* batch = batches[partition];
+    int row_idx = batch->AddRow();
+    batch->CopyRow(row, batch->GetRow(row_idx));
+    batch->CommitLastRow();
+    if (batch->IsFull()) {
+      status = build_partitions_[partition]->AddBatch(batch);
+      batch->Reset();
+    }
+  }
+  int64_t bytes_after = 0;
+  for (int i = 0; i < NUM_PARTITIONS; ++i) {
+    if (status.ok()) status = build_partitions_[i]->AddBatch(batches[i]);
+    delete batches[i];
+    bytes_after += build_partitions_[i]->bytes_written();
+  }
+  RETURN_IF_ERROR(status);
+
+  VLOG_FILE << "AggregationNode(node_id=" << id() << ") spilled " << hash_tbl_->size()
+            << " aggregation tuples at level " << build_level_;
+  COUNTER_UPDATE(num_spills_counter_, 1);
+  COUNTER_UPDATE(spilled_bytes_counter_, bytes_after - bytes_before);
+  ResetHashTable(build_level_ > 0 || preaggregated_input_);
+  return Status::OK;
+}
+
+void AggregationNode::FinishBuildPartitions() {
+  for (int i = 0; i < build_partitions_.size(); ++i) {
+    if (build_partitions_[i]->num_rows() == 0) {
+      delete build_partitions_[i];
+      continue;
+    }
+    SpilledPartition partition;
+    partition.stream = build_partitions_[i];
+    partition.level = build_level_;
+    spilled_partitions_.push_back(partition);
+  }
+  build_partitions_.clear();
+}
+
+Status AggregationNode::AggregateSpilledPartition(RuntimeState* state) {
+  DCHECK(!spilled_partitions_.empty());
+  DCHECK(build_partitions_.empty());
+  SpilledPartition partition = spilled_partitions_.front();
+  spilled_partitions_.pop_front();
+  scoped_ptr<SpillStream> stream(partition.stream);
+  build_level_ = partition.level + 1;
+  ResetHashTable(true);
+
+  SCOPED_TIMER(build_timer_);
+  RETURN_IF_ERROR(stream->PrepareForRead());
+  while (true) {
+    RETURN_IF_CANCELLED(state);
+    RowBatch* raw_batch;
+    RETURN_IF_ERROR(stream->GetNext(&raw_batch));
+    if (raw_batch == NULL) break;
+    scoped_ptr<RowBatch> batch(raw_batch);
+    MergeRowBatch(batch.get());
+    if (ShouldSpill()) RETURN_IF_ERROR(SpillHashTable(state));
+    RETURN_IF_ERROR(state->CheckMemLimit());
+  }
+
+  if (!build_partitions_.empty()) {
+    // The partition didn't fit; it is now completely in the next level's partitions.
+    RETURN_IF_ERROR(SpillHashTable(state));
+    FinishBuildPartitions();
+  }
+  COUNTER_SET(hash_table_buckets_counter_, hash_tbl_->num_buckets());
+  return Status::OK;
+}
+
+void AggregationNode::MergeRowBatch(RowBatch* batch) {
+  for (int i = 0; i < batch->num_active_rows(); ++i) {
+    TupleRow* row = batch->GetActiveRow(i);
+    AggregationTuple* agg_tuple = NULL;
+    HashTable::Iterator entry = hash_tbl_->Find(row);
+    if (!entry.HasNext()) {
+      agg_tuple = ConstructAggTuple();
+      hash_tbl_->Insert(reinterpret_cast<TupleRow*>(&agg_tuple));
+    } else {
+      agg_tuple = reinterpret_cast<AggregationTuple*>(entry.GetRow()->GetTuple(0));
+    }
+    MergeAggTuple(agg_tuple, row->GetTuple(0));
+  }
+}
+
+// Pre-aggregates the rows materialized by a scanner thread with a private
+// AggregationNode, whose hash table is flushed once it outgrows
+// --scan_preagg_buffer_size bytes.  Owns the private node.
+class AggregationNode::PreAggregator : public ScanPreAggregator {
+ public:
+  PreAggregator(AggregationNode* node, RuntimeState* state, HdfsScanNode* scan_node)
+    : node_(node), state_(state), scan_node_(scan_node) {
+  }
+
+  virtual void AddBatch(RowBatch* batch, vector<RowBatch*>* output) {
+    node_->ProcessRowBatchWithGrouping(batch);
+    // The aggregation tuples don't reference the batch's data.
+    delete batch;
+    if (node_->hash_table_bytes() > FLAGS_scan_preagg_buffer_size) Flush(output);
+  }
+
+  virtual void Flush(vector<RowBatch*>* output) {
+    node_->FlushPartialAggregates(scan_node_->row_desc(), state_->batch_size(),
+        scan_node_->mem_tracker(), output);
+  }
+
+ private:
+  scoped_ptr<AggregationNode> node_;
+  RuntimeState* state_;
+  HdfsScanNode* scan_node_;
+};
+
+void AggregationNode::InitScanPreAggregation(RuntimeState* state,
+    HdfsScanNode* scan_node) {
+  // Create the first pre-aggregator here, so that a failure to prepare it falls back
+  // to aggregating the scanned rows.  Once the scan pre-aggregates, failing to create
+  // a pre-aggregator fails the scan.
+  ScanPreAggregator* aggregator;
+  Status status = CreatePreAggregator(state, scan_node, &aggregator);
+  if (!status.ok()) {
+    LOG(WARNING) << "AggregationNode(node_id=" << id() << ") not pre-aggregating in "
+                 << "the scanner threads: " << status.GetErrorMsg();
+    return;
+  }
+  preaggregated_input_ = scan_node->SetPreAggregation(
+      bind(&AggregationNode::CreatePreAggregator, this, state, scan_node, _1));
+  if (!preaggregated_input_) {
+    delete aggregator;
+    return;
+  }
+  scan_node->ReturnPreAggregator(pool_->Add(aggregator));
+  // The input rows are partial aggregation tuples, which are merged.
+  ResetHashTable(true);
+  VLOG_QUERY << "AggregationNode(node_id=" << id() << ") pre-aggregating in the "
+             << "scanner threads of node " << scan_node->id();
+}
+
+Status AggregationNode::CreatePreAggregator(RuntimeState* state,
+    HdfsScanNode* scan_node, ScanPreAggregator** aggregator) {
+  AggregationNode* node = new AggregationNode(pool_, *thrift_plan_node_,
+      state->desc_tbl());
+  scoped_ptr<PreAggregator> pre_aggregator(new PreAggregator(node, state, scan_node));
+  node->mem_tracker_.reset(
+      new MemTracker(-1, "PreAggregation", scan_node->mem_tracker()));
+  // The same exprs have already been prepared for this node's input in Prepare().
+  RETURN_IF_ERROR(node->PrepareAggregation(state, scan_node->row_desc(), true));
+  *aggregator = pre_aggregator.release();
+  return Status::OK;
+}
+
+void AggregationNode::FlushPartialAggregates(const RowDescriptor& row_desc,
+    int batch_size, MemTracker* mem_tracker, vector<RowBatch*>* output) {
+  if (hash_tbl_->size() == 0) return;
+  RowBatch* batch = NULL;
+  for (HashTable::Iterator it = hash_tbl_->Begin(); it.HasNext(); it.Next<false>()) {
+    if (batch == NULL || batch->IsFull()) {
+      batch = new RowBatch(row_desc, batch_size, mem_tracker);
+      output->push_back(batch);
+    }
+    int row_idx = batch->AddRow();
+    batch->GetRow(row_idx)->SetTuple(0, it.GetRow()->GetTuple(0));
+    batch->CommitLastRow();
+  }
+  // Row batches are consumed in order, so the tuple memory of all of them goes with
+  // the last one.
+  batch->tuple_data_pool()->AcquireData(tuple_pool_.get(), false);
+  ResetHashTable(false);
+}
+
 void AggregationNode::FinalizeAggTuple(AggregationTuple* agg_out_tuple) {
   DCHECK(agg_out_tuple != NULL);
   Tuple* tuple = agg_out_tuple->tuple();
@@ -576,7 +992,7 @@ void AggregationNode::FinalizeAggTuple(AggregationTuple* agg_out_tuple) {
     if (agg_expr->type() == TYPE_STRING) ++string_slot_idx;
 
     switch (agg_expr->agg_op()) {
-      // Only DISTINCT/MERGE_PC(SA) needs to do finalize
+      // Only the distinct estimates need to do finalize
       case TAggregationOp::DISTINCT_PC:
       case TAggregationOp::MERGE_PC:
       case TAggregationOp::DISTINCT_PCSA:
@@ -584,6 +1000,10 @@ void AggregationNode::FinalizeAggTuple(AggregationTuple* agg_out_tuple) {
         // Convert the bit vector into a number
         FinalizeEstimateSlot(string_slot_idx, slot, agg_expr->agg_op());
         break;
+      case TAggregationOp::HLL:
+      case TAggregationOp::MERGE_HLL:
+        FinalizeHllSlot(slot);
+        break;
         // For all other aggregate, do nothing.
       default:
         break;
@@ -668,6 +1088,37 @@ llvm::Function* AggregationNode::CodegenUpdateSlot(LlvmCodeGen* codegen, int slo
     Function* clear_null_fn = slot_desc->CodegenUpdateNull(codegen, tuple_struct, false);
     builder.CreateCall(clear_null_fn, args[0]);
   }
+
+  if (agg_expr->agg_op() == TAggregationOp::HLL) {
+    // The registers are updated by calling the cross compiled UpdateHllSlot() with a
+    // pointer to the src value.
+    int string_slot_idx = -1;
+    for (int i = 0; i <= slot_idx; ++i) {
+      if (aggregate_exprs_[i]->type() == TYPE_STRING) ++string_slot_idx;
+    }
+    PrimitiveType src_type = agg_expr->GetChild(0)->type();
+    LlvmCodeGen::NamedVariable src_var("src_val", codegen->GetType(src_type));
+    Value* src_ptr = codegen->CreateEntryBlockAlloca(fn, src_var);
+    builder.CreateStore(src_value, src_ptr);
+
+    Type* agg_node_type = codegen->GetType(AggregationNode::LLVM_CLASS_NAME);
+    Type* agg_tuple_type = codegen->GetType(AggregationTuple::LLVM_CLASS_NAME);
+    Value* hll_args[] = {
+      codegen->CastPtrToLlvmPtr(PointerType::get(agg_node_type, 0), this),
+      builder.CreateBitCast(args[0], PointerType::get(agg_tuple_type, 0), "agg_tuple"),
+      codegen->GetIntConstant(TYPE_INT, string_slot_idx),
+      builder.CreateBitCast(dst_ptr, ptr_type, "dst_slot"),
+      builder.CreateBitCast(src_ptr, ptr_type, "src_slot"),
+      codegen->GetIntConstant(TYPE_INT, src_type),
+    };
+    Function* update_hll_fn = codegen->GetFunction(IRFunction::AGG_NODE_UPDATE_HLL_SLOT);
+    builder.CreateCall(update_hll_fn, hll_args);
+    builder.CreateBr(ret_block);
+
+    builder.SetInsertPoint(ret_block);
+    builder.CreateRetVoid();
+    return codegen->FinalizeFunction(fn);
+  }
     
   // Update the slot
   Value* dst_value = builder.CreateLoad(dst_ptr, "dst_val");
@@ -740,9 +1191,15 @@ Function* AggregationNode::CodegenUpdateAggTuple(LlvmCodeGen* codegen) {
     }
   }
 
-  // string and timestamp aggregation currently not supported
+  // string and timestamp aggregation currently not supported, except for ndv over
+  // non-string values (the registers are kept in a string slot).
   for (vector<Expr*>::const_iterator expr = aggregate_exprs_.begin();
       expr != aggregate_exprs_.end(); ++expr) {
+    AggregateExpr* agg_expr = static_cast<AggregateExpr*>(*expr);
+    if (agg_expr->agg_op() == TAggregationOp::HLL) {
+      PrimitiveType src_type = agg_expr->GetChild(0)->type();
+      if (src_type != TYPE_STRING && src_type != TYPE_TIMESTAMP) continue;
+    }
     if ((*expr)->type() == TYPE_STRING || (*expr)->type() == TYPE_TIMESTAMP) {
       VLOG_QUERY << "Could not codegen UpdateAggTuple because "
                  << "string and timestamp aggregation is not yet supported.";
@@ -758,11 +1215,12 @@ Function* AggregationNode::CodegenUpdateAggTuple(LlvmCodeGen* codegen) {
                  << "underlying exprs cannot be codegened.";
       return NULL;
     }
-    // Don't code gen distinct estiamte
+    // Don't code gen distinct estiamte, other than ndv
     if (agg_expr->agg_op() == TAggregationOp::DISTINCT_PC
         || agg_expr->agg_op() == TAggregationOp::DISTINCT_PCSA
         || agg_expr->agg_op() == TAggregationOp::MERGE_PCSA
-        || agg_expr->agg_op() == TAggregationOp::MERGE_PC) {
+        || agg_expr->agg_op() == TAggregationOp::MERGE_PC
+        || agg_expr->agg_op() == TAggregationOp::MERGE_HLL) {
       return NULL;
     }
   }
@@ -882,7 +1340,7 @@ Function* AggregationNode::CodegenProcessRowBatch(
 
     process_batch_fn = codegen->ReplaceCallSites(process_batch_fn, false,
         equals_fn, "Equals", &replaced);
-    DCHECK_EQ(replaced, 1);
+    DCHECK_EQ(replaced, 2);
   }
   
   process_batch_fn = codegen->ReplaceCallSites(process_batch_fn, false, 
@@ -1070,6 +1528,61 @@ void AggregationNode::FinalizeEstimateSlot(int slot_id, void* slot,
   dst_value->len = out.str().length();
 }
 
+void AggregationNode::ConstructHllSlot(AggregationTuple* agg_tuple,
+    const NullIndicatorOffset& null_indicator_offset, int string_slot_idx,
+    void* slot) {
+  StringValue* dst_value = static_cast<StringValue*>(slot);
+  int32_t* string_buffer_lengths = agg_tuple->BufferLengths(
+      agg_tuple_desc_->byte_size());
+  DCHECK_EQ(string_buffer_lengths[string_slot_idx], 0);
+  dst_value->ptr = AllocateStringBuffer(HLL_INITIAL_BUFFER_SIZE,
+      &(string_buffer_lengths[string_slot_idx]));
+  dst_value->len = HyperLogLog::Init(reinterpret_cast<uint8_t*>(dst_value->ptr));
+  agg_tuple->tuple()->SetNotNull(null_indicator_offset);
+}
+
+void AggregationNode::ReserveHllSlot(AggregationTuple* agg_tuple, int string_slot_idx,
+    StringValue* dst_value, int size) {
+  int32_t* string_buffer_lengths = agg_tuple->BufferLengths(agg_tuple_desc_->byte_size());
+  int curr_size = string_buffer_lengths[string_slot_idx];
+  if (size <= curr_size) return;
+  // Grow geometrically while the registers are sparse.  No state is larger than a
+  // dense one.
+  int new_size = ::max(size, ::min(2 * curr_size, HyperLogLog::DENSE_SIZE));
+  char* old_buffer = dst_value->ptr;
+  dst_value->ptr = AllocateStringBuffer(new_size,
+      &(string_buffer_lengths[string_slot_idx]));
+  memcpy(dst_value->ptr, old_buffer, dst_value->len);
+  string_buffer_free_list_.Add(reinterpret_cast<uint8_t*>(old_buffer), curr_size);
+}
+
+void AggregationNode::MergeHllSlot(AggregationTuple* agg_tuple, int string_slot_idx,
+    void* slot, void* value) {
+  DCHECK(value != NULL);
+  StringValue* dst_value = static_cast<StringValue*>(slot);
+  StringValue* src_value = static_cast<StringValue*>(value);
+  const uint8_t* src = reinterpret_cast<const uint8_t*>(src_value->ptr);
+  DCHECK_GE(src_value->len, HyperLogLog::EMPTY_SIZE);
+  ReserveHllSlot(agg_tuple, string_slot_idx, dst_value,
+      HyperLogLog::MaxSizeAfterMerge(reinterpret_cast<uint8_t*>(dst_value->ptr),
+          dst_value->len, src, src_value->len));
+  dst_value->len = HyperLogLog::Merge(reinterpret_cast<uint8_t*>(dst_value->ptr),
+      dst_value->len, src, src_value->len);
+}
+
+void AggregationNode::FinalizeHllSlot(void* slot) {
+  StringValue* dst_value = static_cast<StringValue*>(slot);
+  int64_t estimate = HyperLogLog::Estimate(
+      reinterpret_cast<uint8_t*>(dst_value->ptr), dst_value->len);
+  // We're overwriting the registers with the result.  The buffer is at least
+  // HLL_INITIAL_BUFFER_SIZE bytes, which holds any int64_t.
+  stringstream out;
+  out << estimate;
+  DCHECK_LE(out.str().length(), HLL_INITIAL_BUFFER_SIZE);
+  strncpy(dst_value->ptr, out.str().c_str(), out.str().length());
+  dst_value->len = out.str().length();
+}
+
 string AggregationNode::DistinctEstimateBitMapToString(char* v) {
   stringstream debugstr;
   for (int i = 0; i < NUM_PC_BITMAPS; ++i) {
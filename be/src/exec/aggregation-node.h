@@ -4,6 +4,7 @@
 #define IMPALA_EXEC_AGGREGATION_NODE_H
 
 #include <functional>
+#include <list>
 #include <boost/scoped_ptr.hpp>
 
 #include "exec/exec-node.h"
@@ -21,8 +22,11 @@ namespace impala {
 class AggregateExpr;
 class AggregationTuple;
 class LlvmCodeGen;
+class HdfsScanNode;
 class RowBatch;
 struct RuntimeState;
+class ScanPreAggregator;
+class SpillStream;
 struct StringValue;
 class Tuple;
 class TupleDescriptor;
@@ -38,6 +42,25 @@ class TupleDescriptor;
 // will be appended to the end of the normal tuple data that stores the size of buffer 
 // for that string slot.  This also results in the correct alignment because StringValue 
 // slots are 8-byte aligned and form the tail end of the tuple.
+//
+// If the hash table grows beyond --agg_buffer_size bytes, the node switches to
+// partitioned aggregation: the aggregation tuples in the table (which hold partial
+// aggregates) are hash partitioned on the grouping values into NUM_PARTITIONS spilled
+// partitions and the table is cleared.  Aggregation of the input then continues in the
+// empty table, which is spilled again whenever it fills up, so hot groups are always
+// aggregated in memory by the (codegen'd) ProcessRowBatch path.  Once the input is
+// exhausted, the table is spilled a final time and each partition is aggregated
+// separately by merging its partial aggregation tuples.  A partition that does not fit
+// in memory is repartitioned recursively with a different hash seed.
+//
+// If the child is an HdfsScanNode and --enable_scan_preaggregation is set, the GROUP BY
+// is computed in two phases: each scanner thread of the scan node aggregates the rows
+// it materializes into a small, cache-resident hash table of its own (a private
+// AggregationNode, see PreAggregator), which is flushed as partial aggregation tuples
+// whenever it outgrows --scan_preagg_buffer_size and at the end of each scan range.
+// This node then merges the partial aggregation tuples, as it does for spilled
+// partitions.  For low-cardinality groupings most of the aggregation work is thus done
+// by the scanner threads in parallel.
 class AggregationNode : public ExecNode {
  public:
   AggregationNode(ObjectPool* pool, const TPlanNode& tnode, const DescriptorTbl& descs);
@@ -53,6 +76,22 @@ class AggregationNode : public ExecNode {
   virtual void DebugString(int indentation_level, std::stringstream* out) const;
   
  private:
+  // Number of partitions the hash table is split into when spilling.
+  static const int NUM_PARTITIONS = 16;
+
+  // Maximum number of times a partition is repartitioned.  Beyond that, a partition
+  // is aggregated in memory regardless of --agg_buffer_size.
+  static const int MAX_PARTITION_LEVEL = 8;
+
+  class PreAggregator;
+
+  // A spilled partition of partial aggregation tuples.
+  struct SpilledPartition {
+    SpillStream* stream;
+    // Number of times the input of this partition has been partitioned.
+    int level;
+  };
+
   boost::scoped_ptr<HashTable> hash_tbl_;
   HashTable::Iterator output_iterator_;
 
@@ -89,6 +128,26 @@ class AggregationNode : public ExecNode {
   RuntimeProfile::Counter* get_results_timer_;
   // Num buckets in hash table
   RuntimeProfile::Counter* hash_table_buckets_counter_;   
+  // Number of times the hash table was spilled
+  RuntimeProfile::Counter* num_spills_counter_;
+  // Bytes of partial aggregation tuples written to disk
+  RuntimeProfile::Counter* spilled_bytes_counter_;
+
+  // Partitions the hash table is currently spilled into.  Empty until the table
+  // is spilled for the first time.  Partitioned with seed build_level_.
+  std::vector<SpillStream*> build_partitions_;
+  int build_level_;
+
+  // Spilled partitions that remain to be aggregated and returned.
+  std::list<SpilledPartition> spilled_partitions_;
+
+  // Cache of the plan node, used to create the private AggregationNodes of the
+  // pre-aggregators since our Exprs are not thread safe.
+  boost::scoped_ptr<TPlanNode> thrift_plan_node_;
+
+  // True if the child scan node pre-aggregates its rows, i.e. the input consists of
+  // partial aggregation tuples.
+  bool preaggregated_input_;
 
   // Constructs a new aggregation output tuple (allocated from tuple_pool_),
   // initialized to grouping values computed over 'current_row_'.
@@ -125,10 +184,64 @@ class AggregationNode : public ExecNode {
   // aggregate values
   void FinalizeAggTuple(AggregationTuple* tuple);
 
+  // Merges the partial aggregate values in 'src', a spilled aggregation tuple,
+  // into 'agg_out_tuple'.
+  void MergeAggTuple(AggregationTuple* agg_out_tuple, Tuple* src);
+
+  // Returns the number of bytes used by the hash table and the aggregation tuples.
+  int64_t hash_table_bytes() const;
+
+  // Returns true if the hash table should be spilled before processing more input.
+  bool ShouldSpill() const;
+
+  // Replaces hash_tbl_ with an empty table and frees the aggregation tuples.
+  // If 'merge' is true, the new table is probed with spilled aggregation tuples
+  // rather than child rows.
+  void ResetHashTable(bool merge);
+
+  // Returns the partition of spilled aggregation tuple row 'row' for 'level'.
+  int GetPartition(TupleRow* row, int level);
+
+  // Writes all aggregation tuples in the hash table to build_partitions_, creating
+  // them if necessary, and resets the hash table.
+  Status SpillHashTable(RuntimeState* state);
+
+  // Moves build_partitions_ to spilled_partitions_.
+  void FinishBuildPartitions();
+
+  // Aggregates the next spilled partition into the (empty) hash table, which may
+  // spill again into partitions of the next level.
+  Status AggregateSpilledPartition(RuntimeState* state);
+
   // Do the aggregation for all tuple rows in the batch
   void ProcessRowBatchNoGrouping(RowBatch* batch);
   void ProcessRowBatchWithGrouping(RowBatch* batch);
 
+  // Merges the partial aggregation tuples in 'batch' into the hash table, which must
+  // have been reset for merging.
+  void MergeRowBatch(RowBatch* batch);
+
+  // Makes 'scan_node' pre-aggregate its rows if possible and sets
+  // preaggregated_input_ accordingly.  Must be called before the scan node is opened.
+  void InitScanPreAggregation(RuntimeState* state, HdfsScanNode* scan_node);
+
+  // Creates a pre-aggregator for a scanner thread of 'scan_node' and returns it in
+  // 'aggregator'.  Called by the scan node, possibly from another thread.
+  Status CreatePreAggregator(RuntimeState* state, HdfsScanNode* scan_node,
+      ScanPreAggregator** aggregator);
+
+  // Prepares the exprs, hash table and tuple pool to aggregate rows of
+  // 'input_row_desc'.  Also called for the private nodes of the pre-aggregators,
+  // instead of Prepare().
+  Status PrepareAggregation(RuntimeState* state, const RowDescriptor& input_row_desc,
+      bool disable_codegen);
+
+  // Outputs all aggregation tuples in the hash table (with partial aggregates) as
+  // row batches of 'row_desc' with 'batch_size' rows, appended to 'output', and
+  // resets the hash table.  The batches are charged to 'mem_tracker'.
+  void FlushPartialAggregates(const RowDescriptor& row_desc, int batch_size,
+      MemTracker* mem_tracker, std::vector<RowBatch*>* output);
+
   // Codegen the process row batch loop.  The loop has already been compiled to
   // IR and loaded into the codegen object.  UpdateAggTuple has also been 
   // codegen'd to IR.  This function will modify the loop subsituting the 
@@ -178,6 +291,35 @@ class AggregationNode : public ExecNode {
 
   // Helper function to print aggregation tuple's distinct estimate bitmap
   static std::string DistinctEstimateBitMapToString(char* v);
+
+  // Compute ndv using HyperLogLog (see util/hyperloglog.h).  The registers are stored
+  // in the aggregation tuple's output string slot, which starts out small (the
+  // registers are stored sparsely for few distinct values) and grows as needed.  Like
+  // distinctpc, the intermediate registers are merged across nodes (MERGE_HLL) and
+  // finalized into the estimated number in string form.
+
+  // Initial size of the string buffer holding the registers.
+  const static int HLL_INITIAL_BUFFER_SIZE;
+
+  // Initializes empty registers in the string slot.
+  void ConstructHllSlot(AggregationTuple*, const NullIndicatorOffset&,
+      int string_slot_idx, void* slot);
+
+  // Makes sure that the string buffer of the registers in 'dst' holds at least 'size'
+  // bytes, copying the registers into a larger buffer if necessary.
+  void ReserveHllSlot(AggregationTuple*, int string_slot_idx, StringValue* dst,
+      int size);
+
+  // Adds 'value' of 'type' to the registers.  Cross compiled to IR, so that the codegen'd
+  // UpdateAggTuple can call it.
+  void UpdateHllSlot(AggregationTuple*, int string_slot_idx, void* slot, void* value,
+      PrimitiveType type);
+
+  // Merges the registers in 'value' into the registers in 'slot'.
+  void MergeHllSlot(AggregationTuple*, int string_slot_idx, void* slot, void* value);
+
+  // Converts the registers into the estimated number in string form.
+  void FinalizeHllSlot(void* slot);
 };
 
 }
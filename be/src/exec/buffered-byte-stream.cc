@@ -11,7 +11,7 @@ using namespace std;
 BufferedByteStream::BufferedByteStream(ByteStream* parent, int64_t buffer_size,
                                        HdfsScanNode* scan_node)
     : parent_byte_stream_(parent),
-      mem_pool_(new MemPool()),
+      mem_pool_(new MemPool(scan_node->mem_tracker())),
       byte_buffer_size_(buffer_size),
       byte_buffer_(mem_pool_->Allocate(byte_buffer_size_)),
       byte_offset_(0),
@@ -21,7 +21,6 @@ BufferedByteStream::BufferedByteStream(ByteStream* parent, int64_t buffer_size,
 }
 
 BufferedByteStream::~BufferedByteStream() {
-  COUNTER_UPDATE(scan_node_->memory_used_counter(), mem_pool_->peak_allocated_bytes());
 }
 
 Status BufferedByteStream::GetPosition(int64_t* position) {
@@ -24,7 +24,8 @@ Status DataSink::CreateDataSink(
       if (!thrift_sink.__isset.stream_sink) return Status("Missing data stream sink.");
       // TODO: figure out good buffer size based on size of output row
       tmp_sink = new DataStreamSender(
-          row_desc, thrift_sink.stream_sink, params.destinations, 16 * 1024);
+          row_desc, thrift_sink.stream_sink, params.fragment_instance_id,
+          params.destinations, 16 * 1024);
       sink->reset(tmp_sink);
       break;
 
@@ -30,6 +30,10 @@ class DataSink {
   // Send a row batch into this sink.
   virtual Status Send(RuntimeState* state, RowBatch* batch) = 0;
 
+  // Returns true if Send() only looks at the active rows of the batch, i.e. the
+  // batches passed to it may have a selection (see RowBatch).
+  virtual bool AcceptsSelection() const { return false; }
+
   // Releases all resources that were allocated in Init()/Send().
   // Further Send() calls are illegal after calling Close().
   virtual Status Close(RuntimeState* state) = 0;
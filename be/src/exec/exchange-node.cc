@@ -29,7 +29,8 @@ Status ExchangeNode::Prepare(RuntimeState* state) {
   // row descriptor of this node and the incoming stream should be the same.
   DCHECK_GT(num_senders_, 0);
   stream_recvr_.reset(state->stream_mgr()->CreateRecvr(
-    row_descriptor_, state->fragment_instance_id(), id_, num_senders_, 1024 * 1024));
+    row_descriptor_, state->fragment_instance_id(), id_, num_senders_, 1024 * 1024,
+    runtime_profile_));
   return Status::OK;
 }
 
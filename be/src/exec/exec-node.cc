@@ -2,6 +2,7 @@
 
 #include "exec/exec-node.h"
 
+#include <algorithm>
 #include <sstream>
 
 #include "codegen/llvm-codegen.h"
@@ -14,6 +15,7 @@
 #include "exec/hbase-scan-node.h"
 #include "exec/exchange-node.h"
 #include "exec/merge-node.h"
+#include "exec/sort-node.h"
 #include "exec/topn-node.h"
 #include "runtime/descriptors.h"
 #include "runtime/mem-pool.h"
@@ -26,6 +28,10 @@ using namespace llvm;
 using namespace std;
 using namespace boost;
 
+DEFINE_bool(enable_vectorized_conjuncts, true,
+    "If true, scans and joins evaluate their conjuncts over whole row batches with "
+    "vectorized exprs, if all of the conjuncts support it.");
+
 namespace impala {
 
 const string ExecNode::ROW_THROUGHPUT_COUNTER = "RowsReturnedRate";
@@ -52,8 +58,8 @@ Status ExecNode::Prepare(RuntimeState* state) {
   DCHECK(runtime_profile_.get() != NULL);
   rows_returned_counter_ =
       ADD_COUNTER(runtime_profile_, "RowsReturned", TCounterType::UNIT);
-  memory_used_counter_ =
-      ADD_COUNTER(runtime_profile_, "MemoryUsed", TCounterType::BYTES);
+  mem_tracker_.reset(new MemTracker(runtime_profile(), -1, runtime_profile()->name(),
+      state->instance_mem_tracker()));
   rows_returned_rate_ = runtime_profile()->AddDerivedCounter(
       ROW_THROUGHPUT_COUNTER, TCounterType::UNIT_PER_SECOND,
       bind<int64_t>(&RuntimeProfile::UnitsPerSecond, rows_returned_counter_, 
@@ -159,10 +165,7 @@ Status ExecNode::CreateNode(ObjectPool* pool, const TPlanNode& tnode,
       if (tnode.sort_node.use_top_n) {
         *node = pool->Add(new TopNNode(pool, tnode, descs));
       } else {
-      // TODO: Need Sort Node
-      //  *node = pool->Add(new SortNode(pool, tnode, descs));
-        error_msg << "ORDER BY with no LIMIT not implemented";
-        return Status(error_msg.str());
+        *node = pool->Add(new SortNode(pool, tnode, descs));
       }
       return Status::OK;
     case TPlanNodeType::MERGE_NODE:
@@ -210,6 +213,65 @@ bool ExecNode::EvalConjuncts(Expr* const* exprs, int num_exprs, TupleRow* row) {
   return true;
 }
 
+// Narrows the ascending row indices in sel[0, num_rows) down to the rows for which
+// all exprs return true.  Returns the number of remaining rows.
+static int NarrowSelection(Expr* const* exprs, int num_exprs, RowBatch* batch,
+    int* sel, int num_rows) {
+  for (int i = 0; i < num_exprs && num_rows > 0; ++i) {
+    ExprVector* result = exprs[i]->GetVector(batch, sel, num_rows);
+    const uint8_t* values = result->values<uint8_t>();
+    const uint8_t* nulls = result->nulls();
+    // Narrow the selection to the rows that passed, without branching on the result.
+    int num_selected = 0;
+    for (int j = 0; j < num_rows; ++j) {
+      int row_idx = sel[j];
+      sel[num_selected] = row_idx;
+      num_selected += values[row_idx] & !nulls[row_idx];
+    }
+    num_rows = num_selected;
+  }
+  return num_rows;
+}
+
+int ExecNode::EvalConjuncts(Expr* const* exprs, int num_exprs, RowBatch* batch,
+    int start_row) {
+  if (batch->selection_enabled()) {
+    if (!batch->has_selection()) {
+      if (num_exprs == 0) return batch->num_rows() - start_row;
+      batch->InitSelection();
+    }
+    // The selected rows >= start_row are the tail of the selection.
+    int* sel = batch->selection();
+    int first = lower_bound(sel, sel + batch->num_selected(), start_row) - sel;
+    int num_rows = NarrowSelection(
+        exprs, num_exprs, batch, sel + first, batch->num_selected() - first);
+    batch->set_num_selected(first + num_rows);
+    return num_rows;
+  }
+
+  DCHECK(!batch->has_selection());
+  int num_rows = batch->num_rows() - start_row;
+  if (num_exprs == 0 || num_rows == 0) return num_rows;
+
+  vector<int> sel(num_rows);
+  for (int i = 0; i < num_rows; ++i) {
+    sel[i] = start_row + i;
+  }
+  num_rows = NarrowSelection(exprs, num_exprs, batch, &sel[0], num_rows);
+
+  for (int i = 0; i < num_rows; ++i) {
+    if (sel[i] == start_row + i) continue;
+    batch->CopyRow(batch->GetRow(sel[i]), batch->GetRow(start_row + i));
+  }
+  batch->set_num_rows(start_row + num_rows);
+  return num_rows;
+}
+
+bool ExecNode::VectorizeConjuncts(const vector<Expr*>& conjuncts) {
+  return FLAGS_enable_vectorized_conjuncts && !conjuncts.empty() &&
+      Expr::IsVectorizable(conjuncts);
+}
+
 // Codegen for EvalConjuncts.  The generated signature is
 // For a node with two conjunct predicates
 // define i1 @EvalConjuncts(%"class.impala::Expr"** %exprs, i32 %num_exprs, 
@@ -309,6 +371,15 @@ void ExecNode::CollectNodes(TPlanNodeType::type node_type, vector<ExecNode*>* no
   }
 }
 
+void ExecNode::CollectUnlimitedNodes(TPlanNodeType::type node_type,
+    vector<ExecNode*>* nodes) {
+  if (limit_ != -1) return;
+  if (type_ == node_type) nodes->push_back(this);
+  for (int i = 0; i < children_.size(); ++i) {
+    children_[i]->CollectUnlimitedNodes(node_type, nodes);
+  }
+}
+
 void ExecNode::CollectScanNodes(vector<ExecNode*>* nodes) {
   CollectNodes(TPlanNodeType::HDFS_SCAN_NODE, nodes);
   CollectNodes(TPlanNodeType::HBASE_SCAN_NODE, nodes);
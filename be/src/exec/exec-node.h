@@ -5,9 +5,11 @@
 
 #include <vector>
 #include <sstream>
+#include <boost/scoped_ptr.hpp>
 
 #include "common/status.h"
 #include "runtime/descriptors.h"  // for RowDescriptor
+#include "runtime/mem-tracker.h"
 #include "util/runtime-profile.h"
 #include "gen-cpp/PlanNodes_types.h"
 
@@ -34,6 +36,8 @@ class ExecNode {
   // Sets up internal structures, etc., without doing any actual work.
   // Must be called prior to Open(). Will only be called once in this
   // node's lifetime.
+  // Creates the node's MemTracker, so memory that should be charged to this node
+  // must be allocated in or after Prepare().
   // All code generation (adding functions to the LlvmCodeGen object) must happen
   // in Prepare().  Retrieving the jit compiled function pointer must happen in
   // Open().
@@ -75,6 +79,10 @@ class ExecNode {
   // 'nodes'.
   void CollectNodes(TPlanNodeType::type node_type, std::vector<ExecNode*>* nodes);
 
+  // Same as CollectNodes(), but skips the subtrees rooted at nodes with a limit.
+  void CollectUnlimitedNodes(TPlanNodeType::type node_type,
+      std::vector<ExecNode*>* nodes);
+
   // Collect all scan node types.
   void CollectScanNodes(std::vector<ExecNode*>* nodes);
 
@@ -83,6 +91,18 @@ class ExecNode {
   // out how to deal with declaring a templated std:vector type in IR
   static bool EvalConjuncts(Expr* const* exprs, int num_exprs, TupleRow* row);
 
+  // Evaluate exprs over the active rows in [start_row, num_rows()) of 'batch' with
+  // Expr::GetVector() and remove the rows for which not all exprs return true.  If
+  // the batch has selections enabled, the rows are removed from its selection;
+  // otherwise the remaining rows are moved down to start at 'start_row'.  Returns the
+  // number of remaining rows.  All exprs must be vectorizable.
+  static int EvalConjuncts(Expr* const* exprs, int num_exprs, RowBatch* batch,
+      int start_row);
+
+  // Returns true if 'conjuncts' should be evaluated over whole batches with the
+  // function above rather than row by row.
+  static bool VectorizeConjuncts(const std::vector<Expr*>& conjuncts);
+
   // Codegen function to evaluate the conjuncts.  Returns NULL if codegen was
   // not supported for the conjunct exprs.
   // Codegen'd signature is bool EvalConjuncts(Expr** exprs, int num_exprs, TupleRow*);
@@ -112,7 +132,10 @@ class ExecNode {
   bool ReachedLimit() { return limit_ != -1 && num_rows_returned_ >= limit_; }
 
   RuntimeProfile* runtime_profile() { return runtime_profile_.get(); }
-  RuntimeProfile::Counter* memory_used_counter() const { return memory_used_counter_; }
+
+  // Tracks the memory used by this node (and charges it to the fragment instance).
+  // Set in Prepare().
+  MemTracker* mem_tracker() { return mem_tracker_.get(); }
 
   // Extract node id from p->name().
   static int GetNodeIdFromProfile(RuntimeProfile* p);
@@ -134,8 +157,9 @@ class ExecNode {
   boost::scoped_ptr<RuntimeProfile> runtime_profile_;
   RuntimeProfile::Counter* rows_returned_counter_;
   RuntimeProfile::Counter* rows_returned_rate_;
-  // Account for peak memory used by this node
-  RuntimeProfile::Counter* memory_used_counter_;
+
+  // Reports the current and peak memory used by this node in runtime_profile_.
+  boost::scoped_ptr<MemTracker> mem_tracker_;
 
   ExecNode* child(int i) { return children_[i]; }
 
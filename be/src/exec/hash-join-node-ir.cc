@@ -24,6 +24,9 @@ bool IR_NO_INLINE EvalOtherJoinConjuncts(Expr* const* exprs, int num_exprs,
 
 // CreateOutputRow, EvalOtherJoinConjuncts, and EvalConjuncts are replaced by
 // codegen.
+// The probe rows are processed in two passes to hide the latency of the hash table
+// lookups: when starting on a new probe batch, all rows are hashed and their buckets
+// prefetched before the first row is looked up.
 int HashJoinNode::ProcessProbeBatch(RowBatch* out_batch, RowBatch* probe_batch, 
     int max_added_rows) {
   // This path does not handle full outer or right outer joins
@@ -35,13 +38,22 @@ int HashJoinNode::ProcessProbeBatch(RowBatch* out_batch, RowBatch* probe_batch,
   TupleRow* out_row = reinterpret_cast<TupleRow*>(out_row_mem);
 
   int rows_returned = 0;
-  int probe_rows = probe_batch->num_rows();
+  int probe_rows = probe_batch->num_active_rows();
 
   Expr* const* other_conjuncts = &other_join_conjuncts_[0];
   int num_other_conjuncts = other_join_conjuncts_.size();
 
   Expr* const* conjuncts = &conjuncts_[0];
-  int num_conjuncts = conjuncts_.size();
+  int num_conjuncts = vectorize_conjuncts_ ? 0 : conjuncts_.size();
+
+  uint32_t* probe_hashes = &probe_hashes_[0];
+  uint8_t* probe_rows_may_match = &probe_rows_may_match_[0];
+  if (probe_batch_pos_ == 0) {
+    for (int i = 0; i < probe_rows; ++i) {
+      probe_rows_may_match[i] =
+          hash_tbl_->HashAndPrefetch(probe_batch->GetActiveRow(i), &probe_hashes[i]);
+    }
+  }
 
   while (true) {
     // Create output row for each matching build row
@@ -88,8 +100,12 @@ int HashJoinNode::ProcessProbeBatch(RowBatch* out_batch, RowBatch* probe_batch,
     if (!hash_tbl_iterator_.HasNext()) {
       // Advance to the next probe row
       if (UNLIKELY(probe_batch_pos_ == probe_rows)) goto end;
-      current_probe_row_ = probe_batch->GetRow(probe_batch_pos_++);
-      hash_tbl_iterator_ = hash_tbl_->Find(current_probe_row_);
+      current_probe_row_ = probe_batch->GetActiveRow(probe_batch_pos_);
+      if (probe_rows_may_match[probe_batch_pos_]) {
+        hash_tbl_iterator_ = 
+            hash_tbl_->FindHashed(current_probe_row_, probe_hashes[probe_batch_pos_]);
+      }
+      ++probe_batch_pos_;
       matched_probe_ = false;
     }
   }
@@ -102,8 +118,8 @@ end:
 
 void HashJoinNode::ProcessBuildBatch(RowBatch* build_batch) {
   // insert build row into our hash table
-  for (int i = 0; i < build_batch->num_rows(); ++i) {
-    hash_tbl_->Insert(build_batch->GetRow(i));
+  for (int i = 0; i < build_batch->num_active_rows(); ++i) {
+    hash_tbl_->Insert(build_batch->GetActiveRow(i));
   }
 }
 
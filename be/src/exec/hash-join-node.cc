@@ -2,14 +2,23 @@
 
 #include "exec/hash-join-node.h"
 
+#include <algorithm>
 #include <sstream>
 
 #include "codegen/llvm-codegen.h"
 #include "exec/hash-table.inline.h"
+#include "exec/hdfs-scan-node.h"
 #include "exprs/expr.h"
+#include "runtime/mem-pool.h"
+#include "runtime/raw-value.h"
 #include "runtime/row-batch.h"
+#include "runtime/runtime-filter.h"
 #include "runtime/runtime-state.h"
+#include "runtime/spill-stream.h"
+#include "runtime/tuple-row.h"
+#include "util/cpu-info.h"
 #include "util/debug-util.h"
+#include "util/hash-util.h"
 #include "util/runtime-profile.h"
 
 #include "gen-cpp/PlanNodes_types.h"
@@ -19,13 +28,100 @@ using namespace impala;
 using namespace llvm;
 using namespace std;
 
+DEFINE_int64(join_buffer_size, 256L * 1024L * 1024L,
+    "Number of bytes a hash join node may use for its build side before it partitions "
+    "the build and probe input and spills partitions to disk.");
+DEFINE_int32(join_build_threads, 0,
+    "Number of threads a hash join uses to build its hash table.  If 0, one thread "
+    "per core is used.  Small builds are always done by a single thread.");
+DEFINE_bool(enable_runtime_filters, true,
+    "If true, hash joins compute Bloom filters over their build values and use them to "
+    "filter the rows of the scans on the probe side.");
+DEFINE_int64(runtime_filter_max_bits, 8L * 1024L * 1024L,
+    "Size in bits with which runtime filters are created.  Filters are shrunk once the "
+    "number of build values is known, and not used if the build side has more than "
+    "a quarter as many values.");
+
+// Number of bits per build value the runtime filters are shrunk to.  With 3 hash
+// functions, this gives a false positive rate of about 3%.
+static const int RUNTIME_FILTER_BITS_PER_VALUE = 8;
+
+// Minimum number of bits per build value for a runtime filter to be used (about 15%
+// false positives).
+static const int RUNTIME_FILTER_MIN_BITS_PER_VALUE = 4;
+
+// Minimum number of build rows for the hash table to be built by multiple threads.
+static const int PARALLEL_BUILD_MIN_ROWS = 64 * 1024;
+
+// A hash partition of the build and probe input.  While the partition is in memory,
+// its build rows are deep copied into build_pool.  Once it is spilled, its build and
+// probe rows are written to build_stream and probe_stream, going through build_batch
+// and probe_batch, which only reference the current input batch.
+struct HashJoinNode::Partition {
+  Partition(int level, MemTracker* mem_tracker)
+    : level(level), build_pool(new MemPool(mem_tracker)) {}
+
+  bool is_spilled() const { return build_stream != NULL; }
+
+  int64_t bytes() const {
+    if (is_spilled()) return 0;
+    return build_pool->total_allocated_bytes() + build_rows.size() * sizeof(TupleRow*);
+  }
+
+  // The hash seed level this partition was created with.
+  int level;
+
+  scoped_ptr<MemPool> build_pool;
+  vector<TupleRow*> build_rows;
+
+  scoped_ptr<SpillStream> build_stream;
+  scoped_ptr<SpillStream> probe_stream;
+  scoped_ptr<RowBatch> build_batch;
+  scoped_ptr<RowBatch> probe_batch;
+};
+
+// Appends 'row' to 'batch', writing out the batch to 'stream' if it is full.
+static Status AppendRow(TupleRow* row, RowBatch* batch, SpillStream* stream) {
+  int row_idx = batch->AddRow();
+  batch->CopyRow(row, batch->GetRow(row_idx));
+  batch->CommitLastRow();
+  if (batch->IsFull()) {
+    RETURN_IF_ERROR(stream->AddBatch(batch));
+    batch->Reset();
+  }
+  return Status::OK;
+}
+
+// Writes out the rows in 'batch' to 'stream'.
+static Status FlushBatch(RowBatch* batch, SpillStream* stream) {
+  if (batch->num_rows() == 0) return Status::OK;
+  RETURN_IF_ERROR(stream->AddBatch(batch));
+  batch->Reset();
+  return Status::OK;
+}
+
+// Appends the rows of a batch read from a spill stream to 'dst' and transfers the
+// resources of 'src' to 'dst'.  Only the leading tuples of the rows of 'dst' that
+// correspond to the tuples of 'src' are set.
+static void AppendSpilledBatch(RowBatch* src, RowBatch* dst) {
+  DCHECK_LE(src->num_rows(), dst->capacity() - dst->num_rows());
+  for (int i = 0; i < src->num_rows(); ++i) {
+    int row_idx = dst->AddRow();
+    src->CopyRow(src->GetRow(i), dst->GetRow(row_idx));
+    dst->CommitLastRow();
+  }
+  src->TransferResourceOwnership(dst);
+}
+
 const char* HashJoinNode::LLVM_CLASS_NAME = "class.impala::HashJoinNode";
 
 HashJoinNode::HashJoinNode(
     ObjectPool* pool, const TPlanNode& tnode, const DescriptorTbl& descs)
   : ExecNode(pool, tnode, descs),
     join_op_(tnode.hash_join_node.join_op),
-    build_pool_(new MemPool()),
+    build_input_(NULL),
+    probe_input_(NULL),
+    build_level_(0),
     codegen_process_build_batch_fn_(NULL),
     process_build_batch_fn_(NULL),
     codegen_process_probe_batch_fn_(NULL),
@@ -57,6 +153,19 @@ Status HashJoinNode::Init(ObjectPool* pool, const TPlanNode& tnode) {
   RETURN_IF_ERROR(
       Expr::CreateExprTrees(pool, tnode.hash_join_node.other_join_conjuncts,
                             &other_join_conjuncts_));
+
+  int num_build_threads =
+      FLAGS_join_build_threads > 0 ? FLAGS_join_build_threads : CpuInfo::num_cores();
+  if (num_build_threads > 1) {
+    build_expr_copies_.resize(num_build_threads);
+    for (int i = 0; i < num_build_threads; ++i) {
+      for (int j = 0; j < eq_join_conjuncts.size(); ++j) {
+        Expr* expr;
+        RETURN_IF_ERROR(Expr::CreateExprTree(pool, eq_join_conjuncts[j].right, &expr));
+        build_expr_copies_[i].push_back(expr);
+      }
+    }
+  }
   return Status::OK;
 }
 
@@ -78,6 +187,10 @@ Status HashJoinNode::Prepare(RuntimeState* state) {
       ADD_COUNTER(runtime_profile(), "BuildBuckets", TCounterType::UNIT);
   probe_row_counter_ =
       ADD_COUNTER(runtime_profile(), "ProbeRows", TCounterType::UNIT);
+  spilled_partitions_counter_ =
+      ADD_COUNTER(runtime_profile(), "SpilledPartitions", TCounterType::UNIT);
+  spilled_bytes_counter_ =
+      ADD_COUNTER(runtime_profile(), "SpilledBytes", TCounterType::BYTES);
 
   // build and probe exprs are evaluated in the context of the rows produced by our
   // right and left children, respectively
@@ -91,16 +204,35 @@ Status HashJoinNode::Prepare(RuntimeState* state) {
 
   // pre-compute the tuple index of build tuples in the output row
   build_tuple_size_ = child(1)->row_desc().tuple_descriptors().size();
+  probe_tuple_size_ = child(0)->row_desc().tuple_descriptors().size();
   build_tuple_idx_.reserve(build_tuple_size_);
   for (int i = 0; i < build_tuple_size_; ++i) {
     TupleDescriptor* build_tuple_desc = child(1)->row_desc().tuple_descriptors()[i];
     build_tuple_idx_.push_back(row_descriptor_.GetTupleIdx(build_tuple_desc->id()));
   }
 
+  // The copies are only evaluated by HashTable::ParallelInsert(), which doesn't use
+  // codegen.
+  for (int i = 0; i < build_expr_copies_.size(); ++i) {
+    RETURN_IF_ERROR(
+        Expr::Prepare(build_expr_copies_[i], state, child(1)->row_desc(), true));
+    build_evaluators_.push_back(pool_->Add(new HashTable(build_expr_copies_[i],
+        build_expr_copies_[i], build_tuple_size_, false, 1)));
+  }
+
+  build_pool_.reset(new MemPool(mem_tracker()));
   // TODO: default buckets
-  hash_tbl_.reset(new HashTable(build_exprs_, probe_exprs_, build_tuple_size_, false));
+  hash_tbl_.reset(new HashTable(build_exprs_, probe_exprs_, build_tuple_size_, false,
+      HashTable::DEFAULT_INITIAL_BUCKETS, mem_tracker()));
   
-  probe_batch_.reset(new RowBatch(row_descriptor_, state->batch_size()));
+  probe_batch_.reset(new RowBatch(row_descriptor_, state->batch_size(), mem_tracker()));
+  probe_batch_->set_selection_enabled(true);
+  probe_hashes_.resize(probe_batch_->capacity());
+  probe_rows_may_match_.resize(probe_batch_->capacity());
+
+  if (FLAGS_enable_runtime_filters) InitRuntimeFilters(state);
+
+  vectorize_conjuncts_ = !match_all_build_ && VectorizeConjuncts(conjuncts_);
   
   LlvmCodeGen* codegen = state->llvm_codegen();
   if (codegen != NULL) {
@@ -122,8 +254,16 @@ Status HashJoinNode::Prepare(RuntimeState* state) {
 Status HashJoinNode::Close(RuntimeState* state) {
   // Must reset probe_batch_ in Close() to release resources
   probe_batch_.reset(NULL);
-  COUNTER_UPDATE(memory_used_counter_, build_pool_->peak_allocated_bytes());
-  COUNTER_UPDATE(memory_used_counter_, hash_tbl_->byte_size());
+  for (int i = 0; i < partitions_.size(); ++i) {
+    delete partitions_[i];
+  }
+  partitions_.clear();
+  for (list<Partition*>::iterator it = spilled_partitions_.begin();
+       it != spilled_partitions_.end(); ++it) {
+    delete *it;
+  }
+  spilled_partitions_.clear();
+  current_partition_.reset();
   return ExecNode::Close(state);
 }
 
@@ -159,38 +299,123 @@ Status HashJoinNode::Open(RuntimeState* state) {
 
   eos_ = false;
 
-  // Do a full scan of child(1) and store everything in hash_tbl_
+  RETURN_IF_ERROR(child(1)->Open(state));
+  RETURN_IF_ERROR(BuildHashTable(state));
+  RETURN_IF_ERROR(child(0)->Open(state));
+  RETURN_IF_ERROR(InitProbe(state));
+  return Status::OK;
+}
+
+Status HashJoinNode::BuildHashTable(RuntimeState* state) {
+  // Do a full scan of the build input and store everything in hash_tbl_
   // The hash join node needs to keep in memory all build tuples, including the tuple
   // row ptrs.  The row ptrs are copied into the hash table's internal structure so they
   // don't need to be stored in the build_pool_.
-  RowBatch build_batch(child(1)->row_desc(), state->batch_size());
-  RETURN_IF_ERROR(child(1)->Open(state));
+  RowBatch build_batch(child(1)->row_desc(), state->batch_size(), mem_tracker());
+  build_batch.set_selection_enabled(true);
   while (true) {
     RETURN_IF_CANCELLED(state);
     bool eos;
-    RETURN_IF_ERROR(child(1)->GetNext(state, &build_batch, &eos));
+    RETURN_IF_ERROR(GetNextBuildBatch(state, &build_batch, &eos));
     SCOPED_TIMER(build_timer_);
-    // take ownership of tuple data of build_batch
-    build_pool_->AcquireData(build_batch.tuple_data_pool(), false);
-
-    // Call codegen version if possible
-    if (process_build_batch_fn_ == NULL) {
-      ProcessBuildBatch(&build_batch);
+    // Only the first pass sees the whole build input.
+    if (build_input_ == NULL) InsertRuntimeFilters(&build_batch);
+    if (partitions_.empty()) {
+      // take ownership of tuple data of build_batch
+      build_pool_->AcquireData(build_batch.tuple_data_pool(), false);
+      if (pending_build_rows_.empty()) {
+        InsertBuildBatch(&build_batch);
+        VLOG_ROW << hash_tbl_->DebugString(true, &child(1)->row_desc());
+        if (!build_evaluators_.empty() &&
+            hash_tbl_->size() >= PARALLEL_BUILD_MIN_ROWS) {
+          StartParallelBuild();
+        }
+      } else {
+        AddPendingBuildRows(&build_batch);
+      }
+      if (build_level_ < MAX_PARTITION_LEVEL && build_bytes() > FLAGS_join_buffer_size) {
+        RETURN_IF_ERROR(InsertPendingBuildRows(state));
+        RETURN_IF_ERROR(PartitionHashTable(state));
+      }
     } else {
-      process_build_batch_fn_(this, &build_batch);
+      for (int i = 0; i < build_batch.num_active_rows(); ++i) {
+        RETURN_IF_ERROR(AddBuildRow(state, build_batch.GetActiveRow(i)));
+      }
+      RETURN_IF_ERROR(SpillPartitions(state));
+      RETURN_IF_ERROR(FlushPartitions());
     }
-    VLOG_ROW << hash_tbl_->DebugString(true, &child(1)->row_desc());
 
     build_batch.Reset();
+    RETURN_IF_ERROR(state->CheckMemLimit());
     if (eos) break;
   }
+  if (build_input_ == NULL) PublishRuntimeFilters(state);
+  {
+    SCOPED_TIMER(build_timer_);
+    RETURN_IF_ERROR(InsertPendingBuildRows(state));
+    if (!partitions_.empty()) RETURN_IF_ERROR(BuildFromPartitions(state));
+  }
   COUNTER_UPDATE(build_row_counter_, hash_tbl_->size());
   COUNTER_UPDATE(build_buckets_counter_, hash_tbl_->num_buckets());
 
   VLOG_ROW << hash_tbl_->DebugString(true, &child(1)->row_desc());
+  return Status::OK;
+}
 
-  RETURN_IF_ERROR(child(0)->Open(state));
+void HashJoinNode::InitRuntimeFilters(RuntimeState* state) {
+  // Outer joins that preserve unmatched probe rows cannot filter the probe input.
+  if (join_op_ != TJoinOp::INNER_JOIN && join_op_ != TJoinOp::LEFT_SEMI_JOIN &&
+      join_op_ != TJoinOp::RIGHT_OUTER_JOIN) {
+    return;
+  }
+  for (int i = 0; i < probe_exprs_.size(); ++i) {
+    if (!probe_exprs_[i]->is_slotref()) continue;
+    SlotId slot_id = static_cast<SlotRef*>(probe_exprs_[i])->slot_id();
+    const SlotDescriptor* slot = state->desc_tbl().GetSlotDescriptor(slot_id);
+    // The build values are hashed as values of the slot's type.
+    if (slot == NULL || slot->type() != build_exprs_[i]->type()) continue;
+    runtime_filters_.push_back(state->obj_pool()->Add(
+        new RuntimeFilter(id(), i, slot, FLAGS_runtime_filter_max_bits)));
+  }
+}
+
+void HashJoinNode::InsertRuntimeFilters(RowBatch* batch) {
+  for (int i = 0; i < runtime_filters_.size(); ++i) {
+    RuntimeFilter* filter = runtime_filters_[i];
+    Expr* build_expr = build_exprs_[filter->expr_idx()];
+    for (int j = 0; j < batch->num_active_rows(); ++j) {
+      filter->Insert(build_expr->GetValue(batch->GetActiveRow(j)));
+    }
+  }
+}
+
+void HashJoinNode::PublishRuntimeFilters(RuntimeState* state) {
+  if (runtime_filters_.empty()) return;
+  // Filtering the input of a node with a limit would change which rows it returns.
+  vector<ExecNode*> scan_nodes;
+  child(0)->CollectUnlimitedNodes(TPlanNodeType::HDFS_SCAN_NODE, &scan_nodes);
+  for (int i = 0; i < runtime_filters_.size(); ++i) {
+    RuntimeFilter* filter = runtime_filters_[i];
+    if (filter->num_values() * RUNTIME_FILTER_MIN_BITS_PER_VALUE > filter->num_bits()) {
+      VLOG_QUERY << "HashJoinNode(node_id=" << id() << ") not using runtime filter for "
+                 << "conjunct " << filter->expr_idx() << ": too many build values ("
+                 << filter->num_values() << ")";
+      filter->SetAlwaysTrue();
+    } else {
+      filter->Fold(filter->num_values() * RUNTIME_FILTER_BITS_PER_VALUE);
+      for (int j = 0; j < scan_nodes.size(); ++j) {
+        HdfsScanNode* scan_node = static_cast<HdfsScanNode*>(scan_nodes[j]);
+        if (scan_node->tuple_id() != filter->slot()->parent()) continue;
+        scan_node->AddRuntimeFilter(filter);
+      }
+    }
+    TRuntimeFilter tfilter;
+    filter->ToThrift(&tfilter);
+    state->SendRuntimeFilter(tfilter);
+  }
+}
 
+Status HashJoinNode::InitProbe(RuntimeState* state) {
   // seed probe batch and current_probe_row_, etc.
   // The child node will only assign tuples to the tuple row for the tuples it
   // computes.  The other tuple ptrs must be set to NULL.
@@ -200,18 +425,25 @@ Status HashJoinNode::Open(RuntimeState* state) {
   probe_batch_->ClearBatch();
   
   while (true) {
-    RETURN_IF_ERROR(child(0)->GetNext(state, probe_batch_.get(), &probe_eos_));
-    COUNTER_UPDATE(probe_row_counter_, probe_batch_->num_rows());
+    RETURN_IF_ERROR(GetNextProbeBatch(state));
     probe_batch_pos_ = 0;
-    if (probe_batch_->num_rows() == 0) {
+    if (probe_batch_->num_active_rows() == 0) {
       if (probe_eos_) {
         eos_ = true;
+        // finish up right outer join
+        if (match_all_build_) hash_tbl_iterator_ = hash_tbl_->Begin();
         break;
       }
       probe_batch_->Reset();
       continue;
+    } else if (!match_all_build_) {
+      // ProcessProbeBatch() probes the whole batch at once, starting at the first row.
+      current_probe_row_ = NULL;
+      matched_probe_ = true;
+      hash_tbl_iterator_ = hash_tbl_->End();
+      break;
     } else {
-      current_probe_row_ = probe_batch_->GetRow(probe_batch_pos_++);
+      current_probe_row_ = probe_batch_->GetActiveRow(probe_batch_pos_++);
       VLOG_ROW << "probe row: " << PrintRow(current_probe_row_, child(0)->row_desc());
       matched_probe_ = false;
       hash_tbl_iterator_ = hash_tbl_->Find(current_probe_row_);
@@ -222,6 +454,296 @@ Status HashJoinNode::Open(RuntimeState* state) {
   return Status::OK;
 }
 
+Status HashJoinNode::GetNextBuildBatch(RuntimeState* state, RowBatch* batch,
+    bool* eos) {
+  if (build_input_ == NULL) return child(1)->GetNext(state, batch, eos);
+  RowBatch* spilled_batch;
+  RETURN_IF_ERROR(build_input_->GetNext(&spilled_batch));
+  *eos = spilled_batch == NULL;
+  if (spilled_batch != NULL) {
+    scoped_ptr<RowBatch> batch_ptr(spilled_batch);
+    AppendSpilledBatch(spilled_batch, batch);
+  }
+  return Status::OK;
+}
+
+Status HashJoinNode::GetNextProbeBatch(RuntimeState* state) {
+  if (probe_input_ == NULL) {
+    RETURN_IF_ERROR(child(0)->GetNext(state, probe_batch_.get(), &probe_eos_));
+  } else {
+    RowBatch* spilled_batch;
+    RETURN_IF_ERROR(probe_input_->GetNext(&spilled_batch));
+    probe_eos_ = spilled_batch == NULL;
+    if (spilled_batch != NULL) {
+      scoped_ptr<RowBatch> batch_ptr(spilled_batch);
+      AppendSpilledBatch(spilled_batch, probe_batch_.get());
+    }
+  }
+
+  if (!partitions_.empty()) {
+    // Keep the rows of in-memory partitions and move the others to their
+    // partition's probe stream.
+    int num_rows = 0;
+    int* sel = probe_batch_->has_selection() ? probe_batch_->selection() : NULL;
+    for (int i = 0; i < probe_batch_->num_active_rows(); ++i) {
+      TupleRow* row = probe_batch_->GetActiveRow(i);
+      Partition* partition = partitions_[GetPartition(probe_exprs_, row)];
+      if (!partition->is_spilled()) {
+        if (sel != NULL) {
+          sel[num_rows] = sel[i];
+        } else if (i != num_rows) {
+          probe_batch_->CopyRow(row, probe_batch_->GetRow(num_rows));
+        }
+        ++num_rows;
+      } else if (match_all_probe_ || partition->build_stream->num_rows() > 0) {
+        RETURN_IF_ERROR(AppendRow(
+            row, partition->probe_batch.get(), partition->probe_stream.get()));
+      }
+    }
+    if (sel != NULL) {
+      probe_batch_->set_num_selected(num_rows);
+    } else {
+      probe_batch_->set_num_rows(num_rows);
+    }
+    RETURN_IF_ERROR(FlushPartitions());
+  }
+  COUNTER_UPDATE(probe_row_counter_, probe_batch_->num_active_rows());
+  return Status::OK;
+}
+
+int64_t HashJoinNode::build_bytes() const {
+  int64_t bytes = build_pool_->total_allocated_bytes() + hash_tbl_->byte_size()
+      + pending_build_rows_.capacity() * sizeof(TupleRow*);
+  for (int i = 0; i < partitions_.size(); ++i) {
+    bytes += partitions_[i]->bytes();
+  }
+  return bytes;
+}
+
+int HashJoinNode::GetPartition(const vector<Expr*>& exprs, TupleRow* row) {
+  // Use a different seed per level so that repartitioning a partition splits it.
+  // This is a different hash function from the one used by the hash table, so the
+  // rows within a partition are still spread over all buckets.
+  uint32_t hash = HashUtil::FVN_SEED + build_level_;
+  for (int i = 0; i < exprs.size(); ++i) {
+    hash = RawValue::GetHashValue(exprs[i]->GetValue(row), exprs[i]->type(), hash);
+  }
+  return hash % NUM_PARTITIONS;
+}
+
+Status HashJoinNode::PartitionHashTable(RuntimeState* state) {
+  DCHECK(partitions_.empty());
+  VLOG_FILE << "HashJoinNode(node_id=" << id() << ") partitioning " << hash_tbl_->size()
+            << " build rows at level " << build_level_;
+  for (int i = 0; i < NUM_PARTITIONS; ++i) {
+    partitions_.push_back(new Partition(build_level_, mem_tracker()));
+  }
+  // The rows are copied out of build_pool_ before it is freed, so spill as we go to
+  // bound the size of the copy.
+  int num_rows = 0;
+  for (HashTable::Iterator it = hash_tbl_->Begin(); it.HasNext(); it.Next<false>()) {
+    RETURN_IF_ERROR(AddBuildRow(state, it.GetRow()));
+    if (++num_rows % state->batch_size() == 0) {
+      RETURN_IF_ERROR(SpillPartitions(state));
+      RETURN_IF_ERROR(FlushPartitions());
+    }
+  }
+  RETURN_IF_ERROR(SpillPartitions(state));
+  RETURN_IF_ERROR(FlushPartitions());
+
+  hash_tbl_.reset(new HashTable(build_exprs_, probe_exprs_, build_tuple_size_, false,
+      HashTable::DEFAULT_INITIAL_BUCKETS, mem_tracker()));
+  build_pool_.reset(new MemPool(mem_tracker()));
+  return Status::OK;
+}
+
+Status HashJoinNode::AddBuildRow(RuntimeState* state, TupleRow* row) {
+  Partition* partition = partitions_[GetPartition(build_exprs_, row)];
+  if (partition->is_spilled()) {
+    return AppendRow(row, partition->build_batch.get(), partition->build_stream.get());
+  }
+  partition->build_rows.push_back(row->DeepCopy(
+      child(1)->row_desc().tuple_descriptors(), partition->build_pool.get()));
+  return Status::OK;
+}
+
+Status HashJoinNode::SpillPartitions(RuntimeState* state) {
+  while (build_bytes() > FLAGS_join_buffer_size) {
+    Partition* largest = NULL;
+    for (int i = 0; i < partitions_.size(); ++i) {
+      if (partitions_[i]->is_spilled()) continue;
+      if (largest == NULL || partitions_[i]->bytes() > largest->bytes()) {
+        largest = partitions_[i];
+      }
+    }
+    if (largest == NULL) break;
+    RETURN_IF_ERROR(SpillPartition(state, largest));
+  }
+  return Status::OK;
+}
+
+Status HashJoinNode::SpillPartition(RuntimeState* state, Partition* partition) {
+  DCHECK(!partition->is_spilled());
+  partition->build_stream.reset(new SpillStream(child(1)->row_desc()));
+  RETURN_IF_ERROR(partition->build_stream->Init());
+  partition->probe_stream.reset(new SpillStream(child(0)->row_desc()));
+  RETURN_IF_ERROR(partition->probe_stream->Init());
+  partition->build_batch.reset(
+      new RowBatch(child(1)->row_desc(), state->batch_size(), mem_tracker()));
+  partition->probe_batch.reset(
+      new RowBatch(child(0)->row_desc(), state->batch_size(), mem_tracker()));
+
+  for (int i = 0; i < partition->build_rows.size(); ++i) {
+    RETURN_IF_ERROR(AppendRow(partition->build_rows[i], partition->build_batch.get(),
+        partition->build_stream.get()));
+  }
+  RETURN_IF_ERROR(
+      FlushBatch(partition->build_batch.get(), partition->build_stream.get()));
+  VLOG_FILE << "HashJoinNode(node_id=" << id() << ") spilled partition with "
+            << partition->build_rows.size() << " build rows at level " << build_level_;
+  partition->build_rows.clear();
+  partition->build_pool.reset();
+  COUNTER_UPDATE(spilled_partitions_counter_, 1);
+  return Status::OK;
+}
+
+Status HashJoinNode::FlushPartitions() {
+  for (int i = 0; i < partitions_.size(); ++i) {
+    Partition* partition = partitions_[i];
+    if (!partition->is_spilled()) continue;
+    RETURN_IF_ERROR(
+        FlushBatch(partition->build_batch.get(), partition->build_stream.get()));
+    RETURN_IF_ERROR(
+        FlushBatch(partition->probe_batch.get(), partition->probe_stream.get()));
+  }
+  return Status::OK;
+}
+
+void HashJoinNode::InsertBuildBatch(RowBatch* batch) {
+  // Call codegen version if possible
+  if (process_build_batch_fn_ == NULL) {
+    ProcessBuildBatch(batch);
+  } else {
+    process_build_batch_fn_(this, batch);
+  }
+}
+
+Status HashJoinNode::InsertBuildRows(RuntimeState* state,
+    const vector<TupleRow*>& rows) {
+  if (!build_evaluators_.empty() && hash_tbl_->size() == 0 &&
+      rows.size() >= PARALLEL_BUILD_MIN_ROWS) {
+    VLOG_FILE << "HashJoinNode(node_id=" << id() << ") inserting " << rows.size()
+              << " build rows with " << build_evaluators_.size() << " threads";
+    return hash_tbl_->ParallelInsert(rows, build_evaluators_);
+  }
+  // The batch only passes the row ptrs.
+  RowBatch batch(child(1)->row_desc(), state->batch_size(), mem_tracker());
+  for (int i = 0; i < rows.size(); ++i) {
+    int row_idx = batch.AddRow();
+    batch.CopyRow(rows[i], batch.GetRow(row_idx));
+    batch.CommitLastRow();
+    if (batch.IsFull()) {
+      InsertBuildBatch(&batch);
+      batch.Reset();
+    }
+  }
+  InsertBuildBatch(&batch);
+  return Status::OK;
+}
+
+void HashJoinNode::StartParallelBuild() {
+  DCHECK(pending_build_rows_.empty());
+  VLOG_FILE << "HashJoinNode(node_id=" << id() << ") switching to a parallel build "
+            << "after " << hash_tbl_->size() << " build rows";
+  // The table's rows are copied into build_pool_, since they are only referenced by
+  // the table's nodes.
+  int row_byte_size = build_tuple_size_ * sizeof(Tuple*);
+  for (HashTable::Iterator it = hash_tbl_->Begin(); it.HasNext(); it.Next<false>()) {
+    TupleRow* row = reinterpret_cast<TupleRow*>(build_pool_->Allocate(row_byte_size));
+    memcpy(row, it.GetRow(), row_byte_size);
+    pending_build_rows_.push_back(row);
+  }
+  hash_tbl_.reset(new HashTable(build_exprs_, probe_exprs_, build_tuple_size_, false,
+      HashTable::DEFAULT_INITIAL_BUCKETS, mem_tracker()));
+}
+
+void HashJoinNode::AddPendingBuildRows(RowBatch* batch) {
+  int row_byte_size = build_tuple_size_ * sizeof(Tuple*);
+  for (int i = 0; i < batch->num_active_rows(); ++i) {
+    TupleRow* row = reinterpret_cast<TupleRow*>(build_pool_->Allocate(row_byte_size));
+    batch->CopyRow(batch->GetActiveRow(i), row);
+    pending_build_rows_.push_back(row);
+  }
+}
+
+Status HashJoinNode::InsertPendingBuildRows(RuntimeState* state) {
+  if (pending_build_rows_.empty()) return Status::OK;
+  RETURN_IF_ERROR(InsertBuildRows(state, pending_build_rows_));
+  pending_build_rows_.clear();
+  return Status::OK;
+}
+
+Status HashJoinNode::BuildFromPartitions(RuntimeState* state) {
+  // The rows stay in the partitions' pools.
+  vector<TupleRow*> rows;
+  for (int i = 0; i < partitions_.size(); ++i) {
+    const vector<TupleRow*>& build_rows = partitions_[i]->build_rows;
+    rows.insert(rows.end(), build_rows.begin(), build_rows.end());
+  }
+  return InsertBuildRows(state, rows);
+}
+
+Status HashJoinNode::NextSpilledPartition(RuntimeState* state, RowBatch* out_batch) {
+  // Rows returned so far may reference the build rows of this pass.
+  out_batch->tuple_data_pool()->AcquireData(build_pool_.get(), false);
+  for (int i = 0; i < partitions_.size(); ++i) {
+    Partition* partition = partitions_[i];
+    if (partition->is_spilled()) {
+      COUNTER_UPDATE(spilled_bytes_counter_, partition->build_stream->bytes_written()
+          + partition->probe_stream->bytes_written());
+      partition->build_batch.reset();
+      partition->probe_batch.reset();
+      // Join the partitions of the deepest level first to free up scratch space.
+      spilled_partitions_.push_front(partition);
+    } else {
+      out_batch->tuple_data_pool()->AcquireData(partition->build_pool.get(), false);
+      delete partition;
+    }
+  }
+  partitions_.clear();
+  current_partition_.reset();
+  build_input_ = NULL;
+  probe_input_ = NULL;
+
+  while (!spilled_partitions_.empty()) {
+    current_partition_.reset(spilled_partitions_.front());
+    spilled_partitions_.pop_front();
+    bool has_build_rows = current_partition_->build_stream->num_rows() > 0;
+    bool has_probe_rows = current_partition_->probe_stream->num_rows() > 0;
+    // Skip partitions that cannot produce any output.
+    if ((has_probe_rows && (has_build_rows || match_all_probe_)) ||
+        (has_build_rows && match_all_build_)) {
+      break;
+    }
+    current_partition_.reset();
+  }
+  if (current_partition_ == NULL) return Status::OK;
+
+  build_level_ = current_partition_->level + 1;
+  build_input_ = current_partition_->build_stream.get();
+  probe_input_ = current_partition_->probe_stream.get();
+  RETURN_IF_ERROR(build_input_->PrepareForRead());
+  RETURN_IF_ERROR(probe_input_->PrepareForRead());
+
+  hash_tbl_.reset(new HashTable(build_exprs_, probe_exprs_, build_tuple_size_, false,
+      HashTable::DEFAULT_INITIAL_BUCKETS, mem_tracker()));
+  joined_build_rows_.clear();
+  eos_ = false;
+  RETURN_IF_ERROR(BuildHashTable(state));
+  RETURN_IF_ERROR(InitProbe(state));
+  return Status::OK;
+}
+
 Status HashJoinNode::GetNext(RuntimeState* state, RowBatch* out_batch, bool* eos) {
   RETURN_IF_CANCELLED(state);
   SCOPED_TIMER(runtime_profile_->total_time_counter());
@@ -230,15 +752,25 @@ Status HashJoinNode::GetNext(RuntimeState* state, RowBatch* out_batch, bool* eos
     return Status::OK;
   }
 
-  // These cases are simpler and use a more efficient processing loop
-  if (!match_all_build_) {
-    if (eos_) {
-      *eos = true;
-      return Status::OK;
+  while (true) {
+    // These cases are simpler and use a more efficient processing loop
+    if (!match_all_build_) {
+      RETURN_IF_ERROR(LeftJoinGetNext(state, out_batch, eos));
+    } else {
+      RETURN_IF_ERROR(RightJoinGetNext(state, out_batch, eos));
     }
-    return LeftJoinGetNext(state, out_batch, eos);
+    if (!*eos || ReachedLimit()) return Status::OK;
+
+    // Done with the current pass, join the next spilled partition (if any).
+    RETURN_IF_ERROR(NextSpilledPartition(state, out_batch));
+    if (current_partition_ == NULL) return Status::OK;
+    *eos = false;
+    if (out_batch->IsFull()) return Status::OK;
   }
+}
 
+Status HashJoinNode::RightJoinGetNext(RuntimeState* state, RowBatch* out_batch,
+    bool* eos) {
   Expr* const* other_conjuncts = &other_join_conjuncts_[0];
   int num_other_conjuncts = other_join_conjuncts_.size();
 
@@ -301,7 +833,7 @@ Status HashJoinNode::GetNext(RuntimeState* state, RowBatch* out_batch, bool* eos
       }
     }
     
-    if (probe_batch_pos_ == probe_batch_->num_rows()) {
+    if (probe_batch_pos_ == probe_batch_->num_active_rows()) {
       // pass on resources, out_batch might still need them
       probe_batch_->TransferResourceOwnership(out_batch);
       probe_batch_pos_ = 0;
@@ -311,9 +843,9 @@ Status HashJoinNode::GetNext(RuntimeState* state, RowBatch* out_batch, bool* eos
         probe_batch_->ClearBatch();
         while (true) {
           probe_timer.Stop();
-          RETURN_IF_ERROR(child(0)->GetNext(state, probe_batch_.get(), &probe_eos_));
+          RETURN_IF_ERROR(GetNextProbeBatch(state));
           probe_timer.Start();
-          if (probe_batch_->num_rows() == 0) {
+          if (probe_batch_->num_active_rows() == 0) {
             if (probe_eos_) {
               eos_ = true;
               break;
@@ -321,7 +853,6 @@ Status HashJoinNode::GetNext(RuntimeState* state, RowBatch* out_batch, bool* eos
             probe_batch_->Reset();
             continue;
           } else {
-            COUNTER_UPDATE(probe_row_counter_, probe_batch_->num_rows());
             break;
           }
         }
@@ -337,7 +868,7 @@ Status HashJoinNode::GetNext(RuntimeState* state, RowBatch* out_batch, bool* eos
     if (eos_) break;
 
     // join remaining rows in probe batch_
-    current_probe_row_ = probe_batch_->GetRow(probe_batch_pos_++);
+    current_probe_row_ = probe_batch_->GetActiveRow(probe_batch_pos_++);
     VLOG_ROW << "probe row: " << PrintRow(current_probe_row_, child(0)->row_desc());
     matched_probe_ = false;
     hash_tbl_iterator_ = hash_tbl_->Find(current_probe_row_);
@@ -384,16 +915,20 @@ Status HashJoinNode::LeftJoinGetNext(RuntimeState* state,
     if (limit() != -1) max_added_rows = min(max_added_rows, limit() - rows_returned());
     
     // Continue processing this row batch
+    int start_row = out_batch->num_rows();
+    int rows_added;
     if (process_probe_batch_fn_ == NULL) {
-      num_rows_returned_ += 
-          ProcessProbeBatch(out_batch, probe_batch_.get(), max_added_rows);
-      COUNTER_SET(rows_returned_counter_, num_rows_returned_);
+      rows_added = ProcessProbeBatch(out_batch, probe_batch_.get(), max_added_rows);
     } else {
       // Use codegen'd function
-      num_rows_returned_ += 
+      rows_added =
           process_probe_batch_fn_(this, out_batch, probe_batch_.get(), max_added_rows);
-      COUNTER_SET(rows_returned_counter_, num_rows_returned_);
     }
+    if (vectorize_conjuncts_) {
+      rows_added = EvalConjuncts(&conjuncts_[0], conjuncts_.size(), out_batch, start_row);
+    }
+    num_rows_returned_ += rows_added;
+    COUNTER_SET(rows_returned_counter_, num_rows_returned_);
 
     if (ReachedLimit() || out_batch->IsFull()) {
       *eos = ReachedLimit();
@@ -401,7 +936,8 @@ Status HashJoinNode::LeftJoinGetNext(RuntimeState* state,
     }
     
     // Check to see if we're done processing the current probe batch
-    if (!hash_tbl_iterator_.HasNext() && probe_batch_pos_ == probe_batch_->num_rows()) {
+    if (!hash_tbl_iterator_.HasNext() &&
+        probe_batch_pos_ == probe_batch_->num_active_rows()) {
       probe_batch_->TransferResourceOwnership(out_batch);
       probe_batch_pos_ = 0;
       if (out_batch->IsFull()) break;
@@ -411,9 +947,8 @@ Status HashJoinNode::LeftJoinGetNext(RuntimeState* state,
       } else {
         probe_batch_->ClearBatch();
         probe_timer.Stop();
-        RETURN_IF_ERROR(child(0)->GetNext(state, probe_batch_.get(), &probe_eos_));
+        RETURN_IF_ERROR(GetNextProbeBatch(state));
         probe_timer.Start();
-        COUNTER_UPDATE(probe_row_counter_, probe_batch_->num_rows());
       }
     }
   }
@@ -559,6 +1094,10 @@ Function* HashJoinNode::CodegenProcessBuildBatch(LlvmCodeGen* codegen,
   // Codegen for evaluating build rows
   Function* eval_row_fn = hash_tbl_->CodegenEvalTupleRow(codegen, true);
   if (eval_row_fn == NULL) return NULL;
+
+  // Codegen HashTable::Equals, used to find the bucket of a duplicate build key
+  Function* equals_fn = hash_tbl_->CodegenEquals(codegen);
+  if (equals_fn == NULL) return NULL;
   
   int replaced = 0;
   // Replace call sites
@@ -570,6 +1109,10 @@ Function* HashJoinNode::CodegenProcessBuildBatch(LlvmCodeGen* codegen,
       hash_fn, "HashCurrentRow", &replaced);
   DCHECK_EQ(replaced, 1);
 
+  process_build_batch_fn = codegen->ReplaceCallSites(process_build_batch_fn, false,
+      equals_fn, "Equals", &replaced);
+  DCHECK_EQ(replaced, 1);
+
   return codegen->OptimizeFunctionWithExprs(process_build_batch_fn);
 }
 
@@ -596,8 +1139,10 @@ Function* HashJoinNode::CodegenProcessProbeBatch(LlvmCodeGen* codegen,
   Function* join_conjuncts_fn = CodegenEvalConjuncts(codegen, other_join_conjuncts_);
   if (join_conjuncts_fn == NULL) return NULL;
   
-  // Codegen evaluating conjuncts
-  Function* conjuncts_fn = CodegenEvalConjuncts(codegen, conjuncts_);
+  // Codegen evaluating conjuncts.  If they are evaluated over the output batch, none
+  // are evaluated per row.
+  Function* conjuncts_fn = CodegenEvalConjuncts(codegen,
+      vectorize_conjuncts_ ? vector<Expr*>() : conjuncts_);
   if (conjuncts_fn == NULL) return NULL;
 
   // Replace all call sites with codegen version
@@ -606,9 +1151,10 @@ Function* HashJoinNode::CodegenProcessProbeBatch(LlvmCodeGen* codegen,
       hash_fn, "HashCurrentRow", &replaced);
   DCHECK_EQ(replaced, 1);
   
+  // Called when hashing the probe batch and again by FindHashed()
   process_probe_batch_fn = codegen->ReplaceCallSites(process_probe_batch_fn, false,
       eval_row_fn, "EvalProbeRow", &replaced);
-  DCHECK_EQ(replaced, 1);
+  DCHECK_EQ(replaced, 2);
 
   process_probe_batch_fn = codegen->ReplaceCallSites(process_probe_batch_fn, false,
       create_output_row_fn, "CreateOutputRow", &replaced);
@@ -624,7 +1170,7 @@ Function* HashJoinNode::CodegenProcessProbeBatch(LlvmCodeGen* codegen,
     
   process_probe_batch_fn = codegen->ReplaceCallSites(process_probe_batch_fn, false,
       equals_fn, "Equals", &replaced);
-  DCHECK_EQ(replaced, 2);
+  DCHECK_EQ(replaced, 1);
 
   return codegen->OptimizeFunctionWithExprs(process_probe_batch_fn);
 }
@@ -3,6 +3,7 @@
 #ifndef IMPALA_EXEC_HASH_JOIN_NODE_H
 #define IMPALA_EXEC_HASH_JOIN_NODE_H
 
+#include <list>
 #include <boost/scoped_ptr.hpp>
 #include <boost/unordered_set.hpp>
 
@@ -15,6 +16,8 @@ namespace impala {
 
 class MemPool;
 class RowBatch;
+class RuntimeFilter;
+class SpillStream;
 class TupleRow;
 
 // Node for in-memory hash joins:
@@ -29,6 +32,26 @@ class TupleRow;
 //   multiple rows per left input row
 // - TODO: fix this, so in the case of 1x1/nx1 joins (for instance, fact to dimension tbl)
 //   we don't do these extra copies
+//
+// Spilling (hybrid hash join):
+// If the build rows and hash table exceed --join_buffer_size bytes, the build input is
+// hash partitioned on the join exprs into NUM_PARTITIONS partitions and the largest
+// partitions are spilled to disk until the in-memory partitions fit in the budget.
+// The remaining build input is added to its partition, in memory or on disk.  After
+// the build input is exhausted, the hash table is built from the in-memory partitions.
+// Probe rows that fall into a spilled partition are written to that partition's probe
+// stream instead of being joined.  After the probe input is exhausted, each pair of
+// spilled build and probe streams is joined in the same way, which may partition
+// the spilled input again (with a different hash seed) if it still does not fit.
+//
+// Runtime filters:
+// For inner, left semi and right outer joins, probe rows without a build match are
+// dropped.  For every equi-join conjunct whose probe expr is a slot ref, a
+// RuntimeFilter (Bloom filter plus min/max) over the build values is computed while
+// the build input is read.  Before the probe input is opened, the filters are handed
+// to the hdfs scans in this fragment that materialize the slot, and sent to the
+// coordinator, which merges the filters of all instances of this node and forwards
+// them to the scans of the slot in other fragments.
 class HashJoinNode : public ExecNode {
  public:
   HashJoinNode(ObjectPool* pool, const TPlanNode& tnode, const DescriptorTbl& descs);
@@ -46,6 +69,16 @@ class HashJoinNode : public ExecNode {
   void DebugString(int indentation_level, std::stringstream* out) const;
   
  private:
+  // Number of partitions the input is split into when the build side does not fit.
+  static const int NUM_PARTITIONS = 16;
+
+  // Maximum number of times the input is repartitioned.  Beyond that, partitions are
+  // joined in memory regardless of --join_buffer_size.
+  static const int MAX_PARTITION_LEVEL = 8;
+
+  // A hash partition of the build and probe input (defined in the .cc).
+  struct Partition;
+
   boost::scoped_ptr<HashTable> hash_tbl_;
   HashTable::Iterator hash_tbl_iterator_;
 
@@ -68,6 +101,11 @@ class HashJoinNode : public ExecNode {
   bool match_one_build_;  // match at most one build row to each probe row
   bool match_all_build_;  // output all rows coming from the build input
 
+  // If true, conjuncts_ are not evaluated by ProcessProbeBatch() but over the rows it
+  // added to the output batch, with ExecNode::EvalConjuncts(RowBatch*).  Only used
+  // for left joins.
+  bool vectorize_conjuncts_;
+
   bool matched_probe_;  // if true, we have matched the current probe row
   bool eos_;  // if true, nothing left to return in GetNext()
   boost::scoped_ptr<MemPool> build_pool_;  // holds everything referenced in hash_tbl_
@@ -80,6 +118,12 @@ class HashJoinNode : public ExecNode {
   bool probe_eos_;  // if true, probe child has no more rows to process
   TupleRow* current_probe_row_;
 
+  // Hashes of the rows in probe_batch_, computed by ProcessProbeBatch() when it starts
+  // on a new batch.  probe_rows_may_match_[i] is false if row i has a NULL join key
+  // and cannot match; its hash is not set.
+  std::vector<uint32_t> probe_hashes_;
+  std::vector<uint8_t> probe_rows_may_match_;
+
   // build_tuple_idx_[i] is the tuple index of child(1)'s tuple[i] in the output row
   std::vector<int> build_tuple_idx_;
   int build_tuple_size_;
@@ -109,6 +153,44 @@ class HashJoinNode : public ExecNode {
   RuntimeProfile::Counter* build_row_counter_;   // num build rows
   RuntimeProfile::Counter* probe_row_counter_;   // num probe rows
   RuntimeProfile::Counter* build_buckets_counter_;   // num buckets in hash table
+  RuntimeProfile::Counter* spilled_partitions_counter_;   // num partitions spilled
+  RuntimeProfile::Counter* spilled_bytes_counter_;   // bytes written to spill streams
+
+  // The input of the current join pass: NULL to read from the children, otherwise
+  // the spill streams of the partition being joined.
+  SpillStream* build_input_;
+  SpillStream* probe_input_;
+
+  // Partitions of the current pass.  Empty unless the build side did not fit in
+  // memory.  Partitioned with hash seed build_level_.
+  std::vector<Partition*> partitions_;
+  int build_level_;
+
+  // Number of tuples of a probe row (child(0)'s row).
+  int probe_tuple_size_;
+
+  // Spilled partitions that remain to be joined, and the one being joined.
+  std::list<Partition*> spilled_partitions_;
+  boost::scoped_ptr<Partition> current_partition_;
+
+  // Runtime filters for the equi-join conjuncts, populated from the build input in the
+  // first pass.  Owned by the RuntimeState's obj pool, since the scans they are
+  // handed to may outlive this node's Close().
+  std::vector<RuntimeFilter*> runtime_filters_;
+
+  // Copies of build_exprs_, one per thread of a parallel build, and the hash tables
+  // that evaluate them for HashTable::ParallelInsert().  Empty if the build is
+  // single-threaded.
+  std::vector<std::vector<Expr*> > build_expr_copies_;
+  std::vector<HashTable*> build_evaluators_;
+
+  // Build rows of the current pass that have not been inserted into hash_tbl_ yet.
+  // The build rows are inserted batch by batch until hash_tbl_ holds
+  // PARALLEL_BUILD_MIN_ROWS rows.  With build_evaluators_, the rows are then moved
+  // here and the remaining rows are collected while the build input is consumed and
+  // inserted all at once, so that this can be done in parallel.  The row ptrs are
+  // copied into build_pool_.
+  std::vector<TupleRow*> pending_build_rows_;
 
   // set up build_- and probe_exprs_
   Status Init(ObjectPool* pool, const TPlanNode& tnode);
@@ -117,6 +199,88 @@ class HashJoinNode : public ExecNode {
   // outer
   Status LeftJoinGetNext(RuntimeState* state, RowBatch* row_batch, bool* eos);
 
+  // GetNext helper function for right outer and full outer joins.
+  Status RightJoinGetNext(RuntimeState* state, RowBatch* row_batch, bool* eos);
+
+  // Consumes the build input (build_input_) and builds hash_tbl_, partitioning and
+  // spilling the input if it does not fit.
+  Status BuildHashTable(RuntimeState* state);
+
+  // Creates runtime_filters_ if this join can use them.
+  void InitRuntimeFilters(RuntimeState* state);
+
+  // Adds the build values of the rows in 'batch' to the runtime filters.
+  void InsertRuntimeFilters(RowBatch* batch);
+
+  // Called after the build input was consumed: shrinks the runtime filters to their
+  // final size, applies them to the hdfs scans of child(0) that are not at or below a
+  // node with a limit and sends them to the coordinator.
+  void PublishRuntimeFilters(RuntimeState* state);
+
+  // Fetches the first non-empty probe batch and sets up the probe of its first row.
+  Status InitProbe(RuntimeState* state);
+
+  // Returns the next batch of the build input in 'batch'.
+  Status GetNextBuildBatch(RuntimeState* state, RowBatch* batch, bool* eos);
+
+  // Returns the next batch of the probe input in probe_batch_ and sets probe_eos_.
+  // Rows that belong to spilled partitions are removed from the batch and written
+  // to the partition's probe stream.
+  Status GetNextProbeBatch(RuntimeState* state);
+
+  // Returns the number of bytes used by the build rows held in memory, including
+  // build_pool_, hash_tbl_, pending_build_rows_ and the in-memory partitions.
+  int64_t build_bytes() const;
+
+  // Returns the partition of 'row' evaluated over 'exprs' (build_exprs_ or
+  // probe_exprs_) for the current level.
+  int GetPartition(const std::vector<Expr*>& exprs, TupleRow* row);
+
+  // Switches to partitioned mode: moves the rows in hash_tbl_ into partitions_ and
+  // spills partitions until the remaining ones fit in memory.
+  Status PartitionHashTable(RuntimeState* state);
+
+  // Adds 'row' to its partition.
+  Status AddBuildRow(RuntimeState* state, TupleRow* row);
+
+  // Spills the largest in-memory partitions until the in-memory partitions fit in
+  // memory.
+  Status SpillPartitions(RuntimeState* state);
+
+  // Moves the rows of in-memory partition 'partition' to its (new) spill streams.
+  Status SpillPartition(RuntimeState* state, Partition* partition);
+
+  // Writes the rows buffered for the spilled partitions to their streams.  The
+  // buffered rows reference the current input batch, so this must be called before
+  // the input batch is reset.
+  Status FlushPartitions();
+
+  // Inserts the rows in 'batch' into hash_tbl_, using the codegen'd function
+  // if possible.
+  void InsertBuildBatch(RowBatch* batch);
+
+  // Inserts 'rows' into hash_tbl_.  If hash_tbl_ is empty and there are enough rows,
+  // this is done by multiple threads.
+  Status InsertBuildRows(RuntimeState* state, const std::vector<TupleRow*>& rows);
+
+  // Moves the rows in hash_tbl_ to pending_build_rows_ and resets hash_tbl_, so that
+  // the rest of the build is done by InsertPendingBuildRows().
+  void StartParallelBuild();
+
+  // Adds the rows in 'batch' to pending_build_rows_.
+  void AddPendingBuildRows(RowBatch* batch);
+
+  // Inserts pending_build_rows_ into hash_tbl_ and clears them.
+  Status InsertPendingBuildRows(RuntimeState* state);
+
+  // Builds hash_tbl_ from the in-memory partitions after the build input is consumed.
+  Status BuildFromPartitions(RuntimeState* state);
+
+  // Done with the current pass: queues the spilled partitions and sets up the join
+  // of the next one.  Resources referenced by rows already returned are transferred
+  // to 'out_batch'.
+  Status NextSpilledPartition(RuntimeState* state, RowBatch* out_batch);
+
   // Processes a probe batch for the common (non right-outer join) cases.
   //  out_batch: the batch for resulting tuple rows
   //  probe_batch: the probe batch to process.  This function can be called to
@@ -178,17 +178,17 @@ TEST_F(HashTableTest, BasicTest) {
   FullScan(&hash_table, 0, 5, true, scan_rows, build_rows);
   ProbeTest(&hash_table, probe_rows, 10, false);
 
-  // Resize to two and cause some collisions
-  ResizeTable(&hash_table, 2);
-  EXPECT_EQ(hash_table.num_buckets(), 2);
+  // Resize to eight and cause some collisions
+  ResizeTable(&hash_table, 8);
+  EXPECT_EQ(hash_table.num_buckets(), 8);
   EXPECT_EQ(hash_table.size(), 5);
   memset(scan_rows, 0, sizeof(scan_rows));
   FullScan(&hash_table, 0, 5, true, scan_rows, build_rows);
   ProbeTest(&hash_table, probe_rows, 10, false);
 
-  // Resize to one and turn it into a linked list
-  ResizeTable(&hash_table, 1);
-  EXPECT_EQ(hash_table.num_buckets(), 1);
+  // Resize to six, which is rounded up to the next power of two
+  ResizeTable(&hash_table, 6);
+  EXPECT_EQ(hash_table.num_buckets(), 8);
   EXPECT_EQ(hash_table.size(), 5);
   memset(scan_rows, 0, sizeof(scan_rows));
   FullScan(&hash_table, 0, 5, true, scan_rows, build_rows);
@@ -226,14 +226,120 @@ TEST_F(HashTableTest, ScanTest) {
   ProbeTest(&hash_table, probe_rows, 15, true);
 
   ResizeTable(&hash_table, 20);
-  EXPECT_EQ(hash_table.num_buckets(), 20);
+  EXPECT_EQ(hash_table.num_buckets(), 32);
   ProbeTest(&hash_table, probe_rows, 15, true);
 
-  ResizeTable(&hash_table, 1);
-  EXPECT_EQ(hash_table.num_buckets(), 1);
+  // The 10 distinct keys only need one bucket each, duplicates are chained.
+  ResizeTable(&hash_table, 11);
+  EXPECT_EQ(hash_table.num_buckets(), 16);
+  EXPECT_EQ(hash_table.size(), 55);
+  EXPECT_EQ(hash_table.load_factor(), 10 / 16.0f);
   ProbeTest(&hash_table, probe_rows, 15, true);
 }
 
+// This tests that the table grows before it is full, so that probes for keys that
+// are not in the table terminate.
+TEST_F(HashTableTest, LinearProbingTest) {
+  HashTable hash_table(build_expr_, probe_expr_, 1, false, 16);
+  EXPECT_EQ(hash_table.num_buckets(), 16);
+  for (int i = 0; i < 64; ++i) {
+    hash_table.Insert(CreateTupleRow(i));
+    EXPECT_LT(hash_table.load_factor(), 1.0f);
+    for (int j = 0; j <= i + 1; ++j) {
+      TupleRow* probe_row = CreateTupleRow(j);
+      HashTable::Iterator iter = hash_table.Find(probe_row);
+      if (j <= i) {
+        EXPECT_TRUE(iter != hash_table.End());
+        ValidateMatch(probe_row, iter.GetRow());
+        iter.Next<true>();
+      }
+      EXPECT_TRUE(iter == hash_table.End());
+    }
+  }
+  EXPECT_EQ(hash_table.size(), 64);
+  EXPECT_GE(hash_table.num_buckets(), 64);
+}
+
+// This tests that hashing a batch of probe rows up front and then looking them up
+// finds the same rows as Find().
+TEST_F(HashTableTest, BatchedProbeTest) {
+  HashTable hash_table(build_expr_, probe_expr_, 1, false);
+  for (int val = 0; val < 100; ++val) {
+    for (int i = 0; i <= val % 3; ++i) {
+      hash_table.Insert(CreateTupleRow(val));
+    }
+  }
+
+  const int num_probe_rows = 200;
+  TupleRow* probe_rows[num_probe_rows];
+  uint32_t hashes[num_probe_rows];
+  for (int i = 0; i < num_probe_rows; ++i) {
+    probe_rows[i] = CreateTupleRow(i);
+    EXPECT_TRUE(hash_table.HashAndPrefetch(probe_rows[i], &hashes[i]));
+  }
+
+  for (int i = 0; i < num_probe_rows; ++i) {
+    HashTable::Iterator iter = hash_table.FindHashed(probe_rows[i], hashes[i]);
+    int num_matches = 0;
+    while (iter.HasNext()) {
+      ValidateMatch(probe_rows[i], iter.GetRow());
+      ++num_matches;
+      iter.Next<true>();
+    }
+    EXPECT_EQ(num_matches, i < 100 ? i % 3 + 1 : 0);
+  }
+}
+
+// This tests building the table with multiple threads.
+TEST_F(HashTableTest, ParallelInsertTest) {
+  const int num_threads = 4;
+  const int num_keys = 10000;
+  RowDescriptor desc;
+  vector<vector<Expr*> > expr_copies(num_threads);
+  vector<HashTable*> evaluators;
+  for (int i = 0; i < num_threads; ++i) {
+    expr_copies[i].push_back(pool_.Add(new SlotRef(TYPE_INT, 0)));
+    EXPECT_TRUE(Expr::Prepare(expr_copies[i], NULL, desc).ok());
+    evaluators.push_back(pool_.Add(
+        new HashTable(expr_copies[i], expr_copies[i], 1, false, 1)));
+  }
+
+  // Key i appears i % 3 + 1 times.
+  vector<TupleRow*> build_rows;
+  for (int i = 0; i < num_keys; ++i) {
+    for (int j = 0; j <= i % 3; ++j) {
+      build_rows.push_back(CreateTupleRow(i));
+    }
+  }
+
+  HashTable hash_table(build_expr_, probe_expr_, 1, false);
+  EXPECT_TRUE(hash_table.ParallelInsert(build_rows, evaluators).ok());
+  EXPECT_EQ(hash_table.size(), build_rows.size());
+  EXPECT_EQ(hash_table.load_factor(),
+      num_keys / static_cast<float>(hash_table.num_buckets()));
+
+  for (int i = 0; i < num_keys + 100; ++i) {
+    TupleRow* probe_row = CreateTupleRow(i);
+    HashTable::Iterator iter = hash_table.Find(probe_row);
+    int num_matches = 0;
+    while (iter.HasNext()) {
+      ValidateMatch(probe_row, iter.GetRow());
+      ++num_matches;
+      iter.Next<true>();
+    }
+    EXPECT_EQ(num_matches, i < num_keys ? i % 3 + 1 : 0);
+  }
+
+  // The table can still grow afterwards.
+  for (int i = num_keys; i < 4 * num_keys; ++i) {
+    hash_table.Insert(CreateTupleRow(i));
+  }
+  for (int i = 0; i < 4 * num_keys; i += 1000) {
+    TupleRow* probe_row = CreateTupleRow(i);
+    EXPECT_TRUE(hash_table.Find(probe_row) != hash_table.End());
+  }
+}
+
 // This test continues adding to the hash table to trigger the resize code paths
 TEST_F(HashTableTest, GrowTableTest) {
   int build_row_val = 0;
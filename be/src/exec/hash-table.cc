@@ -1,8 +1,13 @@
 // Copyright (c) 2012 Cloudera, Inc. All rights reserved.
 
+#include <boost/bind.hpp>
+#include <boost/mem_fn.hpp>
+
 #include "codegen/llvm-codegen.h"
 #include "exec/hash-table.inline.h"
 #include "exprs/expr.h"
+#include "runtime/mem-tracker.h"
+#include "runtime/parallel-executor.h"
 #include "runtime/raw-value.h"
 #include "runtime/string-value.inline.h"
 #include "util/debug-util.h"
@@ -14,9 +19,18 @@ using namespace std;
 const char* HashTable::LLVM_CLASS_NAME = "class.impala::HashTable";
 
 const float HashTable::MAX_BUCKET_OCCUPANCY_FRACTION = 0.75f;
+const int64_t HashTable::DEFAULT_INITIAL_BUCKETS;
+
+// Returns the smallest power of two >= num_buckets.
+static int64_t RoundUpNumBuckets(int64_t num_buckets) {
+  int64_t result = 1;
+  while (result < num_buckets) result *= 2;
+  return result;
+}
 
 HashTable::HashTable(const vector<Expr*>& build_exprs, const vector<Expr*>& probe_exprs,
-    int num_build_tuples, bool stores_nulls, int64_t num_buckets) :
+    int num_build_tuples, bool stores_nulls, int64_t num_buckets,
+    MemTracker* mem_tracker) :
     build_exprs_(build_exprs),
     probe_exprs_(probe_exprs),
     num_build_tuples_(num_build_tuples),
@@ -24,10 +38,11 @@ HashTable::HashTable(const vector<Expr*>& build_exprs, const vector<Expr*>& prob
     node_byte_size_(sizeof(Node) + sizeof(Tuple*) * num_build_tuples_),
     num_filled_buckets_(0),
     nodes_(NULL),
-    num_nodes_(0) {
+    num_nodes_(0),
+    mem_tracker_(mem_tracker) {
   DCHECK_EQ(build_exprs_.size(), probe_exprs_.size());
-  buckets_.resize(num_buckets);
-  num_buckets_ = num_buckets;
+  num_buckets_ = RoundUpNumBuckets(num_buckets);
+  buckets_.resize(num_buckets_);
   num_buckets_till_resize_ = MAX_BUCKET_OCCUPANCY_FRACTION * num_buckets_;
 
   // Compute the layout and buffer size to store the evaluated expr results
@@ -39,6 +54,15 @@ HashTable::HashTable(const vector<Expr*>& build_exprs, const vector<Expr*>& prob
 
   nodes_capacity_ = 1024;
   nodes_ = reinterpret_cast<uint8_t*>(malloc(node_byte_size_ * nodes_capacity_));
+  if (mem_tracker_ != NULL) mem_tracker_->Consume(byte_size());
+}
+
+HashTable::~HashTable() {
+  if (mem_tracker_ != NULL) mem_tracker_->Release(byte_size());
+  // TODO: use tr1::array?
+  delete[] expr_values_buffer_;
+  delete[] expr_value_null_bits_;
+  free(nodes_);
 }
 
 bool HashTable::EvalRow(TupleRow* row, const vector<Expr*>& exprs) {
@@ -545,34 +569,212 @@ Function* HashTable::CodegenEquals(LlvmCodeGen* codegen) {
 }
 
 void HashTable::ResizeBuckets(int64_t num_buckets) {
+  num_buckets = RoundUpNumBuckets(num_buckets);
+  DCHECK_GT(num_buckets, num_filled_buckets_);
   vector<Bucket> new_buckets;
-
   new_buckets.resize(num_buckets);
-  num_filled_buckets_ = 0;
-
-  Iterator iter = Begin();
-  while (iter.HasNext()) {
-    int64_t node_idx = iter.node_idx_;
-    // Advance to next node before modifying the node's next link
-    iter.Next<false>();
 
-    Node* node = GetNode(node_idx);
-
-    // Assign it to a new bucket
-    uint32_t hash = node->hash_;
-    int64_t bucket_idx = hash % num_buckets;
-    AddToBucket(&new_buckets[bucket_idx], node_idx, node);
+  // Move each key to its new bucket.  The keys are distinct so there is no need to
+  // compare them, and the lists of nodes with the same key are left as is.
+  int64_t bucket_mask = num_buckets - 1;
+  for (int64_t i = 0; i < num_buckets_; ++i) {
+    const Bucket& bucket = buckets_[i];
+    if (bucket.node_idx_ == -1) continue;
+    int64_t bucket_idx = bucket.hash_ & bucket_mask;
+    while (new_buckets[bucket_idx].node_idx_ != -1) {
+      bucket_idx = (bucket_idx + 1) & bucket_mask;
+    }
+    new_buckets[bucket_idx] = bucket;
   }
 
+  if (mem_tracker_ != NULL) {
+    mem_tracker_->Consume(
+        sizeof(Bucket) * (num_buckets - static_cast<int64_t>(buckets_.size())));
+  }
   buckets_.swap(new_buckets);
   num_buckets_ = buckets_.size();
   num_buckets_till_resize_ = MAX_BUCKET_OCCUPANCY_FRACTION * num_buckets_;
 }
   
+// Minimum number of buckets in each region of a ParallelInsert(), so that few rows
+// run past the end of their region.
+static const int64_t MIN_BUCKETS_PER_REGION = 1024;
+
+struct HashTable::ParallelInsertState {
+  const vector<TupleRow*>* rows;
+  const vector<HashTable*>* evaluators;
+  int num_threads;
+
+  // Hash of each row in 'rows', and whether the row is inserted at all (it isn't if
+  // it has a NULL and the table doesn't store NULLs).  Set by HashRows().
+  vector<uint32_t> hashes;
+  vector<uint8_t> inserted;
+
+  // The rows that are inserted and their hashes.  The row at index i is stored in
+  // node i.
+  vector<TupleRow*> node_rows;
+  vector<uint32_t> node_hashes;
+
+  // The bucket array is split into 2^k regions of 2^region_shift buckets.  Thread t
+  // inserts the rows of regions r with r % num_threads == t.
+  int region_shift;
+};
+
+struct HashTable::ParallelInsertWork {
+  ParallelInsertState* state;
+  int thread_idx;
+  // Set by InsertRegions(): number of buckets filled by this thread and the indices
+  // of the nodes that ran past the end of their region.
+  int64_t num_filled_buckets;
+  vector<int64_t> overflow_nodes;
+};
+
+Status HashTable::ParallelInsert(const vector<TupleRow*>& rows,
+    const vector<HashTable*>& evaluators) {
+  DCHECK_EQ(num_nodes_, 0);
+  DCHECK(!evaluators.empty());
+  ParallelInsertState state;
+  state.rows = &rows;
+  state.evaluators = &evaluators;
+  state.num_threads = evaluators.size();
+  state.hashes.resize(rows.size());
+  state.inserted.resize(rows.size());
+
+  vector<ParallelInsertWork> work(state.num_threads);
+  vector<void*> args(state.num_threads);
+  for (int i = 0; i < state.num_threads; ++i) {
+    work[i].state = &state;
+    work[i].thread_idx = i;
+    work[i].num_filled_buckets = 0;
+    args[i] = &work[i];
+  }
+  RETURN_IF_ERROR(ParallelExecutor::Exec(
+      boost::bind<Status>(boost::mem_fn(&HashTable::HashRows), this, _1),
+      &args[0], args.size()));
+
+  for (int64_t i = 0; i < rows.size(); ++i) {
+    if (!state.inserted[i]) continue;
+    state.node_rows.push_back(rows[i]);
+    state.node_hashes.push_back(state.hashes[i]);
+  }
+  int64_t num_nodes = state.node_rows.size();
+
+  // Size the table so that it doesn't need to grow even if all keys are distinct.
+  int64_t num_regions = RoundUpNumBuckets(state.num_threads);
+  int64_t num_buckets = max(num_buckets_, num_regions * MIN_BUCKETS_PER_REGION);
+  num_buckets = max(num_buckets,
+      static_cast<int64_t>(num_nodes / MAX_BUCKET_OCCUPANCY_FRACTION) + 1);
+  ResizeBuckets(num_buckets);
+  ReserveNodes(num_nodes);
+  state.region_shift = 0;
+  while ((num_regions << state.region_shift) < num_buckets_) ++state.region_shift;
+
+  RETURN_IF_ERROR(ParallelExecutor::Exec(
+      boost::bind<Status>(boost::mem_fn(&HashTable::InsertRegions), this, _1),
+      &args[0], args.size()));
+  num_nodes_ = num_nodes;
+  num_filled_buckets_ = 0;
+  for (int i = 0; i < state.num_threads; ++i) {
+    num_filled_buckets_ += work[i].num_filled_buckets;
+  }
+
+  // Insert the rows that did not fit into their region, continuing their probe
+  // sequence into the next regions.
+  for (int i = 0; i < state.num_threads; ++i) {
+    const vector<int64_t>& overflow_nodes = work[i].overflow_nodes;
+    for (int j = 0; j < overflow_nodes.size(); ++j) {
+      int64_t node_idx = overflow_nodes[j];
+      EvalBuildRow(state.node_rows[node_idx]);
+      uint32_t hash = state.node_hashes[node_idx];
+      bool found;
+      int64_t bucket_idx = Probe(hash, &found);
+      Node* node = GetNode(node_idx);
+      Bucket* bucket = &buckets_[bucket_idx];
+      if (found) {
+        node->next_idx_ = bucket->node_idx_;
+      } else {
+        node->next_idx_ = -1;
+        bucket->hash_ = hash;
+        ++num_filled_buckets_;
+      }
+      bucket->node_idx_ = node_idx;
+    }
+  }
+  return Status::OK;
+}
+
+Status HashTable::HashRows(void* arg) {
+  ParallelInsertWork* work = reinterpret_cast<ParallelInsertWork*>(arg);
+  ParallelInsertState* state = work->state;
+  HashTable* evaluator = (*state->evaluators)[work->thread_idx];
+  int64_t num_rows = state->rows->size();
+  int64_t begin = num_rows * work->thread_idx / state->num_threads;
+  int64_t end = num_rows * (work->thread_idx + 1) / state->num_threads;
+  for (int64_t i = begin; i < end; ++i) {
+    bool has_null = evaluator->EvalBuildRow((*state->rows)[i]);
+    state->inserted[i] = stores_nulls_ || !has_null;
+    if (state->inserted[i]) state->hashes[i] = evaluator->HashCurrentRow();
+  }
+  return Status::OK;
+}
+
+Status HashTable::InsertRegions(void* arg) {
+  ParallelInsertWork* work = reinterpret_cast<ParallelInsertWork*>(arg);
+  ParallelInsertState* state = work->state;
+  HashTable* evaluator = (*state->evaluators)[work->thread_idx];
+  int64_t bucket_mask = num_buckets_ - 1;
+  int64_t num_nodes = state->node_rows.size();
+  for (int64_t node_idx = 0; node_idx < num_nodes; ++node_idx) {
+    uint32_t hash = state->node_hashes[node_idx];
+    int64_t bucket_idx = hash & bucket_mask;
+    int64_t region = bucket_idx >> state->region_shift;
+    if (region % state->num_threads != work->thread_idx) continue;
+    int64_t region_end = (region + 1) << state->region_shift;
+
+    TupleRow* row = state->node_rows[node_idx];
+    Node* node = GetNode(node_idx);
+    memcpy(node->data(), row, sizeof(Tuple*) * num_build_tuples_);
+    bool evaluated = false;
+    for (; bucket_idx < region_end; ++bucket_idx) {
+      Bucket* bucket = &buckets_[bucket_idx];
+      if (bucket->node_idx_ == -1) {
+        node->next_idx_ = -1;
+        bucket->hash_ = hash;
+        bucket->node_idx_ = node_idx;
+        ++work->num_filled_buckets;
+        break;
+      }
+      if (bucket->hash_ != hash) continue;
+      if (!evaluated) {
+        evaluator->EvalBuildRow(row);
+        evaluated = true;
+      }
+      if (evaluator->Equals(GetNode(bucket->node_idx_)->data())) {
+        node->next_idx_ = bucket->node_idx_;
+        bucket->node_idx_ = node_idx;
+        break;
+      }
+    }
+    if (bucket_idx == region_end) work->overflow_nodes.push_back(node_idx);
+  }
+  return Status::OK;
+}
+
+void HashTable::ReserveNodes(int64_t num_nodes) {
+  if (num_nodes <= nodes_capacity_) return;
+  int64_t old_size = nodes_capacity_ * node_byte_size_;
+  nodes_capacity_ = num_nodes;
+  int64_t new_size = nodes_capacity_ * node_byte_size_;
+  nodes_ = reinterpret_cast<uint8_t*>(realloc(nodes_, new_size));
+  if (mem_tracker_ != NULL) mem_tracker_->Consume(new_size - old_size);
+}
+
 void HashTable::GrowNodeArray() {
+  int64_t old_size = nodes_capacity_ * node_byte_size_;
   nodes_capacity_ = nodes_capacity_ + nodes_capacity_ / 2;
   int64_t new_size = nodes_capacity_ * node_byte_size_;
   nodes_ = reinterpret_cast<uint8_t*>(realloc(nodes_, new_size));
+  if (mem_tracker_ != NULL) mem_tracker_->Consume(new_size - old_size);
 }
 
 string HashTable::DebugString(bool skip_empty, const RowDescriptor* desc) {
@@ -583,6 +785,7 @@ string HashTable::DebugString(bool skip_empty, const RowDescriptor* desc) {
     bool first = true;
     if (skip_empty && node_idx == -1) continue;
     ss << i << ": ";
+    if (node_idx != -1) ss << "[" << buckets_[i].hash_ << "] ";
     while (node_idx != -1) {
       Node* node = GetNode(node_idx);
       if (!first) {
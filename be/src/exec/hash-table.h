@@ -7,6 +7,7 @@
 #include <boost/cstdint.hpp>
 #include "codegen/impala-ir.h"
 #include "common/logging.h"
+#include "common/status.h"
 #include "util/hash-util.h"
 
 namespace llvm {
@@ -17,6 +18,7 @@ namespace impala {
 
 class Expr;
 class LlvmCodeGen;
+class MemTracker;
 class RowDescriptor;
 class Tuple;
 class TupleRow;
@@ -37,16 +39,18 @@ class TupleRow;
 //
 // The hash table does not support removes. The hash table is not thread safe.
 //
-// The implementation is based on the boost multiset.  The hashtable is implemented by
-// two data structures: a vector of buckets and a vector of nodes.  Inserted values
-// are stored as nodes (in the order they are inserted).  The buckets (indexed by the
-// mod of the hash) contain pointers to the node vector.  Nodes that fall in the same
-// bucket are linked together (the bucket pointer gets you the head of that linked list).
+// The hashtable is implemented by two data structures: an open-addressing array of
+// buckets and a vector of nodes.  Inserted values are stored as nodes (in the order
+// they are inserted).  Each distinct key occupies one bucket, which holds the hash of
+// the key and the index of the first node with that key; collisions are resolved by
+// linear probing.  Nodes with equal keys (e.g. duplicate build rows in a join) are
+// linked together from that bucket.  Since the hash is stored inline in the bucket
+// array, a probe usually only touches one cache line of buckets and one node, and only
+// compares the keys of nodes whose hash matches.  The number of buckets is always a
+// power of two.
 // For growing the hash table, new buckets are allocated but the node vector is modified
 // in place.
 //
-// TODO: this is not a fancy hash table in terms of memory access patterns (cuckoo-hashing
-// or something that spills to disk). We will likely want to invest more time into this.
 // TODO: hash-join and aggregation have very different access patterns.  Joins insert
 // all the rows and then calls scan to find them.  Aggregation interleaves Find() and 
 // Inserts().  We can want to optimize joins more heavily for Inserts() (in particular
@@ -60,27 +64,39 @@ class HashTable {
   //  - probe_exprs are used during Find()
   //  - num_build_tuples: number of Tuples in the build tuple row
   //  - stores_nulls: if false, TupleRows with nulls are ignored during Insert
-  //  - num_buckets: number of buckets that the hash table should be initialized to
+  //  - num_buckets: number of buckets that the hash table should be initialized to.
+  //    This is rounded up to a power of two.
+  //  - mem_tracker: if non-NULL, the node and bucket memory is charged to it
   HashTable(const std::vector<Expr*>& build_exprs, const std::vector<Expr*>& probe_exprs,
-      int num_build_tuples, bool stores_nulls, int64_t num_buckets = 1024);
+      int num_build_tuples, bool stores_nulls,
+      int64_t num_buckets = DEFAULT_INITIAL_BUCKETS, MemTracker* mem_tracker = NULL);
 
-  ~HashTable() {
-    // TODO: use tr1::array?
-    delete[] expr_values_buffer_;
-    delete[] expr_value_null_bits_;
-    free(nodes_);
-  }
+  ~HashTable();
+
+  static const int64_t DEFAULT_INITIAL_BUCKETS = 1024;
 
   // Insert row into the hash table.  Row will be evaluated over build_exprs_
   // This will grow the hash table if necessary
   void IR_ALWAYS_INLINE Insert(TupleRow* row) {
-    if (num_filled_buckets_ > num_buckets_till_resize_) {
-      // TODO: next prime instead of double?
+    // Growing before the table is full guarantees that a probe always reaches an
+    // empty bucket.
+    if (num_filled_buckets_ >= num_buckets_till_resize_) {
       ResizeBuckets(num_buckets_ * 2);
     }
     InsertImpl(row);
   }
   
+  // Inserts 'rows' into the table, which must be empty, using one thread per element
+  // of 'evaluators'.  Exprs are not thread safe, so each evaluator must be a HashTable
+  // over its own copy of the build exprs; it is only used to evaluate, hash and
+  // compare rows.  The bucket array is sized for all the rows up front and split into
+  // contiguous regions by hash, and each region is only written by one thread.  Rows
+  // whose probe sequence runs past the end of their region are inserted serially
+  // afterwards.  The result is the same as calling Insert() for each row, except for
+  // the order of rows with the same key.
+  Status ParallelInsert(const std::vector<TupleRow*>& rows,
+      const std::vector<HashTable*>& evaluators);
+
   // Returns the start iterator for all rows that match 'probe_row'.  'probe_row' is
   // evaluated with probe_exprs_.  The iterator can be iterated until HashTable::End() 
   // to find all the matching rows.
@@ -92,13 +108,27 @@ class HashTable {
   // Returns HashTable::End() if there is no match.
   Iterator Find(TupleRow* probe_row);
   
+  // Batched version of Find(), used to overlap the cache misses of probing many rows.
+  // The caller first calls HashAndPrefetch() for a batch of probe rows and then
+  // FindHashed() for each of them.  HashAndPrefetch() evaluates 'probe_row', stores
+  // its hash in *hash and prefetches the bucket it maps to.  Returns false if the row
+  // cannot match anything (i.e. it has a NULL and the table does not store NULLs), in
+  // which case FindHashed() must not be called for it.
+  bool IR_ALWAYS_INLINE HashAndPrefetch(TupleRow* probe_row, uint32_t* hash);
+
+  // Returns the same as Find(probe_row), for a row that was passed to
+  // HashAndPrefetch() and is 'hash'.  The probe exprs are only evaluated again if a
+  // bucket with the same hash is found.  The table must not have been modified
+  // since the call to HashAndPrefetch().
+  Iterator IR_ALWAYS_INLINE FindHashed(TupleRow* probe_row, uint32_t hash);
+
   // Returns number of elements in the hash table
   int64_t size() { return num_nodes_; }
 
   // Returns the number of buckets
   int64_t num_buckets() { return buckets_.size(); }
 
-  // Returns the load factor (the number of non-empty buckets)
+  // Returns the load factor (the fraction of non-empty buckets)
   float load_factor() { 
     return num_filled_buckets_ / static_cast<float>(buckets_.size()); 
   }
@@ -158,8 +188,8 @@ class HashTable {
     }
 
     // Iterates to the next element.  In the case where the iterator was
-    // from a Find, this will lazily evaluate that bucket, only returning
-    // TupleRows that match the current scan row.
+    // from a Find, this only returns the remaining TupleRows with the same key,
+    // which all match the current scan row.
     template<bool check_match>
     void Next();
 
@@ -185,11 +215,10 @@ class HashTable {
    private:
     friend class HashTable;
 
-    Iterator(HashTable* table, int bucket_idx, int64_t node, uint32_t hash) :
+    Iterator(HashTable* table, int64_t bucket_idx, int64_t node) :
       table_(table),
       bucket_idx_(bucket_idx),
-      node_idx_(node),
-      scan_hash_(hash) {
+      node_idx_(node) {
     }
 
     HashTable* table_;
@@ -197,8 +226,6 @@ class HashTable {
     int64_t bucket_idx_;        
     // Current node idx (within current bucket)
     int64_t node_idx_;          
-    // cached hash value for the row passed to Find()()
-    uint32_t scan_hash_;    
   };
 
  private:
@@ -208,8 +235,7 @@ class HashTable {
   // Header portion of a Node.  The node data (TupleRow) is right after the 
   // node memory to maximize cache hits.
   struct Node {
-    int64_t next_idx_;  // chain to next node for collisions
-    uint32_t hash_;     // Cache of the hash for data_
+    int64_t next_idx_;  // chain to next node with the same key
 
     TupleRow* data() {
       uint8_t* mem = reinterpret_cast<uint8_t*>(this);
@@ -218,11 +244,15 @@ class HashTable {
     }
   };
 
+  // A slot in the open-addressing bucket array.  This is kept at 16 bytes so that
+  // four buckets share a cache line.
   struct Bucket {
-    int64_t node_idx_;
+    int64_t node_idx_;  // first node with this key, -1 if the bucket is empty
+    uint32_t hash_;     // hash of the key, compared before the key itself
 
     Bucket() {
       node_idx_ = -1;
+      hash_ = 0;
     }
   };
 
@@ -237,15 +267,30 @@ class HashTable {
     return reinterpret_cast<Node*>(nodes_ + node_byte_size_ * idx);
   }
   
-  // Resize the hash table to 'num_buckets'
+  struct ParallelInsertState;
+  struct ParallelInsertWork;
+
+  // Work functions of the threads of ParallelInsert().  'arg' is a ParallelInsertWork.
+  // HashRows() evaluates and hashes a range of rows, InsertRegions() inserts the
+  // rows of the regions of the bucket array assigned to the thread.
+  Status HashRows(void* arg);
+  Status InsertRegions(void* arg);
+
+  // Grows the node array so that it can hold at least 'num_nodes' nodes.
+  void ReserveNodes(int64_t num_nodes);
+
+  // Resize the hash table to 'num_buckets', rounded up to a power of two.  There must
+  // be more buckets than distinct keys in the table.
   void ResizeBuckets(int64_t num_buckets);
 
   // Insert row into the hash table
   void IR_ALWAYS_INLINE InsertImpl(TupleRow* row);
 
-  // Chains the node at 'node_idx' to 'bucket'.  Nodes in a bucket are chained
-  // as a linked list; this places the new node at the beginning of the list.
-  void AddToBucket(Bucket* bucket, int64_t node_idx, Node* node);
+  // Linear probes the buckets for the key in 'expr_values_buffer_', which hashes to
+  // 'hash'.  Returns the index of the bucket containing the key and sets *found to
+  // true, or returns the index of the empty bucket the key would be inserted into and
+  // sets *found to false.  Equals() is only called for buckets with the same hash.
+  int64_t IR_ALWAYS_INLINE Probe(uint32_t hash, bool* found);
 
   // Evaluate the exprs over row and cache the results in 'expr_values_buffer_'.
   // Returns whether any expr evaluated to NULL
@@ -293,7 +338,8 @@ class HashTable {
   void GrowNodeArray();
 
   // Load factor that will trigger growing the hash table on insert.  This is 
-  // defined as the number of non-empty buckets / total_buckets
+  // defined as the number of non-empty buckets / total_buckets.  Linear probing
+  // degrades quickly above this.
   static const float MAX_BUCKET_OCCUPANCY_FRACTION;
 
   const std::vector<Expr*>& build_exprs_;
@@ -310,8 +356,7 @@ class HashTable {
   // Number of non-empty buckets.  Used to determine when to grow and rehash
   int64_t num_filled_buckets_;
   // Memory to store node data.  This is not allocated from a pool to take advantage
-  // of realloc.
-  // TODO: integrate with mem pools
+  // of realloc.  It is charged to mem_tracker_ directly.
   uint8_t* nodes_;
   // number of nodes stored (i.e. size of hash table)
   int64_t num_nodes_;
@@ -320,12 +365,16 @@ class HashTable {
 
   std::vector<Bucket> buckets_;
   
-  // equal to buckets_.size() but more efficient than the size function
+  // equal to buckets_.size() but more efficient than the size function.  Always a
+  // power of two, so that num_buckets_ - 1 masks a hash to a bucket index.
   int64_t num_buckets_;
   
   // The number of filled buckets to trigger a resize.  This is cached for efficiency
   int64_t num_buckets_till_resize_;
 
+  // Tracker for nodes_ and buckets_; may be NULL.
+  MemTracker* mem_tracker_;
+
   // Cache of exprs values for the current row being evaluated.  This can either
   // be a build row (during Insert()) or probe row (during Find()).
   std::vector<int> expr_values_buffer_offsets_;
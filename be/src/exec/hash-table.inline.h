@@ -3,6 +3,7 @@
 #ifndef IMPALA_EXEC_HASH_TABLE_INLINE_H
 #define IMPALA_EXEC_HASH_TABLE_INLINE_H
 
+#include "common/compiler-util.h"
 #include "exec/hash-table.h"
 
 namespace impala {
@@ -11,26 +12,47 @@ inline HashTable::Iterator HashTable::Find(TupleRow* probe_row) {
   bool has_nulls = EvalProbeRow(probe_row);
   if (!stores_nulls_ && has_nulls) return End();
   uint32_t hash = HashCurrentRow();
-  int64_t bucket_idx = hash % num_buckets_;
+  bool found;
+  int64_t bucket_idx = Probe(hash, &found);
+  if (!found) return End();
+  return Iterator(this, bucket_idx, buckets_[bucket_idx].node_idx_);
+}
+  
+inline bool HashTable::HashAndPrefetch(TupleRow* probe_row, uint32_t* hash) {
+  bool has_nulls = EvalProbeRow(probe_row);
+  if (!stores_nulls_ && has_nulls) return false;
+  *hash = HashCurrentRow();
+  PREFETCH(&buckets_[*hash & (num_buckets_ - 1)]);
+  return true;
+}
 
-  Bucket* bucket = &buckets_[bucket_idx];
-  int64_t node_idx = bucket->node_idx_;
-  while (node_idx != -1) {
-    Node* node = GetNode(node_idx);
-    if (node->hash_ == hash && Equals(node->data())) {
-      return Iterator(this, bucket_idx, node_idx, hash);
+inline HashTable::Iterator HashTable::FindHashed(TupleRow* probe_row, uint32_t hash) {
+  int64_t bucket_mask = num_buckets_ - 1;
+  int64_t bucket_idx = hash & bucket_mask;
+  // 'expr_values_buffer_' may contain the values of another probe row, so only
+  // evaluate this one once its key actually needs to be compared.
+  bool evaluated = false;
+  while (true) {
+    Bucket* bucket = &buckets_[bucket_idx];
+    if (bucket->node_idx_ == -1) return End();
+    if (bucket->hash_ == hash) {
+      if (!evaluated) {
+        EvalProbeRow(probe_row);
+        evaluated = true;
+      }
+      if (Equals(GetNode(bucket->node_idx_)->data())) {
+        return Iterator(this, bucket_idx, bucket->node_idx_);
+      }
     }
-    node_idx = node->next_idx_;
+    bucket_idx = (bucket_idx + 1) & bucket_mask;
   }
-
-  return End();
 }
-  
+
 inline HashTable::Iterator HashTable::Begin() {
   int64_t bucket_idx = -1;
   Bucket* bucket = NextBucket(&bucket_idx);
   if (bucket != NULL) {
-    return Iterator(this, bucket_idx, bucket->node_idx_, 0);
+    return Iterator(this, bucket_idx, bucket->node_idx_);
   }
   return End();
 }
@@ -44,25 +66,47 @@ inline HashTable::Bucket* HashTable::NextBucket(int64_t* bucket_idx) {
   return NULL;
 }
 
+inline int64_t HashTable::Probe(uint32_t hash, bool* found) {
+  int64_t bucket_mask = num_buckets_ - 1;
+  int64_t bucket_idx = hash & bucket_mask;
+  // The table is never full (see Insert()), so this terminates at an empty bucket.
+  while (true) {
+    Bucket* bucket = &buckets_[bucket_idx];
+    if (bucket->node_idx_ == -1) {
+      *found = false;
+      return bucket_idx;
+    }
+    if (bucket->hash_ == hash && Equals(GetNode(bucket->node_idx_)->data())) {
+      *found = true;
+      return bucket_idx;
+    }
+    bucket_idx = (bucket_idx + 1) & bucket_mask;
+  }
+}
+
 inline void HashTable::InsertImpl(TupleRow* row) {
   bool has_null = EvalBuildRow(row);
   if (!stores_nulls_ && has_null) return;
 
   uint32_t hash = HashCurrentRow();
-  int64_t bucket_idx = hash % num_buckets_;
+  bool found;
+  int64_t bucket_idx = Probe(hash, &found);
   if (num_nodes_ == nodes_capacity_) GrowNodeArray();
   Node* node = GetNode(num_nodes_);
   TupleRow* data = node->data();
-  node->hash_ = hash;
   memcpy(data, row, sizeof(Tuple*) * num_build_tuples_);
-  AddToBucket(&buckets_[bucket_idx], num_nodes_, node);
-  ++num_nodes_;
-}
 
-inline void HashTable::AddToBucket(Bucket* bucket, int64_t node_idx, Node* node) {
-  if (bucket->node_idx_ == -1) ++num_filled_buckets_;
-  node->next_idx_ = bucket->node_idx_;
-  bucket->node_idx_ = node_idx;
+  Bucket* bucket = &buckets_[bucket_idx];
+  if (found) {
+    // Same key as the bucket's nodes, place the new node at the head of the list.
+    node->next_idx_ = bucket->node_idx_;
+  } else {
+    node->next_idx_ = -1;
+    bucket->hash_ = hash;
+    ++num_filled_buckets_;
+  }
+  bucket->node_idx_ = num_nodes_;
+  ++num_nodes_;
 }
 
 template<bool check_match>
@@ -71,28 +115,17 @@ inline void HashTable::Iterator::Next() {
 
   // TODO: this should prefetch the next tuplerow
   Node* node = table_->GetNode(node_idx_);
-  // Iterator is not from a full table scan, evaluate equality now.  Only the current
-  // bucket needs to be scanned. 'expr_values_buffer_' contains the results
-  // for the current probe row.
+  // Move onto the next node with the same key
+  if (node->next_idx_ != -1) {
+    node_idx_ = node->next_idx_;
+    return;
+  }
+
   if (check_match) {
-    // TODO: this should prefetch the next node
-    int64_t next_idx = node->next_idx_;
-    while (next_idx != -1) {
-      node = table_->GetNode(next_idx);
-      if (node->hash_ == scan_hash_ && table_->Equals(node->data())) {
-        node_idx_ = next_idx;
-        return;
-      } 
-      next_idx = node->next_idx_;
-    }
+    // Iterator is from a Find().  All the matches for the probe row are in the
+    // current bucket's list, so we are done.
     *this = table_->End();
   } else {
-    // Move onto the next chained node
-    if (node->next_idx_ != -1) {
-      node_idx_ = node->next_idx_;
-      return;
-    }
-
     // Move onto the next bucket
     Bucket* bucket = table_->NextBucket(&bucket_idx_);
     if (bucket == NULL) {
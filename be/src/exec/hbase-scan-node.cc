@@ -27,7 +27,6 @@ HBaseScanNode::HBaseScanNode(ObjectPool* pool, const TPlanNode& tnode,
       tuple_idx_(0),
       filters_(tnode.hbase_scan_node.filters),
       num_errors_(0),
-      tuple_pool_(new MemPool()),
       hbase_scanner_(NULL),
       row_key_slot_(NULL),
       text_converter_(new TextConverter('\\')) {
@@ -43,6 +42,7 @@ bool HBaseScanNode::CmpColPos(const SlotDescriptor* a, const SlotDescriptor* b)
 Status HBaseScanNode::Prepare(RuntimeState* state) {
   RETURN_IF_ERROR(ScanNode::Prepare(state));
 
+  tuple_pool_.reset(new MemPool(mem_tracker()));
   hbase_scanner_.reset(new HBaseTableScanner(this, state->htable_cache()));
 
   tuple_desc_ = state->desc_tbl().GetTupleDescriptor(tuple_id_);
@@ -222,7 +222,6 @@ Status HBaseScanNode::GetNext(RuntimeState* state, RowBatch* row_batch, bool* eo
 
 Status HBaseScanNode::Close(RuntimeState* state) {
   SCOPED_TIMER(runtime_profile_->total_time_counter());
-  COUNTER_UPDATE(memory_used_counter(), tuple_pool_->peak_allocated_bytes());
 
   JNIEnv* env = getJNIEnv();
   hbase_scanner_->Close(env);
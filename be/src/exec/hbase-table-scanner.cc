@@ -82,8 +82,8 @@ HBaseTableScanner::HBaseTableScanner(ScanNode* scan_node, HBaseTableCache* htabl
     num_addl_requested_cols_(0),
     num_keyvalues_(0),
     all_keyvalues_present_(false),
-    value_pool_(new MemPool()),
-    buffer_pool_(new MemPool()),
+    value_pool_(new MemPool(scan_node->mem_tracker())),
+    buffer_pool_(new MemPool(scan_node->mem_tracker())),
     rows_cached_(DEFAULT_ROWS_CACHED),
     scan_setup_timer_(ADD_COUNTER(scan_node_->runtime_profile(),
       "HBaseTableScanner.ScanSetup", TCounterType::CPU_TICKS)) {
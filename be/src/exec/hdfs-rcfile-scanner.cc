@@ -10,15 +10,14 @@
 #include "runtime/row-batch.h"
 #include "runtime/tuple-row.h"
 #include "runtime/tuple.h"
-#include "runtime/hdfs-fs-cache.h"
 #include "runtime/string-value.h"
 #include "util/runtime-profile.h"
 #include "common/object-pool.h"
 #include "gen-cpp/PlanNodes_types.h"
-#include "exec/buffered-byte-stream.h"
 #include "exec/hdfs-rcfile-scanner.h"
 #include "exec/hdfs-sequence-scanner.h"
 #include "exec/hdfs-scan-node.h"
+#include "exec/scan-range-context.h"
 #include "exec/serde-utils.inline.h"
 #include "exec/text-converter.inline.h"
 
@@ -37,33 +36,43 @@ const char* const HdfsRCFileScanner::RCFILE_METADATA_KEY_NUM_COLS =
 
 const uint8_t HdfsRCFileScanner::RCFILE_VERSION_HEADER[4] = {'R', 'C', 'F', 1};
 
-static const uint8_t RC_FILE_RECORD_DELIMITER = 0xff;
+const int HdfsRCFileScanner::HEADER_SIZE = 1024;
 
-HdfsRCFileScanner::HdfsRCFileScanner(HdfsScanNode* scan_node, RuntimeState* state,
-    MemPool* mem_pool)
-    : HdfsScanner(scan_node, state, mem_pool),
-      scan_range_fully_buffered_(false),
-      key_buffer_pool_(new MemPool()),
+#define RETURN_IF_FALSE(x) if (UNLIKELY(!(x))) return parse_status_
+
+HdfsRCFileScanner::HdfsRCFileScanner(HdfsScanNode* scan_node, RuntimeState* state)
+    : HdfsScanner(scan_node, state, NULL),
+      only_parsing_header_(false),
+      header_(NULL),
+      key_buffer_pool_(new MemPool(scan_node->mem_tracker())),
       key_buffer_length_(0),
-      compressed_data_buffer_length_(0),
-      column_buffer_pool_(new MemPool()) {
-  // Initialize the parser to find bytes that are 0xff.
-  find_first_parser_.reset(new DelimitedTextParser(scan_node, RC_FILE_RECORD_DELIMITER));
+      column_buffer_pool_(new MemPool(scan_node->mem_tracker())),
+      column_buffer_length_(0) {
 }
 
 HdfsRCFileScanner::~HdfsRCFileScanner() {
-  // Collect the maximum amount of memory we used to process this file.
-  COUNTER_UPDATE(scan_node_->memory_used_counter(),
-      column_buffer_pool_->peak_allocated_bytes());
-  COUNTER_UPDATE(scan_node_->memory_used_counter(),
-      key_buffer_pool_->peak_allocated_bytes());
+}
+
+void HdfsRCFileScanner::IssueInitialRanges(HdfsScanNode* scan_node,
+    const vector<HdfsFileDesc*>& files) {
+  // Issue just the header range for each file.  When the header is complete,
+  // we'll issue the ranges for that file.
+  for (int i = 0; i < files.size(); ++i) {
+    int64_t partition_id = reinterpret_cast<int64_t>(files[i]->ranges[0]->meta_data());
+    DiskIoMgr::ScanRange* header_range = scan_node->AllocateScanRange(
+        files[i]->filename.c_str(), HEADER_SIZE, 0, partition_id, -1);
+    scan_node->AddDiskIoRange(header_range);
+  }
+}
+
+void HdfsRCFileScanner::IssueFileRanges(const char* filename) {
+  HdfsFileDesc* file_desc = scan_node_->GetFileDesc(filename);
+  scan_node_->AddDiskIoRange(file_desc);
 }
 
 Status HdfsRCFileScanner::Prepare() {
   RETURN_IF_ERROR(HdfsScanner::Prepare());
 
-  text_converter_.reset(new TextConverter(0));
-
   // Allocate the buffers for the key information that is used to read and decode
   // the column data from its run length encoding.
   int num_part_keys = scan_node_->num_partition_keys();
@@ -96,148 +105,234 @@ Status HdfsRCFileScanner::Prepare() {
   col_buf_pos_ = reinterpret_cast<int32_t*>(
       key_buffer_pool_->Allocate(sizeof(int32_t) * num_cols_));
 
+  decompress_timer_ = ADD_COUNTER(
+      scan_node_->runtime_profile(), "DecompressionTime", TCounterType::CPU_TICKS);
+
   return Status::OK;
 }
 
-Status HdfsRCFileScanner::Close() {
+Status HdfsRCFileScanner::InitNewRange() {
+  DCHECK(header_ != NULL);
+  only_parsing_header_ = false;
+
+  HdfsPartitionDescriptor* hdfs_partition = context_->partition_descriptor();
+  text_converter_.reset(new TextConverter(hdfs_partition->escape_char()));
+
+  template_tuple_ = context_->template_tuple();
+
+  if (header_->is_compressed) {
+    RETURN_IF_ERROR(Codec::CreateDecompressor(state_,
+        column_buffer_pool_.get(), context_->compact_data(),
+        header_->codec, &decompressor_));
+  }
+
+  ResetRowGroup();
+  InitBatchConjuncts();
   return Status::OK;
 }
 
-Status HdfsRCFileScanner::InitCurrentScanRange(HdfsPartitionDescriptor* hdfs_partition, 
-    DiskIoMgr::ScanRange* scan_range, Tuple* template_tuple, 
-    ByteStream* current_byte_stream_) {
-  RETURN_IF_ERROR(HdfsScanner::InitCurrentScanRange(hdfs_partition, scan_range, 
-      template_tuple, current_byte_stream_));
-  end_of_scan_range_ = scan_range->len() + scan_range->offset();
-
-  // Check the Location (file name) to see if we have changed files.
-  // If this a new file then we need to read and process the header.
-  if (previous_location_ != current_byte_stream_->GetLocation()) {
-    RETURN_IF_ERROR(current_byte_stream_->Seek(0));
+Status HdfsRCFileScanner::ProcessScanRange(ScanRangeContext* context) {
+  context_ = context;
+
+  header_ = reinterpret_cast<FileHeader*>(
+      scan_node_->GetFileMetadata(context_->filename()));
+  if (header_ == NULL) {
+    // This is the initial scan range just to parse the header
+    only_parsing_header_ = true;
+    header_ = state_->obj_pool()->Add(new FileHeader());
     RETURN_IF_ERROR(ReadFileHeader());
-    // Save the current file name if we get the same file we can avoid
-    // rereading the header information.
-    previous_location_ = current_byte_stream_->GetLocation();
-    // Save the seek offset of the end of the header information.  If we
-    // get a scan range that starts at the beginning of the file we can avoid
-    // reading the header but we must seek past it to get to the beginning of the data.
-    current_byte_stream_->GetPosition(&header_end_);
-  } else if (scan_range->offset() == 0) {
-    // If are at the beginning of the file and we previously read the file header
-    // we do not have to read it again but we need to seek past the file header.
-    // We saved the offset above when we previously read and processed the header.
-    RETURN_IF_ERROR(current_byte_stream_->Seek(header_end_));
+
+    // Header is parsed, set the metadata in the scan node and issue more ranges
+    scan_node_->SetFileMetadata(context_->filename(), header_);
+    IssueFileRanges(context_->filename());
+    return Status::OK;
   }
 
-  // Offset may not point to row group boundary so we need to search for the next
-  // sync block.
-  if (scan_range->offset() != 0) {
-    RETURN_IF_ERROR(current_byte_stream_->Seek(scan_range->offset()));
-    RETURN_IF_ERROR(find_first_parser_->FindSyncBlock(end_of_scan_range_,
-          SYNC_HASH_SIZE, &(sync_hash_[0]), current_byte_stream_));
+  // Initialize state for new scan range
+  RETURN_IF_ERROR(InitNewRange());
+
+  // Find the first row group
+  bool found;
+  RETURN_IF_ERROR(FindFirstRowGroup(&found));
+  if (!found) return Status::OK;
+
+  // Process Range.
+  // We can continue through errors by skipping to to the next SYNC hash.
+  Status status;
+  int64_t first_error_offset = 0;
+  int num_errors = 0;
+
+  do {
+    status = ProcessRange();
+
+    // Catch errors from file format parsing.  We call some utilities
+    // that do not log errors so generate a reasonable message.
+    if (!status.ok()) {
+      // Save the offset of the first error.
+      if (first_error_offset == 0) first_error_offset = row_group_start_;
+      if (state_->LogHasSpace()) {
+        stringstream ss;
+        ss << "Format error in row group ";
+        if (context_->eosr()) {
+          ss << "at end of file.";
+        } else {
+          ss << "at offset: "  << row_group_start_;
+        }
+        state_->LogError(ss.str());
+      }
+    }
+
+    // If no errors or we abort on error then exit loop.
+    if (state_->abort_on_error() || status.ok()) break;
+
+    // If we are not at the end of the scan range, try to recover at the next
+    // row group.
+    if (!context_->eosr()) {
+      parse_status_ = Status::OK;
+      ++num_errors;
+      bool past_sync;
+      status = SkipToSync(header_->sync, SYNC_HASH_SIZE, &past_sync);
+      if (!status.ok() || context_->eosr()) break;
+      ResetRowGroup();
+    }
+  } while (!context_->eosr());
+
+  if (num_errors != 0 || !status.ok()) {
+    if (state_->LogHasSpace()) {
+      stringstream ss;
+      ss  << "First error while processing: " << context_->filename()
+          << " at offset: "  << first_error_offset;
+      state_->LogError(ss.str());
+      state_->ReportFileErrors(context_->filename(), num_errors == 0 ? 1 : num_errors);
+    }
+    if (state_->abort_on_error()) return status;
   }
-  int64_t position;
-  RETURN_IF_ERROR(current_byte_stream_->GetPosition(&position));
 
-  ResetRowGroup();
+  // All done with this scan range.
+  return Status::OK;
+}
 
-  scan_range_fully_buffered_ = false;
-  previous_total_length_ = 0;
-  tuple_ = NULL;
+Status HdfsRCFileScanner::Close() {
+  context_->AcquirePool(column_buffer_pool_.get());
+  if (!only_parsing_header_) scan_node_->RangeComplete();
+  context_->Complete();
+  return Status::OK;
+}
+
+Status HdfsRCFileScanner::FindFirstRowGroup(bool* found) {
+  if (context_->scan_range()->offset() == 0) {
+    // Scan range that starts at the beginning of the file, just skip ahead by
+    // the header size.
+    RETURN_IF_FALSE(
+        SerDeUtils::SkipBytes(context_, header_->header_size, &parse_status_));
+    *found = true;
+    return Status::OK;
+  }
 
+  // Offset may not point to row group boundary so we need to search for the next
+  // sync block.
+  bool past_sync;
+  RETURN_IF_ERROR(SkipToSync(header_->sync, SYNC_HASH_SIZE, &past_sync));
+  *found = !context_->eosr();
   return Status::OK;
 }
 
 Status HdfsRCFileScanner::ReadFileHeader() {
-  vector<uint8_t> head;
-  RETURN_IF_ERROR(SerDeUtils::ReadBytes(current_byte_stream_,
-      sizeof(RCFILE_VERSION_HEADER), &head));
-  if (!memcmp(&head[0], HdfsSequenceScanner::SEQFILE_VERSION_HEADER, 
+  uint8_t* header;
+  RETURN_IF_FALSE(SerDeUtils::ReadBytes(context_,
+      sizeof(RCFILE_VERSION_HEADER), &header, &parse_status_));
+  if (!memcmp(header, HdfsSequenceScanner::SEQFILE_VERSION_HEADER,
       sizeof(HdfsSequenceScanner::SEQFILE_VERSION_HEADER))) {
-    version_ = SEQ6;
-  } else if (!memcmp(&head[0], RCFILE_VERSION_HEADER, sizeof(RCFILE_VERSION_HEADER))) {
-    version_ = RCF1;
+    header_->version = SEQ6;
+  } else if (!memcmp(header, RCFILE_VERSION_HEADER, sizeof(RCFILE_VERSION_HEADER))) {
+    header_->version = RCF1;
   } else {
     stringstream ss;
     ss << "Invalid RCFILE_VERSION_HEADER: '"
-       << SerDeUtils::HexDump(&head[0], sizeof(RCFILE_VERSION_HEADER)) << "'";
+       << SerDeUtils::HexDump(header, sizeof(RCFILE_VERSION_HEADER)) << "'";
     return Status(ss.str());
   }
-  
-  if (version_ == SEQ6) {
-    vector<char> buf;
-    RETURN_IF_ERROR(SerDeUtils::ReadText(current_byte_stream_, &buf));
-    if (strncmp(&buf[0], HdfsRCFileScanner::RCFILE_KEY_CLASS_NAME,
-        strlen(HdfsRCFileScanner::RCFILE_KEY_CLASS_NAME))) {
+
+  if (header_->version == SEQ6) {
+    uint8_t* class_name;
+    int len;
+    RETURN_IF_FALSE(SerDeUtils::ReadText(context_, &class_name, &len, &parse_status_));
+    if (len != strlen(HdfsRCFileScanner::RCFILE_KEY_CLASS_NAME) ||
+        memcmp(class_name, HdfsRCFileScanner::RCFILE_KEY_CLASS_NAME, len)) {
       stringstream ss;
       ss << "Invalid RCFILE_KEY_CLASS_NAME: '"
-         << string(&buf[0], strlen(HdfsRCFileScanner::RCFILE_KEY_CLASS_NAME))
-         << "'";
+         << string(reinterpret_cast<char*>(class_name), len) << "'";
       return Status(ss.str());
     }
 
-    RETURN_IF_ERROR(SerDeUtils::ReadText(current_byte_stream_, &buf));
-    if (strncmp(&buf[0], HdfsRCFileScanner::RCFILE_VALUE_CLASS_NAME,
-        strlen(HdfsRCFileScanner::RCFILE_VALUE_CLASS_NAME))) {
+    RETURN_IF_FALSE(SerDeUtils::ReadText(context_, &class_name, &len, &parse_status_));
+    if (len != strlen(HdfsRCFileScanner::RCFILE_VALUE_CLASS_NAME) ||
+        memcmp(class_name, HdfsRCFileScanner::RCFILE_VALUE_CLASS_NAME, len)) {
       stringstream ss;
       ss << "Invalid RCFILE_VALUE_CLASS_NAME: '"
-         << string(&buf[0], strlen(HdfsRCFileScanner::RCFILE_VALUE_CLASS_NAME))
-         << "'";
+         << string(reinterpret_cast<char*>(class_name), len) << "'";
       return Status(ss.str());
     }
   }
 
-  RETURN_IF_ERROR(SerDeUtils::ReadBoolean(current_byte_stream_, &is_compressed_));
+  RETURN_IF_FALSE(
+      SerDeUtils::ReadBoolean(context_, &header_->is_compressed, &parse_status_));
 
-  if (version_ == SEQ6) {
+  if (header_->version == SEQ6) {
     // Read the is_blk_compressed header field. This field should *always*
     // be FALSE, and is the result of a defect in the original RCFile
     // implementation contained in Hive.
     bool is_blk_compressed;
-    RETURN_IF_ERROR(SerDeUtils::ReadBoolean(current_byte_stream_, &is_blk_compressed));
+    RETURN_IF_FALSE(
+        SerDeUtils::ReadBoolean(context_, &is_blk_compressed, &parse_status_));
     if (is_blk_compressed) {
       stringstream ss;
       ss << "RC files do no support block compression, set in: '"
-         << current_byte_stream_->GetLocation() << "'";
+         << context_->filename() << "'";
       return Status(ss.str());
     }
   }
 
-  vector<char> codec;
-  if (is_compressed_) {
-    // Read the codec and get the right decompressor class.
-    RETURN_IF_ERROR(SerDeUtils::ReadText(current_byte_stream_, &codec));
-    string codec_str(&codec[0], codec.size());
-    RETURN_IF_ERROR(Codec::CreateDecompressor(state_,
-        column_buffer_pool_.get(), !has_noncompact_strings_, codec_str, &decompressor_));
+  if (header_->is_compressed) {
+    uint8_t* codec_ptr;
+    int len;
+    RETURN_IF_FALSE(SerDeUtils::ReadText(context_, &codec_ptr, &len, &parse_status_));
+    header_->codec = string(reinterpret_cast<char*>(codec_ptr), len);
   }
 
-  VLOG_FILE << current_byte_stream_->GetLocation() << ": "
-            << (is_compressed_ ?  "block compressed" : "not compressed");
-  if (is_compressed_) VLOG_FILE << string(&codec[0], codec.size());
+  VLOG_FILE << context_->filename() << ": "
+            << (header_->is_compressed ?  "block compressed" : "not compressed");
+  if (header_->is_compressed) VLOG_FILE << header_->codec;
 
   RETURN_IF_ERROR(ReadFileHeaderMetadata());
 
-  RETURN_IF_ERROR(SerDeUtils::ReadBytes(current_byte_stream_,
-      HdfsRCFileScanner::SYNC_HASH_SIZE, &sync_hash_[0]));
+  uint8_t* sync;
+  RETURN_IF_FALSE(SerDeUtils::ReadBytes(context_, SYNC_HASH_SIZE, &sync, &parse_status_));
+  memcpy(header_->sync, sync, SYNC_HASH_SIZE);
+
+  header_->header_size = context_->total_bytes_returned();
   return Status::OK;
 }
 
 Status HdfsRCFileScanner::ReadFileHeaderMetadata() {
   int map_size = 0;
-  vector<char> key;
-  vector<char> value;
-
-  RETURN_IF_ERROR(SerDeUtils::ReadInt(current_byte_stream_, &map_size));
+  RETURN_IF_FALSE(SerDeUtils::ReadInt(context_, &map_size, &parse_status_));
 
   for (int i = 0; i < map_size; ++i) {
-    RETURN_IF_ERROR(SerDeUtils::ReadText(current_byte_stream_, &key));
-    RETURN_IF_ERROR(SerDeUtils::ReadText(current_byte_stream_, &value));
-
-    if (!strncmp(&key[0], HdfsRCFileScanner::RCFILE_METADATA_KEY_NUM_COLS,
-        strlen(HdfsRCFileScanner::RCFILE_METADATA_KEY_NUM_COLS))) {
-      string tmp(&value[0], value.size());
-      int file_num_cols = atoi(tmp.c_str());
+    uint8_t* key_ptr;
+    int key_len;
+    RETURN_IF_FALSE(SerDeUtils::ReadText(context_, &key_ptr, &key_len, &parse_status_));
+    // The key is only valid until the next read from the context.
+    string key(reinterpret_cast<char*>(key_ptr), key_len);
+
+    uint8_t* value_ptr;
+    int value_len;
+    RETURN_IF_FALSE(
+        SerDeUtils::ReadText(context_, &value_ptr, &value_len, &parse_status_));
+
+    if (key == HdfsRCFileScanner::RCFILE_METADATA_KEY_NUM_COLS) {
+      string value(reinterpret_cast<char*>(value_ptr), value_len);
+      int file_num_cols = atoi(value.c_str());
       if (file_num_cols != num_cols_) {
         return Status("Unexpected hive.io.rcfile.column.number value!");
       }
@@ -247,16 +342,16 @@ Status HdfsRCFileScanner::ReadFileHeaderMetadata() {
 }
 
 Status HdfsRCFileScanner::ReadSync() {
-  uint8_t hash[HdfsRCFileScanner::SYNC_HASH_SIZE];
-  RETURN_IF_ERROR(SerDeUtils::ReadBytes(current_byte_stream_,
-      HdfsRCFileScanner::SYNC_HASH_SIZE, &hash[0]));
-  if (memcmp(&hash[0], &sync_hash_[0], HdfsRCFileScanner::SYNC_HASH_SIZE)) {
+  uint8_t* hash;
+  RETURN_IF_FALSE(SerDeUtils::ReadBytes(context_,
+      HdfsRCFileScanner::SYNC_HASH_SIZE, &hash, &parse_status_));
+  if (memcmp(hash, header_->sync, HdfsRCFileScanner::SYNC_HASH_SIZE)) {
     if (state_->LogHasSpace()) {
       stringstream ss;
-      ss  << "Bad sync hash in current HdfsRCFileScanner: "
-          << current_byte_stream_->GetLocation() << "." << endl
+      ss  << "Bad sync hash in HdfsRCFileScanner at file offset "
+          << (context_->file_offset() - SYNC_HASH_SIZE) << "." << endl
           << "Expected: '"
-          << SerDeUtils::HexDump(sync_hash_, HdfsRCFileScanner::SYNC_HASH_SIZE)
+          << SerDeUtils::HexDump(header_->sync, HdfsRCFileScanner::SYNC_HASH_SIZE)
           << "'" << endl
           << "Actual:   '"
           << SerDeUtils::HexDump(hash, HdfsRCFileScanner::SYNC_HASH_SIZE)
@@ -285,79 +380,72 @@ void HdfsRCFileScanner::ResetRowGroup() {
   memset(col_buf_pos_, 0, num_cols_ * sizeof(int32_t));
 }
 
-Status HdfsRCFileScanner::ReadRowGroup() {
+Status HdfsRCFileScanner::ReadRowGroup(bool* eosr) {
   ResetRowGroup();
-  int64_t position;
-  bool eof;
 
   while (num_rows_ == 0) {
-    RETURN_IF_ERROR(ReadHeader());
+    row_group_start_ = context_->file_offset();
+    // The scan range owns the row groups up to the first sync block past its end.
+    *eosr = context_->eosr();
+    bool sync;
+    Status status = ReadHeader(&sync);
+    if (!status.ok()) {
+      // There is nothing after the last row group of the file.
+      if (*eosr) return Status::OK;
+      return status;
+    }
+    if (sync && *eosr) return Status::OK;
+    *eosr = false;
+
     RETURN_IF_ERROR(ReadKeyBuffers());
-    if (has_noncompact_strings_ || previous_total_length_ < total_col_length_) {
+
+    // If the rows don't copy their strings, they point into the column buffer
+    // and each row group needs a new one.  Pass the previous one to the current
+    // row batch which holds the rows of the previous row group.
+    if (!context_->compact_data() || column_buffer_length_ < total_col_length_) {
+      if (!context_->compact_data()) context_->AcquirePool(column_buffer_pool_.get());
       column_buffer_ = column_buffer_pool_->Allocate(total_col_length_);
-      previous_total_length_ = total_col_length_;
+      column_buffer_length_ = total_col_length_;
     }
     RETURN_IF_ERROR(ReadColumnBuffers());
-    RETURN_IF_ERROR(current_byte_stream_->GetPosition(&position));
-    if (position >= end_of_scan_range_) {
-      RETURN_IF_ERROR(current_byte_stream_->Eof(&eof));
-      if (eof) {
-        scan_range_fully_buffered_ = true;
-        break;
-      }
-
-      // We must read up to the next sync marker.
-      int32_t record_length;
-      RETURN_IF_ERROR(SerDeUtils::ReadInt(current_byte_stream_, &record_length));
-      if (record_length == HdfsRCFileScanner::SYNC_MARKER) {
-        // If the marker is there, it's an error not to have a Sync block following the
-        // Marker.
-        RETURN_IF_ERROR(ReadSync());
-        scan_range_fully_buffered_ = true;
-        break;
-      } else {
-        RETURN_IF_ERROR(current_byte_stream_->Seek(position));
-      }
-    }
   }
   return Status::OK;
 }
 
-Status HdfsRCFileScanner::ReadHeader() {
+Status HdfsRCFileScanner::ReadHeader(bool* sync) {
   int32_t record_length;
-  RETURN_IF_ERROR(SerDeUtils::ReadInt(current_byte_stream_, &record_length));
+  RETURN_IF_FALSE(SerDeUtils::ReadInt(context_, &record_length, &parse_status_));
+  *sync = false;
   // The sync block is marked with a record_length of -1.
   if (record_length == HdfsRCFileScanner::SYNC_MARKER) {
     RETURN_IF_ERROR(ReadSync());
-    RETURN_IF_ERROR(SerDeUtils::ReadInt(current_byte_stream_, &record_length));
+    RETURN_IF_FALSE(SerDeUtils::ReadInt(context_, &record_length, &parse_status_));
+    *sync = true;
   }
   if (record_length < 0) {
     stringstream ss;
-    int64_t position;
-    current_byte_stream_->GetPosition(&position);
+    int64_t position = context_->file_offset();
     position -= sizeof(int32_t);
     ss << "Bad record length: " << record_length << " in file: "
-        << current_byte_stream_->GetLocation() << " at offset: " << position;
+        << context_->filename() << " at offset: " << position;
     return Status(ss.str());
   }
-  RETURN_IF_ERROR(SerDeUtils::ReadInt(current_byte_stream_, &key_length_));
+  RETURN_IF_FALSE(SerDeUtils::ReadInt(context_, &key_length_, &parse_status_));
   if (key_length_ < 0) {
     stringstream ss;
-    int64_t position;
-    current_byte_stream_->GetPosition(&position);
+    int64_t position = context_->file_offset();
     position -= sizeof(int32_t);
     ss << "Bad key length: " << key_length_ << " in file: "
-        << current_byte_stream_->GetLocation() << " at offset: " << position;
+        << context_->filename() << " at offset: " << position;
     return Status(ss.str());
   }
-  RETURN_IF_ERROR(SerDeUtils::ReadInt(current_byte_stream_, &compressed_key_length_));
+  RETURN_IF_FALSE(SerDeUtils::ReadInt(context_, &compressed_key_length_, &parse_status_));
   if (compressed_key_length_ < 0) {
     stringstream ss;
-    int64_t position;
-    current_byte_stream_->GetPosition(&position);
+    int64_t position = context_->file_offset();
     position -= sizeof(int32_t);
     ss << "Bad compressed key length: " << compressed_key_length_ << " in file: "
-        << current_byte_stream_->GetLocation() << " at offset: " << position;
+        << context_->filename() << " at offset: " << position;
     return Status(ss.str());
   }
   return Status::OK;
@@ -368,18 +456,19 @@ Status HdfsRCFileScanner::ReadKeyBuffers() {
     key_buffer_ = key_buffer_pool_->Allocate(key_length_);
     key_buffer_length_ = key_length_;
   }
-  if (is_compressed_) {
-    if (compressed_data_buffer_length_ < compressed_key_length_) {
-      compressed_data_buffer_ = key_buffer_pool_->Allocate(compressed_key_length_);
-      compressed_data_buffer_length_ = compressed_key_length_;
-    }
-    RETURN_IF_ERROR(SerDeUtils::ReadBytes(current_byte_stream_,
-        compressed_key_length_, compressed_data_buffer_));
+  // The key data is needed for the whole row group, it is copied out of the
+  // io buffers.  Compressed keys are decompressed straight into key_buffer_.
+  uint8_t* key_data;
+  if (header_->is_compressed) {
+    RETURN_IF_FALSE(SerDeUtils::ReadBytes(context_,
+        compressed_key_length_, &key_data, &parse_status_));
+    SCOPED_TIMER(decompress_timer_);
     RETURN_IF_ERROR(decompressor_->ProcessBlock(compressed_key_length_,
-        compressed_data_buffer_, &key_length_, &key_buffer_));
+        key_data, &key_length_, &key_buffer_));
   } else {
-    RETURN_IF_ERROR(
-        SerDeUtils::ReadBytes(current_byte_stream_, key_length_, key_buffer_));
+    RETURN_IF_FALSE(
+        SerDeUtils::ReadBytes(context_, key_length_, &key_data, &parse_status_));
+    memcpy(key_buffer_, key_data, key_length_);
   }
 
   total_col_length_ = 0;
@@ -390,6 +479,15 @@ Status HdfsRCFileScanner::ReadKeyBuffers() {
   for (int col_idx = 0; col_idx < num_cols_; ++col_idx) {
     GetCurrentKeyBuffer(col_idx, !ReadColumn(col_idx), &key_buf_ptr);
     DCHECK_LE(key_buf_ptr, key_buffer_ + key_length_);
+    if (col_buf_len_[col_idx] < 0 || col_buf_uncompressed_len_[col_idx] < 0 ||
+        (!header_->is_compressed &&
+         col_buf_len_[col_idx] != col_buf_uncompressed_len_[col_idx])) {
+      stringstream ss;
+      ss << "Bad column buffer length: " << col_buf_len_[col_idx]
+         << " (uncompressed: " << col_buf_uncompressed_len_[col_idx]
+         << ") for column: " << col_idx;
+      return Status(ss.str());
+    }
   }
   DCHECK_EQ(key_buf_ptr, key_buffer_ + key_length_);
 
@@ -431,11 +529,9 @@ inline Status HdfsRCFileScanner::NextField(int col_idx) {
     uint8_t* col_key_buf = &col_key_bufs_[col_idx][0];
     int bytes_read = SerDeUtils::GetVLong(col_key_buf, key_buf_pos_[col_idx], &length);
     if (bytes_read == -1) {
-        int64_t position;
-        current_byte_stream_->GetPosition(&position);
         stringstream ss;
         ss << "Invalid column length in file: "
-           << current_byte_stream_->GetLocation() << " at offset: " << position;
+           << context_->filename() << " in row group at offset: " << row_group_start_;
         if (state_->LogHasSpace()) state_->LogError(ss.str());
         return Status(ss.str());
     }
@@ -472,150 +568,111 @@ inline Status HdfsRCFileScanner::NextRow(bool* eorg) {
 Status HdfsRCFileScanner::ReadColumnBuffers() {
   for (int col_idx = 0; col_idx < num_cols_; ++col_idx) {
     if (!ReadColumn(col_idx)) {
-      RETURN_IF_ERROR(SerDeUtils::SkipBytes(current_byte_stream_, col_buf_len_[col_idx]));
+      // Step over the column using its length from the key buffer.
+      RETURN_IF_FALSE(
+          SerDeUtils::SkipBytes(context_, col_buf_len_[col_idx], &parse_status_));
+      continue;
+    }
+    DCHECK_LE(
+        col_buf_uncompressed_len_[col_idx] + col_bufs_off_[col_idx], total_col_length_);
+    uint8_t* col_data;
+    RETURN_IF_FALSE(SerDeUtils::ReadBytes(context_,
+        col_buf_len_[col_idx], &col_data, &parse_status_));
+    uint8_t* output = column_buffer_ + col_bufs_off_[col_idx];
+    if (header_->is_compressed) {
+      // Decompress straight from the io buffer into the column buffer.
+      SCOPED_TIMER(decompress_timer_);
+      RETURN_IF_ERROR(decompressor_->ProcessBlock(col_buf_len_[col_idx],
+          col_data, &col_buf_uncompressed_len_[col_idx], &output));
     } else {
-      // TODO: Stream through these column buffers instead of reading everything
-      // in at once.
-      DCHECK_LE(
-          col_buf_uncompressed_len_[col_idx] + col_bufs_off_[col_idx], total_col_length_);
-      if (is_compressed_) {
-        if (compressed_data_buffer_length_ < col_buf_len_[col_idx]) {
-          compressed_data_buffer_ = key_buffer_pool_->Allocate(col_buf_len_[col_idx]);
-          compressed_data_buffer_length_ = col_buf_len_[col_idx];
-        }
-        RETURN_IF_ERROR(SerDeUtils::ReadBytes(current_byte_stream_,
-            col_buf_len_[col_idx], compressed_data_buffer_));
-        uint8_t* compressed_output = column_buffer_ + col_bufs_off_[col_idx];
-        RETURN_IF_ERROR(decompressor_->ProcessBlock(col_buf_len_[col_idx],
-            compressed_data_buffer_, &col_buf_uncompressed_len_[col_idx],
-            &compressed_output));
-      } else {
-        RETURN_IF_ERROR(SerDeUtils::ReadBytes(current_byte_stream_,
-            col_buf_len_[col_idx], column_buffer_ + col_bufs_off_[col_idx]));
-      }
+      memcpy(output, col_data, col_buf_len_[col_idx]);
     }
   }
   return Status::OK;
 }
 
-// TODO: We should be able to skip over badly fomrated data and move to the
-//       next sync block to restart the scan.
-Status HdfsRCFileScanner::GetNext(RowBatch* row_batch, bool* eosr) {
-  AllocateTupleBuffer(row_batch);
-  // Indicates whether the current row has errors.
-  bool error_in_row = false;
-
-  if (scan_node_->ReachedLimit()) {
-    tuple_ = NULL;
-    *eosr = true;
-    return Status::OK;
-  }
-
+Status HdfsRCFileScanner::ProcessRange() {
+  const vector<SlotDescriptor*>& materialized_slots = scan_node_->materialized_slots();
 
-  // HdfsRCFileScanner effectively does buffered IO, in that it reads the
-  // rcfile into a column buffer, and sets an eof marker at that
-  // point, before the buffer is drained.
-  // In the following loop, eosr tracks the end of stream flag that
-  // tells the scan node to move onto the next scan range.
-  // scan_range_fully_buffered_ is set once the RC file has been fully
-  // read into RCRowGroups.
-  while (!scan_node_->ReachedLimit() && !row_batch->IsFull() && !(*eosr)) {
-    if (num_rows_ == row_pos_) {
-      // scan_range_fully_buffered_ is set iff the scan range has been
-      // exhausted due to a previous read.
-      if (scan_range_fully_buffered_) {
-        *eosr = true;
-        break;
-      }
-      RETURN_IF_ERROR(ReadRowGroup());
-
-      if (num_rows_ == 0) break;
+  while (true) {
+    if (row_pos_ == num_rows_) {
+      // Done with the current row group, read the next one.
+      bool eosr;
+      RETURN_IF_ERROR(ReadRowGroup(&eosr));
+      if (eosr) break;
     }
-
-    SCOPED_TIMER(scan_node_->materialize_tuple_timer());
-    // Copy rows out of the current row group into the row_batch
-    while (!scan_node_->ReachedLimit() && !row_batch->IsFull()) {
-      bool eorg = false;
-      RETURN_IF_ERROR(NextRow(&eorg));
-      if (eorg) break;
-
-      // Index into current row in row_batch.
-      int row_idx = row_batch->AddRow();
-      DCHECK(row_idx != RowBatch::INVALID_ROW_INDEX);
-      TupleRow* current_row = row_batch->GetRow(row_idx);
-      current_row->SetTuple(scan_node_->tuple_idx(), tuple_);
-      // Initialize tuple_ from the partition key template tuple before writing the
-      // slots
-      InitTuple(template_tuple_, tuple_);
-
-      const vector<SlotDescriptor*>& materialized_slots = 
-          scan_node_->materialized_slots();
-      vector<SlotDescriptor*>::const_iterator it;
-
-      for (it = materialized_slots.begin(); it != materialized_slots.end(); ++it) {
-        const SlotDescriptor* slot_desc = *it;
-        int rc_column_idx = slot_desc->col_pos() - scan_node_->num_partition_keys();
-
-        const char* col_start = reinterpret_cast<const char*>(&((column_buffer_ +
-            col_bufs_off_[rc_column_idx])[col_buf_pos_[rc_column_idx]]));
-        int field_len = cur_field_length_[rc_column_idx];
-        DCHECK_LE(col_start + field_len,
-            reinterpret_cast<const char*>(column_buffer_ + total_col_length_));
-
-        if (!text_converter_->WriteSlot(slot_desc, tuple_, 
-              col_start, field_len, !has_noncompact_strings_, false, tuple_pool_)) {
-          ReportColumnParseError(slot_desc, col_start, field_len);
-          error_in_row = true;
+    DCHECK_LT(row_pos_, num_rows_);
+
+    MemPool* pool;
+    TupleRow* tuple_row;
+    int max_tuples = context_->GetMemory(&pool, &tuple_, &tuple_row);
+    max_tuples = min(max_tuples, num_rows_ - row_pos_);
+
+    if (materialized_slots.empty()) {
+      // Handle case where there are no slots to materialize (e.g. count(*)).  No
+      // columns are read so there is nothing to step through.
+      row_pos_ += max_tuples;
+      int num_to_commit = WriteEmptyTuples(context_, tuple_row, max_tuples);
+      if (num_to_commit > 0) context_->CommitRows(num_to_commit);
+    } else {
+      int max_added_tuples = (scan_node_->limit() == -1) ?
+          max_tuples : scan_node_->limit() - scan_node_->rows_returned();
+
+      SCOPED_TIMER(scan_node_->materialize_tuple_timer());
+      int num_to_commit = 0;
+      for (int i = 0; i < max_tuples && num_to_commit < max_added_tuples; ++i) {
+        bool eorg;
+        RETURN_IF_ERROR(NextRow(&eorg));
+        DCHECK(!eorg);
+
+        // Initialize tuple_ from the partition key template tuple before writing the
+        // slots
+        InitTuple(template_tuple_, tuple_);
+        tuple_row->SetTuple(scan_node_->tuple_idx(), tuple_);
+
+        bool error_in_row = false;
+        for (int j = 0; j < materialized_slots.size(); ++j) {
+          const SlotDescriptor* slot_desc = materialized_slots[j];
+          int rc_column_idx = slot_desc->col_pos() - scan_node_->num_partition_keys();
+
+          const char* col_start = reinterpret_cast<const char*>(column_buffer_ +
+              col_bufs_off_[rc_column_idx] + col_buf_pos_[rc_column_idx]);
+          int field_len = cur_field_length_[rc_column_idx];
+          DCHECK_LE(col_start + field_len,
+              reinterpret_cast<const char*>(column_buffer_ + total_col_length_));
+
+          if (!text_converter_->WriteSlot(slot_desc, tuple_, col_start, field_len,
+                context_->compact_data(), false, pool)) {
+            ReportColumnParseError(slot_desc, col_start, field_len);
+            error_in_row = true;
+          }
         }
-      }
 
-      if (error_in_row) {
-        error_in_row = false;
-        if (state_->LogHasSpace()) {
-          stringstream ss;
-          ss << "file: " << current_byte_stream_->GetLocation();
-          state_->LogError(ss.str());
-        }
-        if (state_->abort_on_error()) {
-          state_->ReportFileErrors(current_byte_stream_->GetLocation(), 1);
-          return Status(state_->ErrorLog());
+        if (UNLIKELY(error_in_row)) {
+          ++num_errors_in_file_;
+          if (state_->LogHasSpace()) {
+            stringstream ss;
+            ss << "file: " << context_->filename();
+            state_->LogError(ss.str());
+          }
+          if (state_->abort_on_error()) {
+            state_->ReportFileErrors(context_->filename(), 1);
+            return Status(state_->ErrorLog());
+          }
         }
-      }
 
-      // Evaluate the conjuncts and add the row to the batch
-      if (ExecNode::EvalConjuncts(conjuncts_, num_conjuncts_, current_row)) {
-        row_batch->CommitLastRow();
-        if (scan_node_->ReachedLimit() || row_batch->IsFull()) {
-          tuple_ = NULL;
-          return Status::OK;
+        // Evaluate the conjuncts and add the row to the batch
+        if (ExecNode::EvalConjuncts(conjuncts_, num_conjuncts_, tuple_row) &&
+            EvalRuntimeFilters(tuple_row)) {
+          ++num_to_commit;
+          tuple_ = context_->next_tuple(tuple_);
+          tuple_row = context_->next_row(tuple_row);
         }
-        char* new_tuple = reinterpret_cast<char*>(tuple_);
-        new_tuple += tuple_byte_size_;
-        tuple_ = reinterpret_cast<Tuple*>(new_tuple);
       }
+      context_->CommitRows(num_to_commit);
     }
+    if (scan_node_->ReachedLimit()) break;
   }
-
-  // Note that number of rows remaining == 0 -> scan_range_fully_buffered_
-  // at this point, hence we don't need to explicitly check that
-  // scan_range_fully_buffered_ == true.
-  if (scan_node_->ReachedLimit() || num_rows_ == 0 || num_rows_ == row_pos_) {
-    // We reached the limit, drained the row group or hit the end of the table.
-    // No more work to be done. Clean up all pools with the last row batch.
-    *eosr = true;
-  } else {
-    DCHECK(row_batch->IsFull());
-    // The current row_batch is full, but we haven't yet reached our limit.
-    // Hang on to the last chunks. We'll continue from there in the next
-    // call to GetNext().
-    *eosr = false;
-  }
-  // Maintian ownership of last memory chunk if not at the end of the scan range.
-  if (has_noncompact_strings_) {
-    row_batch->tuple_data_pool()->AcquireData(column_buffer_pool_.get(), !*eosr);
-  }
-  row_batch->tuple_data_pool()->AcquireData(tuple_pool_, !*eosr);
-
   return Status::OK;
 }
 
@@ -623,7 +680,7 @@ void HdfsRCFileScanner::DebugString(int indentation_level, stringstream* out) co
   // TODO: Add more details of internal state.
   *out << string(indentation_level * 2, ' ');
   *out << "HdfsRCFileScanner(tupleid=" << scan_node_->tuple_idx() <<
-    " file=" << current_byte_stream_->GetLocation();
+    " file=" << context_->filename();
   // TODO: Scanner::DebugString
   //  ExecNode::DebugString(indentation_level, out);
   *out << "])" << endl;
@@ -201,13 +201,15 @@
 //
 // Text ::= VInt, Chars (Length prefixed UTF-8 characters)
 //
-// The above file format is read in chunks.  The "key" buffer is read. The "keys"
-// are really the lengths of the column data blocks and the lengths of the values
-// within those blocks.  Using this information the column "buffers" (data)
-// that are needed by the query are read into a single buffer.  Column data that
-// is not used by the query is skipped and not read from the file.  The key data
-// and the column data my be compressed.  The key data is compressed in a single
-// block while the column data is compressed separately by column.
+// The above file format is read in chunks from the ScanRangeContext.  The "key"
+// buffer is read.  The "keys" are really the lengths of the column data blocks and
+// the lengths of the values within those blocks.  Using this information the column
+// "buffers" (data) that are needed by the query are read, column by column, into a
+// single buffer as the io buffers arrive.  Column data that is not used by the query
+// is stepped over using the lengths from the key buffer, it is neither copied nor
+// decompressed.  The key data and the column data may be compressed.  The key data
+// is compressed in a single block while the column data is compressed separately by
+// column.  Compressed data is decompressed straight out of the io buffers.
 
 namespace impala {
 
@@ -218,14 +220,17 @@ class Tuple;
 // A scanner for reading RCFiles into tuples. 
 class HdfsRCFileScanner : public HdfsScanner {
  public:
-  HdfsRCFileScanner(HdfsScanNode* scan_node, RuntimeState* state, MemPool* tuple_pool);
+  HdfsRCFileScanner(HdfsScanNode* scan_node, RuntimeState* state);
   virtual ~HdfsRCFileScanner();
-  virtual Status GetNext(RowBatch* row_batch, bool* eos);
+
+  // Implementation of HdfsScanner interface.
   virtual Status Prepare();
-  virtual Status InitCurrentScanRange(HdfsPartitionDescriptor* hdfs_partition, 
-      DiskIoMgr::ScanRange* scan_range, Tuple* template_tuple, ByteStream* byte_stream);
+  virtual Status ProcessScanRange(ScanRangeContext* context);
   virtual Status Close();
 
+  // Issue the initial scan ranges for all rc files.
+  static void IssueInitialRanges(HdfsScanNode*, const std::vector<HdfsFileDesc*>&);
+
   void DebugString(int indentation_level, std::stringstream* out) const;
 
  private:
@@ -251,6 +256,46 @@ class HdfsRCFileScanner : public HdfsScanner {
   // of the file {'R', 'C', 'F' 1} 
   static const uint8_t RCFILE_VERSION_HEADER[4];
 
+  // Estimate of header size in bytes.  Headers are likely on remote nodes.  If
+  // this is not big enough, the scanner will read more as necessary.
+  static const int HEADER_SIZE;
+
+  enum Version {
+    SEQ6,     // The version pre hive-0.9 which uses the seq header
+    RCF1      // The version post hive-0.9 which uses a new header
+  };
+
+  // Data that is fixed across headers.  This struct is shared between scan ranges.
+  struct FileHeader {
+    // The sync hash read in from the file header.
+    uint8_t sync[SYNC_HASH_SIZE];
+
+    Version version;
+
+    // true if the file is compressed.
+    bool is_compressed;
+
+    // Codec name if it is compressed.
+    std::string codec;
+
+    // End of the header block so we don't have to reparse it.
+    int64_t header_size;
+  };
+
+  // Issue the scan ranges for the file once its header is parsed.
+  void IssueFileRanges(const char* filename);
+
+  // Initialize the state for a new scan range.
+  Status InitNewRange();
+
+  // Move to the first row group of the scan range.  *found is set to false if
+  // no row group starts in the scan range.
+  Status FindFirstRowGroup(bool* found);
+
+  // Materialize the rows of the scan range.  Returns on error, at the end of the
+  // scan range or when the limit is reached.
+  Status ProcessRange();
+
   // read the current RCFile header
   // Verifies:
   //   version
@@ -258,9 +303,7 @@ class HdfsRCFileScanner : public HdfsScanner {
   //   value class
   //   number of columns
   // Sets:
-  //   is_compressed_
-  //   decompressor_
-  //   sync_hash_
+  //   header_
   Status ReadFileHeader();
 
   // read the RCFile Header Metadata section in the current file
@@ -275,8 +318,8 @@ class HdfsRCFileScanner : public HdfsScanner {
   // Sets:
   //   key_length_
   //   compressed_key_length_
-  //   num_rows_
-  Status ReadHeader();
+  //   *sync: true if there was a sync block before the header.
+  Status ReadHeader(bool* sync);
 
   // Read and validate the rowgroup sync field
   Status ReadSync();
@@ -301,7 +344,8 @@ class HdfsRCFileScanner : public HdfsScanner {
   //   col_bufs_off_
   void GetCurrentKeyBuffer(int col_idx, bool skip_col_data, uint8_t** key_buf_ptr);
 
-  // Read the rowgroup column buffers
+  // Read the rowgroup column buffers, stepping over the ones that are not
+  // materialized.
   // Sets:
   //   column_buffer_: Fills the buffer with either file data or decompressed data.
   Status ReadColumnBuffers();
@@ -316,12 +360,14 @@ class HdfsRCFileScanner : public HdfsScanner {
   //   cur_field_length_[col_idx]
   Status NextField(int col_idx);
 
-  // Read a row group into buffers.
+  // Read the next row group with rows into buffers.  Sets *eosr if there are no
+  // more row groups in the scan range: the scan range ends with the row group
+  // before the first sync block past its end.
   // Calls:
   //   ReadHeader
   //   ReadKeyBuffers
   //   ReadColumnBuffers
-  Status ReadRowGroup();
+  Status ReadRowGroup(bool* eosr);
 
   // Move to next row. Return false if we were at the last row.
   // Calls NexField on each column that we are reading.
@@ -339,39 +385,11 @@ class HdfsRCFileScanner : public HdfsScanner {
     return scan_node_->GetMaterializedSlotIdx(col_idx) != HdfsScanNode::SKIP_COLUMN;
   }
 
-  // Helper class for converting text to other types;
-  boost::scoped_ptr<TextConverter> text_converter_;
-
-  // Parser to find the first record block.
-  boost::scoped_ptr<DelimitedTextParser> find_first_parser_;
-
-  // Location (file name) of previous scan range.
-  std::string previous_location_;
-
-  enum Version {
-    SEQ6,     // The version pre hive-0.9 which uses the seq header
-    RCF1      // The version post hive-0.9 which uses a new header
-  };
-
-  Version version_;
+  // If true, this scanner is only processing the header bytes.
+  bool only_parsing_header_;
 
-  // Offset to end of file header.
-  int64_t header_end_;
-
-  // End of the scan range.
-  int end_of_scan_range_;
-
-  // Guard variable to prevent reading again from RCFileReader when
-  // the file is exhausted but not all rows have been materialised
-  // from the row group. Reset to false with every
-  // InitCurrentScanRange.
-  bool scan_range_fully_buffered_;
-
-  // true if the current RCFile is compressed
-  bool is_compressed_;
-
-  // The sync_hash_ from the file header.
-  uint8_t sync_hash_[SYNC_HASH_SIZE];
+  // Header for this scan range.  Memory is owned by the parent scan node.
+  FileHeader* header_;
 
   // number of columns in this rowgroup object
   int num_cols_;
@@ -391,6 +409,9 @@ class HdfsRCFileScanner : public HdfsScanner {
   // Read from the row group header.
   int compressed_key_length_;
 
+  // File offset of the current row group, for error messages.
+  int64_t row_group_start_;
+
   // Decompressor class to use, if any.
   boost::scoped_ptr<Codec> decompressor_;
 
@@ -405,21 +426,16 @@ class HdfsRCFileScanner : public HdfsScanner {
 
   // Memory pool for key buffer information
   // This must be separate from the column_buffer_pool_ since it gets passed to
-  // the row memory pool.  This memory is local to this code and is not acquired.
+  // the row batches.  This memory is local to this code and is not acquired.
   boost::scoped_ptr<MemPool> key_buffer_pool_;
 
-  // Buffer for reading key data.
+  // Buffer for the key data.  The key data is copied, or decompressed, out of the
+  // io buffers since it is needed until the row group is done.
   uint8_t* key_buffer_;
 
   // Length of key_buffer_.
   int key_buffer_length_;
 
-  // Temporary buffer for compressed data. Allocated from key_buffer_pool_.
-  uint8_t* compressed_data_buffer_;
-
-  // Length of the compressed data buffer.
-  int compressed_data_buffer_length_;
-
   // Current position in the key buffer, by column
   int32_t* key_buf_pos_;
 
@@ -432,20 +448,25 @@ class HdfsRCFileScanner : public HdfsScanner {
   // Column data buffer
   uint8_t* column_buffer_;
 
-  // Memory pool for column buffer
+  // Memory pool for column buffer.  If the row batches don't have compact data,
+  // the string slots point into it and it is passed to the row batches with each
+  // row group.
   boost::scoped_ptr<MemPool> column_buffer_pool_;
 
   // Sum of the lenghts of the column data to be read from the file.
   int total_col_length_;
 
-  // Previous total length of the column data.
-  int previous_total_length_;
+  // Length of column_buffer_.
+  int column_buffer_length_;
 
   // Offsets into column data buffer, by column.
   int32_t* col_bufs_off_;
 
   // Column buffer byte offset, by column.
   int32_t* col_buf_pos_;
+
+  // Time spent decompressing bytes
+  RuntimeProfile::Counter* decompress_timer_;
 };
 
 }
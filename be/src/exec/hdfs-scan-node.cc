@@ -21,6 +21,7 @@
 #include "runtime/mem-pool.h"
 #include "runtime/raw-value.h"
 #include "runtime/row-batch.h"
+#include "runtime/runtime-filter.h"
 #include "util/debug-util.h"
 #include "util/runtime-profile.h"
 
@@ -41,21 +42,23 @@ HdfsScanNode::HdfsScanNode(ObjectPool* pool, const TPlanNode& tnode,
       thrift_plan_node_(new TPlanNode(tnode)),
       tuple_id_(tnode.hdfs_scan_node.tuple_id),
       compact_data_(tnode.compact_data),
+      vectorize_conjuncts_(false),
       reader_context_(NULL),
       tuple_desc_(NULL),
       unknown_disk_id_warned_(false),
-      tuple_pool_(new MemPool()),
       num_unqueued_files_(0),
       scanner_pool_(new ObjectPool()),
       current_scanner_(NULL),
       current_byte_stream_(NULL),
       num_partition_keys_(0),
       done_(false),
-      partition_key_pool_(new MemPool()),
       next_range_to_issue_idx_(0),
       all_ranges_in_queue_(false),
       ranges_in_flight_(0),
-      all_ranges_issued_(false) {
+      all_ranges_issued_(false),
+      num_runtime_filters_(0),
+      runtime_filters_received_counter_(NULL),
+      rows_rejected_by_filters_counter_(NULL) {
 }
 
 HdfsScanNode::~HdfsScanNode() {
@@ -88,15 +91,17 @@ Status HdfsScanNode::GetNext(RuntimeState* state, RowBatch* row_batch, bool* eos
       materialized_row_batches_.pop_front();
 
       row_batch->Swap(materialized_batch);
+      if (!row_batch->selection_enabled()) row_batch->Compact();
       // Update the number of materialized rows instead of when they are materialized.
       // This means that scanners might process and queue up more rows that are necessary
       // for the limit case but we want to avoid the synchronized writes to 
       // num_rows_returned_
-      num_rows_returned_ += row_batch->num_rows();
+      num_rows_returned_ += row_batch->num_active_rows();
       COUNTER_SET(rows_returned_counter_, num_rows_returned_);
       
       if (ReachedLimit()) {
         int num_rows_over = num_rows_returned_ - limit_;
+        row_batch->Compact();
         row_batch->set_num_rows(row_batch->num_rows() - num_rows_over);
         num_rows_returned_ -= num_rows_over;
         COUNTER_SET(rows_returned_counter_, num_rows_returned_);
@@ -238,7 +243,8 @@ Status HdfsScanNode::InitNextScanRange(RuntimeState* state, bool* scan_ranges_fi
 
     // TODO: HACK.  Skip this file if it uses the io mgr, it is handled very differently
     if (partition->file_format() == THdfsFileFormat::TEXT ||
-        partition->file_format() == THdfsFileFormat::SEQUENCE_FILE) {
+        partition->file_format() == THdfsFileFormat::SEQUENCE_FILE ||
+        partition->file_format() == THdfsFileFormat::RC_FILE) {
       ++current_file_scan_ranges_;
       continue;
     }
@@ -311,7 +317,7 @@ HdfsScanner* HdfsScanNode::CreateScanner(HdfsPartitionDescriptor* partition) {
       scanner = new HdfsSequenceScanner(this, runtime_state_);
       break;
     case THdfsFileFormat::RC_FILE:
-      scanner = new HdfsRCFileScanner(this, runtime_state_, tuple_pool_.get());
+      scanner = new HdfsRCFileScanner(this, runtime_state_);
       break;
     case THdfsFileFormat::TREVNI:
       scanner = new HdfsTrevniScanner(this, runtime_state_, tuple_pool_.get());
@@ -331,10 +337,17 @@ Status HdfsScanNode::Prepare(RuntimeState* state) {
   runtime_state_ = state;
   RETURN_IF_ERROR(ScanNode::Prepare(state));
 
+  tuple_pool_.reset(new MemPool(mem_tracker()));
+  partition_key_pool_.reset(new MemPool(mem_tracker()));
   tuple_desc_ = state->desc_tbl().GetTupleDescriptor(tuple_id_);
   DCHECK(tuple_desc_ != NULL);
   current_range_idx_ = 0;
 
+  runtime_filters_received_counter_ =
+      ADD_COUNTER(runtime_profile(), "RuntimeFiltersReceived", TCounterType::UNIT);
+  rows_rejected_by_filters_counter_ =
+      ADD_COUNTER(runtime_profile(), "RowsRejectedByRuntimeFilters", TCounterType::UNIT);
+
   // One-time initialisation of state that is constant across scan ranges
   DCHECK(tuple_desc_->table_desc() != NULL);
 
@@ -375,6 +388,8 @@ Status HdfsScanNode::Prepare(RuntimeState* state) {
     }
   }
 
+  vectorize_conjuncts_ = VectorizeConjuncts(conjuncts_);
+
   // Codegen scanner specific functions
   if (state->llvm_codegen() != NULL) {
     Function* text_fn = HdfsTextScanner::Codegen(this);
@@ -426,7 +441,7 @@ Status HdfsScanNode::Open(RuntimeState* state) {
   } 
 
   RETURN_IF_ERROR(runtime_state_->io_mgr()->RegisterReader(
-      hdfs_connection_, state->max_io_buffers(), &reader_context_));
+      hdfs_connection_, state->max_io_buffers(), &reader_context_, mem_tracker()));
   runtime_state_->io_mgr()->set_bytes_read_counter(reader_context_, bytes_read_counter());
   runtime_state_->io_mgr()->set_read_timer(reader_context_, read_timer());
 
@@ -452,7 +467,8 @@ Status HdfsScanNode::Open(RuntimeState* state) {
 
     // TODO: remove when all scanners are updated
     if (partition->file_format() == THdfsFileFormat::TEXT ||
-        partition->file_format() == THdfsFileFormat::SEQUENCE_FILE) {
+        partition->file_format() == THdfsFileFormat::SEQUENCE_FILE ||
+        partition->file_format() == THdfsFileFormat::RC_FILE) {
       ++num_unqueued_files_;
       total_scan_ranges += ranges.size();
     } 
@@ -497,6 +513,7 @@ Status HdfsScanNode::Open(RuntimeState* state) {
   HdfsTextScanner::IssueInitialRanges(this, per_type_files[THdfsFileFormat::TEXT]);
   HdfsSequenceScanner::IssueInitialRanges(this, 
       per_type_files[THdfsFileFormat::SEQUENCE_FILE]);
+  HdfsRCFileScanner::IssueInitialRanges(this, per_type_files[THdfsFileFormat::RC_FILE]);
   
   // scanners have added their initial ranges, issue the first batch to the io mgr.
   IssueMoreRanges();
@@ -535,10 +552,69 @@ Status HdfsScanNode::Close(RuntimeState* state) {
 
   scanner_pool_.reset(NULL);
 
-  COUNTER_UPDATE(memory_used_counter_, tuple_pool_->peak_allocated_bytes());
   return ExecNode::Close(state);
 }
 
+void HdfsScanNode::AddRuntimeFilter(const RuntimeFilter* filter) {
+  DCHECK_EQ(filter->slot()->parent(), tuple_id_);
+  lock_guard<mutex> l(runtime_filters_lock_);
+  if (num_runtime_filters_ == MAX_RUNTIME_FILTERS) {
+    VLOG_QUERY << "Ignoring runtime filter from node " << filter->src_node_id()
+               << ": scan node " << id() << " has too many filters";
+    return;
+  }
+  runtime_filters_[num_runtime_filters_] = filter;
+  // Make the filter visible to the scanner threads before the count.
+  __sync_synchronize();
+  ++num_runtime_filters_;
+  COUNTER_UPDATE(runtime_filters_received_counter_, 1);
+}
+
+bool HdfsScanNode::SetPreAggregation(const CreatePreAggregatorFn& create_fn) {
+  // With a limit, the returned rows must be scanned rows.
+  if (limit_ != -1) return false;
+  // Only formats that go through the io mgr are processed by scanner threads.  The
+  // others are scanned in GetNext() and return their rows directly.
+  for (ScanRangeMap::iterator it = per_file_scan_ranges_.begin();
+       it != per_file_scan_ranges_.end(); ++it) {
+    DCHECK(!it->second->ranges.empty());
+    int64_t partition_id = reinterpret_cast<int64_t>(it->second->ranges[0]->meta_data());
+    HdfsPartitionDescriptor* partition = hdfs_table_->GetPartition(partition_id);
+    if (partition == NULL) return false;
+    if (partition->file_format() != THdfsFileFormat::TEXT &&
+        partition->file_format() != THdfsFileFormat::SEQUENCE_FILE &&
+        partition->file_format() != THdfsFileFormat::RC_FILE) {
+      return false;
+    }
+  }
+  create_pre_aggregator_fn_ = create_fn;
+  return true;
+}
+
+Status HdfsScanNode::GetPreAggregator(ScanPreAggregator** aggregator) {
+  *aggregator = NULL;
+  if (create_pre_aggregator_fn_.empty()) return Status::OK;
+  {
+    unique_lock<recursive_mutex> l(lock_);
+    if (!free_pre_aggregators_.empty()) {
+      *aggregator = free_pre_aggregators_.back();
+      free_pre_aggregators_.pop_back();
+      return Status::OK;
+    }
+  }
+  // Creating a pre-aggregator prepares its exprs, which is done without holding lock_
+  // so that the disk thread and the other scanner threads aren't blocked.
+  ScanPreAggregator* new_aggregator;
+  RETURN_IF_ERROR(create_pre_aggregator_fn_(&new_aggregator));
+  *aggregator = scanner_pool_->Add(new_aggregator);
+  return Status::OK;
+}
+
+void HdfsScanNode::ReturnPreAggregator(ScanPreAggregator* aggregator) {
+  unique_lock<recursive_mutex> l(lock_);
+  free_pre_aggregators_.push_back(aggregator);
+}
+
 void HdfsScanNode::AddDiskIoRange(DiskIoMgr::ScanRange* range) {
   unique_lock<recursive_mutex> lock(lock_);
   all_ranges_.push_back(range);
@@ -703,10 +779,15 @@ void HdfsScanNode::AddMaterializedRowBatch(RowBatch* row_batch) {
 }
 
 void HdfsScanNode::ScannerThread(HdfsScanner* scanner, ScanRangeContext* context) {
-  // Call into the scanner to process the range.  From the scanner's perspective,
-  // everything is single threaded.
-  Status status = scanner->ProcessScanRange(context);
-  scanner->Close();
+  Status status = context->InitPreAggregation();
+  if (status.ok()) {
+    // Call into the scanner to process the range.  From the scanner's perspective,
+    // everything is single threaded.
+    status = scanner->ProcessScanRange(context);
+    scanner->Close();
+  } else {
+    context->Complete();
+  }
 
   // Scanner thread completed. Take a look and update the status 
   unique_lock<recursive_mutex> l(lock_);
@@ -761,6 +842,12 @@ void HdfsScanNode::RangeComplete() {
 }
 
 void HdfsScanNode::ComputeSlotMaterializationOrder(vector<int>* order) const {
+  if (vectorize_conjuncts_) {
+    // No conjuncts are evaluated while the tuple is materialized.
+    order->insert(order->begin(), materialized_slots().size(), 0);
+    return;
+  }
+
   const vector<Expr*>& conjuncts = ExecNode::conjuncts();
   // Initialize all order to be conjuncts.size() (after the last conjunct)
   order->insert(order->begin(), materialized_slots().size(), conjuncts.size());
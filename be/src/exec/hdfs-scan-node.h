@@ -7,6 +7,7 @@
 #include <memory>
 #include <stdint.h>
 
+#include <boost/function.hpp>
 #include <boost/scoped_ptr.hpp>
 #include <boost/thread/condition_variable.hpp>
 #include <boost/thread/mutex.hpp>
@@ -29,6 +30,7 @@ class ByteStream;
 class DescriptorTbl;
 class HdfsScanner;
 class RowBatch;
+class RuntimeFilter;
 class Status;
 class ScanRangeContext;
 class Tuple;
@@ -45,6 +47,21 @@ struct HdfsFileDesc {
   HdfsFileDesc(const std::string& filename) : filename(filename) {}
 };
 
+// Streaming partial aggregation that a scanner thread applies to the rows it
+// materializes, before they are queued for the parent node (see AggregationNode).
+// An instance is only used by one scanner thread at a time.
+class ScanPreAggregator {
+ public:
+  virtual ~ScanPreAggregator() {}
+
+  // Aggregates the rows of 'batch' and deletes it.  If the aggregator is full
+  // afterwards, its partial aggregates are appended to 'output' as row batches.
+  virtual void AddBatch(RowBatch* batch, std::vector<RowBatch*>* output) = 0;
+
+  // Appends all partial aggregates that have not been output yet to 'output'.
+  virtual void Flush(std::vector<RowBatch*>* output) = 0;
+};
+
 // A ScanNode implementation that is used for all tables read directly from 
 // HDFS-serialised data. 
 // A HdfsScanNode spawns multiple scanner threads to process the bytes in
@@ -65,8 +82,8 @@ struct HdfsFileDesc {
 // a better way.
 // TODO: this needs to be moved into the io mgr.  RegisterReader needs to take
 // another argument for max parallel ranges or something like that.
-// TODO: this class supports two types of scanners, TEXT and SEQUENCE which use
-// the io mgr and RCFILE and TREVNI which don't.  Remove the non io mgr path.
+// TODO: this class supports two types of scanners, TEXT, SEQUENCE and RCFILE which
+// use the io mgr and TREVNI which doesn't.  Remove the non io mgr path.
 class HdfsScanNode : public ScanNode {
  public:
   HdfsScanNode(ObjectPool* pool, const TPlanNode& tnode, const DescriptorTbl& descs);
@@ -92,6 +109,11 @@ class HdfsScanNode : public ScanNode {
   int limit() const { return limit_; }
 
   bool compact_data() const { return compact_data_; }
+
+  // If true, the text and sequence scanners don't evaluate the conjuncts per row but
+  // pass them to the ScanRangeContext, which evaluates them over the committed rows
+  // with ExecNode::EvalConjuncts(RowBatch*).
+  bool vectorize_conjuncts() const { return vectorize_conjuncts_; }
   
   const std::vector<SlotDescriptor*>& materialized_slots()
       const { return materialized_slots_; }
@@ -110,6 +132,8 @@ class HdfsScanNode : public ScanNode {
   
   const TupleDescriptor* tuple_desc() { return tuple_desc_; }
 
+  int tuple_id() const { return tuple_id_; }
+
   hdfsFS hdfs_connection() { return hdfs_connection_; }
 
   RuntimeState* runtime_state() { return runtime_state_; }
@@ -169,10 +193,50 @@ class HdfsScanNode : public ScanNode {
   // e.g. order[2] = 1 indicates materialized_slots[2] must be materialized before
   // evaluating conjuncts[1].  Slots that are not referenced by any conjuncts will have
   // order set to conjuncts.size()
+  // If vectorize_conjuncts(), all slots are materialized before any conjunct.
   void ComputeSlotMaterializationOrder(std::vector<int>* order) const;
   
+  // Adds a runtime filter on a slot of this node's tuple.  Rows that fail the filter
+  // are dropped by the scanners.  This is thread safe and may be called while the scan
+  // is running, in which case the filter applies to the rows scanned from then on.
+  // 'filter' is not owned and must outlive this node.  Filters beyond
+  // MAX_RUNTIME_FILTERS are ignored.
+  void AddRuntimeFilter(const RuntimeFilter* filter);
+
+  // Returns the number of runtime filters.  The scanners read this without taking a
+  // lock: filters are only ever appended and the count is incremented after the
+  // filter is stored.
+  const volatile int* num_runtime_filters() const { return &num_runtime_filters_; }
+
+  const RuntimeFilter* runtime_filter(int i) const { return runtime_filters_[i]; }
+
+  RuntimeProfile::Counter* rows_rejected_by_filters_counter() {
+    return rows_rejected_by_filters_counter_;
+  }
+
+  typedef boost::function<Status (ScanPreAggregator**)> CreatePreAggregatorFn;
+
+  // Makes the scanner threads pre-aggregate the rows they materialize with
+  // aggregators created by 'create_fn', so that this node returns partial aggregation
+  // tuples rather than rows.  Must be called after SetScanRanges() and before Open().
+  // Returns false, and leaves the node unchanged, if the rows cannot be
+  // pre-aggregated, i.e. if the node has a limit or scans formats that are not
+  // processed by scanner threads.
+  bool SetPreAggregation(const CreatePreAggregatorFn& create_fn);
+
+  // Returns a pre-aggregator for a new scanner thread in 'aggregator', or NULL if the
+  // rows are not pre-aggregated.  Returns an error if a new pre-aggregator could not
+  // be created.  Thread safe.
+  Status GetPreAggregator(ScanPreAggregator** aggregator);
+
+  // Makes 'aggregator', which must have been flushed, available to other scanner
+  // threads.  Thread safe.
+  void ReturnPreAggregator(ScanPreAggregator* aggregator);
+
   const static int SKIP_COLUMN = -1;
 
+  const static int MAX_RUNTIME_FILTERS = 8;
+
  private:
   // Cache of the plan node.  This is needed to be able to create a copy of
   // the conjuncts per scanner since our Exprs are not thread safe.
@@ -188,6 +252,9 @@ class HdfsScanNode : public ScanNode {
   // stream to another node that will release the memory.
   bool compact_data_;
 
+  // See vectorize_conjuncts().  Set in Prepare().
+  bool vectorize_conjuncts_;
+
   // ReaderContext object to use with the disk-io-mgr
   DiskIoMgr::ReaderContext* reader_context_;
 
@@ -309,6 +376,22 @@ class HdfsScanNode : public ScanNode {
   // Pool for allocating partition key tuple and string buffers
   boost::scoped_ptr<MemPool> partition_key_pool_;
 
+  // Runtime filters added by AddRuntimeFilter().  runtime_filters_lock_ serializes
+  // writers only.
+  boost::mutex runtime_filters_lock_;
+  const RuntimeFilter* runtime_filters_[MAX_RUNTIME_FILTERS];
+  volatile int num_runtime_filters_;
+
+  RuntimeProfile::Counter* runtime_filters_received_counter_;
+  RuntimeProfile::Counter* rows_rejected_by_filters_counter_;
+
+  // Set by SetPreAggregation().  Empty if the rows are not pre-aggregated.
+  CreatePreAggregatorFn create_pre_aggregator_fn_;
+
+  // Pre-aggregators that are not in use by a scanner thread.  The aggregators are
+  // owned by scanner_pool_.  Protected by lock_.
+  std::vector<ScanPreAggregator*> free_pre_aggregators_;
+
   // The queue of all ranges that the scanners want to issue.
   std::vector<DiskIoMgr::ScanRange*> all_ranges_;
 
@@ -35,9 +35,10 @@ int HdfsScanner::WriteAlignedTuples(MemPool* pool, TupleRow* tuple_row, int row_
   for (int i = 0; i < num_tuples; ++i) {
     uint8_t error_in_row = false;
     // Materialize a single tuple.  This function will be replaced by a codegen'd
-    // function.
+    // function.  The runtime filters are not codegen'd: they are usually added after
+    // the scan started.
     if (WriteCompleteTuple(pool, fields, tuple, tuple_row, template_tuple, 
-          error, &error_in_row)) {
+          error, &error_in_row) && EvalRuntimeFilters(tuple_row)) {
       ++tuples_returned;
       tuple_mem += tuple_byte_size_;
       tuple_row_mem += row_size;
@@ -12,6 +12,7 @@
 #include "exec/hdfs-byte-stream.h"
 #include "exec/hdfs-scan-node.h"
 #include "exec/scan-range-context.h"
+#include "exec/serde-utils.inline.h"
 #include "exec/text-converter.inline.h"
 #include "exprs/expr.h"
 #include "runtime/descriptors.h"
@@ -20,8 +21,10 @@
 #include "runtime/mem-pool.h"
 #include "runtime/raw-value.h"
 #include "runtime/row-batch.h"
+#include "runtime/runtime-filter.h"
 #include "runtime/tuple-row.h"
 #include "runtime/tuple.h"
+#include "runtime/string-search.h"
 #include "runtime/string-value.h"
 #include "util/debug-util.h"
 #include "util/runtime-profile.h"
@@ -55,10 +58,16 @@ HdfsScanner::HdfsScanner(HdfsScanNode* scan_node, RuntimeState* state,
                               !scan_node->tuple_desc()->string_slots().empty()),
       current_scan_range_(NULL),
       num_null_bytes_(scan_node->tuple_desc()->num_null_bytes()),
-      write_tuples_fn_(NULL) {
+      write_tuples_fn_(NULL),
+      num_runtime_filters_(scan_node->num_runtime_filters()),
+      num_rows_rejected_by_filters_(0) {
 }
 
 HdfsScanner::~HdfsScanner() {
+  if (num_rows_rejected_by_filters_ > 0) {
+    COUNTER_UPDATE(scan_node_->rows_rejected_by_filters_counter(),
+        num_rows_rejected_by_filters_);
+  }
 }
 
 Status HdfsScanner::Prepare() {
@@ -76,6 +85,90 @@ Status HdfsScanner::CreateConjunctsCopy() {
   return Status::OK;
 }
 
+// Returns the offset in 'buffer' of the sync marker (-1) followed by 'sync', or
+// 'buffer_len' if it is not there.
+static int FindSyncBlock(const uint8_t* buffer, int buffer_len,
+    const uint8_t* sync, int sync_len) {
+  char marker_and_sync[4 + sync_len];
+  marker_and_sync[0] = marker_and_sync[1] = 
+      marker_and_sync[2] = marker_and_sync[3] = 0xff;
+  memcpy(marker_and_sync + 4, sync, sync_len);
+
+  StringValue needle(marker_and_sync, 4 + sync_len);
+  StringValue haystack(
+      const_cast<char*>(reinterpret_cast<const char*>(buffer)), buffer_len);
+
+  StringSearch search(&needle);
+  int offset = search.Search(&haystack);
+  if (offset == -1) return buffer_len;
+  return offset;
+}
+
+Status HdfsScanner::SkipToSync(const uint8_t* sync, int sync_size, bool* past_sync) {
+  *past_sync = false;
+  bool eosr = false;
+  int offset = sync_size;
+  int buffer_len;
+  do {
+    uint8_t* buffer;
+  
+    RETURN_IF_ERROR(context_->GetRawBytes(&buffer, &buffer_len, &eosr));
+    offset = FindSyncBlock(buffer, buffer_len, sync, sync_size);
+    DCHECK_LE(offset, buffer_len);
+
+    // We need to check for a sync that spans buffers.
+    if (offset == buffer_len) {
+      // The marker (-1) and the sync can start anywhere in the
+      // last sync_size + 3 bytes of the buffer.  
+      const int tail_size = sync_size + sizeof(int32_t) - 1;
+      uint8_t* bp = buffer + buffer_len - tail_size;
+      uint8_t save[2 * tail_size];
+
+      // Save the tail of the buffer.
+      memcpy(save, bp, tail_size);
+
+      // Read the next buffer.
+      if (!SerDeUtils::SkipBytes(context_, offset, &parse_status_)) return parse_status_;
+      RETURN_IF_ERROR(context_->GetRawBytes(&buffer, &buffer_len, &eosr));
+      offset = buffer_len;
+      if (buffer_len >= tail_size) {
+        memcpy(save + tail_size, buffer, tail_size);
+        offset = FindSyncBlock(save, 2 * tail_size, sync, sync_size);
+
+        // The sync mark does not span the buffers search the whole new buffer.
+        if (offset == 2 * tail_size) {
+          offset = buffer_len;
+          continue;
+        }
+
+        *past_sync = true;
+        // Adjust the offset to be relative to the start of the new buffer
+        offset -= tail_size;
+        // Adjust offset to be past the sync since it spans buffers.
+        offset += sync_size + sizeof(int32_t);
+      }
+    }
+
+    // Advance to the offset.  If *past_sync is set then this is past the sync block.
+    if (offset != 0) {
+      if (!SerDeUtils::SkipBytes(context_, offset, &parse_status_)) return parse_status_;
+    }
+  } while (offset >= buffer_len && !eosr);
+
+  if (!eosr) {
+    VLOG_FILE << "Found sync for: " << context_->filename()
+              << " at " << context_->file_offset() - (*past_sync ? offset : 0);
+  }
+
+  return Status::OK;
+}
+
+void HdfsScanner::InitBatchConjuncts() {
+  if (!scan_node_->vectorize_conjuncts()) return;
+  context_->set_batch_conjuncts(conjuncts_, conjuncts_mem_.size());
+  num_conjuncts_ = 0;
+}
+
 Status HdfsScanner::InitializeCodegenFn(HdfsPartitionDescriptor* partition,
     THdfsFileFormat::type type, const string& scanner_name) {
   Function* codegen_fn = scan_node_->GetCodegenFn(type);
@@ -150,7 +243,8 @@ int HdfsScanner::WriteEmptyTuples(RowBatch* row_batch, int num_tuples) {
     
     TupleRow* current_row = row_batch->GetRow(row_idx);
     current_row->SetTuple(scan_node_->tuple_idx(), template_tuple_);
-    if (!ExecNode::EvalConjuncts(conjuncts_, num_conjuncts_, current_row)) {
+    if (!ExecNode::EvalConjuncts(conjuncts_, num_conjuncts_, current_row) ||
+        !EvalRuntimeFilters(current_row)) {
       return 0;
     }
     // Add first tuple
@@ -189,7 +283,10 @@ int HdfsScanner::WriteEmptyTuples(ScanRangeContext* context,
     return num_tuples;
   } else {
     row->SetTuple(scan_node_->tuple_idx(), template_tuple_);
-    if (!ExecNode::EvalConjuncts(conjuncts_, num_conjuncts_, row)) return 0;
+    if (!ExecNode::EvalConjuncts(conjuncts_, num_conjuncts_, row) ||
+        !EvalRuntimeFilters(row)) {
+      return 0;
+    }
     row = context->next_row(row);
 
     for (int n = 1; n < num_tuples; ++n) {
@@ -200,6 +297,19 @@ int HdfsScanner::WriteEmptyTuples(ScanRangeContext* context,
   return num_tuples;
 }
 
+bool HdfsScanner::EvalRuntimeFiltersSlow(TupleRow* row) {
+  // Filters are published before the count (see HdfsScanNode::AddRuntimeFilter()).
+  int num_filters = *num_runtime_filters_;
+  Tuple* tuple = row->GetTuple(scan_node_->tuple_idx());
+  for (int i = 0; i < num_filters; ++i) {
+    if (!scan_node_->runtime_filter(i)->Eval(tuple)) {
+      ++num_rows_rejected_by_filters_;
+      return false;
+    }
+  }
+  return true;
+}
+
 bool HdfsScanner::WriteCompleteTuple(MemPool* pool, FieldLocation* fields, 
     Tuple* tuple, TupleRow* tuple_row, Tuple* template_tuple,
     uint8_t* error_fields, uint8_t* error_in_row) {
@@ -291,8 +401,11 @@ Function* HdfsScanner::CodegenWriteCompleteTuple(
     return NULL;
   }
 
-  // Codegen for eval conjuncts
-  const vector<Expr*>& conjuncts = node->conjuncts();
+  // Codegen for eval conjuncts.  If the conjuncts are evaluated over whole batches,
+  // none are evaluated here.
+  vector<Expr*> no_conjuncts;
+  const vector<Expr*>& conjuncts =
+      node->vectorize_conjuncts() ? no_conjuncts : node->conjuncts();
   for (int i = 0; i < conjuncts.size(); ++i) {
     if (conjuncts[i]->codegen_fn() == NULL) return NULL;
     // TODO: handle cases with scratch buffer.
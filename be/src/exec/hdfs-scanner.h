@@ -213,12 +213,43 @@ class HdfsScanner {
   // Jitted write tuples function pointer.  Null if codegen is disabled.
   WriteTuplesFn write_tuples_fn_;
 
+  // Cache of scan_node_->num_runtime_filters().  Runtime filters can arrive at any
+  // time during the scan, so this is reread for every row.
+  const volatile int* num_runtime_filters_;
+
+  // Number of rows rejected by runtime filters that have not been added to the
+  // scan node's counter yet.  Flushed in the d'tor.
+  int64_t num_rows_rejected_by_filters_;
+
+  // Returns false if the scan node's tuple in 'row' fails one of the runtime filters.
+  // Must be called after the conjuncts passed (the filters are less selective and
+  // more expensive than most conjuncts).
+  bool EvalRuntimeFilters(TupleRow* row) {
+    if (LIKELY(*num_runtime_filters_ == 0)) return true;
+    return EvalRuntimeFiltersSlow(row);
+  }
+
+  // Evaluates all runtime filters against 'row'.
+  bool EvalRuntimeFiltersSlow(TupleRow* row);
+
   // Create a copy of the conjuncts. Exprs are not thread safe (they store results 
   // inside the expr) so each scanner needs its own copy.  This is not needed for
   // codegen'd scanners since they evaluate exprs with a different mechanism.
   // TODO: fix exprs
   Status CreateConjunctsCopy();
 
+  // If the scan node vectorizes its conjuncts, hands the conjuncts to context_ to be
+  // evaluated over the committed rows and stops evaluating them per row.  Must be
+  // called after context_ is set.
+  void InitBatchConjuncts();
+
+  // Skips to the next sync block of a sequence or rc file: the sync marker (-1)
+  // followed by the 'sync_size' bytes of 'sync'.  On return, context_ is positioned
+  // at the sync marker or, if the sync block spanned two io buffers, just past the
+  // sync, in which case *past_sync is set to true.  If there is no sync block in
+  // the rest of the scan range, context_ is at the end of the range.
+  Status SkipToSync(const uint8_t* sync, int sync_size, bool* past_sync);
+
   // Initializes write_tuples_fn_ to the jitted function if codegen is possible.
   // - partition - partition descriptor for this scanner/scan range
   // - type - type for this scanner
@@ -2,6 +2,8 @@
 
 #include "exec/hdfs-sequence-scanner.h"
 
+#include <boost/bind.hpp>
+
 #include "codegen/llvm-codegen.h"
 #include "exec/delimited-text-parser.inline.h"
 #include "exec/hdfs-scan-node.h"
@@ -9,8 +11,9 @@
 #include "exec/serde-utils.inline.h"
 #include "exec/text-converter.inline.h"
 #include "runtime/descriptors.h"
+#include "runtime/exec-env.h"
 #include "runtime/runtime-state.h"
-#include "runtime/string-search.h"
+#include "runtime/thread-pool.h"
 #include "runtime/tuple.h"
 #include "runtime/tuple-row.h"
 
@@ -19,6 +22,12 @@ using namespace impala;
 using namespace llvm;
 using namespace std;
 
+DEFINE_int32(seq_decompress_blocks, 4,
+    "Number of blocks of a block compressed sequence file that a scanner reads ahead. "
+    "The blocks are decompressed by the shared decompression threads (see "
+    "--num_decompression_threads) while the blocks before them are parsed.  If 1, "
+    "each block is decompressed on the scanner thread as it is read.");
+
 const char* const HdfsSequenceScanner::SEQFILE_VALUE_CLASS_NAME =
   "org.apache.hadoop.io.Text";
 
@@ -33,16 +42,20 @@ static const uint8_t SEQUENCE_FILE_RECORD_DELIMITER = 0xff;
 HdfsSequenceScanner::HdfsSequenceScanner(HdfsScanNode* scan_node, RuntimeState* state) 
     : HdfsScanner(scan_node, state, NULL),
       header_(NULL),
-      unparsed_data_buffer_pool_(new MemPool()),
+      unparsed_data_buffer_pool_(new MemPool(scan_node->mem_tracker())),
       unparsed_data_buffer_(NULL),
       num_buffered_records_in_compressed_block_(0),
+      next_block_idx_(0),
+      num_read_blocks_(0),
+      current_block_(NULL),
       have_sync_(false),
       block_start_(0) {
 }
 
 HdfsSequenceScanner::~HdfsSequenceScanner() {
-  COUNTER_UPDATE(scan_node_->memory_used_counter(),
-      unparsed_data_buffer_pool_->peak_allocated_bytes());
+  for (int i = 0; i < blocks_.size(); ++i) {
+    delete blocks_[i];
+  }
 }
 
 void HdfsSequenceScanner::IssueInitialRanges(HdfsScanNode* scan_node, 
@@ -131,18 +144,21 @@ Status HdfsSequenceScanner::ProcessScanRange(ScanRangeContext* context) {
     // If no errors or we abort on error then exit loop.
     if (state_->abort_on_error() || status.ok()) break;
 
-    // If we are not at the end of the scan range, try to recover.
-    if (!context_->eosr()) {
+    // If we are not at the end of the scan range, try to recover.  Blocks that were
+    // read ahead are not affected by the error, we only skip ahead in the file once
+    // they are parsed.
+    if (!context_->eosr() || HaveBufferedBlocks()) {
       parse_status_ = Status::OK;
       ++num_errors;
-      status = SkipToSync();
-      if (context_->eosr()) break;
-
       // If block compressed, reset the number of records.
       // We will be at the beginning of a block.
       num_buffered_records_in_compressed_block_ = 0;
+      if (!HaveBufferedBlocks()) {
+        status = SkipToSync(header_->sync, SYNC_HASH_SIZE, &have_sync_);
+        if (context_->eosr()) break;
+      }
     }
-  } while (!context_->eosr());
+  } while (!context_->eosr() || HaveBufferedBlocks());
 
   if (num_errors != 0 || !status.ok()) {
     if (state_->LogHasSpace()) {
@@ -161,6 +177,11 @@ Status HdfsSequenceScanner::ProcessScanRange(ScanRangeContext* context) {
 
 Status HdfsSequenceScanner::Close() {
   context_->AcquirePool(unparsed_data_buffer_pool_.get());
+  for (int i = 0; i < blocks_.size(); ++i) {
+    // Blocks that were read ahead but not parsed may still be decompressed.
+    WaitForDecompression(blocks_[i]);
+    context_->AcquirePool(blocks_[i]->pool.get());
+  }
   if (!only_parsing_header_) scan_node_->RangeComplete();
   context_->Complete();
   return Status::OK;
@@ -182,15 +203,28 @@ Status HdfsSequenceScanner::InitNewRange() {
 
   template_tuple_ = context_->template_tuple();
 
-  if (header_->is_compressed) {
+  if (header_->is_blk_compressed) {
+    // Each block that is read ahead has its own decompressor and pool so they can
+    // be decompressed in parallel.
+    int num_blocks = max(FLAGS_seq_decompress_blocks, 1);
+    for (int i = 0; i < num_blocks; ++i) {
+      CompressedBlock* block = new CompressedBlock();
+      blocks_.push_back(block);
+      block->pool.reset(new MemPool(scan_node_->mem_tracker()));
+      RETURN_IF_ERROR(Codec::CreateDecompressor(state_, block->pool.get(),
+          context_->compact_data(), header_->codec, &block->decompressor));
+    }
+  } else if (header_->is_compressed) {
     // For record-compressed data we always want to copy since they tend to be
     // small and occupy a bigger mempool chunk.
-    if (!header_->is_blk_compressed) context_->set_compact_data(true);
+    context_->set_compact_data(true);
     RETURN_IF_ERROR(Codec::CreateDecompressor(state_,
         unparsed_data_buffer_pool_.get(), context_->compact_data(),
         header_->codec, &decompressor_));
   }
   
+  InitBatchConjuncts();
+
   // Initialize codegen fn
   RETURN_IF_ERROR(InitializeCodegenFn(hdfs_partition, 
       THdfsFileFormat::SEQUENCE_FILE, "HdfsSequenceScanner"));
@@ -212,23 +246,6 @@ Status HdfsSequenceScanner::Prepare() {
   return Status::OK;
 }
 
-int FindSyncBlock(const uint8_t* buffer, int buffer_len, 
-    const uint8_t* sync, int sync_len) {
-  char marker_and_sync[4 + sync_len];
-  marker_and_sync[0] = marker_and_sync[1] = 
-      marker_and_sync[2] = marker_and_sync[3] = 0xff;
-  memcpy(marker_and_sync + 4, sync, sync_len);
-
-  StringValue needle(marker_and_sync, 4 + sync_len);
-  StringValue haystack(
-      const_cast<char*>(reinterpret_cast<const char*>(buffer)), buffer_len);
-
-  StringSearch search(&needle);
-  int offset = search.Search(&haystack);
-  if (offset == -1) return buffer_len;
-  return offset;
-}
-
 Status HdfsSequenceScanner::FindFirstRecord(bool* found) {
   Status status;
   if (context_->scan_range()->offset() == 0) {
@@ -239,7 +256,7 @@ Status HdfsSequenceScanner::FindFirstRecord(bool* found) {
     return Status::OK;
   }
 
-  RETURN_IF_ERROR(SkipToSync());
+  RETURN_IF_ERROR(SkipToSync(header_->sync, SYNC_HASH_SIZE, &have_sync_));
   *found = !context_->eosr();
   return Status::OK;
 }
@@ -316,7 +333,8 @@ inline Status HdfsSequenceScanner::GetRecord(uint8_t** record_ptr,
 // Process block compressed sequence files.  This is the most used sequence file
 // format.  The general strategy is to process the data in large chunks to minimize
 // function calls.  The process is:
-// 1. Decompress an entire block
+// 1. Decompress an entire block.  Up to FLAGS_seq_decompress_blocks blocks are read
+//    ahead and decompressed by the decompression pool while this thread parses.
 // 2. In row batch sizes:
 //   a. Collect the start of records and their lengths
 //   b. Parse cols locations to field_locations_
@@ -326,11 +344,12 @@ inline Status HdfsSequenceScanner::GetRecord(uint8_t** record_ptr,
 Status HdfsSequenceScanner::ProcessBlockCompressedScanRange() {
   DCHECK(header_->is_blk_compressed);
 
-  while (!context_->eosr() || num_buffered_records_in_compressed_block_ > 0) {
+  while (!context_->eosr() || HaveBufferedBlocks() ||
+      num_buffered_records_in_compressed_block_ > 0) {
     if (num_buffered_records_in_compressed_block_ == 0) {
-      if (context_->eosr()) return Status::OK;
-      // No more decompressed data, decompress the next block
-      RETURN_IF_ERROR(ReadCompressedBlock());
+      if (context_->eosr() && !HaveBufferedBlocks()) return Status::OK;
+      // No more decompressed data, move to the next block
+      RETURN_IF_ERROR(NextCompressedBlock());
       if (num_buffered_records_in_compressed_block_ < 0) return parse_status_;
     }
     
@@ -453,7 +472,8 @@ Status HdfsSequenceScanner::ProcessRange() {
       memset(errors, 0, sizeof(errors));
 
       add_row = WriteCompleteTuple(pool, &field_locations_[0], tuple_, tuple_row_mem,
-          template_tuple_, &errors[0], &error_in_row);
+          template_tuple_, &errors[0], &error_in_row) &&
+          EvalRuntimeFilters(tuple_row_mem);
 
       if (UNLIKELY(error_in_row)) {
         for (int i = 0; i < scan_node_->materialized_slots().size(); ++i) {
@@ -605,72 +625,78 @@ Status HdfsSequenceScanner::CheckSync() {
   return Status::OK;
 }
 
-Status HdfsSequenceScanner::SkipToSync() {
-  bool eosr = false;
-  int offset = SYNC_HASH_SIZE;
-  int buffer_len;
-  do {
-    uint8_t* buffer;
-  
-    RETURN_IF_ERROR(context_->GetRawBytes(&buffer, &buffer_len, &eosr));
-    offset = FindSyncBlock(buffer, buffer_len, header_->sync, SYNC_HASH_SIZE);
-    DCHECK_LE(offset, buffer_len);
-
-    // We need to check for a sync that spans buffers.
-    if (offset == buffer_len) {
-      // The marker (-1) and the sync can start anywhere in the
-      // last 19 bytes of the buffer.  
-      static const int tail_size = SYNC_HASH_SIZE + sizeof(int32_t) - 1;
-      uint8_t* bp = buffer + buffer_len - tail_size;
-      uint8_t save[2 * tail_size];
-
-      // Save the tail of the buffer.
-      memcpy(save, bp, tail_size);
-
-      // Read the next buffer.
-      RETURN_IF_FALSE(SerDeUtils::SkipBytes(context_, offset, &parse_status_));
-      RETURN_IF_ERROR(context_->GetRawBytes(&buffer, &buffer_len, &eosr));
-      offset = buffer_len;
-      if (buffer_len >= tail_size) {
-        memcpy(save + tail_size, buffer, tail_size);
-        offset = FindSyncBlock(save, 2 * tail_size, header_->sync, SYNC_HASH_SIZE);
-
-        // The sync mark does not span the buffers search the whole new buffer.
-        if (offset == 2 * tail_size) {
-          offset = buffer_len;
-          continue;
-        }
-
-        have_sync_ = true;
-        // Adjust the offset to be relative to the start of the new buffer
-        offset -= tail_size;
-        // Adjust offset to be past the sync since it spans buffers.
-        offset += SYNC_HASH_SIZE + sizeof(int32_t);
-      }
-    }
-
-    // Advance to the offset.  If have_sync_ is set then this is past the sync block.
-    if (offset != 0) {
-      RETURN_IF_FALSE(SerDeUtils::SkipBytes(context_, offset, &parse_status_));
+void HdfsSequenceScanner::ReadCompressedBlocks() {
+  ThreadPool* decompression_pool = state_->exec_env()->decompression_pool();
+  while (num_read_blocks_ < blocks_.size() && !context_->eosr() && read_status_.ok()) {
+    CompressedBlock* block =
+        blocks_[(next_block_idx_ + num_read_blocks_) % blocks_.size()];
+    read_status_ = ReadCompressedBlock(block);
+    if (!read_status_.ok()) break;
+    ++num_read_blocks_;
+    if (blocks_.size() == 1) continue;
+    {
+      lock_guard<mutex> l(blocks_lock_);
+      block->decompressed = false;
     }
-  } while (offset >= buffer_len && !eosr);
+    // The status of each block is checked when it is parsed.
+    decompression_pool->Offer(bind(&HdfsSequenceScanner::DecompressBlock, this, block));
+  }
+}
 
-  if (!eosr) {
-    VLOG_FILE << "Found sync for: " << context_->filename()
-              << " at " << context_->file_offset() - (have_sync_ ? offset : 0);
+void HdfsSequenceScanner::DecompressBlock(CompressedBlock* block) {
+  {
+    SCOPED_TIMER(decompress_timer_);
+    uint8_t* compressed_data =
+        block->compressed_data.empty() ? NULL : &block->compressed_data[0];
+    int len = 0;
+    block->status = block->decompressor->ProcessBlock(block->compressed_data.size(),
+        compressed_data, &len, &block->data);
   }
+  // Signal while holding the lock: once the lock is released, the scanner may be
+  // closed and destroyed.
+  lock_guard<mutex> l(blocks_lock_);
+  block->decompressed = true;
+  block_decompressed_cv_.notify_all();
+}
 
-  return Status::OK;
+void HdfsSequenceScanner::WaitForDecompression(CompressedBlock* block) {
+  unique_lock<mutex> l(blocks_lock_);
+  while (!block->decompressed) block_decompressed_cv_.wait(l);
 }
 
-Status HdfsSequenceScanner::ReadCompressedBlock() {
-  // We are reading a new compressed block.  Pass the previous buffer pool 
-  // bytes to the batch.  We don't need them anymore.
-  if (!context_->compact_data()) {
-    context_->AcquirePool(unparsed_data_buffer_pool_.get());
+Status HdfsSequenceScanner::NextCompressedBlock() {
+  // The block parsed last is done.  Pass its buffers to the batch, we don't need them
+  // anymore, and reuse its slot.
+  if (current_block_ != NULL) {
+    if (!context_->compact_data()) context_->AcquirePool(current_block_->pool.get());
+    current_block_ = NULL;
   }
+  ReadCompressedBlocks();
+  if (num_read_blocks_ == 0) {
+    // Either the end of the scan range or the read of the next block failed.
+    num_buffered_records_in_compressed_block_ = 0;
+    if (read_status_.ok()) return Status::OK;
+    // The failed read was into the slot after the blocks that were read.
+    block_start_ = blocks_[next_block_idx_]->block_start;
+    Status status = read_status_;
+    read_status_ = Status::OK;
+    return status;
+  }
+
+  current_block_ = blocks_[next_block_idx_];
+  next_block_idx_ = (next_block_idx_ + 1) % blocks_.size();
+  --num_read_blocks_;
+  WaitForDecompression(current_block_);
+  block_start_ = current_block_->block_start;
+  RETURN_IF_ERROR(current_block_->status);
+  num_buffered_records_in_compressed_block_ = current_block_->num_records;
+  next_record_in_compressed_block_ = current_block_->data;
+  return Status::OK;
+}
 
+Status HdfsSequenceScanner::ReadCompressedBlock(CompressedBlock* block) {
   block_start_ = context_->file_offset();
+  block->block_start = block_start_;
   if (have_sync_) {
     // We skipped ahead on an error and read the sync block.
     have_sync_ = false;
@@ -691,13 +717,12 @@ Status HdfsSequenceScanner::ReadCompressedBlock() {
     RETURN_IF_ERROR(CheckSync());
   }
 
-  RETURN_IF_FALSE(SerDeUtils::ReadVLong(context_, 
-      &num_buffered_records_in_compressed_block_, &parse_status_));
-  if (num_buffered_records_in_compressed_block_ < 0) {
+  RETURN_IF_FALSE(
+      SerDeUtils::ReadVLong(context_, &block->num_records, &parse_status_));
+  if (block->num_records < 0) {
     if (state_->LogHasSpace()) {
       stringstream ss;
-      ss << "Bad compressed block record count: "
-         << num_buffered_records_in_compressed_block_;
+      ss << "Bad compressed block record count: " << block->num_records;
       state_->LogError(ss.str());
     }
     return Status("bad record count");
@@ -726,11 +751,15 @@ Status HdfsSequenceScanner::ReadCompressedBlock() {
   RETURN_IF_FALSE(
       SerDeUtils::ReadBytes(context_, block_size, &compressed_data, &parse_status_));
 
-  int len = 0;
-  SCOPED_TIMER(decompress_timer_);
-  RETURN_IF_ERROR(decompressor_->ProcessBlock(block_size, compressed_data,
-      &len, &unparsed_data_buffer_));
-  next_record_in_compressed_block_ = unparsed_data_buffer_;
+  if (blocks_.size() == 1) {
+    // Decompress straight from the io buffer.
+    int len = 0;
+    SCOPED_TIMER(decompress_timer_);
+    block->status = block->decompressor->ProcessBlock(block_size, compressed_data,
+        &len, &block->data);
+  } else {
+    block->compressed_data.assign(compressed_data, compressed_data + block_size);
+  }
   return Status::OK;
 }
 
@@ -3,6 +3,9 @@
 #ifndef IMPALA_EXEC_HDFS_SEQUENCE_SCANNER_H
 #define IMPALA_EXEC_HDFS_SEQUENCE_SCANNER_H
 
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+
 #include "util/codec.h"
 #include "exec/hdfs-scanner.h"
 #include "exec/delimited-text-parser.h"
@@ -220,9 +223,61 @@ class HdfsSequenceScanner : public HdfsScanner {
   // more common and can be parsed more efficiently in larger pieces.
   Status ProcessBlockCompressedScanRange();
 
-  // Read a compressed block.
-  // Decompress to unparsed_data_buffer_ allocated from unparsed_data_buffer_pool_.
-  Status ReadCompressedBlock();
+  // A block of a block compressed file.  Blocks are read ahead of parsing, up to
+  // FLAGS_seq_decompress_blocks at a time, and decompressed by the exec env's
+  // decompression pool while the blocks before them are parsed.
+  struct CompressedBlock {
+    CompressedBlock() : decompressed(true) { }
+
+    // Pool for the decompressed data and the decompressor that allocates from it.
+    boost::scoped_ptr<MemPool> pool;
+    boost::scoped_ptr<Codec> decompressor;
+
+    // Copy of the compressed data.  The context's buffers are reused by the next
+    // read so the data has to be copied before reading the next block.
+    std::vector<uint8_t> compressed_data;
+
+    // File offset of the block and the number of records in it.
+    int64_t block_start;
+    int64_t num_records;
+
+    // The decompressed records and the status of decompressing them.
+    uint8_t* data;
+    Status status;
+
+    // False while the block is queued or being decompressed by the decompression
+    // pool.  Protected by blocks_lock_.
+    bool decompressed;
+  };
+
+  // Read a compressed block into 'block'.  If blocks are decompressed one at a
+  // time, the block is decompressed right away, otherwise the compressed data is
+  // copied to block->compressed_data.
+  Status ReadCompressedBlock(CompressedBlock* block);
+
+  // Decompresses the data of a block read by ReadCompressedBlock() into block->data
+  // and block->status, and marks it decompressed.  Runs in the decompression pool.
+  void DecompressBlock(CompressedBlock* block);
+
+  // Waits until 'block' is decompressed.
+  void WaitForDecompression(CompressedBlock* block);
+
+  // Reads blocks of the scan range into the free slots of blocks_ and queues them
+  // for decompression.  A read error is saved in read_status_ and returned once the
+  // blocks before it are parsed.
+  void ReadCompressedBlocks();
+
+  // Sets up the next block read ahead for parsing, after reading more blocks into
+  // the slots freed by the blocks parsed so far.  Sets
+  // num_buffered_records_in_compressed_block_ to 0 if the end of the scan range is
+  // reached.
+  Status NextCompressedBlock();
+
+  // Returns true if there are blocks, or a read error, that were read ahead and not
+  // returned by NextCompressedBlock() yet.
+  bool HaveBufferedBlocks() const {
+    return num_read_blocks_ > 0 || !read_status_.ok();
+  }
 
   // Read compressed or uncompressed records from the byte stream into memory
   // in unparsed_data_buffer_pool_.  Not used for block compressed files.
@@ -235,10 +290,6 @@ class HdfsSequenceScanner : public HdfsScanner {
   // read and verify a sync block.
   Status CheckSync();
 
-  // Find the next sync block to start a scan range or recover from error.
-  // IF the sync block spanned a buffer then set have_sync_ = true.
-  Status SkipToSync();
-
   // Appends the current file and line to the RuntimeState's error log.
   // row_idx is 0-based (in current batch) where the parse error occured.
   virtual void LogRowParseError(std::stringstream*, int row_idx);
@@ -297,9 +348,29 @@ class HdfsSequenceScanner : public HdfsScanner {
   // Buffer for data read from HDFS or from decompressing the HDFS data.
   uint8_t* unparsed_data_buffer_;
 
-  // Number of buffered records unparsed_data_buffer_ from block compressed data.
+  // Number of records left to parse in the current block of block compressed data.
   int64_t num_buffered_records_in_compressed_block_;
 
+  // Ring of the blocks of a block compressed file that are read ahead.  Owned by
+  // this scanner.
+  std::vector<CompressedBlock*> blocks_;
+
+  // Index in blocks_ of the next block to parse and the number of blocks from there
+  // on that were read and not parsed yet.
+  int next_block_idx_;
+  int num_read_blocks_;
+
+  // Block that is being parsed; its slot is freed by the next NextCompressedBlock().
+  CompressedBlock* current_block_;
+
+  // Error reading the block after the ones read ahead.
+  Status read_status_;
+
+  // Protects CompressedBlock::decompressed.  block_decompressed_cv_ is signalled when
+  // a block is decompressed.
+  boost::mutex blocks_lock_;
+  boost::condition_variable block_decompressed_cv_;
+
   // Next record from block compressed data.
   uint8_t* next_record_in_compressed_block_;
 
@@ -23,7 +23,7 @@ const char* HdfsTextScanner::LLVM_CLASS_NAME = "class.impala::HdfsTextScanner";
 
 HdfsTextScanner::HdfsTextScanner(HdfsScanNode* scan_node, RuntimeState* state) 
     : HdfsScanner(scan_node, state, NULL),
-      boundary_mem_pool_(new MemPool()),
+      boundary_mem_pool_(new MemPool(scan_node->mem_tracker())),
       boundary_row_(boundary_mem_pool_.get()),
       boundary_column_(boundary_mem_pool_.get()),
       slot_idx_(0),
@@ -34,8 +34,6 @@ HdfsTextScanner::HdfsTextScanner(HdfsScanNode* scan_node, RuntimeState* state)
 }
 
 HdfsTextScanner::~HdfsTextScanner() {
-  COUNTER_UPDATE(scan_node_->memory_used_counter(),
-      boundary_mem_pool_->peak_allocated_bytes());
 }
 
 void HdfsTextScanner::IssueInitialRanges(HdfsScanNode* scan_node, 
@@ -112,6 +110,8 @@ void HdfsTextScanner::InitNewRange(ScanRangeContext* context) {
   partial_tuple_ = reinterpret_cast<Tuple*>(
       boundary_mem_pool_->Allocate(scan_node_->tuple_desc()->byte_size()));
 
+  InitBatchConjuncts();
+
   // Initialize codegen fn
   InitializeCodegenFn(hdfs_partition, THdfsFileFormat::TEXT, "HdfsTextScanner");
 }
@@ -393,7 +393,8 @@ int HdfsTextScanner::WriteFields(MemPool* pool, TupleRow* tuple_row,
       ++num_tuples_processed;
       --num_tuples;
 
-      if (ExecNode::EvalConjuncts(conjuncts_, num_conjuncts_, tuple_row)) {
+      if (ExecNode::EvalConjuncts(conjuncts_, num_conjuncts_, tuple_row) &&
+          EvalRuntimeFilters(tuple_row)) {
         ++num_tuples_materialized;
         tuple_ = context_->next_tuple(tuple_);
         tuple_row = context_->next_row(tuple_row);
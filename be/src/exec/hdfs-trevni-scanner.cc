@@ -20,6 +20,7 @@
 #include "exec/read-write-util.h"
 #include "exec/serde-utils.h"
 #include "exec/text-converter.inline.h"
+#include "exprs/expr.h"
 #include "gen-cpp/Descriptors_types.h"
 #include "gen-cpp/JavaConstants_constants.h"
 
@@ -31,27 +32,142 @@ HdfsTrevniScanner::HdfsTrevniScanner(HdfsScanNode* scan_node, RuntimeState* stat
                                      MemPool* mem_pool)
     : HdfsScanner(scan_node, state, mem_pool),
       decompressor_(NULL),
-      compressed_data_pool_(new MemPool()),
+      compressed_data_pool_(new MemPool(scan_node->mem_tracker())),
       file_checksum_(false),
       compressed_buffer_size_(0),
-      object_pool_(new ObjectPool) {
+      object_pool_(new ObjectPool),
+      blocks_skipped_counter_(NULL) {
 }
 
 HdfsTrevniScanner::~HdfsTrevniScanner() {
-  COUNTER_UPDATE(scan_node_->memory_used_counter(),
-      compressed_data_pool_->peak_allocated_bytes());
-  for (int i = 0; i < column_info_.size(); ++i) {
-    COUNTER_UPDATE(scan_node_->memory_used_counter(),
-        column_info_[i].mem_pool->peak_allocated_bytes());
-  }
 }
 
 Status HdfsTrevniScanner::Prepare() {
   RETURN_IF_ERROR(HdfsScanner::Prepare());
   tuple_ = NULL;
+
+  // A column is a predicate column if it must be materialized before some conjunct.
+  vector<int> order;
+  scan_node_->ComputeSlotMaterializationOrder(&order);
+  is_predicate_column_.resize(order.size());
+  for (int i = 0; i < order.size(); ++i) {
+    is_predicate_column_[i] = order[i] < num_conjuncts_;
+  }
+
+  InitBlockPredicates();
+  blocks_skipped_counter_ = ADD_COUNTER(
+      scan_node_->runtime_profile(), "TrevniBlocksSkipped", TCounterType::UNIT);
   return Status::OK;
 }
 
+// Maps the opcode of a comparison to the op evaluated against the block stats.
+// Returns false if the opcode isn't a comparison that the stats can evaluate.
+static bool GetStatsOp(TExprOpcode::type opcode, TrevniBlockStats::Op* op) {
+  switch (opcode) {
+    case TExprOpcode::EQ_CHAR_CHAR:
+    case TExprOpcode::EQ_SHORT_SHORT:
+    case TExprOpcode::EQ_INT_INT:
+    case TExprOpcode::EQ_LONG_LONG:
+    case TExprOpcode::EQ_FLOAT_FLOAT:
+    case TExprOpcode::EQ_DOUBLE_DOUBLE:
+    case TExprOpcode::EQ_STRINGVALUE_STRINGVALUE:
+    case TExprOpcode::EQ_TIMESTAMPVALUE_TIMESTAMPVALUE:
+      *op = TrevniBlockStats::EQ;
+      return true;
+    case TExprOpcode::LT_CHAR_CHAR:
+    case TExprOpcode::LT_SHORT_SHORT:
+    case TExprOpcode::LT_INT_INT:
+    case TExprOpcode::LT_LONG_LONG:
+    case TExprOpcode::LT_FLOAT_FLOAT:
+    case TExprOpcode::LT_DOUBLE_DOUBLE:
+    case TExprOpcode::LT_STRINGVALUE_STRINGVALUE:
+    case TExprOpcode::LT_TIMESTAMPVALUE_TIMESTAMPVALUE:
+      *op = TrevniBlockStats::LT;
+      return true;
+    case TExprOpcode::LE_CHAR_CHAR:
+    case TExprOpcode::LE_SHORT_SHORT:
+    case TExprOpcode::LE_INT_INT:
+    case TExprOpcode::LE_LONG_LONG:
+    case TExprOpcode::LE_FLOAT_FLOAT:
+    case TExprOpcode::LE_DOUBLE_DOUBLE:
+    case TExprOpcode::LE_STRINGVALUE_STRINGVALUE:
+    case TExprOpcode::LE_TIMESTAMPVALUE_TIMESTAMPVALUE:
+      *op = TrevniBlockStats::LE;
+      return true;
+    case TExprOpcode::GT_CHAR_CHAR:
+    case TExprOpcode::GT_SHORT_SHORT:
+    case TExprOpcode::GT_INT_INT:
+    case TExprOpcode::GT_LONG_LONG:
+    case TExprOpcode::GT_FLOAT_FLOAT:
+    case TExprOpcode::GT_DOUBLE_DOUBLE:
+    case TExprOpcode::GT_STRINGVALUE_STRINGVALUE:
+    case TExprOpcode::GT_TIMESTAMPVALUE_TIMESTAMPVALUE:
+      *op = TrevniBlockStats::GT;
+      return true;
+    case TExprOpcode::GE_CHAR_CHAR:
+    case TExprOpcode::GE_SHORT_SHORT:
+    case TExprOpcode::GE_INT_INT:
+    case TExprOpcode::GE_LONG_LONG:
+    case TExprOpcode::GE_FLOAT_FLOAT:
+    case TExprOpcode::GE_DOUBLE_DOUBLE:
+    case TExprOpcode::GE_STRINGVALUE_STRINGVALUE:
+    case TExprOpcode::GE_TIMESTAMPVALUE_TIMESTAMPVALUE:
+      *op = TrevniBlockStats::GE;
+      return true;
+    default:
+      return false;
+  }
+}
+
+void HdfsTrevniScanner::InitBlockPredicates() {
+  block_predicates_.clear();
+  const vector<SlotDescriptor*>& materialized_slots = scan_node_->materialized_slots();
+  for (int i = 0; i < num_conjuncts_; ++i) {
+    Expr* conjunct = conjuncts_[i];
+    TrevniBlockStats::Op op;
+    if (!GetStatsOp(conjunct->op(), &op) || conjunct->GetNumChildren() != 2) continue;
+    Expr* slot_ref = conjunct->GetChild(0);
+    Expr* constant = conjunct->GetChild(1);
+    if (!slot_ref->is_slotref()) {
+      // 'constant op column': flip it around.
+      swap(slot_ref, constant);
+      switch (op) {
+        case TrevniBlockStats::LT: op = TrevniBlockStats::GT; break;
+        case TrevniBlockStats::LE: op = TrevniBlockStats::GE; break;
+        case TrevniBlockStats::GT: op = TrevniBlockStats::LT; break;
+        case TrevniBlockStats::GE: op = TrevniBlockStats::LE; break;
+        default: break;
+      }
+    }
+    if (!slot_ref->is_slotref() || !constant->IsConstant()) continue;
+    if (slot_ref->type() != constant->type()) continue;
+
+    SlotId slot_id = static_cast<SlotRef*>(slot_ref)->slot_id();
+    int column_idx = -1;
+    for (int j = 0; j < materialized_slots.size(); ++j) {
+      if (materialized_slots[j]->id() == slot_id) {
+        column_idx = j;
+        break;
+      }
+    }
+    if (column_idx == -1) continue;
+
+    void* value = constant->GetValue(NULL);
+    if (value == NULL) continue;
+    BlockPredicate predicate;
+    predicate.column_idx = column_idx;
+    predicate.op = op;
+    predicate.type = slot_ref->type();
+    if (predicate.type == TYPE_STRING) {
+      StringValue* str = reinterpret_cast<StringValue*>(value);
+      predicate.value.assign(str->ptr, str->len);
+    } else {
+      predicate.value.assign(reinterpret_cast<char*>(value), GetByteSize(predicate.type));
+    }
+    block_predicates_.push_back(predicate);
+  }
+}
+
 Status HdfsTrevniScanner::Close() {
   return Status::OK;
 }
@@ -74,8 +190,46 @@ Status HdfsTrevniScanner::InitCurrentScanRange(HdfsPartitionDescriptor* hdfs_par
   RETURN_IF_ERROR(ReadFileHeader());
 
   // Read the column information for the columns we are interested in.
+  const vector<SlotDescriptor*>& materialized_slots = scan_node_->materialized_slots();
   for (int i = 0; i < column_info_.size(); ++i) {
-    RETURN_IF_ERROR(ReadColumnInfo(&column_info_[i]));
+    TrevniColumnInfo* column = &column_info_[i];
+    RETURN_IF_ERROR(ReadColumnInfo(column));
+
+    if (!column->encodings_metadata.empty()) {
+      if (column->encodings_metadata.size() != column->block_desc.size()) {
+        return FileReadError("Wrong number of block encodings for: " + column->name);
+      }
+      for (int j = 0; j < column->block_desc.size(); ++j) {
+        TrevniEncoding encoding =
+            static_cast<TrevniEncoding>(column->encodings_metadata[j]);
+        if (encoding != TREVNI_PLAIN && encoding != TREVNI_DICTIONARY) {
+          return FileReadError("Unknown block encoding for: " + column->name);
+        }
+        if (encoding == TREVNI_DICTIONARY && column->type != TREVNI_STRING &&
+            column->type != TREVNI_BYTES && column->type != TREVNI_INT &&
+            column->type != TREVNI_LONG) {
+          return FileReadError("Dictionary encoding not supported for: " + column->name);
+        }
+        column->block_desc[j].encoding = encoding;
+      }
+    }
+
+    if (column->stats_metadata.empty()) continue;
+
+    // The stats are only an optimization, the file can be read without them.
+    vector<TrevniBlockStats> stats;
+    Status status = TrevniBlockStats::Parse(
+        column->stats_metadata, materialized_slots[i]->type(), &stats);
+    if (status.ok() && stats.size() == column->block_desc.size()) {
+      for (int j = 0; j < stats.size(); ++j) {
+        column->block_desc[j].stats = stats[j];
+      }
+      column->has_stats = true;
+    } else {
+      VLOG_FILE << "Ignoring block stats of column " << column->name << " in file "
+                << current_byte_stream_->GetLocation() << ": "
+                << (status.ok() ? "wrong number of blocks" : status.GetErrorMsg());
+    }
   }
 
   return Status::OK;
@@ -132,7 +286,8 @@ Status HdfsTrevniScanner::ReadFileHeader() {
     column_info_[slot_idx].current_offset = buf[i];
     // Each column needs its own memory pool since we must hold on to each
     // columns block buffer when passing memory to our caller.
-    column_info_[slot_idx].mem_pool = object_pool_->Add(new MemPool());
+    column_info_[slot_idx].mem_pool =
+        object_pool_->Add(new MemPool(scan_node_->mem_tracker()));
   }
   return Status::OK;
 }
@@ -245,6 +400,12 @@ Status HdfsTrevniScanner::ReadColumnMetadata(int column_idx) {
           return FileReadError("Bad definition level specification: " + strval);
         }
         break;
+      case COL_STATS:
+        col_info->stats_metadata = value;
+        break;
+      case COL_ENCODINGS:
+        col_info->encodings_metadata = value;
+        break;
     }
   }
 
@@ -350,8 +511,8 @@ Status HdfsTrevniScanner::ReadCurrentBlock(TrevniColumnInfo* column) {
   }
   
   // The definition and repetition arrays are after the data.
+  uint8_t* bp = &column->buffer[block->size];
   if (column->max_def_level > 0) {
-    uint8_t* bp = &column->buffer[block->size];
     if (column->max_rep_level > 0) {
       int size = IntegerArray::IntegerSize(column->max_rep_level);
       int array_size = IntegerArray::ArraySize(size, block->row_count);
@@ -371,20 +532,17 @@ Status HdfsTrevniScanner::ReadCurrentBlock(TrevniColumnInfo* column) {
   }
   column->current_value = column->buffer;
   column->current_row_count = block->row_count;
+  column->value_matches = true;
+  column->has_dictionary_filter = false;
+  column->dictionary_block = block->encoding == TREVNI_DICTIONARY;
+  if (column->dictionary_block) {
+    RETURN_IF_ERROR(ReadDictionary(column - &column_info_[0], bp));
+  }
   ++column->current_block;
   RETURN_IF_ERROR(current_byte_stream_->GetPosition(&column->current_offset));
   return Status::OK;
 }
 
-Status HdfsTrevniScanner::FileReadError(const string& msg) {
-  if (state_->LogHasSpace()) {
-    stringstream ss;
-    ss << "file: " << current_byte_stream_->GetLocation() << ": " << msg;
-    state_->LogError(ss.str());
-  }
-  return Status(msg);
-}
-
 // Store a value into a slot, return true if there is overflow.
 template <typename T>
 bool WriteSlot(void* slot, int64_t value) {
@@ -393,168 +551,450 @@ bool WriteSlot(void* slot, int64_t value) {
   return val != value;
 }
 
-Status HdfsTrevniScanner::GetNext(RowBatch* row_batch, bool* eosr) {
-  AllocateTupleBuffer(row_batch);
-  // Indicates whether the current row has errors.
-  bool error_in_row = false;
-  string error_str;
-
-  if (scan_node_->ReachedLimit()) {
-    tuple_ = NULL;
-    *eosr = true;
-    return Status::OK;
+Status HdfsTrevniScanner::ReadDictionary(int column_idx, uint8_t* end) {
+  TrevniColumnInfo* column = &column_info_[column_idx];
+  const SlotDescriptor* slot_desc = scan_node_->materialized_slots()[column_idx];
+  const uint8_t* data = column->buffer;
+  int32_t num_entries;
+  // Every entry takes at least a byte.
+  if (!ReadWriteUtil::GetZInt(&data, end, &num_entries) || num_entries <= 0 ||
+      num_entries > end - data) {
+    return FileReadError("Bad dictionary size for: " + column->name);
   }
 
-  SCOPED_TIMER(scan_node_->materialize_tuple_timer());
-  // Index into current row in row_batch.
-  int row_idx = RowBatch::INVALID_ROW_INDEX;
-
-  while (!scan_node_->ReachedLimit() && !row_batch->IsFull() && row_count_ > 0) {
-    const vector<SlotDescriptor*>& materialized_slots = scan_node_->materialized_slots();
-    vector<SlotDescriptor*>::const_iterator it;
-
-    InitTuple(template_tuple_, tuple_);
-    TrevniColumnInfo* column = &column_info_[0];
-    for (it = materialized_slots.begin();
-         it != materialized_slots.end(); ++it, ++column) {
-      const SlotDescriptor* slot_desc = *it;
-
-      if (UNLIKELY(column->current_row_count == 0)) {
-        RETURN_IF_ERROR(ReadCurrentBlock(column));
+  bool is_string = column->type == TREVNI_STRING || column->type == TREVNI_BYTES;
+  if (is_string != (slot_desc->type() == TYPE_STRING)) {
+    return FileReadError("Dictionary type does not match the column: " + column->name);
+  }
+  column->dictionary_size = num_entries;
+  column->dictionary_value_size =
+      is_string ? sizeof(StringValue) : GetByteSize(slot_desc->type());
+  column->dictionary.resize(num_entries * column->dictionary_value_size);
+  column->dictionary_overflow.assign(num_entries, false);
+
+  for (int i = 0; i < num_entries; ++i) {
+    void* slot = &column->dictionary[i * column->dictionary_value_size];
+    int64_t value;
+    if (!ReadWriteUtil::GetZLong(&data, end, &value)) {
+      return FileReadError("Bad dictionary entry for: " + column->name);
+    }
+    if (is_string) {
+      if (value < 0 || value > end - data) {
+        return FileReadError("Bad dictionary entry for: " + column->name);
       }
+      StringValue* str_slot = reinterpret_cast<StringValue*>(slot);
+      str_slot->ptr = reinterpret_cast<char*>(const_cast<uint8_t*>(data));
+      str_slot->len = value;
+      data += value;
+      continue;
+    }
+    switch (slot_desc->type()) {
+      case TYPE_TINYINT:
+        column->dictionary_overflow[i] = WriteSlot<int8_t>(slot, value);
+        break;
+      case TYPE_SMALLINT:
+        column->dictionary_overflow[i] = WriteSlot<int16_t>(slot, value);
+        break;
+      case TYPE_INT:
+        column->dictionary_overflow[i] = WriteSlot<int32_t>(slot, value);
+        break;
+      case TYPE_BIGINT:
+        *reinterpret_cast<int64_t*>(slot) = value;
+        break;
+      default:
+        return FileReadError("Bad type for dictionary column: " + column->name);
+    }
+  }
+  column->codes.Reset(data, end, TrevniRleEncoder::BitWidth(num_entries));
+
+  // Evaluate the predicates on the column against each dictionary entry.
+  column->has_dictionary_filter = false;
+  column->dictionary_matches.assign(num_entries, true);
+  for (int i = 0; i < block_predicates_.size(); ++i) {
+    const BlockPredicate& predicate = block_predicates_[i];
+    if (predicate.column_idx != column_idx) continue;
+    column->has_dictionary_filter = true;
+    StringValue str;
+    const void* constant = predicate.GetValue(&str);
+    for (int j = 0; j < num_entries; ++j) {
+      if (!column->dictionary_matches[j]) continue;
+      column->dictionary_matches[j] = TrevniBlockStats::Eval(predicate.op,
+          &column->dictionary[j * column->dictionary_value_size], constant,
+          predicate.type);
+    }
+  }
+  column->num_dictionary_matches = 0;
+  for (int i = 0; i < num_entries; ++i) {
+    if (column->dictionary_matches[i]) ++column->num_dictionary_matches;
+  }
+  return Status::OK;
+}
 
-      if (column->ValueIsNull()) {
-        tuple_->SetNull(slot_desc->null_indicator_offset());
-        --column->current_row_count;
-        continue;
-      }
+Status HdfsTrevniScanner::FileReadError(const string& msg) {
+  if (state_->LogHasSpace()) {
+    stringstream ss;
+    ss << "file: " << current_byte_stream_->GetLocation() << ": " << msg;
+    state_->LogError(ss.str());
+  }
+  return Status(msg);
+}
 
-      void* slot = tuple_->GetSlot(slot_desc->tuple_offset());
-      if (column->type == TREVNI_BOOL) {
-        *reinterpret_cast<bool*>(slot) = column->bool_column.GetNextValue();
-      } else if (column->length == 0) {
-        // Handle variable length values.
-        int64_t value;
-        int len = ReadWriteUtil::GetZLong(column->current_value, &value);
-        column->current_value += len;
-        switch (column->type) {
-          case TREVNI_INT:
-          case TREVNI_LONG: {
-            switch (slot_desc->type()) {
-              case TYPE_TINYINT:
-                error_in_row = WriteSlot<int8_t>(slot, value);
-                break;
-              case TYPE_SMALLINT:
-                 error_in_row = WriteSlot<int16_t>(slot, value);
-                 break;
-              case TYPE_INT:
-                error_in_row = WriteSlot<int32_t>(slot, value);
-                break;
-              case TYPE_BIGINT:
-                *reinterpret_cast<int64_t*>(slot) = value;
-                break;
-              default:
-                DCHECK(false);
-                return Status("Bad type");
-            }
-            break;
-          }
-
-          // TODO: Does TREVNI_BYTES map to a data type?
-          case TREVNI_BYTES:
-          case TREVNI_STRING: {
-            StringValue* str_slot = reinterpret_cast<StringValue*>(slot);
-            str_slot->len = value;
-            if (!has_noncompact_strings_) {
-              char* slot_data = reinterpret_cast<char*>(tuple_pool_->Allocate(value));
-              memcpy(slot_data, column->current_value, str_slot->len);
-              str_slot->ptr = slot_data;
-            } else {
-              str_slot->ptr = reinterpret_cast<char*>(column->current_value);
-            }
-            column->current_value += value;
-            break;
-          }
-          default:
-            DCHECK(0);
-            return Status("Bad Trevni type");
-        }
-      } else {
-        // Fixed length types: They are read into an aligned buffer.
+bool HdfsTrevniScanner::ReadSlot(TrevniColumnInfo* column, 
+    const SlotDescriptor* slot_desc, Tuple* tuple, bool* error_in_row) {
+  DCHECK_GT(column->current_row_count, 0);
+  --column->current_row_count;
+  if (column->ValueIsNull()) {
+    tuple->SetNull(slot_desc->null_indicator_offset());
+    // Comparisons with NULL are never true.
+    column->value_matches = !column->has_dictionary_filter;
+    return true;
+  }
+
+  void* slot = tuple->GetSlot(slot_desc->tuple_offset());
+  column->value_matches = true;
+  if (column->dictionary_block) {
+    int32_t code;
+    if (!column->codes.GetNext(&code) || code < 0 || code >= column->dictionary_size) {
+      parse_status_ = FileReadError("Bad dictionary code for: " + column->name);
+      return false;
+    }
+    const uint8_t* entry = &column->dictionary[code * column->dictionary_value_size];
+    if (slot_desc->type() == TYPE_STRING && !has_noncompact_strings_) {
+      const StringValue* entry_str = reinterpret_cast<const StringValue*>(entry);
+      StringValue* str_slot = reinterpret_cast<StringValue*>(slot);
+      str_slot->len = entry_str->len;
+      str_slot->ptr = reinterpret_cast<char*>(tuple_pool_->Allocate(entry_str->len));
+      memcpy(str_slot->ptr, entry_str->ptr, entry_str->len);
+    } else {
+      memcpy(slot, entry, column->dictionary_value_size);
+    }
+    *error_in_row |= column->dictionary_overflow[code];
+    column->value_matches =
+        !column->has_dictionary_filter || column->dictionary_matches[code];
+  } else if (column->type == TREVNI_BOOL) {
+    *reinterpret_cast<bool*>(slot) = column->bool_column.GetNextValue();
+  } else if (column->length == 0) {
+    // Handle variable length values.
+    int64_t value;
+    int len = ReadWriteUtil::GetZLong(column->current_value, &value);
+    column->current_value += len;
+    switch (column->type) {
+      case TREVNI_INT:
+      case TREVNI_LONG: {
         switch (slot_desc->type()) {
           case TYPE_TINYINT:
-            *reinterpret_cast<int8_t*>(slot) =
-                *reinterpret_cast<int8_t*>(column->current_value);
+            *error_in_row |= WriteSlot<int8_t>(slot, value);
             break;
           case TYPE_SMALLINT:
-            *reinterpret_cast<int16_t*>(slot) =
-                *reinterpret_cast<int16_t*>(column->current_value);
+            *error_in_row |= WriteSlot<int16_t>(slot, value);
             break;
           case TYPE_INT:
-            *reinterpret_cast<int32_t*>(slot) =
-                *reinterpret_cast<int32_t*>(column->current_value);
+            *error_in_row |= WriteSlot<int32_t>(slot, value);
             break;
           case TYPE_BIGINT:
-            *reinterpret_cast<int64_t*>(slot) =
-                *reinterpret_cast<int64_t*>(column->current_value);
-            break;
-          case TYPE_FLOAT:
-            *reinterpret_cast<float*>(slot) =
-                *reinterpret_cast<float*>(column->current_value);
+            *reinterpret_cast<int64_t*>(slot) = value;
             break;
-          case TYPE_DOUBLE:
-            *reinterpret_cast<double*>(slot) =
-                *reinterpret_cast<double*>(column->current_value);
-            break;
-          case TYPE_TIMESTAMP: {
-            // This may not be aligned.
-            memcpy(slot, column->current_value, column->length);
-            break;
-          }
           default:
-            DCHECK(0);
-            return Status("Bad type");
+            DCHECK(false);
+            parse_status_ = Status("Bad type");
+            return false;
         }
-        column->current_value += column->length;
+        break;
       }
-      --column->current_row_count;
-    }
-    
-    if (error_in_row) {
-      error_in_row = false;
-      if (state_->LogHasSpace()) {
-        stringstream ss;
-        ss << "file " << current_byte_stream_->GetLocation() << error_str <<endl;
-        state_->LogError(ss.str());
+
+      // TODO: Does TREVNI_BYTES map to a data type?
+      case TREVNI_BYTES:
+      case TREVNI_STRING: {
+        StringValue* str_slot = reinterpret_cast<StringValue*>(slot);
+        str_slot->len = value;
+        if (!has_noncompact_strings_) {
+          char* slot_data = reinterpret_cast<char*>(tuple_pool_->Allocate(value));
+          memcpy(slot_data, column->current_value, str_slot->len);
+          str_slot->ptr = slot_data;
+        } else {
+          str_slot->ptr = reinterpret_cast<char*>(column->current_value);
+        }
+        column->current_value += value;
+        break;
       }
-      if (state_->abort_on_error()) {
-        state_->ReportFileErrors(current_byte_stream_->GetLocation(), 1);
-        return Status(state_->ErrorLog());
+      default:
+        DCHECK(0);
+        parse_status_ = Status("Bad Trevni type");
+        return false;
+    }
+  } else {
+    // Fixed length types: They are read into an aligned buffer.
+    switch (slot_desc->type()) {
+      case TYPE_TINYINT:
+        *reinterpret_cast<int8_t*>(slot) =
+            *reinterpret_cast<int8_t*>(column->current_value);
+        break;
+      case TYPE_SMALLINT:
+        *reinterpret_cast<int16_t*>(slot) =
+            *reinterpret_cast<int16_t*>(column->current_value);
+        break;
+      case TYPE_INT:
+        *reinterpret_cast<int32_t*>(slot) =
+            *reinterpret_cast<int32_t*>(column->current_value);
+        break;
+      case TYPE_BIGINT:
+        *reinterpret_cast<int64_t*>(slot) =
+            *reinterpret_cast<int64_t*>(column->current_value);
+        break;
+      case TYPE_FLOAT:
+        *reinterpret_cast<float*>(slot) =
+            *reinterpret_cast<float*>(column->current_value);
+        break;
+      case TYPE_DOUBLE:
+        *reinterpret_cast<double*>(slot) =
+            *reinterpret_cast<double*>(column->current_value);
+        break;
+      case TYPE_TIMESTAMP: {
+        // This may not be aligned.
+        memcpy(slot, column->current_value, column->length);
+        break;
       }
+      default:
+        DCHECK(0);
+        parse_status_ = Status("Bad type");
+        return false;
     }
-    --row_count_;
+    column->current_value += column->length;
+  }
+  return true;
+}
 
-    // TODO: The code from here down is more or less common to all scanners. Move it.
-    // We now have a complete row, with everything materialized
-    DCHECK(!row_batch->IsFull());
-    if (row_idx == RowBatch::INVALID_ROW_INDEX) {
-      row_idx = row_batch->AddRow();
+Status HdfsTrevniScanner::SkipRows(TrevniColumnInfo* column, int64_t num_rows) {
+  while (num_rows > 0) {
+    if (column->current_row_count == 0) {
+      // Step over whole blocks without reading them.
+      while (column->current_block < column->block_desc.size()) {
+        const TrevniBlockInfo& block = column->block_desc[column->current_block];
+        if (block.row_count > num_rows) break;
+        column->current_offset +=
+            column->decompressor == NULL ? block.size : block.compressed_size;
+        ++column->current_block;
+        num_rows -= block.row_count;
+      }
+      if (num_rows == 0) break;
+      RETURN_IF_ERROR(ReadCurrentBlock(column));
+    }
+    int num_block_rows = min<int64_t>(num_rows, column->current_row_count);
+
+    // Only non-null rows have a value in the column data.
+    int num_values = num_block_rows;
+    if (column->max_def_level > 0) {
+      num_values = 0;
+      for (int i = 0; i < num_block_rows; ++i) {
+        if (column->def_level.GetNextValue() >= column->max_def_level) ++num_values;
+      }
     }
-    TupleRow* current_row = row_batch->GetRow(row_idx);
-    current_row->SetTuple(scan_node_->tuple_idx(), tuple_);
 
-    // Evaluate the conjuncts and add the row to the batch
-    if (ExecNode::EvalConjuncts(conjuncts_, num_conjuncts_, current_row)) {
-      row_batch->CommitLastRow();
-      row_idx = RowBatch::INVALID_ROW_INDEX;
-      if (scan_node_->ReachedLimit() || row_batch->IsFull()) {
-        tuple_ = NULL;
+    if (column->dictionary_block) {
+      if (!column->codes.Skip(num_values)) {
+        return FileReadError("Bad dictionary codes for: " + column->name);
+      }
+    } else if (column->type == TREVNI_BOOL) {
+      column->bool_column.SkipValues(num_values);
+    } else if (column->length == 0) {
+      for (int i = 0; i < num_values; ++i) {
+        int64_t value;
+        column->current_value += ReadWriteUtil::GetZLong(column->current_value, &value);
+        // Strings are stored as their length followed by the bytes.
+        if (column->type == TREVNI_BYTES || column->type == TREVNI_STRING) {
+          column->current_value += value;
+        }
+      }
+    } else {
+      column->current_value += num_values * column->length;
+    }
+
+    column->current_row_count -= num_block_rows;
+    num_rows -= num_block_rows;
+  }
+  return Status::OK;
+}
+
+Status HdfsTrevniScanner::ReportRowError() {
+  if (state_->LogHasSpace()) {
+    stringstream ss;
+    ss << "file " << current_byte_stream_->GetLocation() << endl;
+    state_->LogError(ss.str());
+  }
+  if (state_->abort_on_error()) {
+    state_->ReportFileErrors(current_byte_stream_->GetLocation(), 1);
+    return Status(state_->ErrorLog());
+  }
+  return Status::OK;
+}
+
+Status HdfsTrevniScanner::SkipBlocks(int64_t* max_rows) {
+  while (row_count_ > 0) {
+    *max_rows = row_count_;
+    int64_t skip_rows = 0;
+    for (int i = 0; i < block_predicates_.size(); ++i) {
+      const BlockPredicate& predicate = block_predicates_[i];
+      TrevniColumnInfo* column = &column_info_[predicate.column_idx];
+
+      // The block the current row is in: the one partially read or the next one.
+      int block_idx = column->current_block;
+      int64_t rows_left;
+      if (column->current_row_count > 0) {
+        --block_idx;
+        rows_left = column->current_row_count;
+      } else if (block_idx < column->block_desc.size()) {
+        rows_left = column->block_desc[block_idx].row_count;
+      } else {
+        continue;
+      }
+      if (rows_left == 0) continue;
+
+      StringValue str;
+      const void* value = predicate.GetValue(&str);
+      const TrevniBlockInfo& block = column->block_desc[block_idx];
+      if (column->has_stats &&
+          !block.stats.MayMatch(predicate.op, value, predicate.type, block.row_count)) {
+        skip_rows = rows_left;
         break;
       }
-      uint8_t* new_tuple = reinterpret_cast<uint8_t*>(tuple_);
-      new_tuple += tuple_byte_size_;
-      tuple_ = reinterpret_cast<Tuple*>(new_tuple);
+      if (block.encoding == TREVNI_DICTIONARY) {
+        // The stats may be too coarse: check the dictionary, which is only read
+        // once the block is loaded.
+        if (column->current_row_count == 0) RETURN_IF_ERROR(ReadCurrentBlock(column));
+        if (column->num_dictionary_matches == 0) {
+          skip_rows = rows_left;
+          break;
+        }
+      }
+      *max_rows = min(*max_rows, rows_left);
     }
+    if (skip_rows == 0) break;
+
+    for (int i = 0; i < column_info_.size(); ++i) {
+      RETURN_IF_ERROR(SkipRows(&column_info_[i], skip_rows));
+    }
+    row_count_ -= skip_rows;
+    COUNTER_UPDATE(blocks_skipped_counter_, 1);
+  }
+  return Status::OK;
+}
+
+Status HdfsTrevniScanner::MaterializeRows(RowBatch* row_batch, int num_rows) {
+  const vector<SlotDescriptor*>& materialized_slots = scan_node_->materialized_slots();
+  for (int i = 0; i < num_rows; ++i) {
+    InitTuple(template_tuple_, GetTuple(i));
+  }
+
+  // Decode the predicate columns for all the rows that no dictionary filter has
+  // rejected yet.
+  rejected_rows_.assign(num_rows, false);
+  for (int col_idx = 0; col_idx < column_info_.size(); ++col_idx) {
+    if (!is_predicate_column_[col_idx]) continue;
+    TrevniColumnInfo* column = &column_info_[col_idx];
+    int next_row = 0;
+    for (int i = 0; i < num_rows; ++i) {
+      if (rejected_rows_[i]) continue;
+      RETURN_IF_ERROR(SkipRows(column, i - next_row));
+      next_row = i + 1;
+      if (UNLIKELY(column->current_row_count == 0)) {
+        RETURN_IF_ERROR(ReadCurrentBlock(column));
+      }
+      bool error_in_row = false;
+      if (!ReadSlot(column, materialized_slots[col_idx], GetTuple(i), &error_in_row)) {
+        return parse_status_;
+      }
+      if (UNLIKELY(error_in_row)) RETURN_IF_ERROR(ReportRowError());
+      if (!column->value_matches) rejected_rows_[i] = true;
+    }
+    RETURN_IF_ERROR(SkipRows(column, num_rows - next_row));
+  }
+
+  // Evaluate the conjuncts, moving the tuples that pass to the front of the tuple
+  // buffer so the remaining columns are decoded straight into their final tuples.
+  selected_rows_.clear();
+  if (num_conjuncts_ == 0) {
+    for (int i = 0; i < num_rows; ++i) {
+      if (rejected_rows_[i]) continue;
+      int dst = selected_rows_.size();
+      if (dst != i) memcpy(GetTuple(dst), GetTuple(i), tuple_byte_size_);
+      selected_rows_.push_back(i);
+    }
+  } else {
+    TupleRow* row = row_batch->GetRow(row_batch->AddRow());
+    for (int i = 0; i < num_rows; ++i) {
+      if (rejected_rows_[i]) continue;
+      row->SetTuple(scan_node_->tuple_idx(), GetTuple(i));
+      if (!ExecNode::EvalConjuncts(conjuncts_, num_conjuncts_, row)) continue;
+      int dst = selected_rows_.size();
+      if (dst != i) memcpy(GetTuple(dst), GetTuple(i), tuple_byte_size_);
+      selected_rows_.push_back(i);
+    }
+  }
+
+  // Decode the remaining columns for the selected rows only, skipping the values in
+  // between.
+  int num_selected = selected_rows_.size();
+  for (int col_idx = 0; col_idx < column_info_.size(); ++col_idx) {
+    if (is_predicate_column_[col_idx]) continue;
+    TrevniColumnInfo* column = &column_info_[col_idx];
+    int next_row = 0;
+    for (int i = 0; i < num_selected; ++i) {
+      RETURN_IF_ERROR(SkipRows(column, selected_rows_[i] - next_row));
+      if (UNLIKELY(column->current_row_count == 0)) {
+        RETURN_IF_ERROR(ReadCurrentBlock(column));
+      }
+      bool error_in_row = false;
+      if (!ReadSlot(column, materialized_slots[col_idx], GetTuple(i), &error_in_row)) {
+        return parse_status_;
+      }
+      if (UNLIKELY(error_in_row)) RETURN_IF_ERROR(ReportRowError());
+      next_row = selected_rows_[i] + 1;
+    }
+    RETURN_IF_ERROR(SkipRows(column, num_rows - next_row));
+  }
+  row_count_ -= num_rows;
+
+  // Add the rows that pass the runtime filters.  They can reference any slot so
+  // they are evaluated on the complete tuples.
+  for (int i = 0; i < num_selected; ++i) {
+    TupleRow* current_row = row_batch->GetRow(row_batch->AddRow());
+    current_row->SetTuple(scan_node_->tuple_idx(), GetTuple(i));
+    if (!EvalRuntimeFilters(current_row)) continue;
+    row_batch->CommitLastRow();
+    if (scan_node_->ReachedLimit()) break;
+  }
+  tuple_ = GetTuple(num_selected);
+  return Status::OK;
+}
+
+Status HdfsTrevniScanner::GetNext(RowBatch* row_batch, bool* eosr) {
+  if (scan_node_->ReachedLimit()) {
+    tuple_ = NULL;
+    *eosr = true;
+    return Status::OK;
+  }
+
+  SCOPED_TIMER(scan_node_->materialize_tuple_timer());
+
+  while (!scan_node_->ReachedLimit() && !row_batch->IsFull() && row_count_ > 0) {
+    int64_t block_rows;
+    RETURN_IF_ERROR(SkipBlocks(&block_rows));
+    if (row_count_ == 0) break;
+
+    AllocateTupleBuffer(row_batch);
+    int64_t batch_rows = row_batch->capacity() - row_batch->num_rows();
+    int num_rows = min(min(batch_rows, row_count_), block_rows);
+    if (tuple_byte_size_ > 0) {
+      int tuples_left = (tuple_buffer_ + tuple_buffer_size_ - 
+          reinterpret_cast<uint8_t*>(tuple_)) / tuple_byte_size_;
+      if (tuples_left == 0) {
+        // Rows that failed the runtime filters used up the tuple buffer.
+        tuple_ = NULL;
+        continue;
+      }
+      num_rows = min(num_rows, tuples_left);
+    }
+    RETURN_IF_ERROR(MaterializeRows(row_batch, num_rows));
   }
 
   if (scan_node_->ReachedLimit() || row_count_ == 0) {
@@ -566,6 +1006,8 @@ Status HdfsTrevniScanner::GetNext(RowBatch* row_batch, bool* eosr) {
     // The current row_batch is full, but we haven't yet reached our limit.
     *eosr = false;
   }
+  // The tuple buffer goes to row_batch with the pool below.
+  tuple_ = NULL;
 
   // Maintain ownership of last memory chunk if not at the end of the scan range.
   if (has_noncompact_strings_) {
@@ -6,6 +6,9 @@
 #include "exec/hdfs-scanner.h"
 #include "exec/delimited-text-parser.h"
 #include "exec/trevni-def.h"
+#include "exec/trevni-block-stats.h"
+#include "exec/trevni-encoding.h"
+#include "runtime/string-value.h"
 #include "util/integer-array.h"
 
 namespace impala {
@@ -13,6 +16,18 @@ namespace impala {
 // This scanner parses Trevni file located in HDFS, and writes the
 // content as tuples in the Impala in-memory representation of data, e.g.
 // (tuples, rows, row batches).
+// Rows are materialized a column at a time, a row batch's worth of rows at a time.
+// The columns referenced by the conjuncts are decoded first, for every row, and the
+// conjuncts are evaluated.  The other columns are only decoded for the rows that
+// passed; the values of the rows that did not are skipped over without decoding
+// them.
+// Files written by Impala have per-block statistics for each column.  Blocks whose
+// statistics show that no row can pass a simple comparison conjunct (column op
+// constant) are skipped, in all columns, without being read or decompressed.
+// Dictionary encoded blocks are decoded by looking up each value's code in the
+// block's dictionary.  The comparison conjuncts on the column are evaluated once per
+// dictionary entry; rows whose code fails them are dropped without evaluating the
+// conjuncts or decoding their other columns.
 class HdfsTrevniScanner : public HdfsScanner {
  public:
   HdfsTrevniScanner(HdfsScanNode* scan_node, RuntimeState* state, MemPool* tuple_pool);
@@ -29,7 +44,8 @@ class HdfsTrevniScanner : public HdfsScanner {
         : row_count(),
           size(0),
           compressed_size(0),
-          first_value(NULL) {
+          first_value(NULL),
+          encoding(TREVNI_PLAIN) {
     }
     // Number of rows in this block;
     int32_t row_count; 
@@ -43,6 +59,12 @@ class HdfsTrevniScanner : public HdfsScanner {
     // first value in block.
     // TODO: implement optional storing of first value.
     void* first_value; 
+
+    // Null count and min/max of the values in this block, if the file has them.
+    TrevniBlockStats stats;
+
+    // How the values of the block are encoded.
+    TrevniEncoding encoding;
   };
 
   // Per-column Information.
@@ -57,6 +79,13 @@ class HdfsTrevniScanner : public HdfsScanner {
           max_rep_level(0),
           max_def_level(0),
           decompressor(NULL),
+          has_stats(false),
+          dictionary_block(false),
+          dictionary_size(0),
+          dictionary_value_size(0),
+          has_dictionary_filter(false),
+          num_dictionary_matches(0),
+          value_matches(true),
           current_buffer_size(0),
           buffer(NULL) {
     }
@@ -112,6 +141,43 @@ class HdfsTrevniScanner : public HdfsScanner {
     // Descriptor for each block.
     std::vector<TrevniBlockInfo> block_desc;
 
+    // The impala.stats metadata, if any, parsed into block_desc by ReadColumnInfo().
+    std::vector<uint8_t> stats_metadata;
+
+    // True if the blocks in block_desc have stats.
+    bool has_stats;
+
+    // The impala.encodings metadata, if any, parsed into block_desc by
+    // InitCurrentScanRange().
+    std::vector<uint8_t> encodings_metadata;
+
+    // True if the current block is dictionary encoded.
+    bool dictionary_block;
+
+    // The dictionary of the current block: dictionary_size values of
+    // dictionary_value_size bytes each, in the slot representation.  String values
+    // point into buffer.
+    std::vector<uint8_t> dictionary;
+    int dictionary_size;
+    int dictionary_value_size;
+
+    // For each dictionary entry, true if the value is too big for the slot.
+    std::vector<bool> dictionary_overflow;
+
+    // True if there are block predicates on this column, in which case
+    // dictionary_matches has, for each dictionary entry, whether the value passes
+    // them.
+    bool has_dictionary_filter;
+    std::vector<bool> dictionary_matches;
+    int num_dictionary_matches;
+
+    // Set by ReadSlot(): false if the value it read can't pass the block predicates
+    // (it is null or its dictionary entry failed them).
+    bool value_matches;
+
+    // Decoder for the dictionary codes of the current block.
+    TrevniRleDecoder codes;
+
     // Memory pool for buffer for this column. If the column contains strings
     // then the memory may get passed to the row batch.
     MemPool* mem_pool;
@@ -201,6 +267,70 @@ class HdfsTrevniScanner : public HdfsScanner {
   // Read the current block for column.
   Status ReadCurrentBlock(TrevniColumnInfo* column);
 
+  // Reads the dictionary at the start of the values of the current block of
+  // column_info_[column_idx], which end at 'end', and sets up the code decoder.
+  // Evaluates the block predicates on the column against the dictionary.
+  Status ReadDictionary(int column_idx, uint8_t* end);
+
+  // Materializes the next 'num_rows' rows of the file into tuples starting at tuple_
+  // and adds the ones that pass the conjuncts to row_batch.  There must be room for
+  // 'num_rows' rows in row_batch and for 'num_rows' tuples in the tuple buffer.
+  Status MaterializeRows(RowBatch* row_batch, int num_rows);
+
+  // Decodes the next value of 'column' into the slot for 'slot_desc' in 'tuple'.
+  // The column's current block must have rows left.  Sets *error_in_row if the
+  // value does not fit in the slot.  Returns false and sets parse_status_ if the
+  // column can't be decoded into the slot type.
+  bool ReadSlot(TrevniColumnInfo* column, const SlotDescriptor* slot_desc, Tuple* tuple,
+      bool* error_in_row);
+
+  // Skips over the next 'num_rows' values of 'column', reading new blocks as needed.
+  // Blocks that are skipped entirely are not read.
+  Status SkipRows(TrevniColumnInfo* column, int64_t num_rows);
+
+  // A conjunct of the form 'column op constant' that can be evaluated against the
+  // block stats.
+  struct BlockPredicate {
+    // Index into column_info_.
+    int column_idx;
+
+    TrevniBlockStats::Op op;
+
+    PrimitiveType type;
+
+    // The constant in its slot representation.  For strings, the string bytes.
+    std::string value;
+
+    // Returns a pointer to the slot representation of the constant.  For strings,
+    // that is 'str', which is set to point to value.
+    const void* GetValue(StringValue* str) const {
+      if (type != TYPE_STRING) return value.data();
+      str->ptr = const_cast<char*>(value.data());
+      str->len = value.size();
+      return str;
+    }
+  };
+
+  // Collects the conjuncts that can be evaluated against the block stats into
+  // block_predicates_.
+  void InitBlockPredicates();
+
+  // Skips the rows of the blocks, starting at the current row, that the block stats
+  // show can't pass block_predicates_.  Sets *max_rows to the number of rows from the
+  // new current row to the end of the first block of a predicate column, so that the
+  // next block can be checked before it is read.
+  Status SkipBlocks(int64_t* max_rows);
+
+  // Logs a row with a value that didn't fit in its slot.  Returns an error if the
+  // query should abort.
+  Status ReportRowError();
+
+  // Returns the i-th tuple starting at tuple_.
+  Tuple* GetTuple(int i) {
+    return reinterpret_cast<Tuple*>(reinterpret_cast<uint8_t*>(tuple_) + 
+        i * tuple_byte_size_);
+  }
+
   // The default decompressor class to use.
   Codec* decompressor_;
 
@@ -229,6 +359,24 @@ class HdfsTrevniScanner : public HdfsScanner {
 
   // Object pool for holding decompressors.
   boost::scoped_ptr<ObjectPool> object_pool_;
+
+  // True for the columns (indexed like column_info_) that are referenced by the
+  // conjuncts.  These are decoded for every row; the others only for rows that pass.
+  std::vector<bool> is_predicate_column_;
+
+  // Indices (relative to tuple_) of the rows in the current MaterializeRows() call
+  // that passed the conjuncts.
+  std::vector<int> selected_rows_;
+
+  // For each row in the current MaterializeRows() call, true if a value of the row
+  // failed a dictionary filter, so the row can't pass the conjuncts.
+  std::vector<bool> rejected_rows_;
+
+  // The conjuncts that are evaluated against the block stats.
+  std::vector<BlockPredicate> block_predicates_;
+
+  // Number of blocks (of a predicate column) skipped using the block stats.
+  RuntimeProfile::Counter* blocks_skipped_counter_;
 };
 
 } // namespace impala
@@ -2,6 +2,7 @@
 
 #include "exec/hdfs-trevni-table-writer.h"
 #include "exec/read-write-util.h"
+#include "exec/trevni-encoding.h"
 #include "exec/exec-node.h"
 #include "util/hdfs-util.h"
 #include "exprs/expr.h"
@@ -24,6 +25,11 @@ using namespace std;
 using namespace boost;
 using namespace boost::assign;
 
+DEFINE_bool(trevni_dictionary_encoding, false,
+    "If true, the Trevni writer dictionary encodes the blocks of string, int and long "
+    "columns when that is smaller.  Dictionary encoded blocks are an Impala extension, "
+    "files with them can only be read by Impala.");
+
 namespace impala {
 HdfsTrevniTableWriter::HdfsTrevniTableWriter(RuntimeState* state, OutputPartition* output,
                                              const HdfsPartitionDescriptor* part_desc,
@@ -54,6 +60,9 @@ Status HdfsTrevniTableWriter::Init() {
     tm = type_map_trevni.find(output_exprs_[j]->type());
     DCHECK(tm != type_map_trevni.end());
     columns_[j].type = tm->second;
+    columns_[j].value_type = output_exprs_[j]->type();
+    columns_[j].use_dictionary =
+        FLAGS_trevni_dictionary_encoding && SupportsDictionary(columns_[j].type);
     columns_[j].type_length = GetTrevniTypeLength(columns_[j].type);
     // Make up a name for the column.
     char buf[16];
@@ -77,6 +86,8 @@ Status HdfsTrevniTableWriter::Init() {
 Status HdfsTrevniTableWriter::ResetColumns() {
   for (int i = 0; i < columns_.size(); ++i) {
     columns_[i].block_desc.clear();
+    columns_[i].use_dictionary =
+        FLAGS_trevni_dictionary_encoding && SupportsDictionary(columns_[i].type);
     TrevniBlockInfo* block;
     RETURN_IF_ERROR(CreateNewBlock(&columns_[i], &block));
   }
@@ -108,6 +119,12 @@ void HdfsTrevniTableWriter::SetHeaderFileSize() {
     bytes_added_ += sizeof(int32_t);
     // Just use the biggest type name.
     bytes_added_ += sizeof("timestamp") + 1;
+    // The block stats, their size is added as blocks are created.
+    bytes_added_ += TREVNI_STATS.size() + 1;
+    bytes_added_ += 2 * ReadWriteUtil::MAX_ZINT_LEN;
+    // The block encodings, one byte per block is added as blocks are created.
+    bytes_added_ += TREVNI_ENCODINGS.size() + 1;
+    bytes_added_ += ReadWriteUtil::MAX_ZINT_LEN;
     if (columns_[i].max_def_level > 0) {
       bytes_added_ += sizeof(TREVNI_DEFINITION) + 1;
       // assume the definition level is not more than 2 digits.
@@ -125,10 +142,16 @@ Status HdfsTrevniTableWriter::CreateNewBlock(TrevniColumnInfo* column,
                                              TrevniBlockInfo** blockp) {
   *blockp = NULL;
   uint8_t* buffer = NULL;
-  if (column->compressor != NULL && !column->block_desc.empty()) {
+  if (!column->block_desc.empty()) {
     TrevniBlockInfo* previous_block = &column->block_desc.back();
-    buffer = previous_block->data;
-    RETURN_IF_ERROR(CompressBlock(column, previous_block));
+    if (column->compressor != NULL) {
+      // The plain data buffer can be reused once the block is compressed.
+      buffer = previous_block->data;
+      FinishBlock(column, previous_block);
+      RETURN_IF_ERROR(CompressBlock(column, previous_block));
+    } else {
+      FinishBlock(column, previous_block);
+    }
   }
   column->block_desc.resize(column->block_desc.size() + 1);
   TrevniBlockInfo* block = &column->block_desc.back();
@@ -136,6 +159,9 @@ Status HdfsTrevniTableWriter::CreateNewBlock(TrevniColumnInfo* column,
   // If we are over the limit just return.
   bytes_added_ += sizeof(block->row_count) +
       sizeof(block->size) + sizeof(block->compressed_size);
+  bytes_added_ += TrevniBlockStats::MaxSerializedSize(column->value_type);
+  // The block's encoding.
+  ++bytes_added_;
   if (bytes_added_ > file_limit_ && file_limit_ != 0)  return Status::OK;
 
   // The limit is the amount of the block that is not taken up by the arrays.
@@ -200,6 +226,86 @@ Status HdfsTrevniTableWriter::CreateNewBlock(TrevniColumnInfo* column,
   return Status::OK;
 }
 
+void HdfsTrevniTableWriter::AddDictionaryValue(TrevniColumnInfo* column, void* value) {
+  // The dictionary is keyed on the plain encoding of the values.
+  uint8_t buf[ReadWriteUtil::MAX_ZLONG_LEN];
+  string key;
+  switch (column->type) {
+    case TREVNI_STRING: {
+      const StringValue* string_val = reinterpret_cast<StringValue*>(value);
+      int len = ReadWriteUtil::PutZInt(string_val->len, buf);
+      key.reserve(len + string_val->len);
+      key.assign(reinterpret_cast<char*>(buf), len);
+      key.append(string_val->ptr, string_val->len);
+      break;
+    }
+    case TREVNI_INT: {
+      int len = ReadWriteUtil::PutZInt(*reinterpret_cast<int32_t*>(value), buf);
+      key.assign(reinterpret_cast<char*>(buf), len);
+      break;
+    }
+    case TREVNI_LONG: {
+      int len = ReadWriteUtil::PutZLong(*reinterpret_cast<int64_t*>(value), buf);
+      key.assign(reinterpret_cast<char*>(buf), len);
+      break;
+    }
+    default:
+      DCHECK(false) << "Dictionary encoding not supported for column " << column->name;
+      return;
+  }
+
+  boost::unordered_map<string, int32_t>::iterator it = column->dictionary.find(key);
+  if (it != column->dictionary.end()) {
+    column->codes.push_back(it->second);
+    return;
+  }
+  if (column->dictionary_values.size() + key.size() > MAX_DICTIONARY_BYTES) {
+    // Too many distinct values for a dictionary to pay off.
+    column->use_dictionary = false;
+    column->dictionary.clear();
+    column->dictionary_values.clear();
+    column->codes.clear();
+    return;
+  }
+  int32_t code = column->dictionary.size();
+  column->dictionary[key] = code;
+  column->dictionary_values.insert(
+      column->dictionary_values.end(), key.begin(), key.end());
+  column->codes.push_back(code);
+}
+
+void HdfsTrevniTableWriter::FinishBlock(TrevniColumnInfo* column,
+                                        TrevniBlockInfo* block) {
+  if (column->use_dictionary && !column->codes.empty()) {
+    vector<uint8_t> encoded;
+    uint8_t buf[ReadWriteUtil::MAX_ZINT_LEN];
+    int len = ReadWriteUtil::PutZInt(column->dictionary.size(), buf);
+    encoded.insert(encoded.end(), buf, buf + len);
+    encoded.insert(encoded.end(),
+        column->dictionary_values.begin(), column->dictionary_values.end());
+    TrevniRleEncoder::Encode(column->codes,
+        TrevniRleEncoder::BitWidth(column->dictionary.size()), &encoded);
+
+    if (encoded.size() < block->size) {
+      // Leave room for the level arrays, CompressBlock() appends them to the data.
+      int level_bytes = 0;
+      if (column->max_def_level > 0) {
+        level_bytes += block->def_level.CurrentByteCount();
+        if (column->max_rep_level > 0) level_bytes += block->rep_level.CurrentByteCount();
+      }
+      uint8_t* data = col_mem_pool_->Allocate(encoded.size() + level_bytes);
+      memcpy(data, &encoded[0], encoded.size());
+      bytes_added_ -= block->size - encoded.size();
+      block->data = data;
+      block->size = encoded.size();
+      block->encoding = TREVNI_DICTIONARY;
+    }
+  }
+  column->dictionary.clear();
+  column->dictionary_values.clear();
+  column->codes.clear();
+}
+
 Status HdfsTrevniTableWriter::CompressBlock(TrevniColumnInfo* column,
                                             TrevniBlockInfo* block) {
   // Copy the levels array to the end of the block.
@@ -395,6 +501,8 @@ Status HdfsTrevniTableWriter::AppendRowBatch(RowBatch* batch,
         *new_file = true;
         return Status::OK;
       }
+      if (value != NULL && column->use_dictionary) AddDictionaryValue(column, value);
+      block->stats.Update(value, column->value_type);
       ++block->row_count;
     }
     ++row_count_;
@@ -420,6 +528,16 @@ Status HdfsTrevniTableWriter::Finalize() {
 }
 
 Status HdfsTrevniTableWriter::WriteFileHeader() {
+  // Finish the last block of each column, its encoding and size are part of the
+  // header.
+  for (int i = 0; i < columns_.size(); ++i) {
+    TrevniColumnInfo* column = &columns_[i];
+    FinishBlock(column, &column->block_desc.back());
+    if (column->compressor != NULL) {
+      RETURN_IF_ERROR(CompressBlock(column, &column->block_desc.back()));
+    }
+  }
+
   RETURN_IF_ERROR(Write(TREVNI_VERSION_HEADER, sizeof(TREVNI_VERSION_HEADER)));
   RETURN_IF_ERROR(WriteLong(row_count_));
   RETURN_IF_ERROR(WriteInt(columns_.size()));
@@ -438,10 +556,6 @@ Status HdfsTrevniTableWriter::WriteFileHeader() {
     RETURN_IF_ERROR(WriteLong(start));
 
     TrevniColumnInfo* column = &columns_[i];
-    // Compress the last block if needed.
-    if (column->compressor != NULL && !column->block_desc.empty()) {
-      RETURN_IF_ERROR(CompressBlock(column, &column->block_desc.back()));
-    }
     start += sizeof(int32_t);
 
     // Account for the size of each block.
@@ -471,11 +585,6 @@ Status HdfsTrevniTableWriter::WriteFileHeader() {
   }
   // Write out the value for the last column.
   RETURN_IF_ERROR(WriteLong(start));
-  TrevniColumnInfo* column = &columns_[columns_.size() - 1];
-  // Compress the last block if needed.
-  if (column->compressor != NULL && !column->block_desc.empty()) {
-    RETURN_IF_ERROR(CompressBlock(column, &column->block_desc.back()));
-  }
   return Status::OK;
 }
 
@@ -492,8 +601,8 @@ Status HdfsTrevniTableWriter::WriteFileMetadata() {
 }
 
 Status HdfsTrevniTableWriter::WriteColumnMetadata(TrevniColumnInfo* column) {
-  // Every column has a name and type in the metadata.
-  int count = 2;
+  // Every column has a name, type, block stats and block encodings in the metadata.
+  int count = 4;
   if (column->max_def_level > 0) ++count;
   if (column->max_rep_level > 0) ++count;
   // TODO: include column specific codec
@@ -519,6 +628,21 @@ Status HdfsTrevniTableWriter::WriteColumnMetadata(TrevniColumnInfo* column) {
       RETURN_IF_ERROR(WriteString(rs.str()));
     }
   }
+
+  vector<uint8_t> stats;
+  TrevniBlockStats::AppendHeader(column->value_type, &stats);
+  for (int i = 0; i < column->block_desc.size(); ++i) {
+    column->block_desc[i].stats.AppendStats(column->value_type, &stats);
+  }
+  RETURN_IF_ERROR(WriteString(TREVNI_STATS));
+  RETURN_IF_ERROR(WriteBytes(stats));
+
+  vector<uint8_t> encodings;
+  for (int i = 0; i < column->block_desc.size(); ++i) {
+    encodings.push_back(column->block_desc[i].encoding);
+  }
+  RETURN_IF_ERROR(WriteString(TREVNI_ENCODINGS));
+  RETURN_IF_ERROR(WriteBytes(encodings));
   return Status::OK;
 }
 
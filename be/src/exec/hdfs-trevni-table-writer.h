@@ -7,12 +7,14 @@
 
 #include <hdfs.h>
 #include <boost/scoped_ptr.hpp>
+#include <boost/unordered_map.hpp>
 
 #include "util/integer-array.h"
 #include "util/compress.h"
 #include "runtime/descriptors.h"
 #include "exec/hdfs-table-writer.h"
 #include "exec/trevni-def.h"
+#include "exec/trevni-block-stats.h"
 
 namespace impala {
 
@@ -47,6 +49,10 @@ class HdfsTrevniTableWriter : public HdfsTableWriter {
  private:
   static const int BLOCK_SIZE = 64 * 1024;
 
+  // Largest size of the plain encoded dictionary of a block.  Once a block's
+  // dictionary grows past it, the rest of the column in the file is plain encoded.
+  static const int MAX_DICTIONARY_BYTES = BLOCK_SIZE / 4;
+
   // Per-block information.
   struct TrevniBlockInfo {
     TrevniBlockInfo()
@@ -56,7 +62,8 @@ class HdfsTrevniTableWriter : public HdfsTableWriter {
           compressed_size(0),
           first_value(NULL),
           data(NULL),
-          compressed_data(NULL) {
+          compressed_data(NULL),
+          encoding(TREVNI_PLAIN) {
     }
 
     // Number of rows in this block;
@@ -94,12 +101,19 @@ class HdfsTrevniTableWriter : public HdfsTableWriter {
 
     // Compressed data.
     uint8_t* compressed_data;
+
+    // Null count and min/max of the values in this block.
+    TrevniBlockStats stats;
+
+    // How the values in data are encoded.
+    TrevniEncoding encoding;
   };
 
   // Per-column Information.
   struct TrevniColumnInfo {
     TrevniColumnInfo() 
         : type(TREVNI_UNDEFINED),
+          value_type(INVALID_TYPE),
           type_length(0),
           has_values(false),
           is_array(false),
@@ -107,7 +121,8 @@ class HdfsTrevniTableWriter : public HdfsTableWriter {
           max_rep_level(0),
           has_crc(false),
           compressor(NULL),
-          current_value(NULL) {
+          current_value(NULL),
+          use_dictionary(false) {
       }
 
     // Offset of this column in file.
@@ -116,6 +131,9 @@ class HdfsTrevniTableWriter : public HdfsTableWriter {
     // Type of this column.
     TrevniType type;
 
+    // Impala type of the values in this column.
+    PrimitiveType value_type;
+
     // Length of the column data type, 0 implies variable length;
     int type_length;
 
@@ -152,6 +170,21 @@ class HdfsTrevniTableWriter : public HdfsTableWriter {
 
     // Limit on the number of data bytes to go into the current buffer.
     int32_t limit;
+
+    // True if a dictionary is built for the current block.  The values are always
+    // written plain as well; when the block is done the dictionary encoding is used
+    // instead if it is smaller.
+    bool use_dictionary;
+
+    // Dictionary of the current block: the plain encoding of each distinct value,
+    // mapped to its code.
+    boost::unordered_map<std::string, int32_t> dictionary;
+
+    // The plain encoded dictionary entries, in code order.
+    std::vector<uint8_t> dictionary_values;
+
+    // Dictionary codes of the non-null values in the current block.
+    std::vector<int32_t> codes;
   };
 
   // Create and return a new initialized block descriptor and data buffer
@@ -216,6 +249,20 @@ class HdfsTrevniTableWriter : public HdfsTableWriter {
   Status AppendFixedLengthValue(void* value,
                                 TrevniColumnInfo* column, TrevniBlockInfo** block);
 
+  // Returns true if columns of 'type' can be dictionary encoded.
+  static bool SupportsDictionary(TrevniType type) {
+    return type == TREVNI_STRING || type == TREVNI_INT || type == TREVNI_LONG;
+  }
+
+  // Add a non-null value of the current row to the dictionary of the current block.
+  // Stops dictionary encoding the column if the dictionary gets too big.
+  void AddDictionaryValue(TrevniColumnInfo* column, void* value);
+
+  // Called when no more values will be added to 'block'.  Replaces the plain data
+  // of the block by the dictionary encoding if that is smaller, and clears the
+  // column's dictionary.  Updates bytes_added_.
+  void FinishBlock(TrevniColumnInfo* column, TrevniBlockInfo* block);
+
   // Compress a block of data.
   // First the definition and repetition arrays, if any are copied
   // to the end of the block.  bytes_added_ is updated with the space
@@ -96,7 +96,8 @@ Status MergeNode::GetNext(RuntimeState* state, RowBatch* row_batch, bool* eos) {
     if (child_row_batch_.get() == NULL) {
       RETURN_IF_CANCELLED(state);
       child_row_batch_.reset(
-          new RowBatch(child(child_idx_)->row_desc(), state->batch_size()));
+          new RowBatch(child(child_idx_)->row_desc(), state->batch_size(),
+              mem_tracker()));
       // Open child and fetch the first row batch.
       RETURN_IF_ERROR(child(child_idx_)->Open(state));
       RETURN_IF_ERROR(child(child_idx_)->GetNext(state, child_row_batch_.get(),
@@ -3,6 +3,9 @@
 #include "exec/read-write-util.h"
 #include "exec/byte-stream.h"
 
+#include <string.h>
+#include <algorithm>
+
 using namespace std;
 using namespace impala;
 
@@ -38,6 +41,31 @@ Status ReadWriteUtil::ReadZInt(ByteStream* byte_stream, int32_t* integer) {
   return Status::OK;
 }
 
+bool ReadWriteUtil::GetZInt(const uint8_t** buf, const uint8_t* end, int32_t* integer) {
+  // Copy the bytes out so GetZInt() can't read past 'end'.
+  uint8_t zint[MAX_ZINT_LEN];
+  int len = min<int64_t>(end - *buf, MAX_ZINT_LEN);
+  if (len <= 0) return false;
+  memset(zint, 0, MAX_ZINT_LEN);
+  memcpy(zint, *buf, len);
+  int zint_len = GetZInt(zint, integer);
+  if (zint_len > len) return false;
+  *buf += zint_len;
+  return true;
+}
+
+bool ReadWriteUtil::GetZLong(const uint8_t** buf, const uint8_t* end, int64_t* value) {
+  uint8_t zlong[MAX_ZLONG_LEN];
+  int len = min<int64_t>(end - *buf, MAX_ZLONG_LEN);
+  if (len <= 0) return false;
+  memset(zlong, 0, MAX_ZLONG_LEN);
+  memcpy(zlong, *buf, len);
+  int zlong_len = GetZLong(zlong, value);
+  if (zlong_len > len) return false;
+  *buf += zlong_len;
+  return true;
+}
+
 Status ReadWriteUtil::ReadString(ByteStream* byte_stream, string* str) {
   int64_t len;
   RETURN_IF_ERROR(ReadZLong(byte_stream, &len));
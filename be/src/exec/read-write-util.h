@@ -91,6 +91,14 @@ class ReadWriteUtil {
     return bp - buf;
   }
 
+  // Get a zigzag encoded integer from the buffer at *buf, which ends at 'end', and
+  // advance *buf past it.  Returns false if the encoding runs past 'end'.
+  static bool GetZInt(const uint8_t** buf, const uint8_t* end, int32_t* integer);
+
+  // Get a zigzag encoded long integer from the buffer at *buf, which ends at 'end',
+  // and advance *buf past it.  Returns false if the encoding runs past 'end'.
+  static bool GetZLong(const uint8_t** buf, const uint8_t* end, int64_t* value);
+
   // Read a zigzag encoded integer from the current byte stream.
   static Status ReadZInt(ByteStream* byte_stream, int32_t* integer);
 
@@ -2,6 +2,9 @@
 
 #include "exec/scan-range-context.h"
 
+#include <algorithm>
+
+#include "exec/exec-node.h"
 #include "exec/hdfs-scan-node.h"
 #include "runtime/row-batch.h"
 #include "runtime/mem-pool.h"
@@ -24,7 +27,10 @@ ScanRangeContext::ScanRangeContext(RuntimeState* state, HdfsScanNode* scan_node,
     current_buffer_pos_(NULL),
     total_bytes_returned_(0),
     read_past_buffer_size_(DEFAULT_READ_PAST_SIZE),
-    boundary_pool_(new MemPool()),
+    batch_conjuncts_(NULL),
+    num_batch_conjuncts_(0),
+    pre_aggregator_(NULL),
+    boundary_pool_(new MemPool(scan_node->mem_tracker())),
     boundary_buffer_(new StringBuffer(boundary_pool_.get())),
     cancelled_(false),
     read_eosr_(false),
@@ -48,9 +54,14 @@ ScanRangeContext::~ScanRangeContext() {
 }
 
 void ScanRangeContext::NewRowBatch() {
-  current_row_batch_ = new RowBatch(scan_node_->row_desc(), state_->batch_size());
+  current_row_batch_ = new RowBatch(scan_node_->row_desc(), state_->batch_size(),
+      scan_node_->mem_tracker());
+  // The batch conjuncts only narrow the selection.  HdfsScanNode::GetNext() compacts
+  // the batch if its consumer doesn't handle selections.
+  current_row_batch_->set_selection_enabled(true);
   tuple_mem_ = current_row_batch_->tuple_data_pool()->Allocate(
       state_->batch_size() * tuple_byte_size_);
+  tuple_mem_end_ = tuple_mem_ + state_->batch_size() * tuple_byte_size_;
 }
 
 void ScanRangeContext::AttachCompletedResources(bool done) {
@@ -71,13 +82,31 @@ void ScanRangeContext::AttachCompletedResources(bool done) {
   }
 
   // If there are any rows or any io buffers, pass this batch to the scan node.
-  if (current_row_batch_->num_io_buffers() > 0 || current_row_batch_->num_rows() > 0) {
-    scan_node_->AddMaterializedRowBatch(current_row_batch_);
+  if (current_row_batch_->num_io_buffers() > 0 ||
+      current_row_batch_->num_active_rows() > 0) {
+    AddMaterializedRowBatch(current_row_batch_);
     current_row_batch_ = NULL;
     if (!done) NewRowBatch();
   }
 }
 
+Status ScanRangeContext::InitPreAggregation() {
+  DCHECK(pre_aggregator_ == NULL);
+  return scan_node_->GetPreAggregator(&pre_aggregator_);
+}
+
+void ScanRangeContext::AddMaterializedRowBatch(RowBatch* batch) {
+  if (pre_aggregator_ == NULL) {
+    scan_node_->AddMaterializedRowBatch(batch);
+    return;
+  }
+  vector<RowBatch*> output;
+  pre_aggregator_->AddBatch(batch, &output);
+  for (int i = 0; i < output.size(); ++i) {
+    scan_node_->AddMaterializedRowBatch(output[i]);
+  }
+}
+
 void ScanRangeContext::RemoveFirstBuffer() {
   DCHECK(current_buffer_ != NULL);
   DCHECK(!buffers_.empty());
@@ -240,16 +269,29 @@ int ScanRangeContext::GetMemory(MemPool** pool, Tuple** tuple_mem,
   *pool = current_row_batch_->tuple_data_pool();
   *tuple_mem = reinterpret_cast<Tuple*>(tuple_mem_);
   *tuple_row_mem = current_row_batch_->GetRow(current_row_batch_->AddRow());
-  return current_row_batch_->capacity() - current_row_batch_->num_rows();
+  int num_rows = current_row_batch_->capacity() - current_row_batch_->num_rows();
+  // With batch conjuncts, there can be fewer tuples than rows left.
+  if (tuple_byte_size_ > 0) {
+    num_rows = min<int>(num_rows, (tuple_mem_end_ - tuple_mem_) / tuple_byte_size_);
+  }
+  return num_rows;
 }
 
 void ScanRangeContext::CommitRows(int num_rows) {
   DCHECK_LE(num_rows, current_row_batch_->capacity() - current_row_batch_->num_rows());
+  int start_row = current_row_batch_->num_rows();
   current_row_batch_->CommitRows(num_rows);
-  tuple_mem_ += scan_node_->tuple_desc()->byte_size() * num_rows;
+  tuple_mem_ += tuple_byte_size_ * num_rows;
+  DCHECK_LE(tuple_mem_, tuple_mem_end_);
+
+  if (num_batch_conjuncts_ > 0) {
+    ExecNode::EvalConjuncts(batch_conjuncts_, num_batch_conjuncts_, current_row_batch_,
+        start_row);
+  }
 
-  if (current_row_batch_->IsFull()) {
-    scan_node_->AddMaterializedRowBatch(current_row_batch_);
+  bool out_of_tuple_mem = tuple_byte_size_ > 0 && tuple_mem_ == tuple_mem_end_;
+  if (current_row_batch_->IsFull() || out_of_tuple_mem) {
+    AddMaterializedRowBatch(current_row_batch_);
     NewRowBatch();
   }
 }
@@ -293,7 +335,18 @@ void ScanRangeContext::Complete() {
     // resources attached to it that can't be cleaned up until all previous row
     // batches have been consumed.
     if (current_row_batch_ != NULL) {
-      scan_node_->AddMaterializedRowBatch(current_row_batch_);
+      AddMaterializedRowBatch(current_row_batch_);
+    }
+
+    // The rest of the partial aggregates of this range go after its last batch.
+    if (pre_aggregator_ != NULL) {
+      vector<RowBatch*> output;
+      pre_aggregator_->Flush(&output);
+      for (int i = 0; i < output.size(); ++i) {
+        scan_node_->AddMaterializedRowBatch(output[i]);
+      }
+      scan_node_->ReturnPreAggregator(pre_aggregator_);
+      pre_aggregator_ = NULL;
     }
 
     // Set variables to NULL to make sure this object is not being used after Complete()
@@ -16,11 +16,13 @@
 
 namespace impala {
 
+class Expr;
 class HdfsPartitionDescriptor;
 class HdfsScanNode;
 class MemPool;
 class RowBatch;
 class RuntimeState;
+class ScanPreAggregator;
 class StringBuffer;
 class Tuple;
 class TupleRow;
@@ -58,6 +60,11 @@ class ScanRangeContext {
 
   ~ScanRangeContext();
 
+  // Gets the pre-aggregator for the rows of this range from the scan node, if it
+  // pre-aggregates them.  Must be called by the scanner thread before it processes
+  // the range.
+  Status InitPreAggregation();
+
   // Sets whether of not the resulting tuples have a compact format.  If not, the
   // io buffers must be attached to the row batch, otherwise they can be returned
   // immediately.  This by default, is inferred from the scan_node tuple descriptor
@@ -110,6 +117,16 @@ class ScanRangeContext {
   // Returns true if the scanner should finish (i.e. limit was reached).
   void CommitRows(int num_rows);
 
+  // Sets conjuncts that CommitRows() evaluates over the committed rows with
+  // ExecNode::EvalConjuncts(RowBatch*), removing the rows that don't pass from the
+  // batch's selection.  The tuple memory of removed rows is not reused, so a batch may be passed to the scan
+  // node before it is full.  The conjuncts must be vectorizable and not be shared with
+  // other threads.
+  void set_batch_conjuncts(Expr* const* conjuncts, int num_conjuncts) {
+    batch_conjuncts_ = conjuncts;
+    num_batch_conjuncts_ = num_conjuncts;
+  }
+
   // Enqueue a buffer for this context.  This will wake up the thread in GetBytes() if
   // it is blocked.
   // This can be called from multiple threads but the buffers must be added in order 
@@ -216,6 +233,17 @@ class ScanRangeContext {
   // Tuple memory for current row batch.
   uint8_t* tuple_mem_;
 
+  // End of the tuple memory of the current row batch.
+  uint8_t* tuple_mem_end_;
+
+  // Conjuncts evaluated by CommitRows(), see set_batch_conjuncts().
+  Expr* const* batch_conjuncts_;
+  int num_batch_conjuncts_;
+
+  // Aggregates the completed row batches before they are passed to the scan node.
+  // NULL if the scan node does not pre-aggregate its rows.
+  ScanPreAggregator* pre_aggregator_;
+
   // Pool for allocating boundary buffers.  
   boost::scoped_ptr<MemPool> boundary_pool_;
   boost::scoped_ptr<StringBuffer> boundary_buffer_;
@@ -254,6 +282,10 @@ class ScanRangeContext {
 
   // Attach all completed io buffers to the current row batch
   void AttachCompletedResources(bool done);
+
+  // Passes a completed row batch to the scan node, pre-aggregating it first if
+  // pre_aggregator_ is set.
+  void AddMaterializedRowBatch(RowBatch* batch);
   
   // GetBytes helper to handle the slow path 
   // If peek is set then return the data but do not move the current offset.
@@ -0,0 +1,517 @@
+// Copyright (c) 2012 Cloudera, Inc. All rights reserved.
+
+#include "exec/sort-node.h"
+
+#include <algorithm>
+#include <sstream>
+
+#include "common/logging.h"
+#include "exprs/expr.h"
+#include "runtime/descriptors.h"
+#include "runtime/mem-pool.h"
+#include "runtime/raw-value.h"
+#include "runtime/row-batch.h"
+#include "runtime/runtime-state.h"
+#include "runtime/spill-stream.h"
+#include "runtime/string-value.h"
+#include "runtime/tuple.h"
+#include "runtime/tuple-row.h"
+#include "util/debug-util.h"
+#include "util/runtime-profile.h"
+
+#include "gen-cpp/Exprs_types.h"
+#include "gen-cpp/PlanNodes_types.h"
+
+using namespace boost;
+using namespace impala;
+using namespace std;
+
+DEFINE_int64(sort_buffer_size, 256L * 1024L * 1024L,
+    "Number of bytes of input rows a sort node buffers in memory before it writes "
+    "a sorted run to disk.");
+DEFINE_int32(sort_merge_fan_in, 64,
+    "Maximum number of sorted runs a sort node merges at once.");
+
+class SortNode::SortedRun {
+ public:
+  // Run over the (already sorted) in-memory sort buffer.
+  SortedRun(const vector<SortEntry>* buffer)
+    : buffer_(buffer), buffer_idx_(0), batch_idx_(0) {
+  }
+
+  // Run over a spilled stream.  Takes ownership of 'stream'.
+  SortedRun(SpillStream* stream)
+    : buffer_(NULL), buffer_idx_(0), stream_(stream), batch_idx_(0) {
+  }
+
+  // Positions the run at its first row.
+  Status Init() {
+    if (stream_.get() == NULL) return Status::OK;
+    RETURN_IF_ERROR(stream_->PrepareForRead());
+    return NextBatch(NULL);
+  }
+
+  bool eos() const {
+    if (stream_.get() == NULL) return buffer_idx_ >= buffer_->size();
+    return batch_.get() == NULL;
+  }
+
+  TupleRow* current_row() const {
+    DCHECK(!eos());
+    if (stream_.get() == NULL) return (*buffer_)[buffer_idx_].row;
+    return batch_->GetRow(batch_idx_);
+  }
+
+  // Moves to the next row.  If the current spilled batch is exhausted, its resources
+  // are transferred to 'output_batch', or freed if 'output_batch' is NULL.
+  Status Advance(RowBatch* output_batch) {
+    if (stream_.get() == NULL) {
+      ++buffer_idx_;
+      return Status::OK;
+    }
+    if (++batch_idx_ < batch_->num_rows()) return Status::OK;
+    return NextBatch(output_batch);
+  }
+
+ private:
+  Status NextBatch(RowBatch* output_batch) {
+    if (batch_.get() != NULL && output_batch != NULL) {
+      batch_->TransferResourceOwnership(output_batch);
+    }
+    batch_.reset();
+    batch_idx_ = 0;
+    // Skip empty batches; the stream should not contain any, but be defensive.
+    while (true) {
+      RowBatch* batch;
+      RETURN_IF_ERROR(stream_->GetNext(&batch));
+      batch_.reset(batch);
+      if (batch == NULL || batch->num_rows() > 0) break;
+    }
+    return Status::OK;
+  }
+
+  const vector<SortEntry>* buffer_;
+  int buffer_idx_;
+
+  scoped_ptr<SpillStream> stream_;
+  scoped_ptr<RowBatch> batch_;
+  int batch_idx_;
+};
+
+SortNode::SortNode(ObjectPool* pool, const TPlanNode& tnode, const DescriptorTbl& descs)
+  : ExecNode(pool, tnode, descs),
+    num_normalized_exprs_(0),
+    normalized_key_len_(0),
+    normalized_key_is_complete_(true),
+    output_from_buffer_(false),
+    output_idx_(0) {
+  // TODO: log errors in runtime state
+  Status status = Init(pool, tnode);
+  DCHECK(status.ok()) << "SortNode c'tor:Init failed: \n" << status.GetErrorMsg();
+}
+
+SortNode::~SortNode() {
+  for (int i = 0; i < runs_.size(); ++i) {
+    delete runs_[i];
+  }
+}
+
+Status SortNode::Init(ObjectPool* pool, const TPlanNode& tnode) {
+  RETURN_IF_ERROR(
+      Expr::CreateExprTrees(pool, tnode.sort_node.ordering_exprs, &lhs_ordering_exprs_));
+  RETURN_IF_ERROR(
+      Expr::CreateExprTrees(pool, tnode.sort_node.ordering_exprs, &rhs_ordering_exprs_));
+  is_asc_order_.insert(
+      is_asc_order_.begin(), tnode.sort_node.is_asc_order.begin(),
+      tnode.sort_node.is_asc_order.end());
+  DCHECK_EQ(conjuncts_.size(), 0) << "SortNode should never have predicates to evaluate.";
+  return Status::OK;
+}
+
+Status SortNode::Prepare(RuntimeState* state) {
+  RETURN_IF_ERROR(ExecNode::Prepare(state));
+  sort_timer_ = ADD_COUNTER(runtime_profile(), "SortTime", TCounterType::CPU_TICKS);
+  merge_timer_ = ADD_COUNTER(runtime_profile(), "MergeTime", TCounterType::CPU_TICKS);
+  num_runs_counter_ = ADD_COUNTER(runtime_profile(), "SpilledRuns", TCounterType::UNIT);
+  spilled_bytes_counter_ =
+      ADD_COUNTER(runtime_profile(), "SpilledBytes", TCounterType::BYTES);
+
+  tuple_pool_.reset(new MemPool(mem_tracker()));
+  key_pool_.reset(new MemPool(mem_tracker()));
+  tuple_descs_ = child(0)->row_desc().tuple_descriptors();
+  Expr::Prepare(lhs_ordering_exprs_, state, child(0)->row_desc());
+  Expr::Prepare(rhs_ordering_exprs_, state, child(0)->row_desc());
+  InitNormalizedKeyLayout();
+  return Status::OK;
+}
+
+Status SortNode::Open(RuntimeState* state) {
+  RETURN_IF_CANCELLED(state);
+  SCOPED_TIMER(runtime_profile_->total_time_counter());
+  RETURN_IF_ERROR(child(0)->Open(state));
+
+  RowBatch batch(child(0)->row_desc(), state->batch_size(), mem_tracker());
+  bool eos;
+  do {
+    RETURN_IF_CANCELLED(state);
+    batch.Reset();
+    RETURN_IF_ERROR(child(0)->GetNext(state, &batch, &eos));
+    for (int i = 0; i < batch.num_rows(); ++i) {
+      AddRowToBuffer(batch.GetRow(i));
+    }
+    if (buffer_bytes() > FLAGS_sort_buffer_size) RETURN_IF_ERROR(SpillBuffer(state));
+    RETURN_IF_ERROR(state->CheckMemLimit());
+  } while (!eos);
+
+  SortBuffer();
+  if (runs_.empty()) {
+    // Everything fit in memory.
+    output_from_buffer_ = true;
+    output_idx_ = 0;
+    return Status::OK;
+  }
+
+  // The final in-memory run is merged with the spilled ones.
+  bool has_buffered_run = !sort_buffer_.empty();
+  RETURN_IF_ERROR(MergeIntermediateRuns(
+      state, FLAGS_sort_merge_fan_in - (has_buffered_run ? 1 : 0)));
+  if (has_buffered_run) runs_.push_back(new SortedRun(&sort_buffer_));
+  return PrepareMerge(runs_);
+}
+
+Status SortNode::GetNext(RuntimeState* state, RowBatch* row_batch, bool* eos) {
+  RETURN_IF_CANCELLED(state);
+  SCOPED_TIMER(runtime_profile_->total_time_counter());
+  if (ReachedLimit()) {
+    *eos = true;
+    return Status::OK;
+  }
+
+  if (output_from_buffer_) {
+    while (!row_batch->IsFull() && output_idx_ < sort_buffer_.size()
+        && !ReachedLimit()) {
+      int row_idx = row_batch->AddRow();
+      row_batch->CopyRow(sort_buffer_[output_idx_].row, row_batch->GetRow(row_idx));
+      row_batch->CommitLastRow();
+      ++output_idx_;
+      ++num_rows_returned_;
+    }
+    *eos = output_idx_ == sort_buffer_.size() || ReachedLimit();
+  } else {
+    SCOPED_TIMER(merge_timer_);
+    int num_rows_before = row_batch->num_rows();
+    RETURN_IF_ERROR(MergeNextBatch(row_batch, false, eos));
+    num_rows_returned_ += row_batch->num_rows() - num_rows_before;
+    if (ReachedLimit()) {
+      row_batch->set_num_rows(row_batch->num_rows() - (num_rows_returned_ - limit_));
+      num_rows_returned_ = limit_;
+      *eos = true;
+    }
+  }
+  COUNTER_SET(rows_returned_counter_, num_rows_returned_);
+  return Status::OK;
+}
+
+Status SortNode::Close(RuntimeState* state) {
+  for (int i = 0; i < runs_.size(); ++i) {
+    delete runs_[i];
+  }
+  runs_.clear();
+  merge_heap_.clear();
+  return ExecNode::Close(state);
+}
+
+int SortNode::CompareRows(TupleRow* lhs, TupleRow* rhs) const {
+  for (int i = 0; i < lhs_ordering_exprs_.size(); ++i) {
+    Expr* lhs_expr = lhs_ordering_exprs_[i];
+    Expr* rhs_expr = rhs_ordering_exprs_[i];
+    void* lhs_value = lhs_expr->GetValue(lhs);
+    void* rhs_value = rhs_expr->GetValue(rhs);
+
+    // NULL's always go at the end regardless of asc/desc
+    if (lhs_value == NULL && rhs_value == NULL) continue;
+    if (lhs_value == NULL) return 1;
+    if (rhs_value == NULL) return -1;
+
+    int result = RawValue::Compare(lhs_value, rhs_value, lhs_expr->type());
+    if (!is_asc_order_[i]) result = -result;
+    if (result != 0) return result;
+    // Otherwise, try the next Expr
+  }
+  return 0;
+}
+
+bool SortNode::SortEntryLessThan::operator()(const SortEntry& lhs,
+    const SortEntry& rhs) const {
+  if (node_->normalized_key_len_ > 0) {
+    int result = memcmp(lhs.key, rhs.key, node_->normalized_key_len_);
+    if (result != 0) return result < 0;
+    if (node_->normalized_key_is_complete_) return false;
+  }
+  return node_->CompareRows(lhs.row, rhs.row) < 0;
+}
+
+bool SortNode::RunGreaterThan::operator()(SortedRun* lhs, SortedRun* rhs) const {
+  return node_->CompareRows(lhs->current_row(), rhs->current_row()) > 0;
+}
+
+void SortNode::InitNormalizedKeyLayout() {
+  num_normalized_exprs_ = 0;
+  normalized_key_len_ = 0;
+  normalized_key_is_complete_ = true;
+  for (int i = 0; i < lhs_ordering_exprs_.size(); ++i) {
+    PrimitiveType type = lhs_ordering_exprs_[i]->type();
+    // One byte for the null indicator, followed by the value.
+    int remaining = MAX_NORMALIZED_KEY_LEN - normalized_key_len_ - 1;
+    switch (type) {
+      case TYPE_BOOLEAN:
+      case TYPE_TINYINT:
+      case TYPE_SMALLINT:
+      case TYPE_INT:
+      case TYPE_BIGINT:
+      case TYPE_FLOAT:
+      case TYPE_DOUBLE:
+        if (GetByteSize(type) > remaining) {
+          normalized_key_is_complete_ = false;
+          return;
+        }
+        normalized_key_len_ += 1 + GetByteSize(type);
+        ++num_normalized_exprs_;
+        break;
+      case TYPE_STRING:
+        // Only a prefix of the string is part of the key; ties need a full compare
+        // and no later expr can be normalized.
+        normalized_key_is_complete_ = false;
+        if (remaining > 0) {
+          normalized_key_len_ += 1 + min(remaining, NORMALIZED_STRING_PREFIX_LEN);
+          ++num_normalized_exprs_;
+        }
+        return;
+      default:
+        normalized_key_is_complete_ = false;
+        return;
+    }
+  }
+}
+
+// Writes the 'len' low-order bytes of 'val' in big-endian order.
+static inline void WriteBigEndian(uint64_t val, int len, uint8_t* dst) {
+  for (int i = len - 1; i >= 0; --i) {
+    dst[i] = static_cast<uint8_t>(val);
+    val >>= 8;
+  }
+}
+
+// The normalized key of an expr value is a null indicator byte (0 for non-NULL, 1 for
+// NULL so that NULLs sort last) followed by the value encoded such that memcmp()
+// matches RawValue::Compare():
+//  - integers: two's complement with the sign bit flipped, big-endian
+//  - floating point: IEEE bits with the sign bit flipped for positive values and all
+//    bits flipped for negative values, big-endian
+//  - strings: the first bytes of the string, zero-padded
+// For descending exprs the value bytes (but not the null byte) are inverted.
+void SortNode::NormalizeKey(TupleRow* row, uint8_t* key) {
+  uint8_t* dst = key;
+  for (int i = 0; i < num_normalized_exprs_; ++i) {
+    Expr* expr = lhs_ordering_exprs_[i];
+    PrimitiveType type = expr->type();
+    int value_len = type == TYPE_STRING ?
+        key + normalized_key_len_ - dst - 1 : GetByteSize(type);
+    void* value = expr->GetValue(row);
+    if (value == NULL) {
+      *dst = 1;
+      memset(dst + 1, 0, value_len);
+      dst += 1 + value_len;
+      continue;
+    }
+    *dst++ = 0;
+
+    uint64_t bits = 0;
+    switch (type) {
+      case TYPE_BOOLEAN:
+        bits = *reinterpret_cast<bool*>(value) ? 1 : 0;
+        break;
+      case TYPE_TINYINT:
+        bits = static_cast<uint8_t>(*reinterpret_cast<int8_t*>(value)) ^ 0x80;
+        break;
+      case TYPE_SMALLINT:
+        bits = static_cast<uint16_t>(*reinterpret_cast<int16_t*>(value)) ^ 0x8000;
+        break;
+      case TYPE_INT:
+        bits = static_cast<uint32_t>(*reinterpret_cast<int32_t*>(value)) ^ 0x80000000;
+        break;
+      case TYPE_BIGINT:
+        bits = static_cast<uint64_t>(*reinterpret_cast<int64_t*>(value))
+            ^ 0x8000000000000000ULL;
+        break;
+      case TYPE_FLOAT: {
+        uint32_t float_bits;
+        memcpy(&float_bits, value, sizeof(float_bits));
+        bits = (float_bits & 0x80000000) ? ~float_bits : float_bits ^ 0x80000000;
+        bits &= 0xFFFFFFFF;
+        break;
+      }
+      case TYPE_DOUBLE: {
+        uint64_t double_bits;
+        memcpy(&double_bits, value, sizeof(double_bits));
+        bits = (double_bits & 0x8000000000000000ULL) ?
+            ~double_bits : double_bits ^ 0x8000000000000000ULL;
+        break;
+      }
+      case TYPE_STRING: {
+        StringValue* str = reinterpret_cast<StringValue*>(value);
+        int copy_len = min(str->len, value_len);
+        memcpy(dst, str->ptr, copy_len);
+        memset(dst + copy_len, 0, value_len - copy_len);
+        break;
+      }
+      default:
+        DCHECK(false) << "Type cannot be normalized: " << TypeToString(type);
+    }
+    if (type != TYPE_STRING) WriteBigEndian(bits, value_len, dst);
+    if (!is_asc_order_[i]) {
+      for (int j = 0; j < value_len; ++j) dst[j] = ~dst[j];
+    }
+    dst += value_len;
+  }
+  DCHECK_EQ(dst, key + normalized_key_len_);
+}
+
+void SortNode::AddRowToBuffer(TupleRow* row) {
+  SortEntry entry;
+  entry.row = row->DeepCopy(tuple_descs_, tuple_pool_.get());
+  entry.key = NULL;
+  if (normalized_key_len_ > 0) {
+    entry.key = key_pool_->Allocate(normalized_key_len_);
+    NormalizeKey(entry.row, entry.key);
+  }
+  sort_buffer_.push_back(entry);
+}
+
+int64_t SortNode::buffer_bytes() const {
+  return tuple_pool_->total_allocated_bytes() + key_pool_->total_allocated_bytes()
+      + sort_buffer_.size() * sizeof(SortEntry);
+}
+
+void SortNode::SortBuffer() {
+  SCOPED_TIMER(sort_timer_);
+  sort(sort_buffer_.begin(), sort_buffer_.end(), SortEntryLessThan(this));
+}
+
+Status SortNode::SpillBuffer(RuntimeState* state) {
+  SortBuffer();
+  scoped_ptr<SpillStream> stream(new SpillStream(child(0)->row_desc()));
+  RETURN_IF_ERROR(stream->Init());
+  RowBatch batch(child(0)->row_desc(), state->batch_size());
+  for (int i = 0; i < sort_buffer_.size(); ++i) {
+    int row_idx = batch.AddRow();
+    batch.CopyRow(sort_buffer_[i].row, batch.GetRow(row_idx));
+    batch.CommitLastRow();
+    if (batch.IsFull() || i == sort_buffer_.size() - 1) {
+      RETURN_IF_ERROR(stream->AddBatch(&batch));
+      batch.Reset();
+    }
+  }
+  VLOG_FILE << "SortNode " << id() << " spilled " << sort_buffer_.size() << " rows ("
+            << stream->bytes_written() << " bytes) to " << stream->path();
+  COUNTER_UPDATE(num_runs_counter_, 1);
+  COUNTER_UPDATE(spilled_bytes_counter_, stream->bytes_written());
+  runs_.push_back(new SortedRun(stream.release()));
+
+  sort_buffer_.clear();
+  tuple_pool_->Clear();
+  key_pool_->Clear();
+  return Status::OK;
+}
+
+Status SortNode::MergeIntermediateRuns(RuntimeState* state, int max_runs) {
+  DCHECK_GT(FLAGS_sort_merge_fan_in, 1);
+  DCHECK_GT(max_runs, 0);
+  while (runs_.size() > max_runs) {
+    RETURN_IF_CANCELLED(state);
+    SCOPED_TIMER(merge_timer_);
+    // Merge the oldest runs into a new run at the end of runs_, so that every row
+    // is rewritten as few times as possible.
+    int num_merge_runs = min<int>(FLAGS_sort_merge_fan_in, runs_.size() - max_runs + 1);
+    vector<SortedRun*> merge_runs(runs_.begin(), runs_.begin() + num_merge_runs);
+    runs_.erase(runs_.begin(), runs_.begin() + num_merge_runs);
+    Status status = MergeRuns(state, merge_runs);
+    for (int i = 0; i < merge_runs.size(); ++i) {
+      delete merge_runs[i];
+    }
+    RETURN_IF_ERROR(status);
+  }
+  return Status::OK;
+}
+
+Status SortNode::MergeRuns(RuntimeState* state, const vector<SortedRun*>& runs) {
+  RETURN_IF_ERROR(PrepareMerge(runs));
+  scoped_ptr<SpillStream> stream(new SpillStream(child(0)->row_desc()));
+  RETURN_IF_ERROR(stream->Init());
+  RowBatch batch(child(0)->row_desc(), state->batch_size());
+  bool eos = false;
+  while (!eos) {
+    RETURN_IF_CANCELLED(state);
+    batch.Reset();
+    RETURN_IF_ERROR(MergeNextBatch(&batch, true, &eos));
+    RETURN_IF_ERROR(stream->AddBatch(&batch));
+  }
+  COUNTER_UPDATE(num_runs_counter_, 1);
+  COUNTER_UPDATE(spilled_bytes_counter_, stream->bytes_written());
+  runs_.push_back(new SortedRun(stream.release()));
+  return Status::OK;
+}
+
+Status SortNode::PrepareMerge(const vector<SortedRun*>& runs) {
+  merge_heap_.clear();
+  for (int i = 0; i < runs.size(); ++i) {
+    RETURN_IF_ERROR(runs[i]->Init());
+    if (!runs[i]->eos()) merge_heap_.push_back(runs[i]);
+  }
+  make_heap(merge_heap_.begin(), merge_heap_.end(), RunGreaterThan(this));
+  return Status::OK;
+}
+
+Status SortNode::MergeNextBatch(RowBatch* row_batch, bool deep_copy, bool* eos) {
+  RunGreaterThan run_greater_than(this);
+  while (!row_batch->IsFull() && !merge_heap_.empty()) {
+    pop_heap(merge_heap_.begin(), merge_heap_.end(), run_greater_than);
+    SortedRun* run = merge_heap_.back();
+
+    int row_idx = row_batch->AddRow();
+    TupleRow* src_row = run->current_row();
+    TupleRow* dst_row = row_batch->GetRow(row_idx);
+    if (deep_copy) {
+      for (int i = 0; i < tuple_descs_.size(); ++i) {
+        Tuple* src_tuple = src_row->GetTuple(i);
+        dst_row->SetTuple(i, src_tuple == NULL ? NULL :
+            src_tuple->DeepCopy(*tuple_descs_[i], row_batch->tuple_data_pool()));
+      }
+    } else {
+      row_batch->CopyRow(src_row, dst_row);
+    }
+    row_batch->CommitLastRow();
+
+    RETURN_IF_ERROR(run->Advance(deep_copy ? NULL : row_batch));
+    if (run->eos()) {
+      merge_heap_.pop_back();
+    } else {
+      push_heap(merge_heap_.begin(), merge_heap_.end(), run_greater_than);
+    }
+  }
+  *eos = merge_heap_.empty();
+  return Status::OK;
+}
+
+void SortNode::DebugString(int indentation_level, stringstream* out) const {
+  *out << string(indentation_level * 2, ' ');
+  *out << "SortNode("
+       << " ordering_exprs=" << Expr::DebugString(lhs_ordering_exprs_)
+       << " sort_order=[";
+  for (int i = 0; i < is_asc_order_.size(); ++i) {
+    *out << (i > 0 ? " " : "") << (is_asc_order_[i] ? "asc" : "desc");
+  }
+  *out << "]";
+  ExecNode::DebugString(indentation_level, out);
+  *out << ")";
+}
@@ -0,0 +1,164 @@
+// Copyright (c) 2012 Cloudera, Inc. All rights reserved.
+
+#ifndef IMPALA_EXEC_SORT_NODE_H
+#define IMPALA_EXEC_SORT_NODE_H
+
+#include <vector>
+#include <boost/scoped_ptr.hpp>
+
+#include "exec/exec-node.h"
+#include "runtime/descriptors.h"  // for TupleId
+#include "util/runtime-profile.h"
+
+namespace impala {
+
+class MemPool;
+class RowBatch;
+struct RuntimeState;
+class SpillStream;
+class Tuple;
+
+// Node for ORDER BY without a LIMIT (external merge sort).
+// Input rows are deep copied into a sort buffer until the buffer exceeds
+// --sort_buffer_size bytes.  The buffer is then sorted and, if more input remains,
+// written out as a sorted run to a SpillStream.  Once the input is exhausted, the
+// output is produced directly from the sort buffer if nothing was spilled, otherwise
+// by a multi-way merge of the spilled runs and the final in-memory run.  If there are
+// more runs than --sort_merge_fan_in, runs are merged into larger spilled runs first.
+//
+// To make the in-memory sort cheap, a fixed-length, memcmp()-comparable prefix of the
+// ordering key (the "normalized key") is computed for every row when it is added to
+// the buffer.  Rows are compared by their normalized keys and the ordering exprs are
+// only evaluated if the prefixes are equal and the normalized key does not cover the
+// full ordering key (e.g. strings, timestamps).
+class SortNode : public ExecNode {
+ public:
+  SortNode(ObjectPool* pool, const TPlanNode& tnode, const DescriptorTbl& descs);
+  ~SortNode();
+
+  virtual Status Prepare(RuntimeState* state);
+  virtual Status Open(RuntimeState* state);
+  virtual Status GetNext(RuntimeState* state, RowBatch* row_batch, bool* eos);
+  virtual Status Close(RuntimeState* state);
+
+ protected:
+  virtual void DebugString(int indentation_level, std::stringstream* out) const;
+
+ private:
+  // Maximum number of bytes of the normalized key per row.
+  static const int MAX_NORMALIZED_KEY_LEN = 32;
+
+  // Maximum number of bytes of a string value that are added to the normalized key.
+  static const int NORMALIZED_STRING_PREFIX_LEN = 8;
+
+  // An entry in the sort buffer: the row and its normalized key.
+  struct SortEntry {
+    TupleRow* row;
+    uint8_t* key;
+  };
+
+  // Orders sort entries by normalized key, falling back to the full comparison.
+  class SortEntryLessThan {
+   public:
+    SortEntryLessThan(SortNode* node) : node_(node) {}
+    bool operator()(const SortEntry& lhs, const SortEntry& rhs) const;
+
+   private:
+    SortNode* node_;
+  };
+
+  // A sorted sequence of rows that is one input to the merge: either the final
+  // in-memory sort buffer or a spilled run.
+  class SortedRun;
+
+  // Orders runs by their current row.  Used as a min-heap comparator, i.e. returns
+  // true if lhs' current row sorts after rhs' current row.
+  class RunGreaterThan {
+   public:
+    RunGreaterThan(SortNode* node) : node_(node) {}
+    bool operator()(SortedRun* lhs, SortedRun* rhs) const;
+
+   private:
+    SortNode* node_;
+  };
+
+  Status Init(ObjectPool* pool, const TPlanNode& tnode);
+
+  // Returns <0, 0 or >0 if lhs sorts before, equal to or after rhs, respectively,
+  // according to the ordering exprs.  NULLs always sort last.
+  int CompareRows(TupleRow* lhs, TupleRow* rhs) const;
+
+  // Computes the layout of the normalized key from the ordering exprs.
+  void InitNormalizedKeyLayout();
+
+  // Writes the normalized key of 'row' into 'key' (normalized_key_len_ bytes).
+  void NormalizeKey(TupleRow* row, uint8_t* key);
+
+  // Deep copies 'row' into the sort buffer.
+  void AddRowToBuffer(TupleRow* row);
+
+  // Returns the number of bytes currently held by the sort buffer.
+  int64_t buffer_bytes() const;
+
+  // Sorts the sort buffer.
+  void SortBuffer();
+
+  // Sorts the sort buffer, writes it to a new spilled run and clears the buffer.
+  Status SpillBuffer(RuntimeState* state);
+
+  // Merges the oldest runs until at most 'max_runs' runs are left.
+  Status MergeIntermediateRuns(RuntimeState* state, int max_runs);
+
+  // Merges 'runs' into a new spilled run that is appended to runs_.  The caller
+  // owns 'runs'.
+  Status MergeRuns(RuntimeState* state, const std::vector<SortedRun*>& runs);
+
+  // Initializes the merge heap from 'runs'.
+  Status PrepareMerge(const std::vector<SortedRun*>& runs);
+
+  // Fills 'row_batch' with rows from the merge heap.  The resources of exhausted
+  // spilled batches are transferred to 'row_batch'.  If 'deep_copy' is true, rows are
+  // instead deep copied into row_batch's tuple pool (used for intermediate merges).
+  Status MergeNextBatch(RowBatch* row_batch, bool deep_copy, bool* eos);
+
+  std::vector<TupleDescriptor*> tuple_descs_;
+  std::vector<bool> is_asc_order_;
+
+  // Create two copies of the exprs for evaluating over the TupleRows.
+  // The result of the evaluation is stored in the Expr, so it's not efficient to use
+  // one set of Expr to compare TupleRows.
+  std::vector<Expr*> lhs_ordering_exprs_;
+  std::vector<Expr*> rhs_ordering_exprs_;
+
+  // Normalized key layout.  The first num_normalized_exprs_ ordering exprs are
+  // (possibly partially) encoded in the normalized key; normalized_key_len_ is the
+  // byte length of the key.  If normalized_key_is_complete_ is true, two rows with
+  // equal normalized keys compare equal.
+  int num_normalized_exprs_;
+  int normalized_key_len_;
+  bool normalized_key_is_complete_;
+
+  // The sort buffer and the memory for the rows and keys it references.
+  std::vector<SortEntry> sort_buffer_;
+  boost::scoped_ptr<MemPool> tuple_pool_;
+  boost::scoped_ptr<MemPool> key_pool_;
+
+  // Runs to be merged, in creation order.  Owned by this node.
+  std::vector<SortedRun*> runs_;
+
+  // Min-heap of runs that still have rows, ordered by RunGreaterThan.
+  std::vector<SortedRun*> merge_heap_;
+
+  // If nothing was spilled, the output is read straight from sort_buffer_.
+  bool output_from_buffer_;
+  int output_idx_;
+
+  RuntimeProfile::Counter* sort_timer_;
+  RuntimeProfile::Counter* merge_timer_;
+  RuntimeProfile::Counter* num_runs_counter_;
+  RuntimeProfile::Counter* spilled_bytes_counter_;
+};
+
+}
+
+#endif
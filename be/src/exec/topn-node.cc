@@ -24,8 +24,7 @@ using namespace std;
 TopNNode::TopNNode(ObjectPool* pool, const TPlanNode& tnode, const DescriptorTbl& descs) 
   : ExecNode(pool, tnode, descs),
     tuple_row_less_than_(this),
-    priority_queue_(tuple_row_less_than_),
-    tuple_pool_(new MemPool) {
+    priority_queue_(tuple_row_less_than_) {
   // TODO: log errors in runtime state
   Status status = Init(pool, tnode);
   DCHECK(status.ok()) << "TopNNode c'tor:Init failed: \n" << status.GetErrorMsg();
@@ -78,7 +77,8 @@ bool TopNNode::TupleRowLessThan::operator()(TupleRow* const& lhs, TupleRow* cons
 
 Status TopNNode::Prepare(RuntimeState* state) {
   RETURN_IF_ERROR(ExecNode::Prepare(state));
-  
+
+  tuple_pool_.reset(new MemPool(mem_tracker()));
   tuple_descs_ = child(0)->row_desc().tuple_descriptors();
   Expr::Prepare(lhs_ordering_exprs_, state, child(0)->row_desc());
   Expr::Prepare(rhs_ordering_exprs_, state, child(0)->row_desc());
@@ -90,7 +90,7 @@ Status TopNNode::Open(RuntimeState* state) {
   SCOPED_TIMER(runtime_profile_->total_time_counter());
   RETURN_IF_ERROR(child(0)->Open(state));
 
-  RowBatch batch(child(0)->row_desc(), state->batch_size());
+  RowBatch batch(child(0)->row_desc(), state->batch_size(), mem_tracker());
   bool eos;
   do {
     RETURN_IF_CANCELLED(state);
@@ -99,6 +99,7 @@ Status TopNNode::Open(RuntimeState* state) {
     for (int i = 0; i < batch.num_rows(); ++i) {
       InsertTupleRow(batch.GetRow(i));
     }
+    RETURN_IF_ERROR(state->CheckMemLimit());
   } while (!eos);
   
   DCHECK_LE(priority_queue_.size(), limit_);
@@ -124,7 +125,6 @@ Status TopNNode::GetNext(RuntimeState* state, RowBatch* row_batch, bool* eos) {
 }
 
 Status TopNNode::Close(RuntimeState* state) {
-  COUNTER_UPDATE(memory_used_counter(), tuple_pool_->peak_allocated_bytes());
   return ExecNode::Close(state);
 }
 
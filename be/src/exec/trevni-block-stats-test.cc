@@ -0,0 +1,114 @@
+// Copyright (c) 2012 Cloudera, Inc. All rights reserved.
+
+#include <string>
+#include <vector>
+#include <gtest/gtest.h>
+
+#include "exec/trevni-block-stats.h"
+#include "runtime/string-value.h"
+
+using namespace std;
+
+namespace impala {
+
+TEST(TrevniBlockStatsTest, IntRange) {
+  TrevniBlockStats stats;
+  int32_t values[] = { 10, -5, 7, 20, 3 };
+  for (int i = 0; i < 5; ++i) {
+    stats.Update(&values[i], TYPE_INT);
+  }
+  stats.Update(NULL, TYPE_INT);
+  EXPECT_EQ(stats.null_count(), 1);
+
+  int32_t v = 20;
+  EXPECT_TRUE(stats.MayMatch(TrevniBlockStats::EQ, &v, TYPE_INT, 6));
+  EXPECT_TRUE(stats.MayMatch(TrevniBlockStats::GE, &v, TYPE_INT, 6));
+  EXPECT_FALSE(stats.MayMatch(TrevniBlockStats::GT, &v, TYPE_INT, 6));
+  v = -5;
+  EXPECT_TRUE(stats.MayMatch(TrevniBlockStats::LE, &v, TYPE_INT, 6));
+  EXPECT_FALSE(stats.MayMatch(TrevniBlockStats::LT, &v, TYPE_INT, 6));
+  v = 21;
+  EXPECT_FALSE(stats.MayMatch(TrevniBlockStats::EQ, &v, TYPE_INT, 6));
+  v = 0;
+  EXPECT_TRUE(stats.MayMatch(TrevniBlockStats::EQ, &v, TYPE_INT, 6));
+}
+
+TEST(TrevniBlockStatsTest, AllNull) {
+  TrevniBlockStats stats;
+  for (int i = 0; i < 3; ++i) {
+    stats.Update(NULL, TYPE_BIGINT);
+  }
+  int64_t v = 0;
+  EXPECT_FALSE(stats.MayMatch(TrevniBlockStats::EQ, &v, TYPE_BIGINT, 3));
+  EXPECT_FALSE(stats.MayMatch(TrevniBlockStats::GE, &v, TYPE_BIGINT, 3));
+}
+
+TEST(TrevniBlockStatsTest, Strings) {
+  TrevniBlockStats stats;
+  string values[] = { "mango", "apple", "pear" };
+  for (int i = 0; i < 3; ++i) {
+    StringValue sv(const_cast<char*>(values[i].data()), values[i].size());
+    stats.Update(&sv, TYPE_STRING);
+  }
+  string probe = "banana";
+  StringValue v(const_cast<char*>(probe.data()), probe.size());
+  EXPECT_TRUE(stats.MayMatch(TrevniBlockStats::EQ, &v, TYPE_STRING, 3));
+  probe = "zebra";
+  v = StringValue(const_cast<char*>(probe.data()), probe.size());
+  EXPECT_FALSE(stats.MayMatch(TrevniBlockStats::GE, &v, TYPE_STRING, 3));
+
+  // A value that is too long to track disables the range.
+  string long_value(TrevniBlockStats::MAX_STRING_LEN + 1, 'z');
+  StringValue sv(const_cast<char*>(long_value.data()), long_value.size());
+  stats.Update(&sv, TYPE_STRING);
+  EXPECT_TRUE(stats.MayMatch(TrevniBlockStats::GE, &v, TYPE_STRING, 4));
+}
+
+TEST(TrevniBlockStatsTest, RoundTrip) {
+  vector<TrevniBlockStats> stats(3);
+  double values[] = { 1.5, -2.5, 100.0, 42.0 };
+  stats[0].Update(&values[0], TYPE_DOUBLE);
+  stats[0].Update(&values[1], TYPE_DOUBLE);
+  stats[1].Update(NULL, TYPE_DOUBLE);
+  stats[2].Update(&values[2], TYPE_DOUBLE);
+  stats[2].Update(NULL, TYPE_DOUBLE);
+  stats[2].Update(&values[3], TYPE_DOUBLE);
+
+  vector<uint8_t> buffer;
+  TrevniBlockStats::AppendHeader(TYPE_DOUBLE, &buffer);
+  for (int i = 0; i < stats.size(); ++i) {
+    stats[i].AppendStats(TYPE_DOUBLE, &buffer);
+  }
+  int max_size = 0;
+  for (int i = 0; i < stats.size(); ++i) {
+    max_size += TrevniBlockStats::MaxSerializedSize(TYPE_DOUBLE);
+  }
+  EXPECT_LE(buffer.size(), max_size + 5);
+
+  vector<TrevniBlockStats> result;
+  EXPECT_TRUE(TrevniBlockStats::Parse(buffer, TYPE_DOUBLE, &result).ok());
+  ASSERT_EQ(result.size(), 3);
+  EXPECT_EQ(result[1].null_count(), 1);
+  EXPECT_EQ(result[2].null_count(), 1);
+
+  double v = 0;
+  EXPECT_TRUE(result[0].MayMatch(TrevniBlockStats::EQ, &v, TYPE_DOUBLE, 2));
+  EXPECT_FALSE(result[1].MayMatch(TrevniBlockStats::EQ, &v, TYPE_DOUBLE, 1));
+  EXPECT_FALSE(result[2].MayMatch(TrevniBlockStats::LT, &v, TYPE_DOUBLE, 3));
+  v = 50;
+  EXPECT_TRUE(result[2].MayMatch(TrevniBlockStats::EQ, &v, TYPE_DOUBLE, 3));
+  EXPECT_FALSE(result[0].MayMatch(TrevniBlockStats::GT, &v, TYPE_DOUBLE, 2));
+
+  // Stats for a different type are rejected.
+  EXPECT_FALSE(TrevniBlockStats::Parse(buffer, TYPE_BIGINT, &result).ok());
+  // So are truncated ones.
+  buffer.resize(buffer.size() - 1);
+  EXPECT_FALSE(TrevniBlockStats::Parse(buffer, TYPE_DOUBLE, &result).ok());
+}
+
+}
+
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
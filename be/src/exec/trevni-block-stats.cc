@@ -0,0 +1,198 @@
+// Copyright (c) 2012 Cloudera, Inc. All rights reserved.
+
+#include "exec/trevni-block-stats.h"
+
+#include <cmath>
+#include <sstream>
+
+#include "exec/read-write-util.h"
+#include "runtime/raw-value.h"
+#include "runtime/string-value.h"
+
+using namespace std;
+using namespace impala;
+
+// Only the first 12 bytes of a timestamp slot hold data, the same as in the
+// column data.
+static const int TIMESTAMP_DATA_SIZE = 12;
+
+// Returns the number of bytes a non-string value of 'type' is serialized as.
+static int SerializedValueSize(PrimitiveType type) {
+  return type == TYPE_TIMESTAMP ? TIMESTAMP_DATA_SIZE : GetByteSize(type);
+}
+
+// Returns a pointer to the slot representation of the stored 'value'.  For strings,
+// 'str' is set to point to the bytes of 'value' and returned.
+static const void* SlotValue(const string& value, PrimitiveType type, StringValue* str) {
+  if (type != TYPE_STRING) return value.data();
+  str->ptr = const_cast<char*>(value.data());
+  str->len = value.size();
+  return str;
+}
+
+void TrevniBlockStats::SetValue(const void* value, PrimitiveType type, string* dst) {
+  if (type == TYPE_STRING) {
+    const StringValue* str = reinterpret_cast<const StringValue*>(value);
+    dst->assign(str->ptr, str->len);
+  } else {
+    dst->assign(reinterpret_cast<const char*>(value), GetByteSize(type));
+  }
+}
+
+void TrevniBlockStats::Update(const void* value, PrimitiveType type) {
+  if (value == NULL) {
+    ++null_count_;
+    return;
+  }
+  if (!range_valid_) return;
+  // NaNs don't order with the other values.
+  bool untracked = false;
+  switch (type) {
+    case TYPE_STRING:
+      untracked = reinterpret_cast<const StringValue*>(value)->len > MAX_STRING_LEN;
+      break;
+    case TYPE_FLOAT:
+      untracked = std::isnan(*reinterpret_cast<const float*>(value));
+      break;
+    case TYPE_DOUBLE:
+      untracked = std::isnan(*reinterpret_cast<const double*>(value));
+      break;
+    default:
+      break;
+  }
+  if (untracked) {
+    has_value_ = true;
+    range_valid_ = false;
+    min_value_.clear();
+    max_value_.clear();
+    return;
+  }
+  if (!has_value_) {
+    has_value_ = true;
+    SetValue(value, type, &min_value_);
+    SetValue(value, type, &max_value_);
+    return;
+  }
+  StringValue str;
+  if (RawValue::Compare(value, SlotValue(min_value_, type, &str), type) < 0) {
+    SetValue(value, type, &min_value_);
+  } else if (RawValue::Compare(value, SlotValue(max_value_, type, &str), type) > 0) {
+    SetValue(value, type, &max_value_);
+  }
+}
+
+bool TrevniBlockStats::MayMatch(Op op, const void* value, PrimitiveType type,
+    int32_t row_count) const {
+  DCHECK(value != NULL);
+  // Comparisons with NULL are never true.
+  if (null_count_ >= row_count) return false;
+  if (!has_value_ || !range_valid_) return true;
+
+  StringValue str;
+  int min_cmp = RawValue::Compare(SlotValue(min_value_, type, &str), value, type);
+  int max_cmp = RawValue::Compare(SlotValue(max_value_, type, &str), value, type);
+  switch (op) {
+    case EQ: return min_cmp <= 0 && max_cmp >= 0;
+    case LT: return min_cmp < 0;
+    case LE: return min_cmp <= 0;
+    case GT: return max_cmp > 0;
+    case GE: return max_cmp >= 0;
+    default:
+      DCHECK(false);
+      return true;
+  }
+}
+
+bool TrevniBlockStats::Eval(Op op, const void* value, const void* constant,
+    PrimitiveType type) {
+  int cmp = RawValue::Compare(value, constant, type);
+  switch (op) {
+    case EQ: return cmp == 0;
+    case LT: return cmp < 0;
+    case LE: return cmp <= 0;
+    case GT: return cmp > 0;
+    case GE: return cmp >= 0;
+    default:
+      DCHECK(false);
+      return true;
+  }
+}
+
+int TrevniBlockStats::MaxSerializedSize(PrimitiveType type) {
+  int value_size = type == TYPE_STRING ?
+      ReadWriteUtil::MAX_ZINT_LEN + MAX_STRING_LEN : SerializedValueSize(type);
+  return ReadWriteUtil::MAX_ZINT_LEN + 1 + 2 * value_size;
+}
+
+void TrevniBlockStats::AppendHeader(PrimitiveType type, vector<uint8_t>* buffer) {
+  uint8_t buf[ReadWriteUtil::MAX_ZINT_LEN];
+  int len = ReadWriteUtil::PutZInt(type, buf);
+  buffer->insert(buffer->end(), buf, buf + len);
+}
+
+void TrevniBlockStats::AppendStats(PrimitiveType type, vector<uint8_t>* buffer) const {
+  uint8_t buf[ReadWriteUtil::MAX_ZINT_LEN];
+  int len = ReadWriteUtil::PutZInt(null_count_, buf);
+  buffer->insert(buffer->end(), buf, buf + len);
+  bool has_range = has_value_ && range_valid_;
+  buffer->push_back(has_range ? 1 : 0);
+  if (!has_range) return;
+
+  const string* values[] = { &min_value_, &max_value_ };
+  for (int i = 0; i < 2; ++i) {
+    const uint8_t* data = reinterpret_cast<const uint8_t*>(values[i]->data());
+    if (type == TYPE_STRING) {
+      len = ReadWriteUtil::PutZInt(values[i]->size(), buf);
+      buffer->insert(buffer->end(), buf, buf + len);
+      buffer->insert(buffer->end(), data, data + values[i]->size());
+    } else {
+      buffer->insert(buffer->end(), data, data + SerializedValueSize(type));
+    }
+  }
+}
+
+Status TrevniBlockStats::Parse(const vector<uint8_t>& buffer, PrimitiveType type,
+    vector<TrevniBlockStats>* stats) {
+  stats->clear();
+  if (buffer.empty()) return Status("Empty impala.stats metadata");
+  const uint8_t* data = &buffer[0];
+  const uint8_t* end = data + buffer.size();
+
+  int32_t stats_type;
+  if (!ReadWriteUtil::GetZInt(&data, end, &stats_type)) {
+    return Status("Bad impala.stats metadata");
+  }
+  if (stats_type != type) {
+    stringstream ss;
+    ss << "impala.stats metadata is for type "
+       << TypeToString(static_cast<PrimitiveType>(stats_type))
+       << ", the column is " << TypeToString(type);
+    return Status(ss.str());
+  }
+
+  while (data < end) {
+    TrevniBlockStats block_stats;
+    if (!ReadWriteUtil::GetZInt(&data, end, &block_stats.null_count_) || data >= end) {
+      return Status("Bad impala.stats metadata");
+    }
+    bool has_range = *data++ != 0;
+    block_stats.has_value_ = has_range;
+    block_stats.range_valid_ = has_range;
+    if (has_range) {
+      string* values[] = { &block_stats.min_value_, &block_stats.max_value_ };
+      for (int i = 0; i < 2; ++i) {
+        int32_t len = SerializedValueSize(type);
+        if (type == TYPE_STRING && !ReadWriteUtil::GetZInt(&data, end, &len)) {
+          return Status("Bad impala.stats metadata");
+        }
+        if (len < 0 || len > end - data) return Status("Bad impala.stats metadata");
+        values[i]->assign(reinterpret_cast<const char*>(data), len);
+        data += len;
+        // Pad timestamps back out to the slot size.
+        if (type != TYPE_STRING) values[i]->resize(GetByteSize(type));
+      }
+    }
+    stats->push_back(block_stats);
+  }
+  return Status::OK;
+}
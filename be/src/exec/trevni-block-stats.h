@@ -0,0 +1,99 @@
+// Copyright (c) 2012 Cloudera, Inc. All rights reserved.
+
+#ifndef IMPALA_EXEC_TREVNI_BLOCK_STATS_H
+#define IMPALA_EXEC_TREVNI_BLOCK_STATS_H
+
+#include <string>
+#include <vector>
+#include <boost/cstdint.hpp>
+
+#include "common/status.h"
+#include "runtime/primitive-type.h"
+
+namespace impala {
+
+// Statistics for the values of one block of a Trevni column: the number of nulls and
+// the min and max of the non-null values.  They are written by the Trevni table
+// writer as the impala.stats column metadata and used by the scanner to skip blocks
+// that cannot contain a row that passes the conjuncts.
+// The values are kept in their slot representation for the column's PrimitiveType.
+// Strings longer than MAX_STRING_LEN and NaNs are not tracked: a block containing one
+// has no range, only a null count.
+//
+// The impala.stats metadata value is:
+//   <primitive-type> <block-stats>*     -- one for each block in the column.
+// primitive-type ::= ZInt               -- PrimitiveType of the values
+// block-stats ::= <null-count> <has-range> [<min> <max>]
+// null-count ::= ZInt
+// has-range ::= Byte                    -- 1 if min and max follow
+// min, max ::= ZInt length followed by the bytes for strings, the slot bytes
+//              of the type otherwise.
+class TrevniBlockStats {
+ public:
+  // Longest string value that is tracked.
+  static const int MAX_STRING_LEN = 64;
+
+  // Comparisons that can be evaluated against the stats: 'column op value'.
+  enum Op {
+    EQ,
+    LT,
+    LE,
+    GT,
+    GE
+  };
+
+  TrevniBlockStats()
+    : null_count_(0),
+      has_value_(false),
+      range_valid_(true) {
+  }
+
+  // Adds a value, of type 'type', to the stats.  'value' is NULL for null values.
+  void Update(const void* value, PrimitiveType type);
+
+  // Returns false if no row of a block with 'row_count' rows can satisfy
+  // 'column op value'.  'value' is of type 'type' and not NULL.
+  bool MayMatch(Op op, const void* value, PrimitiveType type, int32_t row_count) const;
+
+  // Returns 'value op constant'.  Both are non-NULL values of type 'type'.
+  static bool Eval(Op op, const void* value, const void* constant, PrimitiveType type);
+
+  // Returns the largest number of bytes AppendStats() adds for a block of type 'type'.
+  static int MaxSerializedSize(PrimitiveType type);
+
+  // Appends the serialized stats for one block to 'buffer'.
+  void AppendStats(PrimitiveType type, std::vector<uint8_t>* buffer) const;
+
+  // Writes the header of the impala.stats metadata value for columns of 'type'.
+  static void AppendHeader(PrimitiveType type, std::vector<uint8_t>* buffer);
+
+  // Parses the impala.stats metadata value 'buffer' into 'stats', one entry per
+  // block.  Returns an error if the value is malformed or was not written for columns
+  // of type 'type'.
+  static Status Parse(const std::vector<uint8_t>& buffer, PrimitiveType type,
+      std::vector<TrevniBlockStats>* stats);
+
+  int32_t null_count() const { return null_count_; }
+
+ private:
+  // Sets 'dst' to the slot representation of 'value'.
+  static void SetValue(const void* value, PrimitiveType type, std::string* dst);
+
+  // Number of null values.
+  int32_t null_count_;
+
+  // True if a non-null value was added.
+  bool has_value_;
+
+  // False if some value could not be tracked.  min_value_/max_value_ are only used
+  // if has_value_ && range_valid_.
+  bool range_valid_;
+
+  // Min and max value, in the slot representation.  For strings, the string bytes.
+  std::string min_value_;
+  std::string max_value_;
+};
+
+}
+
+#endif
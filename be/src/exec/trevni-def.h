@@ -103,6 +103,25 @@ static const std::string TREVNI_ARRAY = "trevni.array";
 static const std::string TREVNI_PARENT = "trevni.parent";
 static const std::string TREVNI_REPETITION = "trevni.repetition";
 static const std::string TREVNI_DEFINITION = "trevni.definition";
+// Impala specific: per-block value statistics, see TrevniBlockStats.
+static const std::string TREVNI_STATS = "impala.stats";
+// Impala specific: the TrevniEncoding of each block, one byte per block.
+static const std::string TREVNI_ENCODINGS = "impala.encodings";
+
+// Encodings of the values in a block.  Columns without the impala.encodings metadata
+// only have plain blocks.
+enum TrevniEncoding {
+  // The values as defined by Trevni.
+  TREVNI_PLAIN = 0,
+  // A dictionary followed by the dictionary codes of the values:
+  //   dictionary-block ::= <dictionary-size> <column-values>* <codes>
+  //   dictionary-size ::= ZInt
+  //   codes ::= -- see TrevniRleEncoder
+  // Only used for string, int and long columns.  This is not part of Trevni: other
+  // Trevni readers can't decode these blocks, so the writer only produces them if
+  // --trevni_dictionary_encoding is set.
+  TREVNI_DICTIONARY = 1
+};
 
 // Types defined by Trevni.
 enum TrevniType {
@@ -170,7 +189,9 @@ enum ColumnMeta {
   COL_ARRAY,        // Trevni: is array
   COL_PARENT,       // Trevni: name of parent column, if any
   COL_REPETITION,     // Impala: Max repetition level, 0 if absent
-  COL_DEFINITION    // Impala: Max definition level, 0 if absent. > 0 implies nullable.
+  COL_DEFINITION,   // Impala: Max definition level, 0 if absent. > 0 implies nullable.
+  COL_STATS,        // Impala: Per-block null counts and min/max values.
+  COL_ENCODINGS     // Impala: Per-block encodings.
 };
 
 static const std::map<const std::string, ColumnMeta> column_meta_map = boost::assign::map_list_of
@@ -181,7 +202,9 @@ static const std::map<const std::string, ColumnMeta> column_meta_map = boost::as
   (TREVNI_ARRAY, COL_ARRAY)
   (TREVNI_PARENT, COL_PARENT)
   (TREVNI_REPETITION, COL_REPETITION)
-  (TREVNI_DEFINITION, COL_DEFINITION);
+  (TREVNI_DEFINITION, COL_DEFINITION)
+  (TREVNI_STATS, COL_STATS)
+  (TREVNI_ENCODINGS, COL_ENCODINGS);
 
 // Map of recognized checksum names
 enum Checksum {
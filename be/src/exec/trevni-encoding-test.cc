@@ -0,0 +1,109 @@
+// Copyright (c) 2012 Cloudera, Inc. All rights reserved.
+
+#include <vector>
+#include <gtest/gtest.h>
+
+#include "exec/trevni-encoding.h"
+
+using namespace std;
+
+namespace impala {
+
+// Encodes 'codes' and checks that they decode back to the same values.
+static void TestRoundTrip(const vector<int32_t>& codes, int bit_width) {
+  vector<uint8_t> buffer;
+  TrevniRleEncoder::Encode(codes, bit_width, &buffer);
+
+  TrevniRleDecoder decoder;
+  const uint8_t* data = buffer.empty() ? NULL : &buffer[0];
+  decoder.Reset(data, data + buffer.size(), bit_width);
+  for (int i = 0; i < codes.size(); ++i) {
+    int32_t code;
+    ASSERT_TRUE(decoder.GetNext(&code));
+    EXPECT_EQ(code, codes[i]) << "index " << i;
+  }
+  int32_t code;
+  EXPECT_FALSE(decoder.GetNext(&code));
+}
+
+TEST(TrevniEncodingTest, BitWidth) {
+  EXPECT_EQ(TrevniRleEncoder::BitWidth(1), 0);
+  EXPECT_EQ(TrevniRleEncoder::BitWidth(2), 1);
+  EXPECT_EQ(TrevniRleEncoder::BitWidth(3), 2);
+  EXPECT_EQ(TrevniRleEncoder::BitWidth(4), 2);
+  EXPECT_EQ(TrevniRleEncoder::BitWidth(5), 3);
+  EXPECT_EQ(TrevniRleEncoder::BitWidth(256), 8);
+  EXPECT_EQ(TrevniRleEncoder::BitWidth(257), 9);
+}
+
+TEST(TrevniEncodingTest, RoundTrip) {
+  for (int bit_width = 1; bit_width <= 20; ++bit_width) {
+    vector<int32_t> codes;
+    for (int i = 0; i < 1000; ++i) {
+      codes.push_back((i * 7919) & ((1 << bit_width) - 1));
+    }
+    TestRoundTrip(codes, bit_width);
+  }
+
+  // A single entry dictionary has no bits per code.
+  TestRoundTrip(vector<int32_t>(100, 0), 0);
+}
+
+TEST(TrevniEncodingTest, Runs) {
+  // Long runs of the same code are stored as rle-runs, the rest is bit packed.
+  vector<int32_t> codes;
+  for (int i = 0; i < 5; ++i) codes.push_back(i);
+  codes.insert(codes.end(), 1000, 3);
+  codes.push_back(6);
+  codes.insert(codes.end(), TrevniRleEncoder::MIN_REPEAT_RUN - 1, 2);
+  codes.insert(codes.end(), 500, 7);
+  TestRoundTrip(codes, 3);
+
+  vector<uint8_t> buffer;
+  TrevniRleEncoder::Encode(codes, 3, &buffer);
+  EXPECT_LT(buffer.size(), 20);
+}
+
+TEST(TrevniEncodingTest, Skip) {
+  vector<int32_t> codes;
+  for (int i = 0; i < 300; ++i) codes.push_back(i % 13);
+  codes.insert(codes.end(), 200, 9);
+  for (int i = 0; i < 300; ++i) codes.push_back(i % 5);
+
+  vector<uint8_t> buffer;
+  TrevniRleEncoder::Encode(codes, 4, &buffer);
+  TrevniRleDecoder decoder;
+  decoder.Reset(&buffer[0], &buffer[0] + buffer.size(), 4);
+
+  int skips[] = { 0, 17, 250, 1, 190, 3, 100 };
+  int idx = 0;
+  for (int i = 0; i < sizeof(skips) / sizeof(skips[0]); ++i) {
+    ASSERT_TRUE(decoder.Skip(skips[i]));
+    idx += skips[i];
+    int32_t code;
+    ASSERT_TRUE(decoder.GetNext(&code));
+    EXPECT_EQ(code, codes[idx]) << "index " << idx;
+    ++idx;
+  }
+  EXPECT_TRUE(decoder.Skip(codes.size() - idx));
+  EXPECT_FALSE(decoder.Skip(1));
+}
+
+TEST(TrevniEncodingTest, Truncated) {
+  vector<int32_t> codes;
+  for (int i = 0; i < 100; ++i) codes.push_back(i);
+  vector<uint8_t> buffer;
+  TrevniRleEncoder::Encode(codes, 7, &buffer);
+
+  TrevniRleDecoder decoder;
+  decoder.Reset(&buffer[0], &buffer[0] + buffer.size() - 1, 7);
+  int32_t code;
+  EXPECT_FALSE(decoder.GetNext(&code));
+}
+
+}
+
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
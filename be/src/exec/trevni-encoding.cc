@@ -0,0 +1,110 @@
+// Copyright (c) 2012 Cloudera, Inc. All rights reserved.
+
+#include "exec/trevni-encoding.h"
+
+#include <algorithm>
+
+#include "exec/read-write-util.h"
+
+using namespace std;
+using namespace impala;
+
+void TrevniRleEncoder::Encode(const vector<int32_t>& codes, int bit_width,
+    vector<uint8_t>* buffer) {
+  int num_codes = codes.size();
+  // Start of the codes not yet written.
+  int literal_start = 0;
+  int i = 0;
+  while (i < num_codes) {
+    int run_end = i + 1;
+    while (run_end < num_codes && codes[run_end] == codes[i]) ++run_end;
+    if (run_end - i >= MIN_REPEAT_RUN) {
+      if (i > literal_start) {
+        AppendPackedRun(&codes[literal_start], i - literal_start, bit_width, buffer);
+      }
+      AppendRepeatRun(codes[i], run_end - i, buffer);
+      literal_start = run_end;
+    }
+    i = run_end;
+  }
+  if (num_codes > literal_start) {
+    AppendPackedRun(&codes[literal_start], num_codes - literal_start, bit_width, buffer);
+  }
+}
+
+void TrevniRleEncoder::AppendRepeatRun(int32_t code, int count, vector<uint8_t>* buffer) {
+  uint8_t buf[ReadWriteUtil::MAX_ZINT_LEN];
+  int len = ReadWriteUtil::PutZInt((count << 1) | 1, buf);
+  buffer->insert(buffer->end(), buf, buf + len);
+  len = ReadWriteUtil::PutZInt(code, buf);
+  buffer->insert(buffer->end(), buf, buf + len);
+}
+
+void TrevniRleEncoder::AppendPackedRun(const int32_t* codes, int count, int bit_width,
+    vector<uint8_t>* buffer) {
+  uint8_t buf[ReadWriteUtil::MAX_ZINT_LEN];
+  int len = ReadWriteUtil::PutZInt(count << 1, buf);
+  buffer->insert(buffer->end(), buf, buf + len);
+
+  int start = buffer->size();
+  buffer->resize(start + (static_cast<int64_t>(count) * bit_width + 7) / 8, 0);
+  uint8_t* packed = &(*buffer)[start];
+  int64_t bit_offset = 0;
+  for (int i = 0; i < count; ++i) {
+    uint32_t code = codes[i];
+    for (int bits = 0; bits < bit_width;) {
+      int shift = bit_offset & 7;
+      int num_bits = min(8 - shift, bit_width - bits);
+      packed[bit_offset >> 3] |= ((code >> bits) & ((1 << num_bits) - 1)) << shift;
+      bits += num_bits;
+      bit_offset += num_bits;
+    }
+  }
+}
+
+void TrevniRleDecoder::Reset(const uint8_t* data, const uint8_t* end, int bit_width) {
+  data_ = data;
+  end_ = end;
+  bit_width_ = bit_width;
+  run_count_ = 0;
+}
+
+bool TrevniRleDecoder::NextRun() {
+  int32_t header;
+  if (!ReadWriteUtil::GetZInt(&data_, end_, &header) || header < 0) return false;
+  run_count_ = header >> 1;
+  repeat_run_ = (header & 1) != 0;
+  if (repeat_run_) {
+    if (!ReadWriteUtil::GetZInt(&data_, end_, &repeated_code_)) return false;
+  } else {
+    int64_t num_bytes = (static_cast<int64_t>(run_count_) * bit_width_ + 7) / 8;
+    if (num_bytes > end_ - data_) return false;
+    packed_ = data_;
+    bit_offset_ = 0;
+    data_ += num_bytes;
+  }
+  return run_count_ > 0 || NextRun();
+}
+
+int32_t TrevniRleDecoder::GetPackedCode() {
+  uint32_t code = 0;
+  for (int bits = 0; bits < bit_width_;) {
+    int shift = bit_offset_ & 7;
+    int num_bits = min(8 - shift, bit_width_ - bits);
+    code |= ((packed_[bit_offset_ >> 3] >> shift) & ((1 << num_bits) - 1)) << bits;
+    bits += num_bits;
+    bit_offset_ += num_bits;
+  }
+  return code;
+}
+
+bool TrevniRleDecoder::Skip(int num_codes) {
+  while (num_codes > 0) {
+    if (run_count_ == 0 && !NextRun()) return false;
+    int n = min(num_codes, run_count_);
+    if (!repeat_run_) bit_offset_ += static_cast<int64_t>(n) * bit_width_;
+    run_count_ -= n;
+    num_codes -= n;
+  }
+  return true;
+}
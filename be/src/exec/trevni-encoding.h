@@ -0,0 +1,102 @@
+// Copyright (c) 2012 Cloudera, Inc. All rights reserved.
+
+#ifndef IMPALA_EXEC_TREVNI_ENCODING_H
+#define IMPALA_EXEC_TREVNI_ENCODING_H
+
+#include <vector>
+#include <boost/cstdint.hpp>
+
+namespace impala {
+
+// Encoder and decoder for the dictionary codes of a dictionary encoded Trevni block.
+// The codes are stored as a sequence of runs:
+//   run ::= <rle-run> | <packed-run>
+//   rle-run ::= ZInt(count << 1 | 1) ZInt(code)  -- 'count' repeats of 'code'
+//   packed-run ::= ZInt(count << 1) <bits>       -- 'count' codes of 'bit_width' bits
+// The packed codes are stored least significant bit first, and the run is padded to
+// a whole byte.
+class TrevniRleEncoder {
+ public:
+  // Shortest run of a repeated code that is stored as an rle-run.
+  static const int MIN_REPEAT_RUN = 8;
+
+  // Returns the number of bits the codes of a dictionary with 'num_entries' entries
+  // are packed in.
+  static int BitWidth(int num_entries) {
+    int bit_width = 0;
+    while (num_entries - 1 >= (1 << bit_width)) ++bit_width;
+    return bit_width;
+  }
+
+  // Appends the runs for 'codes' to 'buffer'.  The codes must fit in 'bit_width' bits.
+  static void Encode(const std::vector<int32_t>& codes, int bit_width,
+      std::vector<uint8_t>* buffer);
+
+ private:
+  // Appends an rle-run of 'count' repeats of 'code'.
+  static void AppendRepeatRun(int32_t code, int count, std::vector<uint8_t>* buffer);
+
+  // Appends a packed-run of the 'count' codes starting at 'codes'.
+  static void AppendPackedRun(const int32_t* codes, int count, int bit_width,
+      std::vector<uint8_t>* buffer);
+};
+
+// Decodes the runs written by TrevniRleEncoder.
+class TrevniRleDecoder {
+ public:
+  TrevniRleDecoder()
+    : data_(NULL),
+      end_(NULL),
+      bit_width_(0),
+      run_count_(0),
+      repeat_run_(false),
+      repeated_code_(0),
+      packed_(NULL),
+      bit_offset_(0) {
+  }
+
+  // Starts decoding the runs in [data, end).
+  void Reset(const uint8_t* data, const uint8_t* end, int bit_width);
+
+  // Returns the next code in *code.  Returns false if the data is exhausted.
+  bool GetNext(int32_t* code) {
+    if (run_count_ == 0 && !NextRun()) return false;
+    --run_count_;
+    if (repeat_run_) {
+      *code = repeated_code_;
+    } else {
+      *code = GetPackedCode();
+    }
+    return true;
+  }
+
+  // Skips over the next 'num_codes' codes.  Returns false if the data is exhausted.
+  bool Skip(int num_codes);
+
+ private:
+  // Reads the header of the next run.  Returns false if there is none or it is
+  // corrupt.
+  bool NextRun();
+
+  // Returns the next code of the current packed run.
+  int32_t GetPackedCode();
+
+  const uint8_t* data_;
+  const uint8_t* end_;
+  int bit_width_;
+
+  // Codes left in the current run.
+  int run_count_;
+
+  // True if the current run is an rle-run of repeated_code_.
+  bool repeat_run_;
+  int32_t repeated_code_;
+
+  // Start of the current packed run and the bit offset of the next code in it.
+  const uint8_t* packed_;
+  int64_t bit_offset_;
+};
+
+}
+
+#endif
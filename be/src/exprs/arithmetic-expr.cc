@@ -27,6 +27,174 @@ string ArithmeticExpr::DebugString() const {
   return out.str();
 }
 
+bool ArithmeticExpr::IsVectorizable() const {
+  switch (op()) {
+    case TExprOpcode::INT_DIVIDE_CHAR_CHAR:
+    case TExprOpcode::INT_DIVIDE_SHORT_SHORT:
+    case TExprOpcode::INT_DIVIDE_INT_INT:
+    case TExprOpcode::INT_DIVIDE_LONG_LONG:
+    case TExprOpcode::MOD_CHAR_CHAR:
+    case TExprOpcode::MOD_SHORT_SHORT:
+    case TExprOpcode::MOD_INT_INT:
+    case TExprOpcode::MOD_LONG_LONG:
+      return false;
+    default:
+      return ChildrenVectorizable();
+  }
+}
+
+// Ops for ComputeBinaryVector().
+namespace {
+
+struct AddOp {
+  template <typename T> static T Apply(T a, T b) { return a + b; }
+};
+struct SubtractOp {
+  template <typename T> static T Apply(T a, T b) { return a - b; }
+};
+struct MultiplyOp {
+  template <typename T> static T Apply(T a, T b) { return a * b; }
+};
+struct DivideOp {
+  template <typename T> static T Apply(T a, T b) { return a / b; }
+};
+struct BitAndOp {
+  template <typename T> static T Apply(T a, T b) { return a & b; }
+};
+struct BitOrOp {
+  template <typename T> static T Apply(T a, T b) { return a | b; }
+};
+struct BitXorOp {
+  template <typename T> static T Apply(T a, T b) { return a ^ b; }
+};
+
+}
+
+// The loops have no branches, so that the compiler can vectorize them.
+template <typename Op, typename T>
+static void BinaryLoop(int begin, int end, const T* lhs, const uint8_t* lhs_nulls,
+    const T* rhs, const uint8_t* rhs_nulls, T* result, uint8_t* result_nulls) {
+  for (int i = begin; i < end; ++i) {
+    result[i] = Op::Apply(lhs[i], rhs[i]);
+    result_nulls[i] = lhs_nulls[i] | rhs_nulls[i];
+  }
+}
+
+template <typename T>
+static void BitNotLoop(int begin, int end, const T* child, const uint8_t* child_nulls,
+    T* result, uint8_t* result_nulls) {
+  for (int i = begin; i < end; ++i) {
+    result[i] = ~child[i];
+    result_nulls[i] = child_nulls[i];
+  }
+}
+
+template <typename Op>
+void ArithmeticExpr::ComputeBinaryVector(int begin, int end, ExprVector* lhs,
+    ExprVector* rhs, ExprVector* result) {
+  switch (type()) {
+    case TYPE_TINYINT:
+      BinaryLoop<Op>(begin, end, lhs->values<int8_t>(), lhs->nulls(),
+          rhs->values<int8_t>(), rhs->nulls(), result->values<int8_t>(), result->nulls());
+      break;
+    case TYPE_SMALLINT:
+      BinaryLoop<Op>(begin, end, lhs->values<int16_t>(), lhs->nulls(),
+          rhs->values<int16_t>(), rhs->nulls(), result->values<int16_t>(),
+          result->nulls());
+      break;
+    case TYPE_INT:
+      BinaryLoop<Op>(begin, end, lhs->values<int32_t>(), lhs->nulls(),
+          rhs->values<int32_t>(), rhs->nulls(), result->values<int32_t>(),
+          result->nulls());
+      break;
+    case TYPE_BIGINT:
+      BinaryLoop<Op>(begin, end, lhs->values<int64_t>(), lhs->nulls(),
+          rhs->values<int64_t>(), rhs->nulls(), result->values<int64_t>(),
+          result->nulls());
+      break;
+    default:
+      DCHECK(false) << "Unexpected type: " << TypeToString(type());
+  }
+}
+
+void ArithmeticExpr::ComputeVector(RowBatch* batch, const int* sel, int num_rows,
+    ExprVector* result) {
+  ExprVector* lhs = children()[0]->GetVector(batch, sel, num_rows);
+  ExprVector* rhs = NULL;
+  if (GetNumChildren() == 2) rhs = children()[1]->GetVector(batch, sel, num_rows);
+  // The ops are computed for all rows in the range, including the unselected ones.
+  int begin = sel[0];
+  int end = sel[num_rows - 1] + 1;
+
+  switch (op()) {
+    case TExprOpcode::BITNOT_CHAR:
+      BitNotLoop(begin, end, lhs->values<int8_t>(), lhs->nulls(),
+          result->values<int8_t>(), result->nulls());
+      break;
+    case TExprOpcode::BITNOT_SHORT:
+      BitNotLoop(begin, end, lhs->values<int16_t>(), lhs->nulls(),
+          result->values<int16_t>(), result->nulls());
+      break;
+    case TExprOpcode::BITNOT_INT:
+      BitNotLoop(begin, end, lhs->values<int32_t>(), lhs->nulls(),
+          result->values<int32_t>(), result->nulls());
+      break;
+    case TExprOpcode::BITNOT_LONG:
+      BitNotLoop(begin, end, lhs->values<int64_t>(), lhs->nulls(),
+          result->values<int64_t>(), result->nulls());
+      break;
+    case TExprOpcode::ADD_LONG_LONG:
+      ComputeBinaryVector<AddOp>(begin, end, lhs, rhs, result);
+      break;
+    case TExprOpcode::ADD_DOUBLE_DOUBLE:
+      BinaryLoop<AddOp>(begin, end, lhs->values<double>(), lhs->nulls(),
+          rhs->values<double>(), rhs->nulls(), result->values<double>(), result->nulls());
+      break;
+    case TExprOpcode::SUBTRACT_LONG_LONG:
+      ComputeBinaryVector<SubtractOp>(begin, end, lhs, rhs, result);
+      break;
+    case TExprOpcode::SUBTRACT_DOUBLE_DOUBLE:
+      BinaryLoop<SubtractOp>(begin, end, lhs->values<double>(), lhs->nulls(),
+          rhs->values<double>(), rhs->nulls(), result->values<double>(), result->nulls());
+      break;
+    case TExprOpcode::MULTIPLY_LONG_LONG:
+      ComputeBinaryVector<MultiplyOp>(begin, end, lhs, rhs, result);
+      break;
+    case TExprOpcode::MULTIPLY_DOUBLE_DOUBLE:
+      BinaryLoop<MultiplyOp>(begin, end, lhs->values<double>(), lhs->nulls(),
+          rhs->values<double>(), rhs->nulls(), result->values<double>(), result->nulls());
+      break;
+    case TExprOpcode::DIVIDE:
+      BinaryLoop<DivideOp>(begin, end, lhs->values<double>(), lhs->nulls(),
+          rhs->values<double>(), rhs->nulls(), result->values<double>(), result->nulls());
+      break;
+
+    case TExprOpcode::BITAND_CHAR_CHAR:
+    case TExprOpcode::BITAND_SHORT_SHORT:
+    case TExprOpcode::BITAND_INT_INT:
+    case TExprOpcode::BITAND_LONG_LONG:
+      ComputeBinaryVector<BitAndOp>(begin, end, lhs, rhs, result);
+      break;
+
+    case TExprOpcode::BITOR_CHAR_CHAR:
+    case TExprOpcode::BITOR_SHORT_SHORT:
+    case TExprOpcode::BITOR_INT_INT:
+    case TExprOpcode::BITOR_LONG_LONG:
+      ComputeBinaryVector<BitOrOp>(begin, end, lhs, rhs, result);
+      break;
+
+    case TExprOpcode::BITXOR_CHAR_CHAR:
+    case TExprOpcode::BITXOR_SHORT_SHORT:
+    case TExprOpcode::BITXOR_INT_INT:
+    case TExprOpcode::BITXOR_LONG_LONG:
+      ComputeBinaryVector<BitXorOp>(begin, end, lhs, rhs, result);
+      break;
+
+    default:
+      DCHECK(false) << "Unknown op: " << op();
+  }
+}
+
 // IR generator for ArithmeticExpr.  For ADD_LONG_LONG, the IR looks like:
 //
 // define i64 @ArithmeticExpr(i8** %row, i8* %state_data, i1* %is_null) {
@@ -15,6 +15,10 @@ class ArithmeticExpr: public Expr {
  public:
   virtual llvm::Function* Codegen(LlvmCodeGen* code_gen);
 
+  // Integer division and modulo are not vectorizable: they would also be computed
+  // for rows with a NULL or unselected divisor, which could be 0.
+  virtual bool IsVectorizable() const;
+
  protected:
   friend class Expr;
 
@@ -22,6 +26,15 @@ class ArithmeticExpr: public Expr {
   ArithmeticExpr(const TExprNode& node);
 
   virtual std::string DebugString() const;
+
+  virtual void ComputeVector(RowBatch* batch, const int* sel, int num_rows,
+      ExprVector* result);
+
+ private:
+  // Applies 'Op' to the values of rows [begin, end) of 'lhs' and 'rhs'.
+  template <typename Op>
+  void ComputeBinaryVector(int begin, int end, ExprVector* lhs, ExprVector* rhs,
+      ExprVector* result);
 };
 
 }
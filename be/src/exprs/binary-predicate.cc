@@ -27,6 +27,181 @@ string BinaryPredicate::DebugString() const {
   return out.str();
 }
 
+// Ops for ComputeCompareVector().
+namespace {
+
+struct EqOp {
+  template <typename T> static bool Apply(const T& a, const T& b) { return a == b; }
+  static bool Apply(const StringValue& a, const StringValue& b) { return a.Eq(b); }
+};
+struct NeOp {
+  template <typename T> static bool Apply(const T& a, const T& b) { return a != b; }
+  static bool Apply(const StringValue& a, const StringValue& b) { return a.Ne(b); }
+};
+struct LtOp {
+  template <typename T> static bool Apply(const T& a, const T& b) { return a < b; }
+  static bool Apply(const StringValue& a, const StringValue& b) { return a.Lt(b); }
+};
+struct GtOp {
+  template <typename T> static bool Apply(const T& a, const T& b) { return a > b; }
+  static bool Apply(const StringValue& a, const StringValue& b) { return a.Gt(b); }
+};
+struct LeOp {
+  template <typename T> static bool Apply(const T& a, const T& b) { return a <= b; }
+  static bool Apply(const StringValue& a, const StringValue& b) { return a.Le(b); }
+};
+struct GeOp {
+  template <typename T> static bool Apply(const T& a, const T& b) { return a >= b; }
+  static bool Apply(const StringValue& a, const StringValue& b) { return a.Ge(b); }
+};
+
+}
+
+// Compares all rows in [begin, end).  The loop has no branches, so that the compiler
+// can vectorize it.
+template <typename Op, typename T>
+static void CompareLoop(int begin, int end, const T* lhs, const uint8_t* lhs_nulls,
+    const T* rhs, const uint8_t* rhs_nulls, uint8_t* result, uint8_t* result_nulls) {
+  for (int i = begin; i < end; ++i) {
+    result[i] = Op::Apply(lhs[i], rhs[i]);
+    result_nulls[i] = lhs_nulls[i] | rhs_nulls[i];
+  }
+}
+
+// Strings are only compared for the selected, non-NULL rows: the values of the
+// other rows may point to memory that is no longer valid.
+template <typename Op>
+static void CompareStringLoop(const int* sel, int num_rows, const StringValue* lhs,
+    const uint8_t* lhs_nulls, const StringValue* rhs, const uint8_t* rhs_nulls,
+    uint8_t* result, uint8_t* result_nulls) {
+  for (int i = 0; i < num_rows; ++i) {
+    int row_idx = sel[i];
+    result_nulls[row_idx] = lhs_nulls[row_idx] | rhs_nulls[row_idx];
+    if (!result_nulls[row_idx]) result[row_idx] = Op::Apply(lhs[row_idx], rhs[row_idx]);
+  }
+}
+
+template <typename Op>
+void BinaryPredicate::ComputeCompareVector(const int* sel, int num_rows,
+    ExprVector* lhs, ExprVector* rhs, ExprVector* result) {
+  int begin = sel[0];
+  int end = sel[num_rows - 1] + 1;
+  uint8_t* values = result->values<uint8_t>();
+  uint8_t* nulls = result->nulls();
+  switch (children()[0]->type()) {
+    case TYPE_BOOLEAN:
+      CompareLoop<Op>(begin, end, lhs->values<uint8_t>(), lhs->nulls(),
+          rhs->values<uint8_t>(), rhs->nulls(), values, nulls);
+      break;
+    case TYPE_TINYINT:
+      CompareLoop<Op>(begin, end, lhs->values<int8_t>(), lhs->nulls(),
+          rhs->values<int8_t>(), rhs->nulls(), values, nulls);
+      break;
+    case TYPE_SMALLINT:
+      CompareLoop<Op>(begin, end, lhs->values<int16_t>(), lhs->nulls(),
+          rhs->values<int16_t>(), rhs->nulls(), values, nulls);
+      break;
+    case TYPE_INT:
+      CompareLoop<Op>(begin, end, lhs->values<int32_t>(), lhs->nulls(),
+          rhs->values<int32_t>(), rhs->nulls(), values, nulls);
+      break;
+    case TYPE_BIGINT:
+      CompareLoop<Op>(begin, end, lhs->values<int64_t>(), lhs->nulls(),
+          rhs->values<int64_t>(), rhs->nulls(), values, nulls);
+      break;
+    case TYPE_FLOAT:
+      CompareLoop<Op>(begin, end, lhs->values<float>(), lhs->nulls(),
+          rhs->values<float>(), rhs->nulls(), values, nulls);
+      break;
+    case TYPE_DOUBLE:
+      CompareLoop<Op>(begin, end, lhs->values<double>(), lhs->nulls(),
+          rhs->values<double>(), rhs->nulls(), values, nulls);
+      break;
+    case TYPE_STRING:
+      CompareStringLoop<Op>(sel, num_rows, lhs->values<StringValue>(), lhs->nulls(),
+          rhs->values<StringValue>(), rhs->nulls(), values, nulls);
+      break;
+    default:
+      DCHECK(false) << "Unexpected type: " << TypeToString(children()[0]->type());
+  }
+}
+
+void BinaryPredicate::ComputeVector(RowBatch* batch, const int* sel, int num_rows,
+    ExprVector* result) {
+  ExprVector* lhs = children()[0]->GetVector(batch, sel, num_rows);
+  ExprVector* rhs = children()[1]->GetVector(batch, sel, num_rows);
+  switch (op()) {
+    case TExprOpcode::EQ_BOOL_BOOL:
+    case TExprOpcode::EQ_CHAR_CHAR:
+    case TExprOpcode::EQ_SHORT_SHORT:
+    case TExprOpcode::EQ_INT_INT:
+    case TExprOpcode::EQ_LONG_LONG:
+    case TExprOpcode::EQ_FLOAT_FLOAT:
+    case TExprOpcode::EQ_DOUBLE_DOUBLE:
+    case TExprOpcode::EQ_STRINGVALUE_STRINGVALUE:
+      ComputeCompareVector<EqOp>(sel, num_rows, lhs, rhs, result);
+      break;
+
+    case TExprOpcode::NE_BOOL_BOOL:
+    case TExprOpcode::NE_CHAR_CHAR:
+    case TExprOpcode::NE_SHORT_SHORT:
+    case TExprOpcode::NE_INT_INT:
+    case TExprOpcode::NE_LONG_LONG:
+    case TExprOpcode::NE_FLOAT_FLOAT:
+    case TExprOpcode::NE_DOUBLE_DOUBLE:
+    case TExprOpcode::NE_STRINGVALUE_STRINGVALUE:
+      ComputeCompareVector<NeOp>(sel, num_rows, lhs, rhs, result);
+      break;
+
+    case TExprOpcode::LT_BOOL_BOOL:
+    case TExprOpcode::LT_CHAR_CHAR:
+    case TExprOpcode::LT_SHORT_SHORT:
+    case TExprOpcode::LT_INT_INT:
+    case TExprOpcode::LT_LONG_LONG:
+    case TExprOpcode::LT_FLOAT_FLOAT:
+    case TExprOpcode::LT_DOUBLE_DOUBLE:
+    case TExprOpcode::LT_STRINGVALUE_STRINGVALUE:
+      ComputeCompareVector<LtOp>(sel, num_rows, lhs, rhs, result);
+      break;
+
+    case TExprOpcode::GT_BOOL_BOOL:
+    case TExprOpcode::GT_CHAR_CHAR:
+    case TExprOpcode::GT_SHORT_SHORT:
+    case TExprOpcode::GT_INT_INT:
+    case TExprOpcode::GT_LONG_LONG:
+    case TExprOpcode::GT_FLOAT_FLOAT:
+    case TExprOpcode::GT_DOUBLE_DOUBLE:
+    case TExprOpcode::GT_STRINGVALUE_STRINGVALUE:
+      ComputeCompareVector<GtOp>(sel, num_rows, lhs, rhs, result);
+      break;
+
+    case TExprOpcode::LE_BOOL_BOOL:
+    case TExprOpcode::LE_CHAR_CHAR:
+    case TExprOpcode::LE_SHORT_SHORT:
+    case TExprOpcode::LE_INT_INT:
+    case TExprOpcode::LE_LONG_LONG:
+    case TExprOpcode::LE_FLOAT_FLOAT:
+    case TExprOpcode::LE_DOUBLE_DOUBLE:
+    case TExprOpcode::LE_STRINGVALUE_STRINGVALUE:
+      ComputeCompareVector<LeOp>(sel, num_rows, lhs, rhs, result);
+      break;
+
+    case TExprOpcode::GE_BOOL_BOOL:
+    case TExprOpcode::GE_CHAR_CHAR:
+    case TExprOpcode::GE_SHORT_SHORT:
+    case TExprOpcode::GE_INT_INT:
+    case TExprOpcode::GE_LONG_LONG:
+    case TExprOpcode::GE_FLOAT_FLOAT:
+    case TExprOpcode::GE_DOUBLE_DOUBLE:
+    case TExprOpcode::GE_STRINGVALUE_STRINGVALUE:
+      ComputeCompareVector<GeOp>(sel, num_rows, lhs, rhs, result);
+      break;
+
+    default:
+      DCHECK(false) << "Unknown op: " << op();
+  }
+}
+
 // IR codegen for binary predicates.  For integer less than, the IR looks like:
 //
 // define i1 @BinaryPredicate(i8** %row, i8* %state_data, i1* %is_null) {
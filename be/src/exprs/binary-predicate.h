@@ -13,6 +13,8 @@ namespace impala {
 class BinaryPredicate : public Predicate {
  public:
   virtual llvm::Function* Codegen(LlvmCodeGen* code_gen);
+
+  virtual bool IsVectorizable() const { return ChildrenVectorizable(); }
  
  protected:
   friend class Expr;
@@ -21,6 +23,15 @@ class BinaryPredicate : public Predicate {
 
   virtual Status Prepare(RuntimeState* state, const RowDescriptor& desc);
   virtual std::string DebugString() const;
+
+  virtual void ComputeVector(RowBatch* batch, const int* sel, int num_rows,
+      ExprVector* result);
+
+ private:
+  // Compares the values of 'lhs' and 'rhs' with 'Op' for the selected rows.
+  template <typename Op>
+  void ComputeCompareVector(const int* sel, int num_rows, ExprVector* lhs,
+      ExprVector* rhs, ExprVector* result);
 };
 
 }
@@ -14,6 +14,8 @@ class BoolLiteral: public Expr {
  public:
   virtual llvm::Function* Codegen(LlvmCodeGen* code_gen);
 
+  virtual bool IsVectorizable() const { return ExprVector::IsSupportedType(type()); }
+
  protected:
   friend class Expr;
 
@@ -34,6 +34,97 @@ bool CastExpr::IsJittable(LlvmCodeGen* codegen) const {
   return Expr::IsJittable(codegen);
 }
 
+bool CastExpr::IsVectorizable() const {
+  if (type() == TYPE_STRING || children()[0]->type() == TYPE_STRING) return false;
+  return ExprVector::IsSupportedType(type()) && ChildrenVectorizable();
+}
+
+// Casts to boolean are true for non-zero values.  Floating point values are truncated
+// to an int first, as in the compute functions.
+template <typename Src>
+static uint8_t CastToBool(Src v) { return v != 0; }
+template <>
+uint8_t CastToBool<float>(float v) { return static_cast<int32_t>(v) != 0; }
+template <>
+uint8_t CastToBool<double>(double v) { return static_cast<int32_t>(v) != 0; }
+
+template <typename Src, typename Dst>
+static void CastLoop(int begin, int end, const Src* child, Dst* result) {
+  for (int i = begin; i < end; ++i) {
+    result[i] = static_cast<Dst>(child[i]);
+  }
+}
+
+template <typename Src>
+static void CastToBoolLoop(int begin, int end, const Src* child, uint8_t* result) {
+  for (int i = begin; i < end; ++i) {
+    result[i] = CastToBool(child[i]);
+  }
+}
+
+template <typename Src>
+static void CastVector(int begin, int end, const Src* child, PrimitiveType type,
+    ExprVector* result) {
+  switch (type) {
+    case TYPE_BOOLEAN:
+      CastToBoolLoop(begin, end, child, result->values<uint8_t>());
+      break;
+    case TYPE_TINYINT:
+      CastLoop(begin, end, child, result->values<int8_t>());
+      break;
+    case TYPE_SMALLINT:
+      CastLoop(begin, end, child, result->values<int16_t>());
+      break;
+    case TYPE_INT:
+      CastLoop(begin, end, child, result->values<int32_t>());
+      break;
+    case TYPE_BIGINT:
+      CastLoop(begin, end, child, result->values<int64_t>());
+      break;
+    case TYPE_FLOAT:
+      CastLoop(begin, end, child, result->values<float>());
+      break;
+    case TYPE_DOUBLE:
+      CastLoop(begin, end, child, result->values<double>());
+      break;
+    default:
+      DCHECK(false) << "Unexpected type: " << TypeToString(type);
+  }
+}
+
+void CastExpr::ComputeVector(RowBatch* batch, const int* sel, int num_rows,
+    ExprVector* result) {
+  ExprVector* child = children()[0]->GetVector(batch, sel, num_rows);
+  int begin = sel[0];
+  int end = sel[num_rows - 1] + 1;
+  memcpy(result->nulls() + begin, child->nulls() + begin, end - begin);
+  switch (children()[0]->type()) {
+    case TYPE_BOOLEAN:
+      CastVector(begin, end, child->values<uint8_t>(), type(), result);
+      break;
+    case TYPE_TINYINT:
+      CastVector(begin, end, child->values<int8_t>(), type(), result);
+      break;
+    case TYPE_SMALLINT:
+      CastVector(begin, end, child->values<int16_t>(), type(), result);
+      break;
+    case TYPE_INT:
+      CastVector(begin, end, child->values<int32_t>(), type(), result);
+      break;
+    case TYPE_BIGINT:
+      CastVector(begin, end, child->values<int64_t>(), type(), result);
+      break;
+    case TYPE_FLOAT:
+      CastVector(begin, end, child->values<float>(), type(), result);
+      break;
+    case TYPE_DOUBLE:
+      CastVector(begin, end, child->values<double>(), type(), result);
+      break;
+    default:
+      DCHECK(false) << "Unexpected type: " << TypeToString(children()[0]->type());
+  }
+}
+
 // IR Generation for Cast Exprs.  For a cast from long to double, the IR
 // looks like:
 //
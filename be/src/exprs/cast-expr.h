@@ -19,9 +19,15 @@ class CastExpr: public Expr {
 
   virtual bool IsJittable(LlvmCodeGen* codegen) const;
 
+  // Only casts between numeric types and booleans are vectorizable.
+  virtual bool IsVectorizable() const;
+
  protected:
   friend class Expr;
   CastExpr(const TExprNode& node);
+
+  virtual void ComputeVector(RowBatch* batch, const int* sel, int num_rows,
+      ExprVector* result);
 };
 
 }
@@ -73,6 +73,66 @@ void* CompoundPredicate::NotComputeFn(Expr* e, TupleRow* row) {
   return &p->result_.bool_val;
 }
 
+// The vectorized versions of the compute functions above.  The loops have no
+// branches, so that the compiler can vectorize them.
+static void AndLoop(int begin, int end, const uint8_t* lhs, const uint8_t* lhs_nulls,
+    const uint8_t* rhs, const uint8_t* rhs_nulls, uint8_t* result,
+    uint8_t* result_nulls) {
+  for (int i = begin; i < end; ++i) {
+    // <> && false is false, true && NULL is NULL
+    uint8_t is_false = (!lhs_nulls[i] & !lhs[i]) | (!rhs_nulls[i] & !rhs[i]);
+    result[i] = !is_false;
+    result_nulls[i] = !is_false & (lhs_nulls[i] | rhs_nulls[i]);
+  }
+}
+
+static void OrLoop(int begin, int end, const uint8_t* lhs, const uint8_t* lhs_nulls,
+    const uint8_t* rhs, const uint8_t* rhs_nulls, uint8_t* result,
+    uint8_t* result_nulls) {
+  for (int i = begin; i < end; ++i) {
+    // <> || true is true, false || NULL is NULL
+    uint8_t is_true = (!lhs_nulls[i] & lhs[i]) | (!rhs_nulls[i] & rhs[i]);
+    result[i] = is_true;
+    result_nulls[i] = !is_true & (lhs_nulls[i] | rhs_nulls[i]);
+  }
+}
+
+static void NotLoop(int begin, int end, const uint8_t* child,
+    const uint8_t* child_nulls, uint8_t* result, uint8_t* result_nulls) {
+  for (int i = begin; i < end; ++i) {
+    result[i] = !child[i];
+    result_nulls[i] = child_nulls[i];
+  }
+}
+
+void CompoundPredicate::ComputeVector(RowBatch* batch, const int* sel, int num_rows,
+    ExprVector* result) {
+  // Both children are always evaluated; there is no short-circuiting per row.
+  ExprVector* lhs = children()[0]->GetVector(batch, sel, num_rows);
+  ExprVector* rhs = NULL;
+  if (GetNumChildren() == 2) rhs = children()[1]->GetVector(batch, sel, num_rows);
+  int begin = sel[0];
+  int end = sel[num_rows - 1] + 1;
+  switch (op()) {
+    case TExprOpcode::COMPOUND_AND:
+      AndLoop(begin, end, lhs->values<uint8_t>(), lhs->nulls(),
+          rhs->values<uint8_t>(), rhs->nulls(), result->values<uint8_t>(),
+          result->nulls());
+      break;
+    case TExprOpcode::COMPOUND_OR:
+      OrLoop(begin, end, lhs->values<uint8_t>(), lhs->nulls(),
+          rhs->values<uint8_t>(), rhs->nulls(), result->values<uint8_t>(),
+          result->nulls());
+      break;
+    case TExprOpcode::COMPOUND_NOT:
+      NotLoop(begin, end, lhs->values<uint8_t>(), lhs->nulls(),
+          result->values<uint8_t>(), result->nulls());
+      break;
+    default:
+      DCHECK(false) << "Unknown op: " << op();
+  }
+}
+
 string CompoundPredicate::DebugString() const {
   stringstream out;
   out << "CompoundPredicate(" << Expr::DebugString() << ")";
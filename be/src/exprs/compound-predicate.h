@@ -13,6 +13,8 @@ class CompoundPredicate: public Predicate {
  public:
   virtual llvm::Function* Codegen(LlvmCodeGen* codegen);
 
+  virtual bool IsVectorizable() const { return ChildrenVectorizable(); }
+
  protected:
   friend class Expr;
 
@@ -21,6 +23,9 @@ class CompoundPredicate: public Predicate {
   virtual Status Prepare(RuntimeState* state, const RowDescriptor& desc);
   virtual std::string DebugString() const;
 
+  virtual void ComputeVector(RowBatch* batch, const int* sel, int num_rows,
+      ExprVector* result);
+
  private:
   friend class OpcodeRegistry;
 
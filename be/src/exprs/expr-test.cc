@@ -11,6 +11,7 @@
 #include "common/object-pool.h"
 #include "runtime/raw-value.h"
 #include "runtime/primitive-type.h"
+#include "runtime/row-batch.h"
 #include "runtime/string-value.h"
 #include "testutil/in-process-query-executor.h"
 #include "gen-cpp/Exprs_types.h"
@@ -125,12 +126,36 @@ class ExprTest : public testing::Test {
     EXPECT_EQ(TypeToString(expr_type), TypeToString(result_types[0]));
     *interpreted_value = result_row[0];
 
+    Expr* root = executor_->select_list_exprs()[0];
+    if (root->IsVectorizable()) {
+      // Evaluating over a batch must give the same result.
+      void* vector_value = GetVectorValue(root);
+      if (*interpreted_value == NULL) {
+        EXPECT_TRUE(vector_value == NULL) << stmt;
+      } else {
+        ASSERT_TRUE(vector_value != NULL) << stmt;
+        EXPECT_EQ(RawValue::Compare(*interpreted_value, vector_value, expr_type), 0)
+            << stmt;
+      }
+    }
+
     if (jitted_value != NULL) {
-      Expr* root = executor_->select_list_exprs()[0];
       *jitted_value = GetCodegenValue(root);
     }
   }
 
+  // Evaluates 'root' with Expr::GetVector() over a batch and returns the value of a
+  // row in the middle of it.
+  void* GetVectorValue(Expr* root) {
+    RowDescriptor row_desc;
+    RowBatch batch(row_desc, 16);
+    batch.AddRows(16);
+    batch.CommitRows(16);
+    int sel[] = { 1, 7, 8 };
+    ExprVector* result = root->GetVector(&batch, sel, 3);
+    return result->GetValue(root->type(), 7);
+  }
+
   void* GetCodegenValue(Expr* root) {
     scoped_ptr<LlvmCodeGen> codegen;
     Status status = LlvmCodeGen::LoadImpalaIR(&pool_, &codegen);
@@ -29,6 +29,7 @@
 #include "gen-cpp/Data_types.h"
 #include "runtime/runtime-state.h"
 #include "runtime/raw-value.h"
+#include "runtime/row-batch.h"
 
 #include "gen-cpp/Exprs_types.h"
 #include "gen-cpp/ImpalaService_types.h"
@@ -731,6 +732,68 @@ bool Expr::IsJittable(LlvmCodeGen* codegen) const {
   return true;
 }
 
+bool ExprVector::IsSupportedType(PrimitiveType type) {
+  switch (type) {
+    case TYPE_BOOLEAN:
+    case TYPE_TINYINT:
+    case TYPE_SMALLINT:
+    case TYPE_INT:
+    case TYPE_BIGINT:
+    case TYPE_FLOAT:
+    case TYPE_DOUBLE:
+    case TYPE_STRING:
+      return true;
+    default:
+      return false;
+  }
+}
+
+void ExprVector::Reserve(PrimitiveType type, int capacity) {
+  DCHECK(IsSupportedType(type));
+  if (capacity <= capacity_) return;
+  // Sized for the largest type, so the vector can be reused for any type.
+  values_.resize(capacity * sizeof(StringValue) / sizeof(int64_t));
+  nulls_.resize(capacity);
+  capacity_ = capacity;
+}
+
+ExprVector* Expr::GetVector(RowBatch* batch, const int* sel, int num_rows) {
+  DCHECK(IsVectorizable());
+  vector_result_.Reserve(type_, batch->capacity());
+  if (num_rows > 0) ComputeVector(batch, sel, num_rows, &vector_result_);
+  return &vector_result_;
+}
+
+void Expr::ComputeVector(RowBatch* batch, const int* sel, int num_rows,
+    ExprVector* result) {
+  DCHECK(IsConstant());
+  void* value = GetValue(NULL);
+  int begin = sel[0];
+  int end = sel[num_rows - 1] + 1;
+  memset(result->nulls() + begin, value == NULL, end - begin);
+  if (value == NULL) return;
+  int value_size = ExprVector::GetValueSize(type_);
+  uint8_t* values = result->values<uint8_t>();
+  for (int i = begin; i < end; ++i) {
+    memcpy(values + i * value_size, value, value_size);
+  }
+}
+
+bool Expr::ChildrenVectorizable() const {
+  for (int i = 0; i < GetNumChildren(); ++i) {
+    if (!ExprVector::IsSupportedType(children_[i]->type())) return false;
+    if (!children_[i]->IsVectorizable()) return false;
+  }
+  return true;
+}
+
+bool Expr::IsVectorizable(const vector<Expr*>& exprs) {
+  for (int i = 0; i < exprs.size(); ++i) {
+    if (!exprs[i]->IsVectorizable()) return false;
+  }
+  return true;
+}
+
 Function* Expr::CodegenExprTree(LlvmCodeGen* codegen) {
   SCOPED_TIMER(codegen->codegen_timer());
   return this->Codegen(codegen);
@@ -26,6 +26,7 @@ namespace impala {
 class Expr;
 class LlvmCodeGen;
 class ObjectPool;
+class RowBatch;
 class RowDescriptor;
 class RuntimeState;
 class TColumnValue;
@@ -191,6 +192,46 @@ struct ExprValue {
   }
 };
 
+// The values of an expr over a batch of rows, returned by Expr::GetVector().
+// The values and null indicators are indexed by the row's index in the batch; only
+// the entries of the rows the expr was evaluated over are valid.
+// Null indicators are one byte per row (rather than a bitmap) and booleans are stored
+// as uint8_t, so that the evaluation loops are plain loops over arrays the compiler
+// can vectorize.  Timestamps are not supported.
+class ExprVector {
+ public:
+  ExprVector() : capacity_(0) { }
+
+  // Returns true if values of 'type' can be stored in an ExprVector.
+  static bool IsSupportedType(PrimitiveType type);
+
+  // Returns the size of a single value of 'type'.
+  static int GetValueSize(PrimitiveType type) {
+    return type == TYPE_STRING ? sizeof(StringValue) : GetByteSize(type);
+  }
+
+  // Makes room for 'capacity' values of 'type'.  Existing values are not preserved.
+  void Reserve(PrimitiveType type, int capacity);
+
+  // Returns the values, as the native type (uint8_t for booleans).
+  template <typename T> T* values() { return reinterpret_cast<T*>(&values_[0]); }
+
+  // Returns the null indicators, 1 if the value is NULL and 0 otherwise.
+  uint8_t* nulls() { return &nulls_[0]; }
+
+  // Returns a pointer to the value for row 'idx', or NULL if it is NULL.
+  void* GetValue(PrimitiveType type, int idx) {
+    if (nulls_[idx]) return NULL;
+    return reinterpret_cast<uint8_t*>(&values_[0]) + idx * GetValueSize(type);
+  }
+
+ private:
+  int capacity_;
+  // int64_t to align the values for all types.
+  std::vector<int64_t> values_;
+  std::vector<uint8_t> nulls_;
+};
+
 // This is the superclass of all expr evaluation nodes.
 class Expr {
  public:
@@ -202,6 +243,12 @@ class Expr {
   // TODO: stop having the result cached in this Expr object 
   void* GetValue(TupleRow* row);
 
+  // Evaluates the expr over the rows of 'batch' whose indices are in 'sel' (which
+  // contains 'num_rows' entries in increasing order) and returns the results, indexed
+  // by row index.  The result is owned by this expr and valid until the next call.
+  // Must only be called if IsVectorizable().
+  ExprVector* GetVector(RowBatch* batch, const int* sel, int num_rows);
+
   // Convenience function: extract value into col_val and sets the
   // appropriate __isset flag.
   // If the value is NULL and as_ascii is false, nothing is set.
@@ -232,6 +279,9 @@ class Expr {
 
   TExprOpcode::type op() const { return opcode_; }
 
+  // Returns true if this expr is a SlotRef.
+  bool is_slotref() const { return is_slotref_; }
+
   // Returns true if expr doesn't contain slotrefs, ie, can be evaluated
   // with GetValue(NULL). The default implementation returns true if all of
   // the children are constant.
@@ -301,6 +351,13 @@ class Expr {
   // until more expr types are supported.
   virtual bool IsJittable(LlvmCodeGen*) const;
 
+  // Returns whether the subtree at this node can be evaluated with GetVector().
+  // Subclasses that implement ComputeVector() should override this.
+  virtual bool IsVectorizable() const { return false; }
+
+  // Returns if all of 'exprs' are vectorizable.
+  static bool IsVectorizable(const std::vector<Expr*>& exprs);
+
   // Returns codegen function for the expr tree rooted at this expr.
   llvm::Function* codegen_fn() { return codegen_fn_; }
 
@@ -355,6 +412,18 @@ class Expr {
   // Return OK if successful, otherwise return error status.
   Status PrepareChildren(RuntimeState* state, const RowDescriptor& row_desc);
 
+  // Computes the values of this expr for the rows of 'batch' in 'sel' into 'result',
+  // which has room for all rows of the batch.  Entries of rows not in 'sel' may be
+  // overwritten: exprs over fixed-length values compute all rows between the first
+  // and last selected row, which is cheaper than following the selection.
+  // The default implementation is for constant exprs and evaluates GetValue(NULL) once.
+  virtual void ComputeVector(RowBatch* batch, const int* sel, int num_rows,
+      ExprVector* result);
+
+  // Returns true if this node's children are vectorizable and of types that
+  // can be stored in an ExprVector.
+  bool ChildrenVectorizable() const;
+
   // function to evaluate expr; typically set in Prepare()
   ComputeFn compute_fn_;
 
@@ -368,6 +437,9 @@ class Expr {
   std::vector<Expr*> children_;
   ExprValue result_;
 
+  // Result of GetVector().
+  ExprVector vector_result_;
+
   // Codegened IR function.  Will be NULL if this expr was not codegen'd.
   llvm::Function* codegen_fn_;
 
@@ -462,7 +534,14 @@ class SlotRef : public Expr {
 
   virtual llvm::Function* Codegen(LlvmCodeGen* codegen);
 
+  virtual bool IsVectorizable() const { return ExprVector::IsSupportedType(type_); }
+
+  SlotId slot_id() const { return slot_id_; }
+
  protected:
+  virtual void ComputeVector(RowBatch* batch, const int* sel, int num_rows,
+      ExprVector* result);
+
   int tuple_idx_;  // within row
   int slot_offset_;  // within tuple
   NullIndicatorOffset null_indicator_offset_;  // within tuple
@@ -14,6 +14,8 @@ class NullLiteral: public Expr {
   NullLiteral(PrimitiveType type);
   virtual llvm::Function* Codegen(LlvmCodeGen* code_gen);
 
+  virtual bool IsVectorizable() const { return ExprVector::IsSupportedType(type()); }
+
  protected:
   friend class Expr;
   
@@ -6,6 +6,7 @@
 
 #include "codegen/llvm-codegen.h"
 #include "gen-cpp/Exprs_types.h"
+#include "runtime/row-batch.h"
 #include "runtime/runtime-state.h"
 
 using namespace std;
@@ -67,6 +68,59 @@ int SlotRef::GetSlotIds(vector<SlotId>* slot_ids) const {
   return 1;
 }
 
+// Copies the slot values of the selected rows into 'values'.  A row's value is NULL if
+// the tuple is NULL or the slot's null indicator is set.
+template <typename T>
+static void GatherSlots(RowBatch* batch, const int* sel, int num_rows, int tuple_idx,
+    int slot_offset, const NullIndicatorOffset& null_indicator_offset, T* values,
+    uint8_t* nulls) {
+  for (int i = 0; i < num_rows; ++i) {
+    int row_idx = sel[i];
+    Tuple* t = batch->GetRow(row_idx)->GetTuple(tuple_idx);
+    bool is_null = t == NULL || t->IsNull(null_indicator_offset);
+    nulls[row_idx] = is_null;
+    if (!is_null) values[row_idx] = *reinterpret_cast<T*>(t->GetSlot(slot_offset));
+  }
+}
+
+void SlotRef::ComputeVector(RowBatch* batch, const int* sel, int num_rows,
+    ExprVector* result) {
+  uint8_t* nulls = result->nulls();
+  switch (type()) {
+    case TYPE_BOOLEAN:
+    case TYPE_TINYINT:
+      GatherSlots(batch, sel, num_rows, tuple_idx_, slot_offset_, null_indicator_offset_,
+          result->values<int8_t>(), nulls);
+      break;
+    case TYPE_SMALLINT:
+      GatherSlots(batch, sel, num_rows, tuple_idx_, slot_offset_, null_indicator_offset_,
+          result->values<int16_t>(), nulls);
+      break;
+    case TYPE_INT:
+      GatherSlots(batch, sel, num_rows, tuple_idx_, slot_offset_, null_indicator_offset_,
+          result->values<int32_t>(), nulls);
+      break;
+    case TYPE_BIGINT:
+      GatherSlots(batch, sel, num_rows, tuple_idx_, slot_offset_, null_indicator_offset_,
+          result->values<int64_t>(), nulls);
+      break;
+    case TYPE_FLOAT:
+      GatherSlots(batch, sel, num_rows, tuple_idx_, slot_offset_, null_indicator_offset_,
+          result->values<float>(), nulls);
+      break;
+    case TYPE_DOUBLE:
+      GatherSlots(batch, sel, num_rows, tuple_idx_, slot_offset_, null_indicator_offset_,
+          result->values<double>(), nulls);
+      break;
+    case TYPE_STRING:
+      GatherSlots(batch, sel, num_rows, tuple_idx_, slot_offset_, null_indicator_offset_,
+          result->values<StringValue>(), nulls);
+      break;
+    default:
+      DCHECK(false) << "Type not vectorizable: " << TypeToString(type());
+  }
+}
+
 string SlotRef::DebugString() const {
   stringstream out;
   out << "SlotRef(slot_id=" << slot_id_
@@ -15,6 +15,8 @@ class StringLiteral: public Expr {
  public:
   virtual llvm::Function* Codegen(LlvmCodeGen* code_gen);
 
+  virtual bool IsVectorizable() const { return ExprVector::IsSupportedType(type()); }
+
  protected:
   friend class Expr;
 
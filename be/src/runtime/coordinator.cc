@@ -29,6 +29,7 @@
 #include "runtime/plan-fragment-executor.h"
 #include "runtime/row-batch.h"
 #include "runtime/parallel-executor.h"
+#include "runtime/runtime-filter.h"
 #include "sparrow/scheduler.h"
 #include "exec/exec-stats.h"
 #include "exec/data-sink.h"
@@ -216,6 +217,7 @@ Status Coordinator::Exec(
 
   ComputeFragmentExecParams(*request);
   ComputeScanRangeAssignment(*request);
+  InitRuntimeFilterRouting(*request);
 
   THostPort coord;
   coord.__set_hostname(FLAGS_hostname);
@@ -243,6 +245,8 @@ Status Coordinator::Exec(
     SetExecPlanFragmentParams(
         0, request->fragments[0], 0, fragment_exec_params_[0], 0, coord, &rpc_params);
     RETURN_IF_ERROR(executor_->Prepare(rpc_params));
+    executor_->runtime_state()->set_runtime_filter_cb(
+        bind<void>(mem_fn(&Coordinator::UpdateFilter), this, _1));
   } else {
     executor_.reset(NULL);
     obj_pool_.reset(new ObjectPool());
@@ -730,6 +734,144 @@ void Coordinator::Cancel() {
   CancelInternal();
 }
 
+void Coordinator::InitRuntimeFilterRouting(const TQueryExecRequest& exec_request) {
+  for (int i = 0; i < exec_request.fragments.size(); ++i) {
+    const TPlanFragment& fragment = exec_request.fragments[i];
+    if (!fragment.__isset.plan) continue;
+    for (int j = 0; j < fragment.plan.nodes.size(); ++j) {
+      const TPlanNode& node = fragment.plan.nodes[j];
+      plan_node_fragment_idx_[node.node_id] = i;
+      if (node.node_type != TPlanNodeType::HASH_JOIN_NODE) continue;
+      FilterTargets& targets = join_filter_targets_[node.node_id];
+      targets.resize(exec_request.fragments.size());
+      // The probe child directly follows the join in the plan's preorder.
+      CollectFilterTargets(exec_request, i, j + 1, &targets);
+    }
+  }
+}
+
+// Returns the index of the node following the subtree of the node at 'node_idx' in
+// 'nodes', which are in preorder.
+static int GetSubtreeEnd(const vector<TPlanNode>& nodes, int node_idx) {
+  int end = node_idx + 1;
+  for (int i = 0; i < nodes[node_idx].num_children; ++i) {
+    end = GetSubtreeEnd(nodes, end);
+  }
+  return end;
+}
+
+void Coordinator::CollectFilterTargets(const TQueryExecRequest& exec_request,
+    int fragment_idx, int node_idx, FilterTargets* targets) {
+  const vector<TPlanNode>& nodes = exec_request.fragments[fragment_idx].plan.nodes;
+  const TPlanNode& node = nodes[node_idx];
+  if (node.limit != -1) return;
+  if (node.node_type == TPlanNodeType::HDFS_SCAN_NODE) {
+    (*targets)[fragment_idx].insert(node.hdfs_scan_node.tuple_id);
+  } else if (node.node_type == TPlanNodeType::EXCHANGE_NODE) {
+    // exec_request.fragments[i + 1] sends to fragment dest_fragment_idx[i]
+    for (int i = 0; i < exec_request.dest_fragment_idx.size(); ++i) {
+      if (exec_request.dest_fragment_idx[i] != fragment_idx) continue;
+      const TPlanFragment& input_fragment = exec_request.fragments[i + 1];
+      if (!input_fragment.__isset.plan || input_fragment.plan.nodes.empty()) continue;
+      if (input_fragment.output_sink.stream_sink.dest_node_id != node.node_id) continue;
+      CollectFilterTargets(exec_request, i + 1, 0, targets);
+    }
+  }
+  int child_idx = node_idx + 1;
+  for (int i = 0; i < node.num_children; ++i) {
+    CollectFilterTargets(exec_request, fragment_idx, child_idx, targets);
+    child_idx = GetSubtreeEnd(nodes, child_idx);
+  }
+}
+
+void Coordinator::UpdateFilter(const TRuntimeFilter& filter) {
+  map<PlanNodeId, int>::const_iterator node_it =
+      plan_node_fragment_idx_.find(filter.src_node_id);
+  if (node_it == plan_node_fragment_idx_.end()) {
+    LOG(ERROR) << "UpdateFilter(): unknown node id " << filter.src_node_id
+               << " for query " << query_id_;
+    return;
+  }
+  int src_fragment_idx = node_it->second;
+
+  TRuntimeFilter merged_filter;
+  {
+    lock_guard<mutex> l(runtime_filters_lock_);
+    pair<PlanNodeId, int> key(filter.src_node_id, filter.expr_idx);
+    RuntimeFilterMap::iterator it = runtime_filters_.find(key);
+    if (it == runtime_filters_.end()) {
+      RuntimeFilterState& state = runtime_filters_[key];
+      state.filter = filter;
+      state.num_pending_instances =
+          fragment_exec_params_[src_fragment_idx].hosts.size() - 1;
+      it = runtime_filters_.find(key);
+    } else {
+      DCHECK_GT(it->second.num_pending_instances, 0);
+      RuntimeFilter::Merge(filter, &it->second.filter);
+      --it->second.num_pending_instances;
+    }
+    if (it->second.num_pending_instances > 0) return;
+    merged_filter = it->second.filter;
+    runtime_filters_.erase(it);
+  }
+
+  if (merged_filter.__isset.always_true && merged_filter.always_true) return;
+  PublishFilter(src_fragment_idx, merged_filter);
+}
+
+void Coordinator::PublishFilter(int src_fragment_idx, const TRuntimeFilter& filter) {
+  map<PlanNodeId, FilterTargets>::const_iterator targets_it =
+      join_filter_targets_.find(filter.src_node_id);
+  if (targets_it == join_filter_targets_.end()) return;
+  const FilterTargets& targets = targets_it->second;
+  // Scans in the join's own fragment received the filter from the join directly.
+  if (executor_.get() != NULL && src_fragment_idx != 0 &&
+      targets[0].count(filter.target_tuple_id) > 0) {
+    executor_->PublishRuntimeFilter(filter);
+  }
+
+  TPublishFilterParams params;
+  params.protocol_version = ImpalaInternalServiceVersion::V1;
+  params.__set_filter(filter);
+  for (int i = 0; i < backend_exec_states_.size(); ++i) {
+    BackendExecState* exec_state = backend_exec_states_[i];
+    // Exec() may still be setting up the instances of later fragments.
+    if (exec_state == NULL || exec_state->fragment_idx == src_fragment_idx) continue;
+    if (targets[exec_state->fragment_idx].count(filter.target_tuple_id) == 0) {
+      continue;
+    }
+    {
+      lock_guard<mutex> l(exec_state->lock);
+      // Nothing to filter if the fragment hasn't started or is already done.
+      if (!exec_state->initiated || exec_state->done) continue;
+    }
+
+    ImpalaInternalServiceClient* backend_client;
+    pair<string, int> hostport = make_pair(exec_state->hostport.ipaddress,
+                                           exec_state->hostport.port);
+    Status status = exec_env_->client_cache()->GetClient(hostport, &backend_client);
+    if (!status.ok()) {
+      VLOG_QUERY << "PublishFilter(): couldn't get a client for " << exec_state->hostport
+                 << ": " << status.GetErrorMsg();
+      continue;
+    }
+    DCHECK(backend_client != NULL);
+    params.__set_dst_fragment_instance_id(exec_state->fragment_instance_id);
+    TPublishFilterResult res;
+    try {
+      VLOG_QUERY << "sending PublishFilter rpc for instance_id="
+                 << exec_state->fragment_instance_id << " backend="
+                 << exec_state->hostport << " src_node=" << filter.src_node_id;
+      backend_client->PublishFilter(res, params);
+    } catch (TException& e) {
+      VLOG_QUERY << "PublishFilter rpc query_id=" << query_id_
+                 << " instance_id=" << exec_state->fragment_instance_id
+                 << " failed: " << e.what();
+    }
+    exec_env_->client_cache()->ReleaseClient(backend_client);
+  }
+}
+
 void Coordinator::CancelInternal() {
   VLOG_QUERY << "Cancel() query_id=" << query_id_;
   DCHECK(!query_status_.ok());
@@ -1071,14 +1213,17 @@ void Coordinator::ComputeFragmentExecParams(const TQueryExecRequest& exec_reques
     // set # of senders
     DCHECK(exec_request.fragments[i].output_sink.__isset.stream_sink);
     const TDataStreamSink& sink = exec_request.fragments[i].output_sink.stream_sink;
-    // we can only handle unpartitioned (= broadcast) output at the moment
-    DCHECK(sink.output_partition.type == TPartitionType::UNPARTITIONED);
+    // we can only handle unpartitioned (= broadcast) and hash-partitioned output
+    DCHECK(sink.output_partition.type == TPartitionType::UNPARTITIONED
+        || sink.output_partition.type == TPartitionType::HASH_PARTITIONED);
     PlanNodeId exch_id = sink.dest_node_id;
     // we might have multiple fragments sending to this exchange node 
     // (distributed MERGE), which is why we need to add up the #senders
     dest_params.per_exch_num_senders[exch_id] += params.hosts.size();
 
-    // create one TPlanFragmentDestination per destination host
+    // create one TPlanFragmentDestination per destination host; for hash-partitioned
+    // output, destination i receives partition i, so all senders need to list
+    // the destinations in the same order
     params.destinations.resize(dest_params.hosts.size());
     for (int j = 0; j < dest_params.hosts.size(); ++j) {
       TPlanFragmentDestination& dest = params.destinations[j];
@@ -1129,9 +1274,8 @@ Status Coordinator::ComputeFragmentHosts(const TQueryExecRequest& exec_request)
         exec_request.per_node_scan_ranges.find(leftmost_scan_id);
     if (entry == exec_request.per_node_scan_ranges.end() || entry->second.empty()) {
       // this scan node doesn't have any scan ranges; run it on the coordinator
-      // TODO: we'll need to revisit this strategy once we can partition joins
-      // (in which case this fragment might be executing a right outer join
-      // with a large build table)
+      // (partitioned joins don't have a leftmost scan in their fragment, so they
+      // inherit the hosts of their leftmost input fragment above)
       params.hosts.push_back(coord);
       continue;
     }
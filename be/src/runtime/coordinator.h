@@ -3,6 +3,8 @@
 #ifndef IMPALA_RUNTIME_COORDINATOR_H
 #define IMPALA_RUNTIME_COORDINATOR_H
 
+#include <map>
+#include <set>
 #include <vector>
 #include <string>
 #include <boost/scoped_ptr.hpp>
@@ -122,6 +124,13 @@ class Coordinator {
   // to CancelInternal().
   Status UpdateFragmentExecStatus(const TReportExecStatusParams& params);
 
+  // Merges the runtime filter computed by one instance of a hash join with those of
+  // the join's other instances.  Once all instances of the join's fragment have
+  // reported, sends the merged filter to the instances of all other fragments that
+  // scan the filter's target tuple.  Filters are an optimization: failures to
+  // deliver them are logged and otherwise ignored.
+  void UpdateFilter(const TRuntimeFilter& filter);
+
   // only valid *after* calling Exec(), and may return NULL if there is no executor
   RuntimeState* runtime_state();
   const RowDescriptor& row_desc() const;
@@ -330,6 +339,28 @@ class Coordinator {
   // The set of hosts that the query will run on. Populated in Exec.
   boost::unordered_set<THostPort> unique_hosts_;
 
+  // Routing information for runtime filters, populated in Exec(): the fragment idx of
+  // every plan node, and for every hash join, the tuples materialized by the hdfs
+  // scans of each fragment that its filters apply to.  These are the scans below the
+  // join's probe child that are not at or below a node with a limit, since filtering
+  // the input of a limit changes which rows it returns.
+  std::map<PlanNodeId, int> plan_node_fragment_idx_;
+  typedef std::vector<std::set<TupleId> > FilterTargets;
+  std::map<PlanNodeId, FilterTargets> join_filter_targets_;
+
+  // A runtime filter that is being merged across the instances of its join.
+  struct RuntimeFilterState {
+    TRuntimeFilter filter;
+    // Number of instances that have not reported the filter yet.
+    int num_pending_instances;
+  };
+
+  // Runtime filters by (join node id, conjunct idx).  Protected by
+  // runtime_filters_lock_, which is never held while calling into other components.
+  typedef std::map<std::pair<PlanNodeId, int>, RuntimeFilterState> RuntimeFilterMap;
+  RuntimeFilterMap runtime_filters_;
+  boost::mutex runtime_filters_lock_;
+
   // Populates fragment_exec_params_.
   void ComputeFragmentExecParams(const TQueryExecRequest& exec_request);
 
@@ -393,6 +424,19 @@ class Coordinator {
   // across all backends(id needs to be for a ScanNode)
   int64_t ComputeTotalScanRangesComplete(int node_id);
 
+  // Populates plan_node_fragment_idx_ and join_filter_targets_.
+  void InitRuntimeFilterRouting(const TQueryExecRequest& exec_request);
+
+  // Adds the tuples of the hdfs scans in the subtree of the node at 'node_idx' in the
+  // plan of fragment 'fragment_idx' to 'targets', following exchange nodes into the
+  // fragments that send to them.  Subtrees rooted at a node with a limit are skipped.
+  void CollectFilterTargets(const TQueryExecRequest& exec_request, int fragment_idx,
+      int node_idx, FilterTargets* targets);
+
+  // Sends a merged runtime filter to all instances, except those of fragment
+  // 'src_fragment_idx', that scan the filter's target tuple in join_filter_targets_.
+  void PublishFilter(int src_fragment_idx, const TRuntimeFilter& filter);
+
   // Runs cancel logic. Assumes that lock_ is held.
   void CancelInternal();
 
@@ -8,6 +8,7 @@
 #include <boost/thread/thread.hpp>
 
 #include "runtime/row-batch.h"
+#include "runtime/row-batch-compressor.h"
 #include "runtime/data-stream-recvr.h"
 #include "runtime/raw-value.h"
 #include "util/debug-util.h"
@@ -25,14 +26,25 @@ namespace impala {
 
 DataStreamMgr::StreamControlBlock::StreamControlBlock(
     const RowDescriptor& row_desc, const TUniqueId& fragment_id,
-    PlanNodeId dest_node_id, int num_senders, int buffer_size)
+    PlanNodeId dest_node_id, int num_senders, int buffer_size,
+    RuntimeProfile* profile)
   : fragment_id_(fragment_id),
     dest_node_id_(dest_node_id),
     row_desc_(row_desc),
     is_cancelled_(false),
     buffer_limit_(buffer_size),
     num_buffered_bytes_(0),
-    num_remaining_senders_(num_senders) {
+    sender_quota_(2 * buffer_size / max(num_senders, 1)),
+    num_remaining_senders_(num_senders),
+    num_parked_senders_(0) {
+  bytes_received_counter_ =
+      ADD_COUNTER(profile, "BytesReceived", TCounterType::BYTES);
+  sender_blocked_timer_ =
+      ADD_COUNTER(profile, "SendersBlockedTime", TCounterType::CPU_TICKS);
+  num_parked_senders_counter_ =
+      ADD_COUNTER(profile, "SendersBlocked", TCounterType::UNIT);
+  peak_buffered_bytes_counter_ =
+      ADD_COUNTER(profile, "PeakBufferedBytes", TCounterType::BYTES);
 }
 
 RowBatch* DataStreamMgr::StreamControlBlock::GetBatch(bool* is_cancelled) {
@@ -53,32 +65,71 @@ RowBatch* DataStreamMgr::StreamControlBlock::GetBatch(bool* is_cancelled) {
   }
 
   DCHECK(!batch_queue_.empty());
-  RowBatch* result = batch_queue_.front().second;
-  num_buffered_bytes_ -= batch_queue_.front().first;
+  const BufferedBatch& front = batch_queue_.front();
+  RowBatch* result = front.batch;
+  num_buffered_bytes_ -= front.size;
+  SenderBufferMap::iterator sender = sender_buffered_bytes_.find(front.sender_id);
+  DCHECK(sender != sender_buffered_bytes_.end());
+  sender->second -= front.size;
+  if (sender->second == 0) sender_buffered_bytes_.erase(sender);
   VLOG_ROW << "fetched #rows=" << result->num_rows();
   batch_queue_.pop_front();
-  data_removal_.notify_one();
+  // resume parked senders; each one re-checks whether it now fits
+  if (num_parked_senders_ > 0) data_removal_.notify_all();
   return result;
 }
 
-void DataStreamMgr::StreamControlBlock::AddBatch(const TRowBatch& thrift_batch) {
-  int batch_size = RowBatch::GetBatchSize(thrift_batch);
-  RowBatch* batch = new RowBatch(row_desc_, thrift_batch);
-  unique_lock<mutex> l(lock_);
-  DCHECK_GT(num_remaining_senders_, 0);
+bool DataStreamMgr::StreamControlBlock::MustWait(
+    const SenderId& sender_id, int batch_size) {
   // if there's something in the queue and this batch will push us over the
   // buffer limit we need to wait until the batch gets drained
-  while (!batch_queue_.empty() && num_buffered_bytes_ + batch_size > buffer_limit_) {
-    VLOG_ROW << " wait removal: empty=" << (batch_queue_.empty() ? 1 : 0)
-             << " #buffered=" << num_buffered_bytes_
-             << " batch_size=" << batch_size << "\n";
-    data_removal_.wait(l);
+  if (!batch_queue_.empty() && num_buffered_bytes_ + batch_size > buffer_limit_) {
+    return true;
+  }
+  // same for the sender's quota, so that a single sender can't flood the buffer
+  // and stall everybody else
+  SenderBufferMap::iterator sender = sender_buffered_bytes_.find(sender_id);
+  return sender != sender_buffered_bytes_.end()
+      && sender->second + batch_size > sender_quota_;
+}
+
+Status DataStreamMgr::StreamControlBlock::AddBatch(
+    const TUniqueId& sender_id, TRowBatch* thrift_batch) {
+  // decompress before accounting for the batch, the buffer limit applies to the
+  // uncompressed data
+  RETURN_IF_ERROR(RowBatchCompressor::Decompress(thrift_batch));
+  int batch_size = RowBatch::GetBatchSize(*thrift_batch);
+  SenderId sender = make_pair(sender_id.hi, sender_id.lo);
+  unique_lock<mutex> l(lock_);
+  DCHECK_GT(num_remaining_senders_, 0);
+  if (!is_cancelled_ && MustWait(sender, batch_size)) {
+    // park this sender until the consumer made room for the batch; the sender's
+    // TransmitData() rpc doesn't return until then
+    SCOPED_TIMER(sender_blocked_timer_);
+    COUNTER_UPDATE(num_parked_senders_counter_, 1);
+    ++num_parked_senders_;
+    while (!is_cancelled_ && MustWait(sender, batch_size)) {
+      VLOG_ROW << " wait removal: #buffered=" << num_buffered_bytes_
+               << " batch_size=" << batch_size << "\n";
+      data_removal_.wait(l);
+    }
+    --num_parked_senders_;
   }
+  if (is_cancelled_) return Status::CANCELLED;
+
+  // the RowBatch takes over thrift_batch's tuple data, so this doesn't copy anything
+  RowBatch* batch = new RowBatch(row_desc_, thrift_batch);
   VLOG_ROW << "added #rows=" << batch->num_rows()
            << " batch_size=" << batch_size << "\n";
-  batch_queue_.push_back(make_pair(batch_size, batch));
+  batch_queue_.push_back(BufferedBatch(batch_size, sender, batch));
   num_buffered_bytes_ += batch_size;
+  sender_buffered_bytes_[sender] += batch_size;
+  COUNTER_UPDATE(bytes_received_counter_, batch_size);
+  if (num_buffered_bytes_ > peak_buffered_bytes_counter_->value()) {
+    COUNTER_SET(peak_buffered_bytes_counter_, static_cast<int64_t>(num_buffered_bytes_));
+  }
   data_arrival_.notify_one();
+  return Status::OK;
 }
 
 void DataStreamMgr::StreamControlBlock::DecrementSenders() {
@@ -97,6 +148,7 @@ void DataStreamMgr::StreamControlBlock::CancelStream() {
   VLOG_QUERY << "cancelled stream: fragment_id=" << fragment_id_
              << " node_id=" << dest_node_id_;
   data_arrival_.notify_one();
+  data_removal_.notify_all();
 }
 
 inline uint32_t DataStreamMgr::GetHashValue(
@@ -109,12 +161,13 @@ inline uint32_t DataStreamMgr::GetHashValue(
 
 DataStreamRecvr* DataStreamMgr::CreateRecvr(
     const RowDescriptor& row_desc, const TUniqueId& fragment_id, PlanNodeId dest_node_id,
-    int num_senders, int buffer_size) {
+    int num_senders, int buffer_size, RuntimeProfile* profile) {
   VLOG_FILE << "creating receiver for fragment="
             << fragment_id << ", node=" << dest_node_id;
+  if (profile == NULL) profile = pool_.Add(new RuntimeProfile(&pool_, "DataStreamRecvr"));
   StreamControlBlock* cb = pool_.Add(
       new StreamControlBlock(row_desc, fragment_id, dest_node_id, num_senders,
-                             buffer_size));
+                             buffer_size, profile));
   size_t hash_value = GetHashValue(fragment_id, dest_node_id);
   lock_guard<mutex> l(lock_);
   fragment_stream_set_.insert(make_pair(fragment_id, dest_node_id));
@@ -143,9 +196,9 @@ DataStreamMgr::StreamMap::iterator DataStreamMgr::FindControlBlock(
 
 Status DataStreamMgr::AddData(
     const TUniqueId& fragment_id, PlanNodeId dest_node_id,
-    const TRowBatch& thrift_batch) {
+    const TUniqueId& sender_id, TRowBatch* thrift_batch) {
   VLOG_ROW << "AddData(): fragment_id=" << fragment_id << " node=" << dest_node_id
-          << " size=" << RowBatch::GetBatchSize(thrift_batch);
+          << " size=" << RowBatch::GetBatchSize(*thrift_batch);
   StreamMap::iterator i = FindControlBlock(fragment_id, dest_node_id);
   if (i == stream_map_.end()) {
     stringstream err;
@@ -154,8 +207,7 @@ Status DataStreamMgr::AddData(
     LOG(ERROR) << err.str();
     return Status(err.str());
   }
-  i->second->AddBatch(thrift_batch);
-  return Status::OK;
+  return i->second->AddBatch(sender_id, thrift_batch);
 }
 
 Status DataStreamMgr::CloseSender(
@@ -4,6 +4,7 @@
 #define IMPALA_RUNTIME_DATA_STREAM_MGR_H
 
 #include <list>
+#include <map>
 #include <set>
 #include <boost/thread/mutex.hpp>
 #include <boost/thread/condition_variable.hpp>
@@ -12,6 +13,7 @@
 #include "common/status.h"
 #include "common/object-pool.h"
 #include "runtime/descriptors.h"  // for PlanNodeId
+#include "util/runtime-profile.h"
 #include "gen-cpp/Types_types.h"  // for TUniqueId
 
 namespace impala {
@@ -38,21 +40,26 @@ class DataStreamMgr {
 
   // Create a receiver for a specific fragment_id/node_id destination; desc_tbl
   // is the query's descriptor table and is needed to decode incoming TRowBatches.
+  // buffer_size is the limit in bytes on the amount of data buffered for the
+  // receiver; each sender may only occupy 200% of buffer_size/num_senders of it.
+  // Flow control counters are added to 'profile', if non-NULL.
   // The caller is responsible for deleting the returned DataStreamRecvr.
   // TODO: create receivers in someone's pool
   DataStreamRecvr* CreateRecvr(
       const RowDescriptor& row_desc, const TUniqueId& fragment_id,
-      PlanNodeId dest_node_id, int num_senders, int buffer_size);
-  
-  // Adds a row batch to the stream identified by fragment_id/dest_node_id.
-  // The call blocks if this ends up pushing the stream over its buffering limit;
-  // it unblocks when the stream consumer removed enough data to make space for
-  // row_batch.
-  // TODO: enforce per-sender quotas (something like 200% of buffer_size/#senders),
-  // so that a single sender can't flood the buffer and stall everybody else.
-  // Returns OK if successful, error status otherwise.
+      PlanNodeId dest_node_id, int num_senders, int buffer_size,
+      RuntimeProfile* profile = NULL);
+
+  // Adds a row batch from the sender identified by sender_id to the stream identified
+  // by fragment_id/dest_node_id.
+  // The call blocks if this ends up pushing the stream over its buffering limit or
+  // the sender over its quota; it unblocks when the stream consumer removed enough
+  // data to make space for row_batch.  The stream takes over the tuple data of
+  // thrift_batch.
+  // Returns OK if successful, CANCELLED if the stream got cancelled, error status
+  // otherwise.
   Status AddData(const TUniqueId& fragment_id, PlanNodeId dest_node_id,
-                 const TRowBatch& thrift_batch);
+                 const TUniqueId& sender_id, TRowBatch* thrift_batch);
 
   // Decreases the #remaining_senders count for the stream identified by
   // fragment_id/dest_node_id.
@@ -69,7 +76,8 @@ class DataStreamMgr {
    public:
     StreamControlBlock(
         const RowDescriptor& row_desc, const TUniqueId& fragment_id,
-        PlanNodeId dest_node_id, int num_senders, int buffer_size);
+        PlanNodeId dest_node_id, int num_senders, int buffer_size,
+        RuntimeProfile* profile);
 
     // Returns next available batch or NULL if end-of-stream or stream got
     // cancelled (sets 'is_cancelled' accordingly).
@@ -81,8 +89,9 @@ class DataStreamMgr {
     RowBatch* GetBatch(bool* is_cancelled);
 
     // Adds a row batch to this stream's queue; blocks if this will
-    // make the stream exceed its buffer limit.
-    void AddBatch(const TRowBatch& batch);
+    // make the stream exceed its buffer limit or the sender exceed its quota.
+    // Returns CANCELLED (and drops the batch) if the stream got cancelled.
+    Status AddBatch(const TUniqueId& sender_id, TRowBatch* batch);
 
     // Decrement the number of remaining senders and signal eos ("new data")
     // if the count drops to 0.
@@ -113,6 +122,18 @@ class DataStreamMgr {
     // total number of bytes held in batch_queue_
     int num_buffered_bytes_;
 
+    // upper limit on the number of bytes a single sender can have in batch_queue_;
+    // a sender is always allowed to have at least one batch buffered
+    int sender_quota_;
+
+    // (TUniqueId.hi, TUniqueId.lo) of a sender
+    typedef std::pair<int64_t, int64_t> SenderId;
+
+    // number of bytes held in batch_queue_ per sender; senders without buffered
+    // data aren't in the map
+    typedef std::map<SenderId, int> SenderBufferMap;
+    SenderBufferMap sender_buffered_bytes_;
+
     // number of senders which haven't closed the channel yet
     // (if it drops to 0, end-of-stream is true)
     int num_remaining_senders_;
@@ -120,12 +141,41 @@ class DataStreamMgr {
     // signal arrival of new batch or the eos/cancelled condition
     boost::condition_variable data_arrival_;
 
-    // signal removal of data by stream consumer
+    // signal removal of data by stream consumer or cancellation to parked senders;
+    // senders wait for different conditions, so this must be notified with
+    // notify_all()
     boost::condition_variable data_removal_;
 
-    // queue of (batch length, batch) pairs
-    typedef std::list<std::pair<int, RowBatch*> > RowBatchQueue;
+    // number of senders currently waiting in AddBatch()
+    int num_parked_senders_;
+
+    struct BufferedBatch {
+      int size;  // batch length in bytes
+      SenderId sender_id;
+      RowBatch* batch;
+
+      BufferedBatch(int size, const SenderId& sender_id, RowBatch* batch)
+        : size(size), sender_id(sender_id), batch(batch) {}
+    };
+    typedef std::list<BufferedBatch> RowBatchQueue;
     RowBatchQueue batch_queue_;
+
+    // total number of bytes received
+    RuntimeProfile::Counter* bytes_received_counter_;
+
+    // total time senders spent parked in AddBatch()
+    RuntimeProfile::Counter* sender_blocked_timer_;
+
+    // number of times a sender got parked
+    RuntimeProfile::Counter* num_parked_senders_counter_;
+
+    // max of num_buffered_bytes_
+    RuntimeProfile::Counter* peak_buffered_bytes_counter_;
+
+    // Returns true if the batch of 'batch_size' bytes from 'sender_id' can't be
+    // added without exceeding the buffer limit or the sender's quota.
+    // Assumes lock_ is being held.
+    bool MustWait(const SenderId& sender_id, int batch_size);
   };
 
   ObjectPool pool_;  // holds control blocks
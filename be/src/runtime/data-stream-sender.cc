@@ -3,7 +3,10 @@
 #include "runtime/data-stream-sender.h"
 
 #include <iostream>
+#include <list>
 #include <boost/shared_ptr.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
 #include <boost/thread/thread.hpp>
 #include <protocol/TBinaryProtocol.h>
 #include <protocol/TDebugProtocol.h>
@@ -15,8 +18,10 @@
 #include "runtime/descriptors.h"
 #include "runtime/tuple-row.h"
 #include "runtime/row-batch.h"
+#include "runtime/row-batch-compressor.h"
 #include "runtime/raw-value.h"
 #include "util/debug-util.h"
+#include "util/hash-util.h"
 #include "util/thrift-client.h"
 
 #include "gen-cpp/Types_types.h"
@@ -31,16 +36,39 @@ using namespace apache::thrift::transport;
 
 // TODO: move this to backend-main.cc (which we don't have yet)
 DEFINE_int32(port, 20001, "port on which to run Impala backend");
+DEFINE_int32(stream_sender_max_queued_batches, 2, "Maximum number of serialized row "
+    "batches per DataStreamSender channel that are queued or being sent; Send() blocks "
+    "once that is reached.");
+DEFINE_bool(compress_row_batches, false, "If true, DataStreamSender compresses the "
+    "row batches it sends with snappy; batches that don't compress well are sent "
+    "uncompressed.");
+DEFINE_double(row_batch_compression_min_savings, 0.2, "Fraction of a row batch's "
+    "size that compression needs to save; otherwise the batch is sent uncompressed "
+    "and compression is suspended for a while (see --compress_row_batches).");
 
 namespace impala {
 
+// Swaps the contents of two TRowBatches.  Must swap every field of TRowBatch.
+static void SwapRowBatch(TRowBatch* a, TRowBatch* b) {
+  std::swap(a->num_rows, b->num_rows);
+  a->row_tuples.swap(b->row_tuples);
+  a->tuple_offsets.swap(b->tuple_offsets);
+  a->tuple_data.swap(b->tuple_data);
+  std::swap(a->compression_type, b->compression_type);
+  std::swap(a->uncompressed_size, b->uncompressed_size);
+  std::swap(a->__isset, b->__isset);
+}
+
 // A channel sends data asynchronously via calls to TransmitData
 // to a single destination ipaddress/node.
 // It has a fixed-capacity buffer and allows the caller either to add rows to
 // that buffer individually (AddRow()), or circumvent the buffer altogether and send
-// TRowBatches directly (SendBatch()). Either way, there can only be one in-flight RPC
-// at any one time (ie, sending will block if the most recent rpc hasn't finished,
-// which allows the receiver node to throttle the sender by withholding acks).
+// TRowBatches directly (SendBatch()). Either way, the serialized batches are queued
+// and sent by the channel's sender thread, one rpc at a time.  Up to
+// FLAGS_stream_sender_max_queued_batches batches can be queued or in flight, so the
+// caller can serialize the next batch while the current one is being sent; beyond
+// that, sending blocks until the receiver acked a batch (which allows the receiver node
+// to throttle the sender by withholding acks).
 // *Not* thread-safe.
 class DataStreamSender::Channel {
  public:
@@ -48,36 +76,45 @@ class DataStreamSender::Channel {
   // combination. buffer_size is specified in bytes and a soft limit on
   // how much tuple data is getting accumulated before being sent; it only applies
   // when data is added via AddRow() and not sent directly via SendBatch().
-  Channel(const RowDescriptor& row_desc, const THostPort& destination,
-          const TUniqueId& fragment_instance_id, PlanNodeId dest_node_id, int buffer_size)
+  Channel(const RowDescriptor& row_desc, const TUniqueId& src_fragment_instance_id,
+          const THostPort& destination, const TUniqueId& fragment_instance_id,
+          PlanNodeId dest_node_id, int buffer_size)
     : row_desc_(row_desc),
+      src_fragment_instance_id_(src_fragment_instance_id),
       ipaddress_(destination.ipaddress),
       port_(destination.port),
       fragment_instance_id_(fragment_instance_id),
       dest_node_id_(dest_node_id),
       num_data_bytes_sent_(0),
-      in_flight_batch_(NULL) {
+      compressor_(NULL),
+      num_pending_batches_(0),
+      shutdown_(false) {
       // TODO: figure out how to size batch_
     int capacity = max(1, buffer_size / max(row_desc.GetRowSize(), 1));
     batch_.reset(new RowBatch(row_desc, capacity));
   }
 
-  // Initialize channel.
+  ~Channel();
+
+  // Initialize channel and start its sender thread.  If compressor is non-NULL, the
+  // batches accumulated via AddRow() are compressed with it.
   // Returns OK if successful, error indication otherwise.
-  Status Init();
+  Status Init(RowBatchCompressor* compressor);
 
   // Copies a single row into this channel's output buffer and flushes buffer
   // if it reaches capacity.
   // Returns error status if any of the preceding rpcs failed, OK otherwise.
   Status AddRow(TupleRow* row);
 
-  // Asynchronously sends a row batch.
+  // Queues a row batch for sending; blocks while the channel has the maximum number
+  // of batches queued or in flight.  The batch must not be modified afterwards; it may
+  // be queued on other channels as well.
   // Returns the status of the most recently finished TransmitData
   // rpc (or OK if there wasn't one that hasn't been reported yet).
-  Status SendBatch(TRowBatch* batch);
+  Status SendBatch(const shared_ptr<TRowBatch>& batch);
 
-  // Return status of last TransmitData rpc (initiated by the most recent call
-  // to either SendBatch() or SendCurrentBatch()).
+  // Waits until all queued batches have been sent and returns the status of the
+  // first TransmitData rpc that failed, if any.
   Status GetSendStatus();
 
   // Flush buffered rows and close channel.
@@ -91,6 +128,7 @@ class DataStreamSender::Channel {
   scoped_ptr<BackendThriftClient> client_;
 
   const RowDescriptor& row_desc_;
+  TUniqueId src_fragment_instance_id_;
   string ipaddress_;
   int port_;
   TUniqueId fragment_instance_id_;
@@ -101,24 +139,51 @@ class DataStreamSender::Channel {
 
   // we're accumulating rows into this batch
   scoped_ptr<RowBatch> batch_;
-  TRowBatch thrift_batch_;
 
-  // accessed by rpc_thread_ and by channel only if there is no in-flight rpc
-  TRowBatch* in_flight_batch_;
-  thread rpc_thread_;  // sender thread
-  Status rpc_status_;  // status of most recently finished TransmitData rpc
+  // owned by the DataStreamSender; NULL if compression is disabled
+  RowBatchCompressor* compressor_;
+
+  // Protects the members below.
+  mutex lock_;
+
+  // Signalled when a batch is queued or shutdown_ is set.
+  condition_variable batch_queued_cv_;
+
+  // Signalled when a batch has been sent.
+  condition_variable batch_sent_cv_;
+
+  // Batches waiting for sender_thread_, in order.
+  list<shared_ptr<TRowBatch> > batch_queue_;
+
+  // Number of batches in batch_queue_ plus the one being sent, if any.
+  int num_pending_batches_;
+
+  // If true, sender_thread_ exits once batch_queue_ is empty.
+  bool shutdown_;
+
+  // Status of the first TransmitData rpc that failed.  Once set, queued batches are
+  // dropped.
+  Status rpc_status_;
+
+  thread sender_thread_;
+
+  // Sends the queued batches until shutdown_ is set.  Runs in sender_thread_.
+  void SenderThread();
 
-  // Synchronously call client_'s TransmitData() and update rpc_status_
-  // based on return value (or set to error if RPC failed).
-  // Should only run in rpc_thread_.
-  void TransmitData();
+  // Synchronously call client_'s TransmitData() for 'batch'.
+  // Should only run in sender_thread_.
+  Status TransmitData(const shared_ptr<TRowBatch>& batch);
 
-  // Serialize batch_ into thrift_batch_ and send via SendBatch().
+  // Serialize batch_ into a new TRowBatch and queue it via SendBatch().
   // Returns SendBatch() status.
   Status SendCurrentBatch();
+
+  // Stops sender_thread_ after it sent all queued batches.
+  void StopSenderThread();
 };
 
-Status DataStreamSender::Channel::Init() {
+Status DataStreamSender::Channel::Init(RowBatchCompressor* compressor) {
+  compressor_ = compressor;
   client_.reset(new BackendThriftClient(ipaddress_, port_));
 
   try {
@@ -130,87 +195,146 @@ Status DataStreamSender::Channel::Init() {
     return Status(msg.str());
   }
 
+  sender_thread_ = thread(&DataStreamSender::Channel::SenderThread, this);
   return Status::OK;
 }
 
-Status DataStreamSender::Channel::SendBatch(TRowBatch* batch) {
+DataStreamSender::Channel::~Channel() {
+  // no-op if Close() already stopped the sender thread
+  StopSenderThread();
+}
+
+Status DataStreamSender::Channel::SendBatch(const shared_ptr<TRowBatch>& batch) {
   VLOG_ROW << "Channel::SendBatch() instance_id=" << fragment_instance_id_
            << " dest_node=" << dest_node_id_ << " #rows=" << batch->num_rows;
-  // return if the previous batch saw an error
-  RETURN_IF_ERROR(GetSendStatus());
-  DCHECK(in_flight_batch_ == NULL);
-  in_flight_batch_ = batch;
-  rpc_thread_ = thread(&DataStreamSender::Channel::TransmitData, this);
+  unique_lock<mutex> l(lock_);
+  while (rpc_status_.ok() &&
+      num_pending_batches_ >= FLAGS_stream_sender_max_queued_batches) {
+    batch_sent_cv_.wait(l);
+  }
+  // return if a previous batch saw an error
+  if (!rpc_status_.ok()) return rpc_status_;
+  batch_queue_.push_back(batch);
+  ++num_pending_batches_;
+  batch_queued_cv_.notify_one();
   return Status::OK;
 }
 
-void DataStreamSender::Channel::TransmitData() {
-  DCHECK(in_flight_batch_ != NULL);
+void DataStreamSender::Channel::SenderThread() {
+  while (true) {
+    shared_ptr<TRowBatch> batch;
+    {
+      unique_lock<mutex> l(lock_);
+      while (batch_queue_.empty() && !shutdown_) {
+        batch_queued_cv_.wait(l);
+      }
+      if (batch_queue_.empty()) return;
+      batch = batch_queue_.front();
+      batch_queue_.pop_front();
+    }
+
+    Status status = TransmitData(batch);
+
+    lock_guard<mutex> l(lock_);
+    if (status.ok()) {
+      num_data_bytes_sent_ += RowBatch::GetBatchSize(*batch);
+      VLOG_ROW << "incremented #data_bytes_sent=" << num_data_bytes_sent_;
+      --num_pending_batches_;
+    } else {
+      if (rpc_status_.ok()) rpc_status_ = status;
+      num_pending_batches_ -= batch_queue_.size() + 1;
+      batch_queue_.clear();
+    }
+    batch_sent_cv_.notify_all();
+  }
+}
+
+Status DataStreamSender::Channel::TransmitData(const shared_ptr<TRowBatch>& batch) {
+  TTransmitDataParams params;
+  // Unless the batch is also queued on other channels, move it into params rather
+  // than copying it.
+  bool shared = !batch.unique();
+  if (shared) {
+    params.__set_row_batch(*batch);
+  } else {
+    SwapRowBatch(batch.get(), &params.row_batch);
+    params.__isset.row_batch = true;
+  }
+  Status status;
   try {
     VLOG_ROW << "Channel::TransmitData() instance_id=" << fragment_instance_id_
              << " dest_node=" << dest_node_id_
-             << " #rows=" << in_flight_batch_->num_rows;
-    TTransmitDataParams params;
+             << " #rows=" << params.row_batch.num_rows;
     params.protocol_version = ImpalaInternalServiceVersion::V1;
     params.__set_dest_fragment_instance_id(fragment_instance_id_);
+    params.__set_src_fragment_instance_id(src_fragment_instance_id_);
     params.__set_dest_node_id(dest_node_id_);
-    params.__set_row_batch(*in_flight_batch_);  // yet another copy
     params.__set_eos(false);
     TTransmitDataResult res;
     client_->iface()->TransmitData(res, params);
-    if (res.status.status_code != TStatusCode::OK) {
-      rpc_status_ = res.status;
-    } else {
-      num_data_bytes_sent_ += RowBatch::GetBatchSize(*in_flight_batch_);
-      VLOG_ROW << "incremented #data_bytes_sent="
-               << num_data_bytes_sent_;
-    }
+    if (res.status.status_code != TStatusCode::OK) status = res.status;
   } catch (TException& e) {
     stringstream msg;
     msg << "TransmitData() to " << ipaddress_ << ":" << port_ << " failed:\n" << e.what();
-    rpc_status_ = Status(msg.str());
-    return;
+    status = Status(msg.str());
   }
-  in_flight_batch_ = NULL;
+  if (!shared) SwapRowBatch(&params.row_batch, batch.get());
+  return status;
 }
 
 Status DataStreamSender::Channel::AddRow(TupleRow* row) {
   int row_num = batch_->AddRow();
   if (row_num == RowBatch::INVALID_ROW_INDEX) {
-    // batch_ is full, let's send it; but first wait for an ongoing
-    // transmission to finish before modifying thrift_batch_
+    // batch_ is full, let's send it
     RETURN_IF_ERROR(SendCurrentBatch());
     row_num = batch_->AddRow();
     DCHECK_NE(row_num, RowBatch::INVALID_ROW_INDEX);
   }
 
   TupleRow* dest = batch_->GetRow(row_num);
-  batch_->CopyRow(row, dest);
   const vector<TupleDescriptor*>& descs = row_desc_.tuple_descriptors();
   for (int i = 0; i < descs.size(); ++i) {
-    dest->SetTuple(i, row->GetTuple(i)->DeepCopy(*descs[i], batch_->tuple_data_pool()));
+    // Tuples are NULL for the unmatched side of outer joins.
+    Tuple* tuple = row->GetTuple(i);
+    if (tuple == NULL) {
+      dest->SetTuple(i, NULL);
+    } else {
+      dest->SetTuple(i, tuple->DeepCopy(*descs[i], batch_->tuple_data_pool()));
+    }
   }
+  batch_->CommitLastRow();
   return Status::OK;
 }
 
 Status DataStreamSender::Channel::SendCurrentBatch() {
-  // make sure there's no in-flight TransmitData() call that might still want to
-  // access thrift_batch_
-  rpc_thread_.join();
-  batch_->Serialize(&thrift_batch_);
+  shared_ptr<TRowBatch> thrift_batch(new TRowBatch());
+  batch_->Serialize(thrift_batch.get());
   batch_->Reset();
-  RETURN_IF_ERROR(SendBatch(&thrift_batch_));
+  if (compressor_ != NULL) RETURN_IF_ERROR(compressor_->Compress(thrift_batch.get()));
+  RETURN_IF_ERROR(SendBatch(thrift_batch));
   return Status::OK;
 }
 
 Status DataStreamSender::Channel::GetSendStatus() {
-  rpc_thread_.join();
+  unique_lock<mutex> l(lock_);
+  while (num_pending_batches_ > 0) {
+    batch_sent_cv_.wait(l);
+  }
   if (!rpc_status_.ok()) {
     LOG(ERROR) << "channel send status: " << rpc_status_.GetErrorMsg();
   }
   return rpc_status_;
 }
 
+void DataStreamSender::Channel::StopSenderThread() {
+  {
+    lock_guard<mutex> l(lock_);
+    shutdown_ = true;
+    batch_queued_cv_.notify_one();
+  }
+  sender_thread_.join();
+}
+
 Status DataStreamSender::Channel::Close() {
   VLOG_RPC << "Channel::Close() instance_id=" << fragment_instance_id_
            << " dest_node=" << dest_node_id_
@@ -221,10 +345,13 @@ Status DataStreamSender::Channel::Close() {
   }
   // if the last transmitted batch resulted in a error, return that error
   RETURN_IF_ERROR(GetSendStatus());
+  // client_ can't be shared with the sender thread
+  StopSenderThread();
   try {
     TTransmitDataParams params;
     params.protocol_version = ImpalaInternalServiceVersion::V1;
     params.__set_dest_fragment_instance_id(fragment_instance_id_);
+    params.__set_src_fragment_instance_id(src_fragment_instance_id_);
     params.__set_dest_node_id(dest_node_id_);
     params.__set_eos(true);
     TTransmitDataResult res;
@@ -242,16 +369,22 @@ Status DataStreamSender::Channel::Close() {
 
 DataStreamSender::DataStreamSender(
     const RowDescriptor& row_desc, const TDataStreamSink& sink,
+    const TUniqueId& fragment_instance_id,
     const vector<TPlanFragmentDestination>& destinations,
     int per_channel_buffer_size)
-  : current_thrift_batch_(&thrift_batch1_) {
+  : row_desc_(row_desc) {
   DCHECK_GT(destinations.size(), 0);
-  DCHECK(sink.output_partition.type == TPartitionType::UNPARTITIONED);
-  broadcast_ = true;
+  DCHECK(sink.output_partition.type == TPartitionType::UNPARTITIONED
+      || sink.output_partition.type == TPartitionType::HASH_PARTITIONED);
+  broadcast_ = sink.output_partition.type == TPartitionType::UNPARTITIONED;
+  if (!broadcast_) {
+    DCHECK(sink.output_partition.__isset.partitioning_exprs);
+    partition_texprs_ = sink.output_partition.partitioning_exprs;
+  }
   // TODO: use something like google3's linked_ptr here (scoped_ptr isn't copyable)
   for (int i = 0; i < destinations.size(); ++i) {
     channels_.push_back(
-        new Channel(row_desc, destinations[i].server,
+        new Channel(row_desc, fragment_instance_id, destinations[i].server,
                     destinations[i].fragment_instance_id,
                     sink.dest_node_id, per_channel_buffer_size));
   }
@@ -266,43 +399,83 @@ DataStreamSender::~DataStreamSender() {
 }
 
 Status DataStreamSender::Init(RuntimeState* state) {
+  if (!broadcast_) {
+    RETURN_IF_ERROR(Expr::CreateExprTrees(&pool_, partition_texprs_, &partition_exprs_));
+    RETURN_IF_ERROR(Expr::Prepare(partition_exprs_, state, row_desc_));
+  }
+  if (FLAGS_compress_row_batches) {
+    compressor_.reset(new RowBatchCompressor(FLAGS_row_batch_compression_min_savings));
+    RETURN_IF_ERROR(compressor_->Init());
+  }
   for (int i = 0; i < channels_.size(); ++i) {
-    RETURN_IF_ERROR(channels_[i]->Init());
+    RETURN_IF_ERROR(channels_[i]->Init(compressor_.get()));
   }
   return Status::OK;
 }
 
 Status DataStreamSender::Send(RuntimeState* state, RowBatch* batch) {
   if (broadcast_ || channels_.size() == 1) {
-    // current_thrift_batch_ is *not* the one that was written by the last call
-    // to Serialize()
-    VLOG_ROW << "serializing " << batch->num_rows() << " rows";
-    batch->Serialize(current_thrift_batch_);
-    // SendBatch() will block if there are still in-flight rpcs (and those will
-    // reference the previously written thrift batch)
+    // serialize once and queue the same TRowBatch on every channel; it is only
+    // freed after the last channel sent it
+    VLOG_ROW << "serializing " << batch->num_active_rows() << " rows";
+    shared_ptr<TRowBatch> thrift_batch(new TRowBatch());
+    batch->Serialize(thrift_batch.get());
+    if (compressor_.get() != NULL) {
+      RETURN_IF_ERROR(compressor_->Compress(thrift_batch.get()));
+    }
+    // SendBatch() will block if a channel has too many queued or in-flight rpcs
     for (int i = 0; i < channels_.size(); ++i) {
-      RETURN_IF_ERROR(channels_[i]->SendBatch(current_thrift_batch_));
+      RETURN_IF_ERROR(channels_[i]->SendBatch(thrift_batch));
     }
-    current_thrift_batch_ =
-        (current_thrift_batch_ == &thrift_batch1_ ? &thrift_batch2_ : &thrift_batch1_);
   } else {
-    // hash-partition batch's rows across channelS
+    // hash-partition batch's rows across channels; each channel buffers its rows
+    // and sends them once it accumulated a full batch
     int num_channels = channels_.size();
-    for (int i = 0; i < batch->num_rows(); ++i) {
-      TupleRow* row = batch->GetRow(i);
-      void* partition_val = partition_expr_->GetValue(row);
-      size_t hash_val = RawValue::GetHashValue(partition_val, partition_expr_->type());
-      RETURN_IF_ERROR(channels_[hash_val % num_channels]->AddRow(row));
+    for (int i = 0; i < batch->num_active_rows(); ++i) {
+      TupleRow* row = batch->GetActiveRow(i);
+      RETURN_IF_ERROR(channels_[GetPartitionHash(row) % num_channels]->AddRow(row));
     }
   }
   return Status::OK;
 }
 
+uint32_t DataStreamSender::GetPartitionHash(TupleRow* row) {
+  uint32_t hash = HashUtil::FVN_SEED;
+  for (int i = 0; i < partition_exprs_.size(); ++i) {
+    Expr* expr = partition_exprs_[i];
+    void* value = expr->GetValue(row);
+    if (value == NULL) {
+      // all NULLs go to the same partition
+      uint32_t null_value = HashUtil::FVN_PRIME;
+      hash = HashUtil::FvnHash(&null_value, sizeof(null_value), hash);
+      continue;
+    }
+    switch (expr->type()) {
+      case TYPE_STRING: {
+        StringValue* string_value = reinterpret_cast<StringValue*>(value);
+        hash = HashUtil::FvnHash(string_value->ptr, string_value->len, hash);
+        break;
+      }
+      case TYPE_TIMESTAMP:
+        // the slot is padded, only the first 12 bytes are data
+        hash = HashUtil::FvnHash(value, 12, hash);
+        break;
+      default:
+        hash = HashUtil::FvnHash(value, GetByteSize(expr->type()), hash);
+    }
+  }
+  return hash;
+}
+
 Status DataStreamSender::Close(RuntimeState* state) {
   // TODO: only close channels that didn't have any errors
   for (int i = 0; i < channels_.size(); ++i) {
     RETURN_IF_ERROR(channels_[i]->Close());
   }
+  if (compressor_.get() != NULL) {
+    VLOG_QUERY << "DataStreamSender compressed " << compressor_->uncompressed_bytes()
+               << " bytes to " << compressor_->sent_bytes();
+  }
   return Status::OK;
 }
 
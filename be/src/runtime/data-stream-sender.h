@@ -5,20 +5,25 @@
 
 #include <vector>
 #include <string>
+#include <boost/scoped_ptr.hpp>
 
 #include "exec/data-sink.h"
 #include "common/object-pool.h"
 #include "common/status.h"
 #include "gen-cpp/Data_types.h"  // for TRowBatch
+#include "gen-cpp/Exprs_types.h"  // for TExpr
 
 namespace impala {
 
 class Expr;
 class RowBatch;
+class RowBatchCompressor;
 class RowDescriptor;
 class TDataStreamSink;
 class THostPort;
 class TPlanFragmentDestination;
+class TupleRow;
+class TUniqueId;
 
 // Single sender of an m:n data stream.
 // Row batch data is routed to destinations based on the provided
@@ -28,27 +33,36 @@ class DataStreamSender : public DataSink {
  public:
   // Construct a sender according to the output specification (sink),
   // sending to the given destinations.
+  // fragment_instance_id identifies this sender to the receivers.
   // Per_channel_buffer_size is the buffer size allocated to each channel
   // and is specified in bytes.
-  // NOTE: This can only do broadcasting right now
-  // (sink.output_partition.type == UNPARTITIONED)
+  // The output is either broadcast to all destinations
+  // (sink.output_partition.type == UNPARTITIONED) or hash-partitioned on
+  // sink.output_partition.partitioning_exprs (HASH_PARTITIONED), in which case
+  // destinations[i] receives partition i.
   DataStreamSender(
     const RowDescriptor& row_desc, const TDataStreamSink& sink,
+    const TUniqueId& fragment_instance_id,
     const std::vector<TPlanFragmentDestination>& destinations,
     int per_channel_buffer_size);
   virtual ~DataStreamSender();
 
   // Setup. Call before Send() or Close().
+  // Creates and prepares the partitioning exprs, if any, and the compressor, if
+  // --compress_row_batches is set.
   virtual Status Init(RuntimeState* state);
 
   // Send data in 'batch' to destination nodes according to partitioning
   // specification provided in c'tor.
   // Blocks until all rows in batch are placed in their appropriate outgoing
-  // buffers (ie, blocks if there are still in-flight rpcs from the last
-  // Send() call).
+  // buffers (ie, blocks if a channel already has the maximum number of batches
+  // queued or in flight, see FLAGS_stream_sender_max_queued_batches).
   // TODO: do we need reuse_batch?
   virtual Status Send(RuntimeState* state, RowBatch* batch);
 
+  // Only the active rows of a batch are sent.
+  virtual bool AcceptsSelection() const { return true; }
+
   // Flush all buffered data and close all existing channels to destination
   // hosts. Further Send() calls are illegal after calling Close().
   virtual Status Close(RuntimeState* state);
@@ -60,17 +74,26 @@ class DataStreamSender : public DataSink {
  private:
   class Channel;
 
-  bool broadcast_;  // if true, send all rows on all channels
+  const RowDescriptor& row_desc_;
 
-  // serialized batches for broadcasting; we need two so we can write
-  // one while the other one is still being sent
-  TRowBatch thrift_batch1_;
-  TRowBatch thrift_batch2_;
-  TRowBatch* current_thrift_batch_;  // the next one to fill in Send()
+  bool broadcast_;  // if true, send all rows on all channels
 
   ObjectPool pool_;  // TODO: reuse RuntimeState's pool
-  Expr* partition_expr_;  // computes per-row partitioning value
+
+  // for HASH_PARTITIONED: exprs that compute the per-row partitioning value
+  std::vector<TExpr> partition_texprs_;
+  std::vector<Expr*> partition_exprs_;
+
   std::vector<Channel*> channels_;
+
+  // compresses outgoing batches; shared by all channels, which are only used
+  // from the Send()/Close() caller's thread; NULL if compression is disabled
+  boost::scoped_ptr<RowBatchCompressor> compressor_;
+
+  // Returns the hash of partition_exprs_ over 'row'.  This is a different hash
+  // function from the one used by HashTable, so that the rows of one partition are
+  // still spread over all buckets of the receiver's hash tables.
+  uint32_t GetPartitionHash(TupleRow* row);
 };
 
 }
@@ -14,6 +14,7 @@
 #include "runtime/data-stream-sender.h"
 #include "runtime/data-stream-recvr.h"
 #include "runtime/descriptors.h"
+#include "runtime/runtime-state.h"
 #include "testutil/test-exec-env.h"
 #include "util/authorization.h"
 #include "util/cpu-info.h"
@@ -24,6 +25,7 @@
 #include "gen-cpp/ImpalaInternalService_types.h"
 #include "gen-cpp/Types_types.h"
 #include "gen-cpp/Descriptors_types.h"
+#include "gen-cpp/Exprs_types.h"
 
 using namespace std;
 using namespace tr1;
@@ -34,6 +36,7 @@ using namespace apache::thrift;
 using namespace apache::thrift::protocol;
 
 DECLARE_int32(port);
+DECLARE_bool(compress_row_batches);
 DEFINE_string(principal, "", "Kerberos principal");
 DEFINE_string(keytab_file, "", "Kerberos keytab");
 
@@ -57,13 +60,20 @@ class ImpalaTestBackend : public ImpalaInternalServiceIf {
       TTransmitDataResult& return_val, const TTransmitDataParams& params) {
     if (!params.eos) {
       mgr_->AddData(params.dest_fragment_instance_id, params.dest_node_id,
-                    params.row_batch).SetTStatus(&return_val);
+                    params.src_fragment_instance_id,
+                    const_cast<TRowBatch*>(&params.row_batch)).SetTStatus(&return_val);
     } else {
       mgr_->CloseSender(params.dest_fragment_instance_id, params.dest_node_id)
           .SetTStatus(&return_val);
     }
   }
 
+  virtual void UpdateFilter(
+      TUpdateFilterResult& return_val, const TUpdateFilterParams& params) {}
+
+  virtual void PublishFilter(
+      TPublishFilterResult& return_val, const TPublishFilterParams& params) {}
+
  private:
   DataStreamMgr* mgr_;
 };
@@ -129,6 +139,7 @@ class DataStreamTest : public testing::Test {
     DataStreamRecvr* stream_recvr;
     Status status;
     int num_rows_received;
+    multiset<int64_t> data_values;
 
     ReceiverInfo(): thread_handle(NULL), num_rows_received(0) {}
   };
@@ -223,7 +234,7 @@ class DataStreamTest : public testing::Test {
     RowBatch* batch;
     VLOG_QUERY <<  "start reading";
     bool is_cancelled;
-    multiset<int64_t> data_values;
+    multiset<int64_t>& data_values = info->data_values;
     while ((batch = info->stream_recvr->GetBatch(&is_cancelled)) != NULL
         && !is_cancelled) {
       VLOG_QUERY << "read batch #rows=" << (batch != NULL ? batch->num_rows() : 0);
@@ -237,7 +248,9 @@ class DataStreamTest : public testing::Test {
     if (is_cancelled) VLOG_QUERY << "reader is cancelled";
     info->status = (is_cancelled ? Status::CANCELLED : Status::OK);
 
-    if (!is_cancelled) {
+    // With hash partitioning, each receiver only gets some of the rows; the test
+    // checks the union of all receivers.
+    if (!is_cancelled && sink_.output_partition.type == TPartitionType::UNPARTITIONED) {
       // check contents of batches
       int64_t expected_val;
       EXPECT_EQ(data_values.size(), NUM_BATCHES * BATCH_CAPACITY * num_senders);
@@ -283,9 +296,15 @@ class DataStreamTest : public testing::Test {
 
   void Sender(int sender_num, int channel_buffer_size) {
     VLOG_QUERY << "create sender " << sender_num;
+    TUniqueId sender_id;
+    sender_id.lo = sender_num;
+    sender_id.hi = 0;
     DataStreamSender sender(
-        *row_desc_, sink_, dest_, channel_buffer_size);
-    EXPECT_TRUE(sender.Init(NULL).ok());
+        *row_desc_, sink_, sender_id, dest_, channel_buffer_size);
+    // The partitioning exprs resolve their slots through the runtime state.
+    RuntimeState state;
+    state.set_desc_tbl(desc_tbl_);
+    EXPECT_TRUE(sender.Init(&state).ok());
     scoped_ptr<RowBatch> batch(CreateRowBatch());
     SenderInfo& info = sender_info_[sender_num];
     int next_val = 0;
@@ -406,6 +425,64 @@ TEST_F(DataStreamTest, MultipleSendersLargeBuffer) {
   StopBackend();
 }
 
+// Hash partitions the rows of a single sender on the bigint slot across two
+// receivers.  Every row must arrive at exactly one of them.
+TEST_F(DataStreamTest, HashPartitioned) {
+  TExprNode slot_ref;
+  slot_ref.node_type = TExprNodeType::SLOT_REF;
+  slot_ref.type = TPrimitiveType::BIGINT;
+  slot_ref.num_children = 0;
+  slot_ref.__set_slot_ref(TSlotRef());
+  slot_ref.slot_ref.slot_id = 0;
+  TExpr partition_expr;
+  partition_expr.nodes.push_back(slot_ref);
+  sink_.output_partition.type = TPartitionType::HASH_PARTITIONED;
+  sink_.output_partition.__set_partitioning_exprs(vector<TExpr>(1, partition_expr));
+
+  StartReceiver(1, 1024);
+  StartReceiver(1, 1024);
+  StartSender();
+  JoinSenders();
+  EXPECT_TRUE(sender_info_[0].status.ok());
+  EXPECT_GT(sender_info_[0].num_bytes_sent, 0);
+  JoinReceivers();
+
+  int total_rows = NUM_BATCHES * BATCH_CAPACITY;
+  multiset<int64_t> all_values;
+  for (int i = 0; i < receiver_info_.size(); ++i) {
+    EXPECT_TRUE(receiver_info_[i].status.ok());
+    // Both receivers get some rows.
+    EXPECT_GT(receiver_info_[i].num_rows_received, 0);
+    EXPECT_LT(receiver_info_[i].num_rows_received, total_rows);
+    EXPECT_EQ(receiver_info_[i].data_values.size(), receiver_info_[i].num_rows_received);
+    all_values.insert(
+        receiver_info_[i].data_values.begin(), receiver_info_[i].data_values.end());
+  }
+  EXPECT_EQ(all_values.size(), total_rows);
+  for (int64_t val = 0; val < total_rows; ++val) {
+    EXPECT_EQ(all_values.count(val), 1) << "value " << val;
+  }
+  StopBackend();
+}
+
+// Sends compressed batches through a single channel, which moves the batches into
+// the rpc params rather than copying them.  The receiver must get all the rows back.
+TEST_F(DataStreamTest, CompressedBatches) {
+  google::FlagSaver flag_saver;
+  FLAGS_compress_row_batches = true;
+  StartReceiver(1, 1024);
+  StartSender();
+  JoinSenders();
+  EXPECT_TRUE(sender_info_[0].status.ok()) << sender_info_[0].status.GetErrorMsg();
+  // The sequential bigints compress well, so the batches are sent compressed.
+  EXPECT_GT(sender_info_[0].num_bytes_sent, 0);
+  EXPECT_LT(sender_info_[0].num_bytes_sent, NUM_BATCHES * BATCH_CAPACITY * PER_ROW_DATA);
+  JoinReceivers();
+  EXPECT_TRUE(receiver_info_[0].status.ok());
+  EXPECT_EQ(receiver_info_[0].num_rows_received, NUM_BATCHES * BATCH_CAPACITY);
+  StopBackend();
+}
+
 TEST_F(DataStreamTest, UnknownSenderSmallResult) {
   // starting a sender w/o a corresponding receiver should result in an error
   // on the sending side
@@ -439,6 +516,78 @@ TEST_F(DataStreamTest, Cancel) {
   StopBackend();
 }
 
+// Adds a batch of 'serialized' directly to the stream, bypassing the rpc layer.
+static void AddBatch(DataStreamMgr* mgr, const TUniqueId& instance_id,
+    PlanNodeId node_id, int64_t sender_num, const TRowBatch& serialized,
+    Status* status) {
+  TUniqueId sender_id;
+  sender_id.lo = sender_num;
+  sender_id.hi = 0;
+  // AddData() takes over the batch's tuple data
+  TRowBatch thrift_batch = serialized;
+  *status = mgr->AddData(instance_id, node_id, sender_id, &thrift_batch);
+}
+
+// Waits up to 10s for the stream's SendersBlocked counter to reach 'num_parked'.
+static void WaitForParkedSenders(RuntimeProfile::Counter* counter, int num_parked) {
+  for (int i = 0; i < 1000 && counter->value() < num_parked; ++i) {
+    usleep(10000);
+  }
+}
+
+TEST_F(DataStreamTest, SenderQuota) {
+  scoped_ptr<RowBatch> batch(CreateRowBatch());
+  GetNextBatch(batch.get(), &next_val_);
+  TRowBatch serialized;
+  batch->Serialize(&serialized);
+  int batch_size = RowBatch::GetBatchSize(serialized);
+
+  // 4 senders: each one gets a quota of 2 batches
+  TUniqueId instance_id;
+  GetNextInstanceId(&instance_id);
+  RuntimeProfile profile(&obj_pool_, "recvr");
+  scoped_ptr<DataStreamRecvr> recvr(stream_mgr_->CreateRecvr(
+      *row_desc_, instance_id, DEST_NODE_ID, 4, 4 * batch_size, &profile));
+  RuntimeProfile::Counter* parked_counter = profile.GetCounter("SendersBlocked");
+  ASSERT_TRUE(parked_counter != NULL);
+  Status status;
+  AddBatch(stream_mgr_, instance_id, DEST_NODE_ID, 0, serialized, &status);
+  EXPECT_TRUE(status.ok());
+  AddBatch(stream_mgr_, instance_id, DEST_NODE_ID, 0, serialized, &status);
+  EXPECT_TRUE(status.ok());
+
+  // sender 0 is over its quota now and gets parked
+  Status parked_status;
+  thread parked_sender(AddBatch, stream_mgr_, instance_id, DEST_NODE_ID, 0,
+      serialized, &parked_status);
+  WaitForParkedSenders(parked_counter, 1);
+  EXPECT_EQ(parked_counter->value(), 1);
+
+  // that doesn't stall the other senders
+  AddBatch(stream_mgr_, instance_id, DEST_NODE_ID, 1, serialized, &status);
+  EXPECT_TRUE(status.ok());
+  EXPECT_EQ(parked_counter->value(), 1);
+
+  // draining sender 0's first batch resumes it
+  bool is_cancelled;
+  scoped_ptr<RowBatch> received(recvr->GetBatch(&is_cancelled));
+  EXPECT_FALSE(is_cancelled);
+  ASSERT_TRUE(received.get() != NULL);
+  EXPECT_EQ(received->num_rows(), BATCH_CAPACITY);
+  parked_sender.join();
+  EXPECT_TRUE(parked_status.ok());
+
+  // cancellation releases parked senders
+  thread cancelled_sender(AddBatch, stream_mgr_, instance_id, DEST_NODE_ID, 0,
+      serialized, &parked_status);
+  WaitForParkedSenders(parked_counter, 2);
+  EXPECT_EQ(parked_counter->value(), 2);
+  stream_mgr_->Cancel(instance_id);
+  cancelled_sender.join();
+  EXPECT_TRUE(parked_status.IsCancelled());
+  StopBackend();
+}
+
 // TODO: more tests:
 // - TEST_F(DataStreamTest, SingleSenderMultipleReceivers)
 // - TEST_F(DataStreamTest, MultipleSendersMultipleReceivers)
@@ -7,10 +7,15 @@
 #include "codegen/llvm-codegen.h"
 #include "runtime/disk-io-mgr.h"
 #include "runtime/disk-io-mgr-stress.h"
+#include "runtime/mem-tracker.h"
 
 using namespace std;
 using namespace boost;
 
+DECLARE_string(disk_io_engine);
+DECLARE_bool(mmap_local_reads);
+DECLARE_int64(max_free_io_buffer_bytes);
+
 const int BUFFER_SIZE = 1024;
 
 namespace impala {
@@ -66,6 +71,65 @@ class DiskIoMgrTest : public testing::Test {
     return range;
   }
 
+  // Reads ranges at unaligned offsets, some of them longer than a buffer, from a
+  // single reader with a range of thread and buffer counts and validates the contents
+  // of every buffer.
+  void ValidateUnalignedReads() {
+    const char* tmp_file = "/tmp/disk_io_mgr_unaligned_test.txt";
+    string data;
+    for (int i = 0; i < 10000; ++i) {
+      data.push_back('a' + i % 26);
+    }
+    CreateTempFile(tmp_file, data.c_str());
+
+    for (int num_threads_per_disk = 1; num_threads_per_disk <= 3; 
+        ++num_threads_per_disk) {
+      for (int num_buffers = 1; num_buffers <= 5; num_buffers += 2) {
+        LOG(INFO) << "Starting test with num_threads_per_disk=" << num_threads_per_disk
+                  << " num_buffers=" << num_buffers;
+        DiskIoMgr io_mgr(2, num_threads_per_disk, BUFFER_SIZE);
+        Status status = io_mgr.Init();
+        ASSERT_TRUE(status.ok());
+
+        DiskIoMgr::ReaderContext* reader;
+        status = io_mgr.RegisterReader(NULL, num_buffers, &reader);
+        ASSERT_TRUE(status.ok());
+
+        vector<DiskIoMgr::ScanRange*> ranges;
+        ranges.push_back(InitRange(tmp_file, 0, 4096, 0));
+        ranges.push_back(InitRange(tmp_file, 1, 3, 1));
+        ranges.push_back(InitRange(tmp_file, 4095, 2, 0));
+        ranges.push_back(InitRange(tmp_file, 1023, 5000, 1));
+        ranges.push_back(InitRange(tmp_file, 7777, 2223, 0));
+        status = io_mgr.AddScanRanges(reader, ranges);
+        ASSERT_TRUE(status.ok());
+
+        int num_ranges_done = 0;
+        bool eos = false;
+        while (!eos) {
+          DiskIoMgr::BufferDescriptor* buffer;
+          status = io_mgr.GetNext(reader, &buffer, &eos);
+          ASSERT_TRUE(status.ok());
+          ASSERT_TRUE(buffer != NULL);
+          ASSERT_GT(buffer->len(), 0);
+          ASSERT_LE(buffer->len(), BUFFER_SIZE);
+          int64_t file_offset = 
+              buffer->scan_range()->offset() + buffer->scan_range_offset();
+          EXPECT_EQ(string(buffer->buffer(), buffer->len()),
+              data.substr(file_offset, buffer->len()));
+          if (buffer->eosr()) {
+            EXPECT_EQ(buffer->scan_range_offset() + buffer->len(), 
+                buffer->scan_range()->len());
+            ++num_ranges_done;
+          }
+          buffer->Return();
+        }
+        EXPECT_EQ(num_ranges_done, ranges.size());
+        io_mgr.UnregisterReader(reader);
+      }
+    }
+  }
+
   ObjectPool pool_;
 };
 
@@ -316,6 +380,74 @@ TEST_F(DiskIoMgrTest, SyncReadTest) {
   }
 }
 
+// Reads ranges that are not block aligned and span multiple buffers with the aio
+// engine.
+TEST_F(DiskIoMgrTest, AioReader) {
+  FLAGS_disk_io_engine = "aio";
+  ValidateUnalignedReads();
+  FLAGS_disk_io_engine = "sync";
+}
+
+// Same as above with mapped reads.
+TEST_F(DiskIoMgrTest, MmapReader) {
+  FLAGS_mmap_local_reads = true;
+  ValidateUnalignedReads();
+  FLAGS_mmap_local_reads = false;
+}
+
+// Tests that io buffers are sized for the read, charged to the reader at that size
+// and that unused buffers are freed beyond the free list limit and by GcIoBuffers().
+TEST_F(DiskIoMgrTest, BufferPool) {
+  // Restores FLAGS_max_free_io_buffer_bytes, also if an assertion fails.
+  google::FlagSaver flag_saver;
+  const int64_t read_size = 1024 * 1024;
+  const char* tmp_file = "/tmp/disk_io_mgr_buffer_pool_test.txt";
+  string data(100, 'x');
+  CreateTempFile(tmp_file, data.c_str());
+
+  for (int max_free_bytes = 0; max_free_bytes <= read_size; max_free_bytes += read_size) {
+    FLAGS_max_free_io_buffer_bytes = max_free_bytes;
+    DiskIoMgr io_mgr(1, 1, read_size);
+    Status status = io_mgr.Init();
+    ASSERT_TRUE(status.ok());
+
+    MemTracker mem_tracker;
+    DiskIoMgr::ReaderContext* reader;
+    status = io_mgr.RegisterReader(NULL, 1, &reader, &mem_tracker);
+    ASSERT_TRUE(status.ok());
+
+    vector<DiskIoMgr::ScanRange*> ranges;
+    ranges.push_back(InitRange(tmp_file, 0, data.size(), 0));
+    status = io_mgr.AddScanRanges(reader, ranges);
+    ASSERT_TRUE(status.ok());
+
+    DiskIoMgr::BufferDescriptor* buffer;
+    bool eos;
+    status = io_mgr.GetNext(reader, &buffer, &eos);
+    ASSERT_TRUE(status.ok());
+    ASSERT_TRUE(buffer != NULL);
+    EXPECT_EQ(buffer->len(), data.size());
+    // A 100 byte read gets a buffer from the smallest size class.
+    EXPECT_GT(mem_tracker.consumption(), 0);
+    EXPECT_LT(mem_tracker.consumption(), read_size);
+    EXPECT_EQ(io_mgr.num_allocated_buffers(), 1);
+    buffer->Return();
+    EXPECT_EQ(mem_tracker.consumption(), 0);
+
+    if (max_free_bytes == 0) {
+      EXPECT_EQ(io_mgr.num_allocated_buffers(), 0);
+      EXPECT_EQ(io_mgr.free_buffer_bytes(), 0);
+    } else {
+      EXPECT_EQ(io_mgr.num_allocated_buffers(), 1);
+      EXPECT_GT(io_mgr.free_buffer_bytes(), 0);
+      io_mgr.GcIoBuffers();
+      EXPECT_EQ(io_mgr.num_allocated_buffers(), 0);
+      EXPECT_EQ(io_mgr.free_buffer_bytes(), 0);
+    }
+    io_mgr.UnregisterReader(reader);
+  }
+}
+
 // This test will test multiple concurrent reads each reading a different file.
 TEST_F(DiskIoMgrTest, MultipleReader) {
   const int NUM_THREADS = 5;
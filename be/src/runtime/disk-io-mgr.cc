@@ -2,12 +2,18 @@
 
 #include "runtime/disk-io-mgr.h"
 
+#include <fcntl.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <queue>
 #include <boost/functional/hash.hpp>
 #include <boost/scoped_ptr.hpp>
 #include <boost/thread/locks.hpp>
 
 #include "common/logging.h"
+#include "runtime/mem-tracker.h"
+#include "util/aio-context.h"
 #include "util/disk-info.h"
 #include "util/hdfs-util.h"
 
@@ -22,6 +28,54 @@ DEFINE_int32(num_disks, 0, "Number of disks on data node.");
 // io and sequential io perform similarly.
 DEFINE_int32(num_threads_per_disk, 1, "number of threads per disk");
 DEFINE_int32(read_size, 8 * 1024 * 1024, "Read Size (in bytes)");
+// Io engine for local file reads.  With "aio", the disk threads only schedule and
+// submit reads and the queue depth per disk is set by aio_queue_depth instead of
+// the number of threads.
+DEFINE_string(disk_io_engine, "sync",
+    "Io engine used for local file reads: 'sync' (blocking reads from the disk "
+    "threads) or 'aio' (linux native async io)");
+DEFINE_int32(aio_queue_depth, 32,
+    "Maximum number of outstanding reads per disk with --disk_io_engine=aio");
+DEFINE_bool(aio_direct_io, true,
+    "If true, local files read with --disk_io_engine=aio are opened with O_DIRECT");
+// Io buffer pool configs.  Buffers of all sizes that are not in use are cached up to
+// max_free_io_buffer_bytes; beyond that they are returned to the system so idle
+// buffers don't accumulate after concurrent queries finish.
+DEFINE_int32(min_io_buffer_size, 64 * 1024, 
+    "Size (in bytes) of the smallest io buffer size class");
+DEFINE_int64(max_free_io_buffer_bytes, 256L * 1024 * 1024,
+    "Maximum bytes of unused io buffers the io mgr keeps for reuse");
+// Mapped reads take precedence over the io engine for local files.
+DEFINE_bool(mmap_local_reads, false,
+    "If true, local files are read by mapping them into memory rather than copying "
+    "into io buffers");
+
+// Alignment of buffers, file offsets and read lengths for O_DIRECT reads.  This is
+// at least the logical block size of any device we expect to read from.
+static const int DIRECT_IO_ALIGNMENT = 4096;
+
+// Time the aio completion threads wait for reads before checking for shut down.
+static const int AIO_POLL_TIMEOUT_MS = 100;
+
+// Io buffers at least this big are backed by huge pages if the os supports it.
+static const int64_t HUGE_PAGE_SIZE = 2 * 1024 * 1024;
+
+// Allocates an io buffer of 'buffer_size' bytes.  Direct io reads are widened to
+// aligned boundaries on both ends which can require up to one extra block on each
+// side, so the buffer is padded for that.
+static char* AllocateIoBuffer(int64_t buffer_size) {
+  int64_t alloc_size = buffer_size + 2 * DIRECT_IO_ALIGNMENT;
+  void* buffer;
+  int ret = posix_memalign(&buffer, 
+      alloc_size >= HUGE_PAGE_SIZE ? HUGE_PAGE_SIZE : DIRECT_IO_ALIGNMENT, alloc_size);
+  CHECK_EQ(ret, 0) << "Could not allocate io buffer: " << strerror(ret);
+#ifdef MADV_HUGEPAGE
+  // Large buffers are read into and scanned sequentially; huge pages cut the tlb
+  // misses doing that.  This is only a hint.
+  if (alloc_size >= HUGE_PAGE_SIZE) madvise(buffer, alloc_size, MADV_HUGEPAGE);
+#endif
+  return reinterpret_cast<char*>(buffer);
+}
 
 using namespace boost;
 using namespace impala;
@@ -59,6 +113,10 @@ struct DiskIoMgr::ReaderContext {
   // reader.
   int num_buffers_per_disk_;
 
+  // Tracker that the io buffers are charged to while they are in use by this reader.
+  // May be NULL.
+  MemTracker* mem_tracker_;
+
   // Condition variable for GetNext
   condition_variable buffer_ready_cond_var_;
 
@@ -144,16 +202,18 @@ struct DiskIoMgr::ReaderContext {
   ReaderContext(int num_disks) 
     : bytes_read_counter_(NULL),
       read_timer_(NULL),
+      mem_tracker_(NULL),
       state_(Inactive),
       disk_states_(num_disks) {
   }
 
   // Resets this object for a new reader
-  void Reset(hdfsFS hdfs_connection, int per_disk_buffers) {
+  void Reset(hdfsFS hdfs_connection, int per_disk_buffers, MemTracker* mem_tracker) {
     DCHECK_EQ(state_, Inactive);
 
     bytes_read_counter_ = NULL;
     read_timer_ = NULL;
+    mem_tracker_ = mem_tracker;
 
     state_ = Active;
     num_buffers_per_disk_ = per_disk_buffers;
@@ -343,7 +403,16 @@ struct DiskIoMgr::DiskQueue {
   // The reader at the head of the queue that will get their io issued next
   list<ReaderContext*>::iterator next_reader;
 
-  DiskQueue(int id) : disk_id(id) {
+  // Async io context for this disk.  Only used with the aio engine.
+  scoped_ptr<AioContext> aio_context;
+
+  // Number of async reads reserved or in flight on this disk.  Protected by 'lock'.
+  int num_aio_slots_used;
+
+  // Signalled when an async read slot is released.
+  condition_variable aio_slot_available;
+
+  DiskQueue(int id) : disk_id(id), num_aio_slots_used(0) {
     next_reader = readers.end();
   }
 };
@@ -365,6 +434,8 @@ void DiskIoMgr::ScanRange::InitInternal(ReaderContext* reader) {
   reader_ = reader;
   local_file_ = NULL;
   hdfs_file_ = NULL;
+  local_fd_ = -1;
+  direct_io_ = false;
   bytes_read_ = 0;
 }
 
@@ -380,12 +451,15 @@ DiskIoMgr::BufferDescriptor::BufferDescriptor(DiskIoMgr* io_mgr) :
 }
 
 void DiskIoMgr::BufferDescriptor::Reset(ReaderContext* reader, 
-      ScanRange* range, char* buffer) {
+      ScanRange* range, char* buffer, int64_t buffer_len) {
   DCHECK(io_mgr_ != NULL);
   DCHECK(buffer_ == NULL);
   reader_ = reader;
   scan_range_ = range;
   buffer_ = buffer;
+  buffer_len_ = buffer_len;
+  buffer_offset_ = 0;
+  mapped_len_ = 0;
   len_ = 0;
   eosr_ = false;
   status_ = Status::OK;
@@ -397,11 +471,16 @@ void DiskIoMgr::BufferDescriptor::Return() {
 }
 
 DiskIoMgr::DiskIoMgr() :
+    use_aio_(false),
+    aio_queue_depth_(0),
+    mmap_reads_(false),
     num_threads_per_disk_(FLAGS_num_threads_per_disk),
     max_read_size_(FLAGS_read_size),
     shut_down_(false),
     total_bytes_read_counter_(TCounterType::BYTES),
     read_timer_(TCounterType::CPU_TICKS),
+    min_buffer_size_(0),
+    free_buffer_bytes_(0),
     num_allocated_buffers_(0) {
   int num_disks = FLAGS_num_disks;
   if (num_disks == 0) num_disks = DiskInfo::num_disks();
@@ -409,11 +488,16 @@ DiskIoMgr::DiskIoMgr() :
 }
 
 DiskIoMgr::DiskIoMgr(int num_disks, int threads_per_disk, int max_read_size) :
+    use_aio_(false),
+    aio_queue_depth_(0),
+    mmap_reads_(false),
     num_threads_per_disk_(threads_per_disk),
     max_read_size_(max_read_size),
     shut_down_(false),
     total_bytes_read_counter_(TCounterType::BYTES),
     read_timer_(TCounterType::CPU_TICKS),
+    min_buffer_size_(0),
+    free_buffer_bytes_(0),
     num_allocated_buffers_(0) {
   if (num_disks == 0) num_disks = DiskInfo::num_disks();
   disk_queues_.resize(num_disks);
@@ -423,6 +507,7 @@ DiskIoMgr::~DiskIoMgr() {
   shut_down_ = true;
   // Notify all worker threads and shut them down. 
   for (int i = 0; i < disk_queues_.size(); ++i) {
+    if (disk_queues_[i] == NULL) continue;
     {
       // This lock is necessary to properly use the condition var to notify
       // the disk worker threads.  The readers also grab this lock so updates
@@ -430,10 +515,13 @@ DiskIoMgr::~DiskIoMgr() {
       unique_lock<mutex> lock(disk_queues_[i]->lock);
     }
     disk_queues_[i]->work_available.notify_all();
+    disk_queues_[i]->aio_slot_available.notify_all();
   }
   disk_thread_group_.join_all();
 
   for (int i = 0; i < disk_queues_.size(); ++i) {
+    if (disk_queues_[i] == NULL) continue;
+    DCHECK_EQ(disk_queues_[i]->num_aio_slots_used, 0);
     int disk_id = disk_queues_[i]->disk_id;
     for (list<ReaderContext*>::iterator reader = disk_queues_[i]->readers.begin(); 
       reader != disk_queues_[i]->readers.end(); ++reader) { 
@@ -442,14 +530,12 @@ DiskIoMgr::~DiskIoMgr() {
     }
   } 
 
-  DCHECK(reader_cache_->ValidateAllInactive()) << endl << DebugString();
+  DCHECK(reader_cache_.get() == NULL || reader_cache_->ValidateAllInactive()) 
+      << endl << DebugString();
   
   // Delete all allocated buffers
-  DCHECK_EQ(num_allocated_buffers_, free_buffers_.size());
-  for (list<char*>::iterator iter = free_buffers_.begin();
-      iter != free_buffers_.end(); ++iter) {
-    delete *iter;
-  }
+  GcIoBuffers();
+  DCHECK_EQ(num_allocated_buffers_, 0);
 
   for (int i = 0; i < disk_queues_.size(); ++i) {
     delete disk_queues_[i];
@@ -457,22 +543,48 @@ DiskIoMgr::~DiskIoMgr() {
 }
 
 Status DiskIoMgr::Init() {
+  if (FLAGS_disk_io_engine == "aio") {
+    use_aio_ = true;
+  } else if (FLAGS_disk_io_engine != "sync") {
+    stringstream ss;
+    ss << "Invalid disk io engine: '" << FLAGS_disk_io_engine 
+       << "'. Valid engines are 'sync' and 'aio'.";
+    return Status(ss.str());
+  }
+  // Each disk thread holds on to a slot while it waits for work.
+  aio_queue_depth_ = max(FLAGS_aio_queue_depth, num_threads_per_disk_);
+  mmap_reads_ = FLAGS_mmap_local_reads;
+
+  min_buffer_size_ = min(FLAGS_min_io_buffer_size, max_read_size_);
+  free_buffers_.resize(SizeClass(max_read_size_) + 1);
+
+  reader_cache_.reset(new ReaderCache(this));
   for (int i = 0; i < disk_queues_.size(); ++i) {
     disk_queues_[i] = new DiskQueue(i);
+    if (use_aio_) {
+      disk_queues_[i]->aio_context.reset(new AioContext(aio_queue_depth_));
+      RETURN_IF_ERROR(disk_queues_[i]->aio_context->Init());
+    }
+  }
+
+  for (int i = 0; i < disk_queues_.size(); ++i) {
+    if (use_aio_) {
+      disk_thread_group_.add_thread(
+          new thread(&DiskIoMgr::AioCompletionLoop, this, disk_queues_[i]));
+    }
     for (int j = 0; j < num_threads_per_disk_; ++j) {
       disk_thread_group_.add_thread(
           new thread(&DiskIoMgr::ReadLoop, this, disk_queues_[i]));
     }
   }
-  reader_cache_.reset(new ReaderCache(this));
   return Status::OK;
 }
 
 Status DiskIoMgr::RegisterReader(hdfsFS hdfs, int num_buffers_per_disk, 
-    ReaderContext** reader) {
+    ReaderContext** reader, MemTracker* mem_tracker) {
   DCHECK(reader_cache_.get() != NULL) << "Must call Init() first.";
   *reader = reader_cache_->GetNewReader();
-  (*reader)->Reset(hdfs, num_buffers_per_disk);
+  (*reader)->Reset(hdfs, num_buffers_per_disk, mem_tracker);
   return Status::OK;
 }
 
@@ -705,10 +817,9 @@ void DiskIoMgr::ReturnBuffer(BufferDescriptor* buffer_desc) {
   // Null buffer meant there was an error or GetNext was called after eos.  Protect
   // against returning those buffers.
   if (buffer_desc->buffer_ != NULL) {
-    ReturnFreeBuffer(buffer_desc->buffer_);
-    buffer_desc->buffer_ = NULL;
-
     ReaderContext* reader = buffer_desc->reader_;
+    ReturnFreeBuffer(buffer_desc);
+
     if (reader != NULL) {
       DCHECK(buffer_desc->reader_ != NULL);
       int disk_id = buffer_desc->scan_range_->disk_id();
@@ -745,15 +856,15 @@ void DiskIoMgr::ReturnBuffer(BufferDescriptor* buffer_desc) {
 
 void DiskIoMgr::ReturnBufferDesc(BufferDescriptor* desc) {
   DCHECK(desc != NULL);
-  unique_lock<mutex> lock(free_buffers_lock_);
+  unique_lock<mutex> lock(free_buffer_descs_lock_);
   free_buffer_descs_.push_back(desc);
 }
 
 DiskIoMgr::BufferDescriptor* DiskIoMgr::GetBufferDesc(
-    ReaderContext* reader, ScanRange* range, char* buffer) {
+    ReaderContext* reader, ScanRange* range, char* buffer, int64_t buffer_len) {
   BufferDescriptor* buffer_desc;
   {
-    unique_lock<mutex> lock(free_buffers_lock_);
+    unique_lock<mutex> lock(free_buffer_descs_lock_);
     if (free_buffer_descs_.empty()) {
       buffer_desc = pool_.Add(new BufferDescriptor(this));
     } else {
@@ -761,26 +872,91 @@ DiskIoMgr::BufferDescriptor* DiskIoMgr::GetBufferDesc(
       free_buffer_descs_.pop_front();
     }
   }
-  buffer_desc->Reset(reader, range, buffer);
+  buffer_desc->Reset(reader, range, buffer, buffer_len);
+  if (reader->mem_tracker_ != NULL) reader->mem_tracker_->Consume(buffer_len);
   return buffer_desc;
 }
 
-char* DiskIoMgr::GetFreeBuffer() {
-  unique_lock<mutex> lock(free_buffers_lock_);
-  if (free_buffers_.empty()) {
+int64_t DiskIoMgr::BufferSize(int size_class) const {
+  return min(static_cast<int64_t>(min_buffer_size_) << size_class, 
+      static_cast<int64_t>(max_read_size_));
+}
+
+int DiskIoMgr::SizeClass(int64_t bytes) const {
+  DCHECK_GT(min_buffer_size_, 0);
+  DCHECK_LE(bytes, max_read_size_);
+  int size_class = 0;
+  while (BufferSize(size_class) < bytes) ++size_class;
+  return size_class;
+}
+
+char* DiskIoMgr::GetFreeBuffer(int64_t* buffer_size, MemTracker* mem_tracker) {
+  int size_class = SizeClass(*buffer_size);
+  *buffer_size = BufferSize(size_class);
+  {
+    unique_lock<mutex> lock(free_buffers_lock_);
+    list<char*>& free_list = free_buffers_[size_class];
+    if (!free_list.empty()) {
+      char* buffer = free_list.front();
+      free_list.pop_front();
+      free_buffer_bytes_ -= *buffer_size;
+      return buffer;
+    }
     ++num_allocated_buffers_;
-    return new char[max_read_size_];
-  } else {
-    char* buffer = free_buffers_.front();
-    free_buffers_.pop_front();
-    return buffer;
   }
+  // The reader is over its limit so this is a bad time to grow the process.  Give
+  // back the idle buffers of other sizes first.
+  if (mem_tracker != NULL && mem_tracker->AnyLimitExceeded()) GcIoBuffers();
+  return AllocateIoBuffer(*buffer_size);
 }
 
-void DiskIoMgr::ReturnFreeBuffer(char* buffer) {
+void DiskIoMgr::ReturnFreeBuffer(char* buffer, int64_t buffer_size) {
   DCHECK(buffer != NULL);
-  unique_lock<mutex> lock(free_buffers_lock_);
-  free_buffers_.push_back(buffer);
+  {
+    unique_lock<mutex> lock(free_buffers_lock_);
+    if (free_buffer_bytes_ + buffer_size <= FLAGS_max_free_io_buffer_bytes) {
+      free_buffers_[SizeClass(buffer_size)].push_back(buffer);
+      free_buffer_bytes_ += buffer_size;
+      return;
+    }
+    --num_allocated_buffers_;
+  }
+  free(buffer);
+}
+
+void DiskIoMgr::GcIoBuffers() {
+  list<char*> buffers_to_free;
+  {
+    unique_lock<mutex> lock(free_buffers_lock_);
+    for (int i = 0; i < free_buffers_.size(); ++i) {
+      num_allocated_buffers_ -= free_buffers_[i].size();
+      buffers_to_free.splice(buffers_to_free.end(), free_buffers_[i]);
+    }
+    free_buffer_bytes_ = 0;
+  }
+  for (list<char*>::iterator it = buffers_to_free.begin(); 
+      it != buffers_to_free.end(); ++it) {
+    free(*it);
+  }
+}
+
+void DiskIoMgr::ReturnFreeBuffer(BufferDescriptor* desc) {
+  if (desc->mapped_len_ > 0) {
+    // Mapped buffers are not charged to the mem tracker.  The memory belongs to the
+    // os buffer cache.
+    DCHECK(desc->buffer_ != NULL);
+    munmap(desc->buffer_, desc->mapped_len_);
+    desc->buffer_ = NULL;
+    desc->mapped_len_ = 0;
+    return;
+  }
+  DCHECK(desc->buffer_ != NULL);
+  if (desc->reader_ != NULL && desc->reader_->mem_tracker_ != NULL) {
+    desc->reader_->mem_tracker_->Release(desc->buffer_len_);
+  }
+  ReturnFreeBuffer(desc->buffer_, desc->buffer_len_);
+  desc->buffer_ = NULL;
+  desc->buffer_len_ = 0;
 }
 
 string DiskIoMgr::DebugString() {
@@ -829,6 +1005,29 @@ Status DiskIoMgr::OpenScanRange(hdfsFS hdfs_connection, ScanRange* range) const
       ss << "Error seeking to " << range->offset_ << " in file: " << range->file_;
       return Status(AppendHdfsErrorMessage(ss.str()));
     }
+  } else if (use_aio_ || mmap_reads_) {
+    if (range->local_fd_ != -1) return Status::OK;
+
+    // Reads are done with explicit offsets so there is no need to seek.
+    if (use_aio_ && !mmap_reads_ && FLAGS_aio_direct_io) {
+      range->local_fd_ = open(range->file_, O_RDONLY | O_DIRECT);
+      range->direct_io_ = range->local_fd_ != -1;
+      // Some file systems (e.g. tmpfs) do not support O_DIRECT.  Fall back to
+      // buffered io for those.
+      if (range->local_fd_ == -1 && errno != EINVAL) {
+        stringstream ss;
+        ss << "Could not open file: " << range->file_ << ": " << strerror(errno);
+        return Status(ss.str());
+      }
+    }
+    if (range->local_fd_ == -1) {
+      range->local_fd_ = open(range->file_, O_RDONLY);
+      if (range->local_fd_ == -1) {
+        stringstream ss;
+        ss << "Could not open file: " << range->file_ << ": " << strerror(errno);
+        return Status(ss.str());
+      }
+    }
   } else {
     if (range->local_file_ != NULL) return Status::OK;
 
@@ -855,6 +1054,9 @@ void DiskIoMgr::CloseScanRange(hdfsFS hdfs_connection, ScanRange* range) const {
     if (range->hdfs_file_ == NULL) return;
     hdfsCloseFile(hdfs_connection, range->hdfs_file_);
     range->hdfs_file_ = NULL;
+  } else if (range->local_fd_ != -1) {
+    close(range->local_fd_);
+    range->local_fd_ = -1;
   } else {
     if (range->local_file_ == NULL) return;
     fclose(range->local_file_);
@@ -930,7 +1132,7 @@ void DiskIoMgr::RemoveReaderFromDiskQueue(DiskQueue* disk_queue, ReaderContext*
 //  2) Multiple threads (including per disk) can work on the same reader.
 //  3) Scan ranges within a reader are round-robined.
 bool DiskIoMgr::GetNextScanRange(DiskQueue* disk_queue, ScanRange** range, 
-    ReaderContext** reader, char** buffer) {
+    ReaderContext** reader) {
   // This loops returns either with work to do or when the disk io mgr shuts down.
   while (true) {
     unique_lock<mutex> disk_lock(disk_queue->lock);
@@ -981,12 +1183,11 @@ bool DiskIoMgr::GetNextScanRange(DiskQueue* disk_queue, ScanRange** range,
     // reader per disk that is the in unlocked hdfs read code section.
     ++state.num_threads_in_read;
     
-    // Get a free buffer from the disk io mgr.  It's a global pool for all readers but
-    // they are lazily allocated.  Each reader is guaranteed its share.
-    *buffer = GetFreeBuffer();
+    // Reserve one of the reader's buffers.  The buffer itself comes from the disk io
+    // mgr's global pool (or is mapped) and is lazily allocated by the caller.  Each
+    // reader is guaranteed its share.
     --(*reader)->num_empty_buffers_;
     --state.num_empty_buffers;
-    DCHECK(*buffer != NULL);
 
     // Round robin ranges 
     *range = *state.ranges.begin();
@@ -1020,7 +1221,8 @@ void DiskIoMgr::HandleReadFinished(DiskQueue* disk_queue, ReaderContext* reader,
     
     DCHECK(reader->Validate()) << endl << reader->DebugString();
     DCHECK_GT(state.num_threads_in_read, 0);
-    DCHECK(buffer->buffer_ != NULL);
+    // Failed mapped reads never got a buffer.
+    DCHECK(buffer->buffer_ != NULL || !buffer->status_.ok());
 
     --state.num_threads_in_read;
 
@@ -1033,8 +1235,7 @@ void DiskIoMgr::HandleReadFinished(DiskQueue* disk_queue, ReaderContext* reader,
       CloseScanRange(reader->hdfs_connection_, buffer->scan_range_);
       ++reader->num_empty_buffers_;
       ++state.num_empty_buffers;
-      ReturnFreeBuffer(buffer->buffer_);
-      buffer->buffer_ = NULL;
+      if (buffer->buffer_ != NULL) ReturnFreeBuffer(buffer);
       ReturnBufferDesc(buffer);
       if (state.num_threads_in_read == 0) {
         state.num_scan_ranges = 0;
@@ -1044,7 +1245,6 @@ void DiskIoMgr::HandleReadFinished(DiskQueue* disk_queue, ReaderContext* reader,
     }
         
     DCHECK_EQ(reader->state_, ReaderContext::Active);
-    DCHECK(buffer->buffer_ != NULL);
 
     // Update the reader's scan ranges.  There are a three cases here:
     //  1. Read error
@@ -1054,8 +1254,7 @@ void DiskIoMgr::HandleReadFinished(DiskQueue* disk_queue, ReaderContext* reader,
       CloseScanRange(reader->hdfs_connection_, buffer->scan_range_);
       ++reader->num_empty_buffers_;
       ++state.num_empty_buffers;
-      ReturnFreeBuffer(buffer->buffer_);
-      buffer->buffer_ = NULL;
+      if (buffer->buffer_ != NULL) ReturnFreeBuffer(buffer);
       buffer->eosr_ = true;
     } else {
       if (!buffer->eosr_) {
@@ -1121,28 +1320,67 @@ void DiskIoMgr::HandleReadFinished(DiskQueue* disk_queue, ReaderContext* reader,
 //   3. HandleReadFinished(): Take locks and update the disk and reader with the 
 //      results of the io.
 // Cancellation checking needs to happen in both steps 1 and 3.
+// With the aio engine, local reads are only submitted in step 2 and steps 2 and 3 are
+// finished by the disk's AioCompletionLoop() thread.
 void DiskIoMgr::ReadLoop(DiskQueue* disk_queue) {
   while (true) {
     char* buffer = NULL;
     ReaderContext* reader = NULL;;
     ScanRange* range = NULL;
+
+    // Don't pick up more work than the disk can have outstanding
+    if (use_aio_ && !ReserveAioSlot(disk_queue)) {
+      DCHECK(shut_down_);
+      break;
+    }
     
     // Get the next scan range to read
-    if (!GetNextScanRange(disk_queue, &range, &reader, &buffer)) {
+    if (!GetNextScanRange(disk_queue, &range, &reader)) {
       DCHECK(shut_down_);
+      if (use_aio_) ReleaseAioSlot(disk_queue);
       break;
     }
     DCHECK(range != NULL);
     DCHECK(reader != NULL);
-    DCHECK(buffer != NULL);
 
-    BufferDescriptor* buffer_desc = GetBufferDesc(reader, range, buffer);
+    bool local_read = reader->hdfs_connection_ == NULL;
+    bool map_range = mmap_reads_ && local_read;
+    bool async_read = use_aio_ && local_read && !map_range;
+
+    // Mapped reads don't need an io buffer.  Otherwise, use the smallest buffer that
+    // fits the next read.
+    int64_t buffer_size = 0;
+    if (!map_range) {
+      buffer_size = min(static_cast<int64_t>(max_read_size_), 
+          range->len_ - range->bytes_read_);
+      buffer = GetFreeBuffer(&buffer_size, reader->mem_tracker_);
+    }
+    BufferDescriptor* buffer_desc = GetBufferDesc(reader, range, buffer, buffer_size);
     DCHECK(buffer_desc != NULL);
 
     // No locks in this section.  Only working on local vars.  We don't want to hold a 
     // lock across the read call.
     buffer_desc->status_ = OpenScanRange(reader->hdfs_connection_, range);
-    if (buffer_desc->status_.ok()) {
+    if (buffer_desc->status_.ok() && map_range) {
+      SCOPED_TIMER(&read_timer_);
+      SCOPED_TIMER(reader->read_timer_);
+
+      buffer_desc->status_ = MapScanRange(range, buffer_desc);
+      buffer_desc->scan_range_offset_ = range->bytes_read_ - buffer_desc->len_;
+
+      if (reader->bytes_read_counter_ != NULL) {
+        COUNTER_UPDATE(reader->bytes_read_counter_, buffer_desc->len_);
+      }
+      COUNTER_UPDATE(&total_bytes_read_counter_, buffer_desc->len_);
+    } else if (buffer_desc->status_.ok() && async_read) {
+      {
+        SCOPED_TIMER(&read_timer_);
+        SCOPED_TIMER(reader->read_timer_);
+        buffer_desc->status_ = SubmitAsyncRead(disk_queue, buffer_desc);
+      }
+      // The completion thread owns the buffer from here on.
+      if (buffer_desc->status_.ok()) continue;
+    } else if (buffer_desc->status_.ok()) {
       // Update counters.
       SCOPED_TIMER(&read_timer_);
       SCOPED_TIMER(reader->read_timer_);
@@ -1157,6 +1395,7 @@ void DiskIoMgr::ReadLoop(DiskQueue* disk_queue) {
       }
       COUNTER_UPDATE(&total_bytes_read_counter_, buffer_desc->len_);
     }
+    if (use_aio_) ReleaseAioSlot(disk_queue);
 
     // Finished read, update reader/disk based on the results
     HandleReadFinished(disk_queue, reader, buffer_desc);
@@ -1164,3 +1403,155 @@ void DiskIoMgr::ReadLoop(DiskQueue* disk_queue) {
 
   DCHECK(shut_down_);
 }
+
+Status DiskIoMgr::MapScanRange(ScanRange* range, BufferDescriptor* buffer_desc) {
+  static const int64_t page_size = sysconf(_SC_PAGESIZE);
+  DCHECK_NE(range->local_fd_, -1);
+  DCHECK(buffer_desc->buffer_ == NULL);
+
+  struct stat file_stat;
+  if (fstat(range->local_fd_, &file_stat) == -1) {
+    stringstream ss;
+    ss << "Could not stat file: " << range->file_ << ": " << strerror(errno);
+    return Status(ss.str());
+  }
+
+  int64_t file_offset = range->offset_ + range->bytes_read_;
+  int64_t bytes_to_read = min(static_cast<int64_t>(max_read_size_), 
+      range->len_ - range->bytes_read_);
+  // Touching mapped bytes past the end of the file faults.  Stop at the end of the
+  // file; like a short read, that ends the scan range.
+  int64_t bytes_in_file = max(static_cast<int64_t>(0), file_stat.st_size - file_offset);
+  int64_t bytes_to_map = min(bytes_to_read, bytes_in_file);
+
+  // Mappings must start on a page boundary.  An empty mapping is not allowed; map a
+  // page for empty reads so the buffer is still valid.
+  int64_t map_offset = file_offset & ~(page_size - 1);
+  int64_t map_len = max(file_offset - map_offset + bytes_to_map, static_cast<int64_t>(1));
+  // The mapping is private and writable because scanners may modify the buffer
+  // in place.  Writes are copy on write and never reach the file.
+  void* addr = mmap(NULL, map_len, PROT_READ | PROT_WRITE, MAP_PRIVATE, 
+      range->local_fd_, map_offset);
+  if (addr == MAP_FAILED) {
+    stringstream ss;
+    ss << "Could not map " << bytes_to_map << " bytes at byte offset " << file_offset
+       << " of file: " << range->file_ << ": " << strerror(errno);
+    return Status(ss.str());
+  }
+  // The buffer is consumed sequentially; start reading it in right away.
+  madvise(addr, map_len, MADV_SEQUENTIAL);
+  madvise(addr, map_len, MADV_WILLNEED);
+
+  buffer_desc->buffer_ = reinterpret_cast<char*>(addr);
+  buffer_desc->buffer_offset_ = file_offset - map_offset;
+  buffer_desc->mapped_len_ = map_len;
+  buffer_desc->len_ = bytes_to_map;
+
+  range->bytes_read_ += bytes_to_map;
+  DCHECK_LE(range->bytes_read_, range->len_);
+  buffer_desc->eosr_ = range->bytes_read_ == range->len_ || bytes_to_map < bytes_to_read;
+  if (!buffer_desc->eosr_) {
+    // Read ahead the next chunk of the range while this one is being processed.
+    int64_t next_len = min(static_cast<int64_t>(max_read_size_), 
+        range->len_ - range->bytes_read_);
+    posix_fadvise(range->local_fd_, file_offset + bytes_to_map, next_len, 
+        POSIX_FADV_WILLNEED);
+  }
+  return Status::OK;
+}
+
+bool DiskIoMgr::ReserveAioSlot(DiskQueue* disk_queue) {
+  unique_lock<mutex> disk_lock(disk_queue->lock);
+  while (!shut_down_ && disk_queue->num_aio_slots_used >= aio_queue_depth_) {
+    disk_queue->aio_slot_available.wait(disk_lock);
+  }
+  if (shut_down_) return false;
+  ++disk_queue->num_aio_slots_used;
+  return true;
+}
+
+void DiskIoMgr::ReleaseAioSlot(DiskQueue* disk_queue) {
+  {
+    unique_lock<mutex> disk_lock(disk_queue->lock);
+    DCHECK_GT(disk_queue->num_aio_slots_used, 0);
+    --disk_queue->num_aio_slots_used;
+  }
+  disk_queue->aio_slot_available.notify_one();
+}
+
+Status DiskIoMgr::SubmitAsyncRead(DiskQueue* disk_queue, BufferDescriptor* buffer_desc) {
+  ScanRange* range = buffer_desc->scan_range_;
+  DCHECK_NE(range->local_fd_, -1);
+  int64_t bytes_to_read = min(static_cast<int64_t>(max_read_size_), 
+      range->len_ - range->bytes_read_);
+  int64_t file_offset = range->offset_ + range->bytes_read_;
+  int64_t read_offset = file_offset;
+  int64_t read_len = bytes_to_read;
+  if (range->direct_io_) {
+    // Widen the read to aligned boundaries.  The buffer is padded for this.
+    read_offset = file_offset & ~static_cast<int64_t>(DIRECT_IO_ALIGNMENT - 1);
+    int64_t read_end = file_offset + bytes_to_read;
+    read_end = (read_end + DIRECT_IO_ALIGNMENT - 1) & 
+        ~static_cast<int64_t>(DIRECT_IO_ALIGNMENT - 1);
+    read_len = read_end - read_offset;
+  }
+  buffer_desc->buffer_offset_ = file_offset - read_offset;
+  return disk_queue->aio_context->SubmitRead(range->local_fd_, buffer_desc->buffer_,
+      read_len, read_offset, buffer_desc);
+}
+
+void DiskIoMgr::AsyncReadFinished(DiskQueue* disk_queue, BufferDescriptor* buffer_desc,
+    int64_t result) {
+  ReaderContext* reader = buffer_desc->reader_;
+  ScanRange* range = buffer_desc->scan_range_;
+  // Only one read per scan range is in flight so the range has not moved since the
+  // read was submitted.
+  int64_t bytes_to_read = min(static_cast<int64_t>(max_read_size_), 
+      range->len_ - range->bytes_read_);
+
+  if (result < 0) {
+    stringstream ss;
+    ss << "Could not read from " << range->file_ << " at byte offset: " 
+       << range->offset_ + range->bytes_read_ << ": " << strerror(-result);
+    buffer_desc->status_ = Status(ss.str());
+  } else {
+    // Direct io reads can start before and end after the requested bytes.  A short
+    // read means the scan range goes past the end of the file.
+    int64_t bytes_read = 
+        max(static_cast<int64_t>(0), result - buffer_desc->buffer_offset_);
+    buffer_desc->len_ = min(bytes_read, bytes_to_read);
+    range->bytes_read_ += buffer_desc->len_;
+    DCHECK_LE(range->bytes_read_, range->len_);
+    buffer_desc->scan_range_offset_ = range->bytes_read_ - buffer_desc->len_;
+    buffer_desc->eosr_ = 
+        range->bytes_read_ == range->len_ || buffer_desc->len_ < bytes_to_read;
+
+    if (reader->bytes_read_counter_ != NULL) {
+      COUNTER_UPDATE(reader->bytes_read_counter_, buffer_desc->len_);
+    }
+    COUNTER_UPDATE(&total_bytes_read_counter_, buffer_desc->len_);
+  }
+
+  ReleaseAioSlot(disk_queue);
+  HandleReadFinished(disk_queue, reader, buffer_desc);
+}
+
+// Readers are only unregistered after all their reads are finished so there are no
+// reads in flight once shut_down_ is set.
+void DiskIoMgr::AioCompletionLoop(DiskQueue* disk_queue) {
+  vector<AioContext::Completion> completions;
+  while (!shut_down_) {
+    completions.clear();
+    Status status = 
+        disk_queue->aio_context->GetCompletions(AIO_POLL_TIMEOUT_MS, &completions);
+    if (!status.ok()) {
+      LOG(ERROR) << status.GetErrorMsg();
+      continue;
+    }
+    for (int i = 0; i < completions.size(); ++i) {
+      AsyncReadFinished(disk_queue, 
+          reinterpret_cast<BufferDescriptor*>(completions[i].cookie),
+          completions[i].result);
+    }
+  }
+}
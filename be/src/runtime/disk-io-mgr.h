@@ -18,6 +18,8 @@
 
 namespace impala {
 
+class MemTracker;
+
 // Manager object that schedules IO for all queries on all disks.  Each query maps
 // to one or more readers, each of which has its own queue of scan ranges.  The
 // API splits up requesting scan ranges (non-blocking) and reading the data (blocking).
@@ -50,6 +52,22 @@ namespace impala {
 // TODO: IoMgr should be able to request additional scan ranges from the coordinator
 // to help deal with stragglers.
 // TODO: look into reducing the number of locks taken in the disk thread loop
+//
+// Local file reads can be done by one of two io engines, selected at startup with
+// --disk_io_engine:
+//  - sync: the disk threads issue blocking reads.  The number of outstanding reads per
+//    disk is the number of disk threads.
+//  - aio: the disk threads submit reads with the kernel's native async io interface
+//    and go on to schedule the next range.  A completion thread per disk reaps the
+//    finished reads and hands them to the readers.  This keeps up to
+//    --aio_queue_depth reads outstanding per disk with only a couple of threads.
+//    Files are opened with O_DIRECT (--aio_direct_io) so the reads bypass the os
+//    buffer cache and are truly asynchronous.
+// Hdfs reads are always done synchronously from the disk threads.
+// With --mmap_local_reads, local files are instead mapped into memory one buffer's
+// worth at a time and the buffers point directly into the mapped region, avoiding
+// the copy out of the os buffer cache.  The region is unmapped when the buffer is
+// returned.
 class DiskIoMgr {
  public:
   struct ReaderContext;
@@ -107,6 +125,13 @@ class DiskIoMgr {
       hdfsFile hdfs_file_;
     };
 
+    // File descriptor used by the aio engine and mapped reads for local files.
+    // -1 if not open.
+    int local_fd_;
+
+    // True if local_fd_ was opened with O_DIRECT.  Reads must then be aligned.
+    bool direct_io_;
+
     // Number of bytes read so far for this scan range
     int bytes_read_;
   };
@@ -117,7 +142,7 @@ class DiskIoMgr {
   class BufferDescriptor {
    public:
     ScanRange* scan_range() { return scan_range_; }
-    char* buffer() { return buffer_; }
+    char* buffer() { return buffer_ + buffer_offset_; }
     int64_t len() { return len_; }
     bool eosr() { return eosr_; }
 
@@ -133,7 +158,8 @@ class DiskIoMgr {
     BufferDescriptor(DiskIoMgr* io_mgr);
 
     // Resets the buffer descriptor state for a new reader, range and data buffer.
-    void Reset(ReaderContext* reader, ScanRange* range, char* buffer);
+    // 'buffer_len' is the size of the io buffer, 0 if there is none.
+    void Reset(ReaderContext* reader, ScanRange* range, char* buffer, int64_t buffer_len);
 
     DiskIoMgr* io_mgr_;
 
@@ -145,6 +171,19 @@ class DiskIoMgr {
     
     // buffer with the read contents
     char* buffer_;
+
+    // Size of buffer_ if it is an io buffer from the disk io mgr's pool, 0 otherwise.
+    int64_t buffer_len_;
+
+    // Offset in buffer_ where the contents for the scan range start.  This is
+    // non-zero for direct io reads that had to start at an aligned file offset
+    // before the requested one and for mapped reads, which start on a page boundary.
+    int buffer_offset_;
+
+    // Length of the mapping starting at buffer_ if this buffer is mapped from a local
+    // file, 0 otherwise.  Mapped buffers are unmapped instead of going back to the
+    // free list.
+    int64_t mapped_len_;
     
     // len of read contents
     int64_t len_;
@@ -185,7 +224,10 @@ class DiskIoMgr {
   //    scan ranges are on the local file system
   // io_buffers_per_disk: The maximum number of io buffers for this reader per disk.
   //    Reads will not happen if there are no available io buffers.
-  Status RegisterReader(hdfsFS hdfs, int io_buffers_per_disk, ReaderContext** reader);
+  // mem_tracker: if non-NULL, io buffers are charged to it while they are in use by
+  //    this reader.
+  Status RegisterReader(hdfsFS hdfs, int io_buffers_per_disk, ReaderContext** reader,
+      MemTracker* mem_tracker = NULL);
 
   // Unregisters reader from the disk io mgr.  This must be called for every 
   // RegisterReader() regardless of cancellation and must be called in the
@@ -251,6 +293,14 @@ class DiskIoMgr {
   // Returns the number of allocated buffers.
   int num_allocated_buffers() const { return num_allocated_buffers_; }
 
+  // Returns the total bytes of the io buffers that are not in use.
+  int64_t free_buffer_bytes() const { return free_buffer_bytes_; }
+
+  // Frees all io buffers that are not in use.  This is called automatically when a
+  // buffer is needed for a reader that is over its memory limit and can be called
+  // to release memory under memory pressure.
+  void GcIoBuffers();
+
   // Dumps the disk io mgr queues (for readers and disks)
   std::string DebugString();
 
@@ -268,8 +318,19 @@ class DiskIoMgr {
   // Pool to allocate BufferDescriptors
   ObjectPool pool_;
 
-  // Number of worker(read) threads per disk.  Also the max depth of queued
-  // work to the disk.
+  // If true, local file reads go through the aio engine.  Set from
+  // --disk_io_engine in Init().
+  bool use_aio_;
+
+  // Maximum number of outstanding async reads per disk.
+  int aio_queue_depth_;
+
+  // If true, local file reads are done by mapping the file.  Set from
+  // --mmap_local_reads in Init().
+  bool mmap_reads_;
+
+  // Number of worker(read) threads per disk.  With the sync engine, this is also the
+  // max depth of queued work to the disk.
   int num_threads_per_disk_;
 
   // Maximum read size.  This is also the size of each allocated buffer.
@@ -294,16 +355,28 @@ class DiskIoMgr {
   // contention.
   boost::scoped_ptr<ReaderCache> reader_cache_;
 
-  // Protects free_buffers_ and free_buffer_descs_
+  // Io buffers come in size classes so short reads (e.g. small files and the ends of
+  // scan ranges) don't tie up a max_read_size_ buffer.  Size class i holds buffers of
+  // min_buffer_size_ * 2^i bytes, except that the last class is max_read_size_.
+  int min_buffer_size_;
+
+  // Protects free_buffers_, free_buffer_bytes_ and num_allocated_buffers_
   boost::mutex free_buffers_lock_;
   
-  // List of free buffer descs that can be handed out to clients.
-  std::list<char*> free_buffers_;
+  // Free io buffers that can be handed out to readers, indexed by size class.
+  std::vector<std::list<char*> > free_buffers_;
+
+  // Total bytes of the buffers in free_buffers_.  Returned buffers that would take
+  // this over --max_free_io_buffer_bytes are freed instead of cached.
+  int64_t free_buffer_bytes_;
+
+  // Protects free_buffer_descs_
+  boost::mutex free_buffer_descs_lock_;
 
   // List of free buffer desc objects that can be handed out to clients
   std::list<BufferDescriptor*> free_buffer_descs_;
 
-  // Total number of allocated buffers, used for debugging.
+  // Total number of allocated io buffers (in use or free).
   int num_allocated_buffers_;
 
   // Per disk queues.  This is static and created once at Init() time.
@@ -312,8 +385,10 @@ class DiskIoMgr {
   std::vector<DiskQueue*> disk_queues_;
 
   // Gets a buffer description object, initialized for this reader, allocating
-  // one as necessary
-  BufferDescriptor* GetBufferDesc(ReaderContext* reader, ScanRange* range, char* buffer);
+  // one as necessary.  'buffer_len' is the size of 'buffer', which is charged to
+  // the reader's mem tracker.
+  BufferDescriptor* GetBufferDesc(ReaderContext* reader, ScanRange* range, char* buffer,
+      int64_t buffer_len);
 
   // Returns a buffer desc object which can now be used for another reader.
   void ReturnBufferDesc(BufferDescriptor* desc);
@@ -322,13 +397,27 @@ class DiskIoMgr {
   // the reader and disk queue state.
   void ReturnBuffer(BufferDescriptor* buffer);
 
-  // Returns a buffer to read into that is the size of max_read_size_.  If there is a
-  // free buffer in the 'free_buffers_', that is returned, otherwise a new one is 
-  // allocated.
-  char* GetFreeBuffer();
+  // Returns the size of buffers in 'size_class'.
+  int64_t BufferSize(int size_class) const;
+
+  // Returns the smallest size class with buffers of at least 'bytes'.
+  int SizeClass(int64_t bytes) const;
+
+  // Returns a buffer to read into with at least *buffer_size bytes (which must be at
+  // most max_read_size_) and sets *buffer_size to its actual size.  If there is a
+  // free buffer of that size class in 'free_buffers_', that is returned, otherwise
+  // a new one is allocated.  If a new buffer is needed and 'mem_tracker' is over its
+  // limit, the free buffers are released first.  Buffers are aligned and padded so
+  // they can be used for direct io.
+  char* GetFreeBuffer(int64_t* buffer_size, MemTracker* mem_tracker);
+
+  // Returns a buffer of 'buffer_size' to the free list, or frees it if the free list
+  // is full.
+  void ReturnFreeBuffer(char* buffer, int64_t buffer_size);
 
-  // Returns a buffer to the free list.
-  void ReturnFreeBuffer(char*);
+  // Returns the buffer of 'desc' to the free list and releases it from the reader's
+  // mem tracker.  Mapped buffers are unmapped instead.
+  void ReturnFreeBuffer(BufferDescriptor* desc);
 
   // Removes the reader from the queue.  Both the disk and reader locks should be
   // taken before.
@@ -364,16 +453,41 @@ class DiskIoMgr {
 
   // This is called from the disk thread to get the next scan to process.  It will
   // wait until a scan range is available and a buffer is available to do the work.
-  // This functions returns the scan range, the reader and buffer to read into.
+  // This functions returns the scan range and the reader.  One of the reader's
+  // buffers for this disk is reserved for the read; the caller allocates it.
   // This function cycles through readers and scan ranges in the reader.
   // Only returns false if the disk thread should be shut down.
   // No locks should be taken before this function call and none are left taken after.
-  bool GetNextScanRange(DiskQueue*, ScanRange** range, 
-      ReaderContext** reader, char** buffer);
+  bool GetNextScanRange(DiskQueue*, ScanRange** range, ReaderContext** reader);
+
+  // Maps the next chunk (up to max_read_size_) of the local 'range' into memory and
+  // points 'buffer_desc' at it.  Updates range to keep track of where in the file we
+  // are.  The scan range must already be open.
+  Status MapScanRange(ScanRange* range, BufferDescriptor* buffer_desc);
 
   // Updates disk queue and reader state after a read is complete.  The read result
   // is captured in the buffer descriptor.
   void HandleReadFinished(DiskQueue*, ReaderContext*, BufferDescriptor*);
+
+  // Blocks until the disk has room for another async read and reserves it.  Returns
+  // false if the io mgr is shutting down.
+  bool ReserveAioSlot(DiskQueue*);
+
+  // Releases an async read slot reserved by ReserveAioSlot().
+  void ReleaseAioSlot(DiskQueue*);
+
+  // Submits the next read for the buffer's scan range to the disk's aio context.  The
+  // scan range must already be open.  If this returns OK, the read is finished by
+  // AioCompletionLoop().
+  Status SubmitAsyncRead(DiskQueue*, BufferDescriptor*);
+
+  // Completion thread loop for the aio engine.  There is one per disk.  It reaps
+  // finished async reads and passes them to HandleReadFinished().
+  void AioCompletionLoop(DiskQueue*);
+
+  // Updates the buffer and scan range with the result of an async read and
+  // releases its slot.  'result' is the number of bytes read or -errno.
+  void AsyncReadFinished(DiskQueue*, BufferDescriptor*, int64_t result);
 };
 
 }
@@ -13,8 +13,11 @@
 #include "runtime/disk-io-mgr.h"
 #include "runtime/hbase-table-cache.h"
 #include "runtime/hdfs-fs-cache.h"
+#include "runtime/mem-tracker.h"
+#include "runtime/thread-pool.h"
 #include "sparrow/simple-scheduler.h"
 #include "sparrow/subscription-manager.h"
+#include "util/cpu-info.h"
 #include "util/metrics.h"
 #include "util/webserver.h"
 #include "util/default-path-handlers.h"
@@ -29,6 +32,12 @@ using sparrow::SubscriptionManager;
 DEFINE_bool(use_statestore, true,
     "Use an external state-store process to manage cluster membership");
 DEFINE_bool(enable_webserver, true, "If true, debug webserver is enabled");
+DEFINE_int64(mem_limit, -1,
+    "Maximum number of bytes all queries running in this process may use together; "
+    "queries fail once the limit is exceeded.  -1 means no limit.");
+DEFINE_int32(num_decompression_threads, 0,
+    "Number of threads shared by all scanners that decompress the blocks the scanners "
+    "read ahead (see --seq_decompress_blocks).  If 0, one thread per core is used.");
 DECLARE_int32(be_port);
 DECLARE_string(ipaddress);
 
@@ -43,6 +52,9 @@ ExecEnv::ExecEnv()
     disk_io_mgr_(new DiskIoMgr()),
     webserver_(new Webserver()),
     metrics_(new Metrics()),
+    mem_tracker_(new MemTracker(FLAGS_mem_limit, "Process")),
+    decompression_pool_(new ThreadPool(FLAGS_num_decompression_threads > 0 ?
+        FLAGS_num_decompression_threads : CpuInfo::num_cores())),
     enable_webserver_(FLAGS_enable_webserver),
     tz_database_(TimezoneDatabase()) {
   // Initialize the scheduler either dynamically (with a statestore) or statically (with
@@ -24,7 +24,9 @@ class DataStreamMgr;
 class DiskIoMgr;
 class HBaseTableCache;
 class HdfsFsCache;
+class MemTracker;
 class TestExecEnv;
+class ThreadPool;
 class Webserver;
 class Metrics;
 
@@ -49,6 +51,14 @@ class ExecEnv {
   Webserver* webserver() { return webserver_.get(); }
   Metrics* metrics() { return metrics_.get(); }
 
+  // Tracker for the memory consumption of all queries in this process; the parent
+  // of all query trackers.  Limited by --mem_limit.
+  MemTracker* mem_tracker() { return mem_tracker_.get(); }
+
+  // Threads that decompress the blocks that scanners read ahead, shared by all
+  // queries.  Sized by --num_decompression_threads.
+  ThreadPool* decompression_pool() { return decompression_pool_.get(); }
+
   void set_enable_webserver(bool enable) { enable_webserver_ = enable; }
 
   sparrow::Scheduler* scheduler() {
@@ -70,6 +80,8 @@ class ExecEnv {
   boost::scoped_ptr<DiskIoMgr> disk_io_mgr_;
   boost::scoped_ptr<Webserver> webserver_;
   boost::scoped_ptr<Metrics> metrics_;
+  boost::scoped_ptr<MemTracker> mem_tracker_;
+  boost::scoped_ptr<ThreadPool> decompression_pool_;
 
   bool enable_webserver_;
 
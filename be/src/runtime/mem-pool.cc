@@ -5,6 +5,8 @@
 #include <stdio.h>
 #include <sstream>
 
+#include "runtime/mem-tracker.h"
+
 using namespace std;
 using namespace impala;
 
@@ -13,51 +15,65 @@ const int MemPool::MAX_CHUNK_SIZE;
 
 const char* MemPool::LLVM_CLASS_NAME = "class.impala::MemPool";
 
-MemPool::MemPool()
+MemPool::MemPool(MemTracker* mem_tracker)
   : current_chunk_idx_(-1),
     last_offset_conversion_chunk_idx_(-1),
     chunk_size_(0),
     total_allocated_bytes_(0),
-    peak_allocated_bytes_(0) {
+    peak_allocated_bytes_(0),
+    mem_tracker_(mem_tracker) {
 }
 
-MemPool::MemPool(int chunk_size)
+MemPool::MemPool(int chunk_size, MemTracker* mem_tracker)
   : current_chunk_idx_(-1),
     last_offset_conversion_chunk_idx_(-1),
     // round up chunk size to nearest 8 bytes
     chunk_size_(((chunk_size + 7) / 8) * 8),
     total_allocated_bytes_(0),
-    peak_allocated_bytes_(0) {
+    peak_allocated_bytes_(0),
+    mem_tracker_(mem_tracker) {
   DCHECK_GT(chunk_size_, 0);
 }
 
-MemPool::MemPool(const vector<string>& chunks)
+MemPool::MemPool(vector<string>* chunks, MemTracker* mem_tracker)
   : current_chunk_idx_(-1),
     last_offset_conversion_chunk_idx_(-1),
     chunk_size_(0),
     total_allocated_bytes_(0),
-    peak_allocated_bytes_(0) {
-  if (chunks.empty()) return;
-  chunks_.reserve(chunks.size());
-  for (int i = 0; i < chunks.size(); ++i) {
+    peak_allocated_bytes_(0),
+    mem_tracker_(mem_tracker) {
+  chunks_.reserve(chunks->size());
+  for (int i = 0; i < chunks->size(); ++i) {
+    // chunks 0..current_chunk_idx_ must not be empty
+    if ((*chunks)[i].empty()) continue;
     chunks_.push_back(ChunkInfo());
     ChunkInfo& chunk = chunks_.back();
     chunk.owns_data = true;
-    chunk.data = new uint8_t[chunks[i].size()];
-    memcpy(chunk.data, chunks[i].data(), chunks[i].size());
-    chunk.size = chunks[i].size();
+    chunk.string_data = new string();
+    chunk.string_data->swap((*chunks)[i]);
+    chunk.data = reinterpret_cast<uint8_t*>(&(*chunk.string_data)[0]);
+    chunk.size = chunk.string_data->size();
     chunk.allocated_bytes = chunk.size;
     chunk.cumulative_allocated_bytes = total_allocated_bytes_;
     total_allocated_bytes_ += chunk.size;
   }
+  chunks->clear();
   current_chunk_idx_ = chunks_.size() - 1;
+  if (mem_tracker_ != NULL) mem_tracker_->Consume(total_allocated_bytes_);
 }
 
 MemPool::~MemPool() {
+  int64_t total_bytes_released = 0;
   for (size_t i = 0; i < chunks_.size(); ++i) {
     if (!chunks_[i].owns_data) continue;
-    delete [] chunks_[i].data;
+    total_bytes_released += chunks_[i].size;
+    if (chunks_[i].string_data != NULL) {
+      delete chunks_[i].string_data;
+    } else {
+      delete [] chunks_[i].data;
+    }
   }
+  if (mem_tracker_ != NULL) mem_tracker_->Release(total_bytes_released);
 }
 
 void MemPool::FindChunk(int min_size) {
@@ -93,6 +109,7 @@ void MemPool::FindChunk(int min_size) {
       }
     }
     chunk_size = ::max(min_size, chunk_size);
+    if (mem_tracker_ != NULL) mem_tracker_->Consume(chunk_size);
     // If there are no free chunks put it at the end, otherwise before the first free.
     if (first_free_idx == static_cast<int>(chunks_.size())) {
       chunks_.push_back(ChunkInfo(chunk_size));
@@ -128,6 +145,14 @@ void MemPool::AcquireData(MemPool* src, bool keep_current) {
   if (num_acquired_chunks <= 0) return;
 
   vector<ChunkInfo>::iterator end_chunk = src->chunks_.begin() + num_acquired_chunks;
+  if (mem_tracker_ != src->mem_tracker_) {
+    int64_t total_transferred_bytes = 0;
+    for (vector<ChunkInfo>::iterator i = src->chunks_.begin(); i != end_chunk; ++i) {
+      if (i->owns_data) total_transferred_bytes += i->size;
+    }
+    if (src->mem_tracker_ != NULL) src->mem_tracker_->Release(total_transferred_bytes);
+    if (mem_tracker_ != NULL) mem_tracker_->Consume(total_transferred_bytes);
+  }
   // insert new chunks after current_chunk_idx_
   vector<ChunkInfo>::iterator insert_chunk = chunks_.begin() + current_chunk_idx_ + 1;
   chunks_.insert(insert_chunk, src->chunks_.begin(), end_chunk);
@@ -12,6 +12,8 @@
 
 namespace impala {
 
+class MemTracker;
+
 // A MemPool maintains a list of memory chunks from which it allocates memory in
 // response to Allocate() calls;
 // Chunks stay around for the lifetime of the mempool or until they are passed on to
@@ -51,20 +53,24 @@ namespace impala {
 // remains unchanged. 
 // The one remaining (empty) chunk is released:
 //    delete p;
+//
+// If a MemTracker is passed in, the sizes of the chunks owned by the pool are charged
+// to it.  Chunks that are passed on to another mempool are charged to that pool's
+// tracker instead.
 
 class MemPool {
  public:
-  MemPool();
+  MemPool(MemTracker* mem_tracker = NULL);
 
   // Allocates mempool with fixed-size chunks of size 'chunk_size'.
   // Chunk_size must be > 0.
-  MemPool(int chunk_size);
+  MemPool(int chunk_size, MemTracker* mem_tracker = NULL);
 
-  // Construct a mempool by initializing the chunk data with a copy of the data
-  // backing the strings (each chunk's allocated_bytes == size).
+  // Construct a mempool whose chunks are the data backing the strings (each chunk's
+  // allocated_bytes == size).  The pool takes over the strings without copying their
+  // data; 'chunks' is empty after the call.
   // Allocate() must never be called on this pool.
-  // TODO: fix this so we don't need to make a copy
-  MemPool(const std::vector<std::string>& chunks);
+  MemPool(std::vector<std::string>* chunks, MemTracker* mem_tracker = NULL);
 
   // Frees all chunks of memory.
   ~MemPool();
@@ -155,6 +161,8 @@ class MemPool {
   struct ChunkInfo {
     bool owns_data;  // true if we eventually need to dealloc data
     uint8_t* data;
+    // if non-NULL, data is backed by this string, which is deleted instead of data
+    std::string* string_data;
     int size;  // in bytes
 
     // number of bytes allocated via Allocate() up to but excluding this chunk;
@@ -168,6 +176,7 @@ class MemPool {
     explicit ChunkInfo(int size)
       : owns_data(true),
         data(new uint8_t[size]),
+        string_data(NULL),
         size(size),
         cumulative_allocated_bytes(0),
         allocated_bytes(0) {}
@@ -175,6 +184,7 @@ class MemPool {
     ChunkInfo()
       : owns_data(true),
         data(NULL),
+        string_data(NULL),
         size(0),
         cumulative_allocated_bytes(0),
         allocated_bytes(0) {}
@@ -201,6 +211,9 @@ class MemPool {
 
   std::vector<ChunkInfo> chunks_;
 
+  // Tracker that the chunk sizes are charged to; may be NULL.
+  MemTracker* mem_tracker_;
+
   // Find or allocated a chunk with at least min_size spare capacity and update
   // current_chunk_idx_. Also updates chunks_, chunk_sizes_ and allocated_bytes_
   // if a new chunk needs to be created.
@@ -0,0 +1,153 @@
+// Copyright (c) 2012 Cloudera, Inc. All rights reserved.
+
+#include <string>
+#include <boost/shared_ptr.hpp>
+#include <gtest/gtest.h>
+
+#include "runtime/mem-pool.h"
+#include "runtime/mem-tracker.h"
+
+using namespace boost;
+using namespace std;
+
+namespace impala {
+
+TEST(MemTrackerTest, SingleTracker) {
+  MemTracker t(-1, "t");
+  EXPECT_FALSE(t.has_limit());
+  t.Consume(10);
+  EXPECT_EQ(t.consumption(), 10);
+  t.Consume(-5);
+  EXPECT_EQ(t.consumption(), 5);
+  t.Release(5);
+  EXPECT_EQ(t.consumption(), 0);
+  EXPECT_EQ(t.peak_consumption(), 10);
+  EXPECT_FALSE(t.AnyLimitExceeded());
+}
+
+TEST(MemTrackerTest, Limit) {
+  MemTracker t(10, "t");
+  EXPECT_TRUE(t.has_limit());
+  t.Consume(10);
+  EXPECT_FALSE(t.LimitExceeded());
+  t.Consume(1);
+  EXPECT_TRUE(t.LimitExceeded());
+  EXPECT_TRUE(t.AnyLimitExceeded());
+  t.Release(1);
+  EXPECT_FALSE(t.AnyLimitExceeded());
+  t.Release(10);
+}
+
+TEST(MemTrackerTest, TrackerHierarchy) {
+  MemTracker p(100, "parent");
+  MemTracker c1(80, "c1", &p);
+  MemTracker c2(50, "c2", &p);
+
+  // everything below limits
+  c1.Consume(60);
+  EXPECT_EQ(c1.consumption(), 60);
+  EXPECT_FALSE(c1.AnyLimitExceeded());
+  EXPECT_EQ(c2.consumption(), 0);
+  EXPECT_EQ(p.consumption(), 60);
+  EXPECT_FALSE(p.AnyLimitExceeded());
+
+  // p goes over limit, which is visible to both children
+  c2.Consume(50);
+  EXPECT_EQ(c2.consumption(), 50);
+  EXPECT_FALSE(c2.LimitExceeded());
+  EXPECT_TRUE(c2.AnyLimitExceeded());
+  EXPECT_TRUE(c1.AnyLimitExceeded());
+  EXPECT_EQ(p.consumption(), 110);
+  EXPECT_TRUE(p.LimitExceeded());
+
+  // c2 goes under limit, c1 over
+  c1.Consume(30);
+  c2.Release(40);
+  EXPECT_EQ(c1.consumption(), 90);
+  EXPECT_TRUE(c1.LimitExceeded());
+  EXPECT_EQ(p.consumption(), 100);
+  EXPECT_FALSE(p.LimitExceeded());
+  EXPECT_FALSE(c2.AnyLimitExceeded());
+
+  c1.Release(90);
+  c2.Release(10);
+  EXPECT_EQ(p.consumption(), 0);
+  EXPECT_EQ(p.peak_consumption(), 110);
+}
+
+TEST(MemTrackerTest, DestroyChild) {
+  MemTracker p(-1, "parent");
+  {
+    MemTracker c(-1, "child", &p);
+    c.Consume(20);
+    EXPECT_EQ(p.consumption(), 20);
+    c.Release(20);
+  }
+  EXPECT_EQ(p.consumption(), 0);
+}
+
+TEST(MemTrackerTest, QueryMemTracker) {
+  MemTracker process(-1, "process");
+  TUniqueId query_id;
+  query_id.hi = 1;
+  query_id.lo = 2;
+  shared_ptr<MemTracker> q1 = MemTracker::GetQueryMemTracker(query_id, 100, &process);
+  shared_ptr<MemTracker> q2 = MemTracker::GetQueryMemTracker(query_id, 100, &process);
+  EXPECT_EQ(q1.get(), q2.get());
+  EXPECT_EQ(q1->limit(), 100);
+  EXPECT_EQ(q1->parent(), &process);
+
+  TUniqueId other_id;
+  other_id.hi = 1;
+  other_id.lo = 3;
+  shared_ptr<MemTracker> q3 = MemTracker::GetQueryMemTracker(other_id, -1, &process);
+  EXPECT_NE(q1.get(), q3.get());
+
+  q1->Consume(10);
+  q3->Consume(5);
+  EXPECT_EQ(process.consumption(), 15);
+  q1->Release(10);
+  q1.reset();
+  q2.reset();
+  EXPECT_EQ(process.consumption(), 5);
+
+  // Once all references are gone, a new tracker is created.
+  shared_ptr<MemTracker> q4 = MemTracker::GetQueryMemTracker(query_id, 50, &process);
+  EXPECT_EQ(q4->limit(), 50);
+  EXPECT_EQ(q4->consumption(), 0);
+  q3->Release(5);
+  q3.reset();
+  q4.reset();
+  EXPECT_EQ(process.consumption(), 0);
+}
+
+TEST(MemTrackerTest, MemPool) {
+  MemTracker t1(-1, "t1");
+  MemTracker t2(-1, "t2");
+  {
+    MemPool p1(&t1);
+    // the first chunk is 4K
+    p1.Allocate(25);
+    EXPECT_EQ(t1.consumption(), 4 * 1024);
+    // the second chunk is 8K
+    p1.Allocate(4 * 1024);
+    EXPECT_EQ(t1.consumption(), 12 * 1024);
+
+    MemPool p2(&t2);
+    // the chunks move to p2, and so does the consumption
+    p2.AcquireData(&p1, false);
+    EXPECT_EQ(t1.consumption(), 0);
+    EXPECT_EQ(t2.consumption(), 12 * 1024);
+  }
+  EXPECT_EQ(t1.consumption(), 0);
+  EXPECT_EQ(t2.consumption(), 0);
+  EXPECT_EQ(t1.peak_consumption(), 12 * 1024);
+}
+
+}
+
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
+
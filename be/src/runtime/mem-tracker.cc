@@ -0,0 +1,113 @@
+// Copyright (c) 2012 Cloudera, Inc. All rights reserved.
+
+#include "runtime/mem-tracker.h"
+
+#include <sstream>
+#include <boost/bind.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/unordered_map.hpp>
+#include <boost/weak_ptr.hpp>
+
+#include "common/logging.h"
+#include "util/debug-util.h"
+#include "util/uid-util.h"
+
+using namespace boost;
+using namespace std;
+
+namespace impala {
+
+// Query trackers by query id.  Entries are removed when the last reference to the
+// tracker is dropped.
+typedef unordered_map<TUniqueId, weak_ptr<MemTracker> > QueryMemTrackerMap;
+static QueryMemTrackerMap query_mem_trackers;
+static mutex query_mem_trackers_lock;
+
+MemTracker::MemTracker(int64_t byte_limit, const string& label, MemTracker* parent)
+  : limit_(byte_limit),
+    label_(label),
+    parent_(parent),
+    consumption_(0),
+    peak_consumption_(0),
+    consumption_counter_(NULL),
+    peak_consumption_counter_(NULL) {
+  Init();
+}
+
+MemTracker::MemTracker(RuntimeProfile* profile, int64_t byte_limit,
+    const string& label, MemTracker* parent)
+  : limit_(byte_limit),
+    label_(label),
+    parent_(parent),
+    consumption_(0),
+    peak_consumption_(0) {
+  consumption_counter_ = ADD_COUNTER(profile, "MemoryUsage", TCounterType::BYTES);
+  peak_consumption_counter_ =
+      ADD_COUNTER(profile, "PeakMemoryUsage", TCounterType::BYTES);
+  Init();
+}
+
+void MemTracker::Init() {
+  for (MemTracker* tracker = this; tracker != NULL; tracker = tracker->parent_) {
+    all_trackers_.push_back(tracker);
+    if (tracker->has_limit()) limit_trackers_.push_back(tracker);
+  }
+}
+
+MemTracker::~MemTracker() {
+  // Owners must release everything they consumed before destroying the tracker.
+  DCHECK_EQ(consumption_, 0) << "MemTracker " << label_ << " leaked memory";
+  // In release builds, give the leaked bytes back to the parents so they don't
+  // stay charged to them forever.
+  if (parent_ != NULL && consumption_ != 0) {
+    LOG(WARNING) << "MemTracker " << label_ << " destroyed with " << consumption_
+                 << " bytes consumed";
+    parent_->Release(consumption_);
+  }
+}
+
+// Deleter for query trackers.  Only removes the map entry if it has not been replaced
+// by a new tracker for the same query in the meantime.
+static void DeleteQueryMemTracker(const TUniqueId& query_id, MemTracker* tracker) {
+  {
+    lock_guard<mutex> l(query_mem_trackers_lock);
+    QueryMemTrackerMap::iterator it = query_mem_trackers.find(query_id);
+    if (it != query_mem_trackers.end() && it->second.expired()) {
+      query_mem_trackers.erase(it);
+    }
+  }
+  delete tracker;
+}
+
+shared_ptr<MemTracker> MemTracker::GetQueryMemTracker(const TUniqueId& query_id,
+    int64_t byte_limit, MemTracker* parent) {
+  lock_guard<mutex> l(query_mem_trackers_lock);
+  QueryMemTrackerMap::iterator it = query_mem_trackers.find(query_id);
+  if (it != query_mem_trackers.end()) {
+    shared_ptr<MemTracker> tracker = it->second.lock();
+    if (tracker.get() != NULL) return tracker;
+  }
+  stringstream label;
+  label << "Query " << PrintId(query_id);
+  shared_ptr<MemTracker> tracker(new MemTracker(byte_limit, label.str(), parent),
+      bind(&DeleteQueryMemTracker, query_id, _1));
+  query_mem_trackers[query_id] = tracker;
+  return tracker;
+}
+
+string MemTracker::DebugString() const {
+  stringstream ss;
+  for (int i = 0; i < all_trackers_.size(); ++i) {
+    const MemTracker* tracker = all_trackers_[i];
+    if (i > 0) ss << ", ";
+    ss << (tracker->label_.empty() ? "<unnamed>" : tracker->label_)
+       << ": consumption=" << PrettyPrinter::Print(tracker->consumption_,
+           TCounterType::BYTES);
+    if (tracker->has_limit()) {
+      ss << " limit=" << PrettyPrinter::Print(tracker->limit_, TCounterType::BYTES);
+    }
+  }
+  return ss.str();
+}
+
+}
@@ -0,0 +1,118 @@
+// Copyright (c) 2012 Cloudera, Inc. All rights reserved.
+
+#ifndef IMPALA_RUNTIME_MEM_TRACKER_H
+#define IMPALA_RUNTIME_MEM_TRACKER_H
+
+#include <string>
+#include <vector>
+#include <boost/cstdint.hpp>
+#include <boost/shared_ptr.hpp>
+
+#include "util/runtime-profile.h"
+#include "gen-cpp/Types_types.h"  // for TUniqueId
+
+namespace impala {
+
+// A MemTracker tracks the memory consumption of one entity (the process, a query,
+// a plan fragment instance or an exec node) and optionally enforces a byte limit on it.
+// Trackers form a tree: consumption that is charged to a tracker is also charged to
+// all of its ancestors, so the tree is process -> query -> fragment instance -> node.
+// Allocators (MemPool, RowBatch, HashTable, DiskIoMgr) take a MemTracker* and call
+// Consume()/Release() as they allocate and free memory; NULL means untracked.
+// Consume() never fails.  Instead, limits are checked by the execution threads at
+// safe points (RuntimeState::CheckMemLimit()), so that a query that exceeds its limit
+// fails with an error rather than the allocation failing.
+// Thread-safe.
+class MemTracker {
+ public:
+  // byte_limit < 0 means no limit.  'parent' may be NULL and must outlive this tracker.
+  MemTracker(int64_t byte_limit = -1, const std::string& label = "",
+      MemTracker* parent = NULL);
+
+  // Same as above, but also reports the current and peak consumption in 'profile'
+  // ("MemoryUsage" and "PeakMemoryUsage").
+  MemTracker(RuntimeProfile* profile, int64_t byte_limit, const std::string& label,
+      MemTracker* parent);
+
+  // The owner must have released everything it consumed.  Leaked consumption is
+  // released from the ancestors in release builds.
+  ~MemTracker();
+
+  // Returns the tracker for 'query_id', creating it with 'byte_limit' and 'parent'
+  // if this is the first fragment instance of the query on this backend.  The tracker
+  // is shared by all fragment instances of the query and removed once the last
+  // reference to it goes away.
+  static boost::shared_ptr<MemTracker> GetQueryMemTracker(const TUniqueId& query_id,
+      int64_t byte_limit, MemTracker* parent);
+
+  // Increases consumption of this tracker and its ancestors by 'bytes'.
+  void Consume(int64_t bytes) {
+    if (bytes == 0) return;
+    for (int i = 0; i < all_trackers_.size(); ++i) {
+      all_trackers_[i]->UpdateConsumption(bytes);
+    }
+  }
+
+  // Decreases consumption of this tracker and its ancestors by 'bytes'.
+  void Release(int64_t bytes) { Consume(-bytes); }
+
+  // Returns true if this tracker or any of its ancestors is over its limit.
+  bool AnyLimitExceeded() const {
+    for (int i = 0; i < limit_trackers_.size(); ++i) {
+      if (limit_trackers_[i]->LimitExceeded()) return true;
+    }
+    return false;
+  }
+
+  bool LimitExceeded() const { return limit_ >= 0 && limit_ < consumption_; }
+
+  int64_t limit() const { return limit_; }
+  bool has_limit() const { return limit_ >= 0; }
+  int64_t consumption() const { return consumption_; }
+  int64_t peak_consumption() const { return peak_consumption_; }
+  const std::string& label() const { return label_; }
+  MemTracker* parent() const { return parent_; }
+
+  // Returns a description of the consumption and limits of this tracker and its
+  // ancestors, e.g. for the error message of a query that exceeded its limit.
+  std::string DebugString() const;
+
+ private:
+  void Init();
+
+  void UpdateConsumption(int64_t delta) {
+    int64_t new_consumption = __sync_add_and_fetch(&consumption_, delta);
+    int64_t peak = peak_consumption_;
+    while (new_consumption > peak) {
+      int64_t old_peak = __sync_val_compare_and_swap(
+          &peak_consumption_, peak, new_consumption);
+      if (old_peak == peak) break;
+      peak = old_peak;
+    }
+    if (consumption_counter_ != NULL) {
+      COUNTER_SET(consumption_counter_, new_consumption);
+      COUNTER_SET(peak_consumption_counter_, peak_consumption_);
+    }
+  }
+
+  int64_t limit_;
+  std::string label_;
+  MemTracker* parent_;
+
+  int64_t consumption_;
+  int64_t peak_consumption_;
+
+  // Counters in the profile this tracker reports to; NULL if none.
+  RuntimeProfile::Counter* consumption_counter_;
+  RuntimeProfile::Counter* peak_consumption_counter_;
+
+  // This tracker followed by all of its ancestors.
+  std::vector<MemTracker*> all_trackers_;
+
+  // The trackers in all_trackers_ that have a limit.
+  std::vector<MemTracker*> limit_trackers_;
+};
+
+}
+
+#endif
@@ -16,12 +16,14 @@
 #include "exec/data-sink.h"
 #include "exec/exec-node.h"
 #include "exec/exchange-node.h"
+#include "exec/hdfs-scan-node.h"
 #include "exec/scan-node.h"
 #include "exec/hbase-table-scanner.h"
 #include "exprs/expr.h"
 #include "runtime/descriptors.h"
 #include "runtime/data-stream-mgr.h"
 #include "runtime/row-batch.h"
+#include "runtime/runtime-filter.h"
 #include "util/cpu-info.h"
 #include "util/debug-util.h"
 #include "util/container-util.h"
@@ -74,6 +76,7 @@ Status PlanFragmentExecutor::Prepare(const TExecPlanFragmentParams& request) {
   runtime_state_.reset(
       new RuntimeState(params.fragment_instance_id, request.query_options,
           request.query_globals.now_string, exec_env_));
+  runtime_state_->InitMemTrackers(query_id_);
 
   // set up desc tbl
   DescriptorTbl* desc_tbl = NULL;
@@ -139,7 +142,10 @@ Status PlanFragmentExecutor::Prepare(const TExecPlanFragmentParams& request) {
   // set up profile counters
   rows_produced_counter_ = ADD_COUNTER(profile(), "RowsProduced", TCounterType::UNIT);
 
-  row_batch_.reset(new RowBatch(plan_->row_desc(), runtime_state_->batch_size()));
+  row_batch_.reset(new RowBatch(plan_->row_desc(), runtime_state_->batch_size(),
+      runtime_state_->instance_mem_tracker()));
+  // Batches returned by GetNext() must not have a selection.
+  row_batch_->set_selection_enabled(sink_.get() != NULL && sink_->AcceptsSelection());
   VLOG(3) << "plan_root=\n" << plan_->DebugString();
   prepared_ = true;
   return Status::OK;
@@ -213,9 +219,9 @@ Status PlanFragmentExecutor::OpenInternal() {
     RETURN_IF_ERROR(GetNextInternal(&batch));
     if (batch == NULL) break;
     if (VLOG_ROW_IS_ON) {
-      VLOG_ROW << "OpenInternal: #rows=" << batch->num_rows();
-      for (int i = 0; i < batch->num_rows(); ++i) {
-        TupleRow* row = batch->GetRow(i);
+      VLOG_ROW << "OpenInternal: #rows=" << batch->num_active_rows();
+      for (int i = 0; i < batch->num_active_rows(); ++i) {
+        TupleRow* row = batch->GetActiveRow(i);
         VLOG_ROW << PrintRow(row, row_desc());
       }
     }
@@ -338,8 +344,9 @@ Status PlanFragmentExecutor::GetNextInternal(RowBatch** batch) {
     row_batch_->Reset();
     SCOPED_TIMER(profile()->total_time_counter());
     RETURN_IF_ERROR(plan_->GetNext(runtime_state_.get(), row_batch_.get(), &done_));
-    if (row_batch_->num_rows() > 0) {
-      COUNTER_UPDATE(rows_produced_counter_, row_batch_->num_rows());
+    RETURN_IF_ERROR(runtime_state_->CheckMemLimit());
+    if (row_batch_->num_active_rows() > 0) {
+      COUNTER_UPDATE(rows_produced_counter_, row_batch_->num_active_rows());
       *batch = row_batch_.get();
       break;
     }
@@ -366,6 +373,29 @@ void PlanFragmentExecutor::Cancel() {
   runtime_state_->stream_mgr()->Cancel(runtime_state_->fragment_instance_id());
 }
 
+void PlanFragmentExecutor::PublishRuntimeFilter(const TRuntimeFilter& tfilter) {
+  DCHECK(prepared_);
+  const SlotDescriptor* slot = desc_tbl().GetSlotDescriptor(tfilter.target_slot_id);
+  if (slot == NULL) return;
+  // The coordinator only sends the filter if it doesn't pass a limit on its way from
+  // the join to this fragment, but the scans may still be below a limit in it.
+  vector<ExecNode*> scan_nodes;
+  plan_->CollectUnlimitedNodes(TPlanNodeType::HDFS_SCAN_NODE, &scan_nodes);
+  RuntimeFilter* filter = NULL;
+  for (int i = 0; i < scan_nodes.size(); ++i) {
+    HdfsScanNode* scan_node = static_cast<HdfsScanNode*>(scan_nodes[i]);
+    if (scan_node->tuple_id() != tfilter.target_tuple_id) continue;
+    if (filter == NULL) {
+      // the obj pool is thread-safe and outlives the scan nodes' scanners
+      filter = obj_pool()->Add(new RuntimeFilter(tfilter, slot));
+    }
+    VLOG_QUERY << "PublishRuntimeFilter(): instance_id="
+               << runtime_state_->fragment_instance_id()
+               << " src_node=" << tfilter.src_node_id << " scan_node=" << scan_node->id();
+    scan_node->AddRuntimeFilter(filter);
+  }
+}
+
 const RowDescriptor& PlanFragmentExecutor::row_desc() {
   return plan_->row_desc();
 }
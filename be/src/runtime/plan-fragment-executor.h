@@ -26,6 +26,7 @@ class TPlanExecRequest;
 class TPlanFragment;
 class TPlanFragmentExecParams;
 class TPlanExecParams;
+class TRuntimeFilter;
 
 // PlanFragmentExecutor handles all aspects of the execution of a single plan fragment,
 // including setup and tear-down, both in the success and error case.
@@ -95,6 +96,12 @@ class PlanFragmentExecutor {
   // Initiate cancellation. Must not be called until after Prepare() returned.
   void Cancel();
 
+  // Applies a runtime filter that was computed by a join in another fragment to the
+  // hdfs scans of its target tuple in this fragment that are not at or below a node
+  // with a limit.  May be called asynchronously
+  // while the fragment is executing, but not before Prepare() returned.
+  void PublishRuntimeFilter(const TRuntimeFilter& filter);
+
   // call these only after Prepare()
   RuntimeState* runtime_state() { return runtime_state_.get(); }
   const RowDescriptor& row_desc();
@@ -42,6 +42,9 @@ class RawValue {
   // is combined with the seed value.
   static uint32_t GetHashValue(const void* value, PrimitiveType type, uint32_t seed = 0);
 
+  // Returns a 64-bit hash of 'value', which must not be NULL.
+  static uint64_t GetHashValue64(const void* value, PrimitiveType type, uint64_t seed = 0);
+
   // Compares both values.
   // Return value is < 0  if v1 < v2, 0 if v1 == v2, > 0 if v1 > v2.
   static int Compare(const void* v1, const void* v2, PrimitiveType type);
@@ -140,6 +143,33 @@ inline uint32_t RawValue::GetHashValue(const void* v, PrimitiveType type, uint32
   }
 }
 
+inline uint64_t RawValue::GetHashValue64(const void* v, PrimitiveType type,
+    uint64_t seed) {
+  DCHECK(v != NULL);
+  switch (type) {
+    case TYPE_STRING: {
+      const StringValue* string_value = reinterpret_cast<const StringValue*>(v);
+      return HashUtil::MurmurHash2_64(string_value->ptr, string_value->len, seed);
+    }
+    case TYPE_BOOLEAN:
+    case TYPE_TINYINT:
+      return HashUtil::MurmurHash2_64(v, 1, seed);
+    case TYPE_SMALLINT:
+      return HashUtil::MurmurHash2_64(v, 2, seed);
+    case TYPE_INT:
+    case TYPE_FLOAT:
+      return HashUtil::MurmurHash2_64(v, 4, seed);
+    case TYPE_BIGINT:
+    case TYPE_DOUBLE:
+      return HashUtil::MurmurHash2_64(v, 8, seed);
+    case TYPE_TIMESTAMP:
+      return HashUtil::MurmurHash2_64(v, 12, seed);
+    default:
+      DCHECK(false) << "invalid type: " << TypeToString(type);
+      return 0;
+  }
+}
+
 }
 
 #endif
@@ -0,0 +1,106 @@
+// Copyright (c) 2012 Cloudera, Inc. All rights reserved.
+
+#include "runtime/row-batch-compressor.h"
+
+#include <algorithm>
+#include <sstream>
+
+#include "common/logging.h"
+#include "util/codec.h"
+
+#include "gen-cpp/Data_types.h"
+#include "gen-cpp/Descriptors_types.h"
+
+using namespace boost;
+using namespace std;
+
+namespace impala {
+
+RowBatchCompressor::RowBatchCompressor(double min_savings)
+  : min_savings_(min_savings),
+    skip_batches_(0),
+    num_batches_to_skip_(0),
+    uncompressed_bytes_(0),
+    sent_bytes_(0) {
+}
+
+RowBatchCompressor::~RowBatchCompressor() {
+}
+
+Status RowBatchCompressor::Init() {
+  Codec* compressor;
+  RETURN_IF_ERROR(Codec::CreateCompressor(
+      NULL, &compression_pool_, true, THdfsCompression::SNAPPY, &compressor));
+  compressor_.reset(compressor);
+  return Status::OK;
+}
+
+Status RowBatchCompressor::Compress(TRowBatch* batch) {
+  DCHECK(compressor_.get() != NULL);
+  DCHECK(!batch->__isset.compression_type);
+  if (batch->tuple_data.empty()) return Status::OK;
+  DCHECK_EQ(batch->tuple_data.size(), 1);
+  string& data = batch->tuple_data[0];
+  int uncompressed_size = data.size();
+  if (uncompressed_size == 0) return Status::OK;
+  uncompressed_bytes_ += uncompressed_size;
+  if (num_batches_to_skip_ > 0) {
+    --num_batches_to_skip_;
+    sent_bytes_ += uncompressed_size;
+    return Status::OK;
+  }
+
+  int compressed_size = 0;
+  uint8_t* compressed = NULL;
+  RETURN_IF_ERROR(compressor_->ProcessBlock(uncompressed_size,
+      reinterpret_cast<uint8_t*>(const_cast<char*>(data.data())),
+      &compressed_size, &compressed));
+  if (compressed_size > uncompressed_size * (1.0 - min_savings_)) {
+    // not worth the decompression on the receiving side; back off
+    skip_batches_ = min(max(2 * skip_batches_, 1), MAX_SKIPPED_BATCHES);
+    num_batches_to_skip_ = skip_batches_;
+    VLOG_ROW << "poor compression ratio: " << compressed_size << "/"
+             << uncompressed_size << " skipping " << skip_batches_ << " batches";
+    sent_bytes_ += uncompressed_size;
+    return Status::OK;
+  }
+  skip_batches_ = 0;
+  data.assign(reinterpret_cast<char*>(compressed), compressed_size);
+  batch->__set_compression_type(THdfsCompression::SNAPPY);
+  batch->__set_uncompressed_size(uncompressed_size);
+  sent_bytes_ += compressed_size;
+  return Status::OK;
+}
+
+Status RowBatchCompressor::Decompress(TRowBatch* batch) {
+  if (!batch->__isset.compression_type) return Status::OK;
+  if (batch->compression_type != THdfsCompression::SNAPPY
+      || batch->tuple_data.size() != 1 || batch->uncompressed_size <= 0) {
+    return Status("Decompress(): unexpected compressed row batch format");
+  }
+  // the codec writes into the buffer we hand it, so it doesn't allocate from 'pool'
+  MemPool pool;
+  Codec* codec;
+  RETURN_IF_ERROR(Codec::CreateDecompressor(
+      NULL, &pool, false, THdfsCompression::SNAPPY, &codec));
+  scoped_ptr<Codec> decompressor(codec);
+  string uncompressed;
+  uncompressed.resize(batch->uncompressed_size);
+  int uncompressed_size = batch->uncompressed_size;
+  uint8_t* output = reinterpret_cast<uint8_t*>(&uncompressed[0]);
+  string& compressed = batch->tuple_data[0];
+  RETURN_IF_ERROR(decompressor->ProcessBlock(compressed.size(),
+      reinterpret_cast<uint8_t*>(&compressed[0]), &uncompressed_size, &output));
+  if (uncompressed_size != batch->uncompressed_size) {
+    stringstream ss;
+    ss << "Decompress(): row batch decompressed to " << uncompressed_size
+       << " bytes, expected " << batch->uncompressed_size;
+    return Status(ss.str());
+  }
+  compressed.swap(uncompressed);
+  batch->__isset.compression_type = false;
+  batch->__isset.uncompressed_size = false;
+  return Status::OK;
+}
+
+}
@@ -0,0 +1,69 @@
+// Copyright (c) 2012 Cloudera, Inc. All rights reserved.
+
+#ifndef IMPALA_RUNTIME_ROW_BATCH_COMPRESSOR_H
+#define IMPALA_RUNTIME_ROW_BATCH_COMPRESSOR_H
+
+#include <boost/scoped_ptr.hpp>
+
+#include "common/status.h"
+#include "runtime/mem-pool.h"
+
+namespace impala {
+
+class Codec;
+class TRowBatch;
+
+// Compresses the tuple data of serialized row batches (TRowBatch) with snappy before
+// they are sent over the network.  Compression is adaptive: batches that don't
+// compress to less than (1 - min_savings) of their size are sent uncompressed, and
+// after such a batch the compressor skips an exponentially growing number of
+// batches (up to MAX_SKIPPED_BATCHES) before it tries again.  A batch that compresses
+// well resets the backoff.
+// Not thread-safe.
+class RowBatchCompressor {
+ public:
+  // min_savings: fraction of the batch size that compression needs to save
+  RowBatchCompressor(double min_savings);
+  ~RowBatchCompressor();
+
+  // Creates the codec.  Must be called before Compress().
+  Status Init();
+
+  // Replaces the tuple data of 'batch', which must consist of a single chunk (as
+  // written by RowBatch::Serialize()), with its compressed form, unless compression
+  // is skipped or doesn't pay off.  Sets batch->compression_type and
+  // batch->uncompressed_size if the data was compressed.
+  Status Compress(TRowBatch* batch);
+
+  // Replaces the tuple data of 'batch' with its uncompressed form if it was
+  // compressed by Compress(); no-op otherwise.  The decompressed data is written
+  // directly into a new chunk, which RowBatch(const RowDescriptor&, TRowBatch*)
+  // then adopts as part of its tuple data pool.
+  static Status Decompress(TRowBatch* batch);
+
+  // Total tuple data bytes passed to Compress() and sent after it returned.
+  int64_t uncompressed_bytes() const { return uncompressed_bytes_; }
+  int64_t sent_bytes() const { return sent_bytes_; }
+
+ private:
+  static const int MAX_SKIPPED_BATCHES = 64;
+
+  const double min_savings_;
+
+  // holds the codec's output buffer, which is reused across calls
+  MemPool compression_pool_;
+  boost::scoped_ptr<Codec> compressor_;
+
+  // number of batches to skip after the most recent poorly compressible batch
+  int skip_batches_;
+
+  // number of batches left to skip before the next compression attempt
+  int num_batches_to_skip_;
+
+  int64_t uncompressed_bytes_;
+  int64_t sent_bytes_;
+};
+
+}
+
+#endif
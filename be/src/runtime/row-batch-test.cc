@@ -0,0 +1,156 @@
+// Copyright (c) 2012 Cloudera, Inc. All rights reserved.
+
+#include <boost/scoped_ptr.hpp>
+#include <gtest/gtest.h>
+
+#include "runtime/row-batch.h"
+#include "runtime/row-batch-compressor.h"
+#include "testutil/bigint-row-test.h"
+#include "gen-cpp/Data_types.h"
+
+using namespace boost;
+using namespace std;
+
+namespace impala {
+
+class RowBatchTest : public BigIntRowTest {
+ protected:
+  static const int BATCH_CAPACITY = 10;
+
+  // Selects the rows with an odd value.
+  static void SelectOdd(RowBatch* batch) {
+    batch->InitSelection();
+    int* sel = batch->selection();
+    int num_selected = 0;
+    for (int i = 0; i < batch->num_selected(); ++i) {
+      if (GetValue(batch->GetRow(sel[i])) % 2 == 1) sel[num_selected++] = sel[i];
+    }
+    batch->set_num_selected(num_selected);
+  }
+};
+
+TEST_F(RowBatchTest, Selection) {
+  RowBatch batch(*row_desc_, BATCH_CAPACITY);
+  batch.set_selection_enabled(true);
+  AddRows(&batch, 6, 0);
+  EXPECT_FALSE(batch.has_selection());
+  EXPECT_EQ(batch.num_active_rows(), 6);
+
+  SelectOdd(&batch);
+  EXPECT_TRUE(batch.has_selection());
+  EXPECT_EQ(batch.num_rows(), 6);
+  ASSERT_EQ(batch.num_active_rows(), 3);
+  for (int i = 0; i < batch.num_active_rows(); ++i) {
+    EXPECT_EQ(GetValue(batch.GetActiveRow(i)), 2 * i + 1);
+  }
+
+  // Committed rows are appended to the selection.
+  AddRows(&batch, 2, 6);
+  ASSERT_EQ(batch.num_active_rows(), 5);
+  EXPECT_EQ(GetValue(batch.GetActiveRow(3)), 6);
+  EXPECT_EQ(GetValue(batch.GetActiveRow(4)), 7);
+
+  // Removing rows also removes them from the selection.
+  batch.set_num_rows(7);
+  ASSERT_EQ(batch.num_active_rows(), 4);
+
+  batch.Compact();
+  EXPECT_FALSE(batch.has_selection());
+  ASSERT_EQ(batch.num_rows(), 4);
+  EXPECT_EQ(GetValue(batch.GetRow(0)), 1);
+  EXPECT_EQ(GetValue(batch.GetRow(1)), 3);
+  EXPECT_EQ(GetValue(batch.GetRow(2)), 5);
+  EXPECT_EQ(GetValue(batch.GetRow(3)), 6);
+
+  batch.InitSelection();
+  batch.Reset();
+  EXPECT_FALSE(batch.has_selection());
+  EXPECT_TRUE(batch.selection_enabled());
+  EXPECT_EQ(batch.num_active_rows(), 0);
+}
+
+TEST_F(RowBatchTest, SwapKeepsSelectionEnabled) {
+  RowBatch src(*row_desc_, BATCH_CAPACITY);
+  src.set_selection_enabled(true);
+  AddRows(&src, 4, 0);
+  SelectOdd(&src);
+
+  RowBatch dst(*row_desc_, BATCH_CAPACITY);
+  dst.Swap(&src);
+  EXPECT_FALSE(dst.selection_enabled());
+  EXPECT_FALSE(src.has_selection());
+  ASSERT_EQ(dst.num_active_rows(), 2);
+  EXPECT_EQ(GetValue(dst.GetActiveRow(1)), 3);
+}
+
+TEST_F(RowBatchTest, SerializeSelection) {
+  RowBatch batch(*row_desc_, BATCH_CAPACITY);
+  batch.set_selection_enabled(true);
+  AddRows(&batch, BATCH_CAPACITY, 0);
+  SelectOdd(&batch);
+
+  TRowBatch thrift_batch;
+  batch.Serialize(&thrift_batch);
+  // The tuple data is serialized into a single chunk, which the receiving batch adopts.
+  EXPECT_EQ(thrift_batch.tuple_data.size(), 1);
+  RowBatch result(*row_desc_, &thrift_batch);
+  EXPECT_TRUE(thrift_batch.tuple_data.empty());
+  ASSERT_EQ(result.num_rows(), BATCH_CAPACITY / 2);
+  for (int i = 0; i < result.num_rows(); ++i) {
+    EXPECT_EQ(GetValue(result.GetRow(i)), 2 * i + 1);
+  }
+}
+
+TEST_F(RowBatchTest, Compression) {
+  const int num_rows = 1000;
+  RowBatch batch(*row_desc_, num_rows);
+  AddRows(&batch, num_rows, 0);
+  TRowBatch thrift_batch;
+  batch.Serialize(&thrift_batch);
+  int uncompressed_size = RowBatch::GetBatchSize(thrift_batch);
+
+  RowBatchCompressor compressor(0.2);
+  ASSERT_TRUE(compressor.Init().ok());
+  ASSERT_TRUE(compressor.Compress(&thrift_batch).ok());
+  EXPECT_TRUE(thrift_batch.__isset.compression_type);
+  EXPECT_EQ(thrift_batch.uncompressed_size, uncompressed_size);
+  EXPECT_LT(RowBatch::GetBatchSize(thrift_batch), uncompressed_size);
+  EXPECT_EQ(compressor.sent_bytes(), RowBatch::GetBatchSize(thrift_batch));
+
+  ASSERT_TRUE(RowBatchCompressor::Decompress(&thrift_batch).ok());
+  EXPECT_FALSE(thrift_batch.__isset.compression_type);
+  EXPECT_EQ(RowBatch::GetBatchSize(thrift_batch), uncompressed_size);
+  RowBatch result(*row_desc_, &thrift_batch);
+  ASSERT_EQ(result.num_rows(), num_rows);
+  for (int i = 0; i < num_rows; ++i) {
+    EXPECT_EQ(GetValue(result.GetRow(i)), i);
+  }
+}
+
+TEST_F(RowBatchTest, CompressionBackoff) {
+  RowBatch batch(*row_desc_, BATCH_CAPACITY);
+  AddRows(&batch, BATCH_CAPACITY, 0);
+
+  // Compression can never save all of the data, so every batch goes out uncompressed.
+  RowBatchCompressor compressor(1.0);
+  ASSERT_TRUE(compressor.Init().ok());
+  for (int i = 0; i < 10; ++i) {
+    TRowBatch thrift_batch;
+    batch.Serialize(&thrift_batch);
+    ASSERT_TRUE(compressor.Compress(&thrift_batch).ok());
+    EXPECT_FALSE(thrift_batch.__isset.compression_type);
+    // Uncompressed batches pass through Decompress() unchanged.
+    ASSERT_TRUE(RowBatchCompressor::Decompress(&thrift_batch).ok());
+    RowBatch result(*row_desc_, &thrift_batch);
+    EXPECT_EQ(result.num_rows(), BATCH_CAPACITY);
+  }
+  EXPECT_EQ(compressor.sent_bytes(), compressor.uncompressed_bytes());
+}
+
+}
+
+int main(int argc, char **argv) {
+  google::InitGoogleLogging(argv[0]);
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
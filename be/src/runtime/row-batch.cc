@@ -14,98 +14,92 @@ namespace impala {
 
 RowBatch::~RowBatch() {
   delete [] tuple_ptrs_;
+  if (mem_tracker_ != NULL) {
+    mem_tracker_->Release(tuple_ptrs_size_);
+    if (selection_.get() != NULL) mem_tracker_->Release(capacity_ * sizeof(int));
+  }
   for (int i = 0; i < io_buffers_.size(); ++i) {
     io_buffers_[i]->Return();
   }
 }
 
+// Tuples in the serialized tuple data start at 8-byte aligned offsets, like the ones
+// handed out by MemPool::Allocate().
+static inline int AlignTupleOffset(int offset) {
+  return ((offset + 7) / 8) * 8;
+}
+
 void RowBatch::Serialize(TRowBatch* output_batch) {
   // why does Thrift not generate a Clear() function?
   output_batch->row_tuples.clear();
   output_batch->tuple_offsets.clear();
   output_batch->tuple_data.clear();
 
-  output_batch->num_rows = num_rows_;
+  int num_rows = num_active_rows();
+  output_batch->num_rows = num_rows;
   row_desc_.ToThrift(&output_batch->row_tuples);
-  output_batch->tuple_offsets.reserve(num_rows_ * num_tuples_per_row_);
-  MemPool output_pool;
-
-  // iterate through all tuples;
-  // for a self-contained batch, convert Tuple* and string pointers into offsets into
-  // our tuple_data_pool_;
-  // otherwise, copy the tuple data, including strings, into output_pool (converting
-  // string pointers into offset in the process)
-  for (int i = 0; i < num_rows_; ++i) {
-    TupleRow* row = GetRow(i);
-    const vector<TupleDescriptor*>& tuple_descs = row_desc_.tuple_descriptors();
-    vector<TupleDescriptor*>::const_iterator desc = tuple_descs.begin();
-    for (int j = 0; desc != tuple_descs.end(); ++desc, ++j) {
-      if (row->GetTuple(j) == NULL) {
-        // NULLs are encoded as -1
-        output_batch->tuple_offsets.push_back(-1);
-        continue;
-      }
+  output_batch->tuple_offsets.reserve(num_rows * num_tuples_per_row_);
 
-      Tuple* t;
-      if (is_self_contained_) {
-        t = row->GetTuple(j);
-        output_batch->tuple_offsets.push_back(
-            tuple_data_pool_->GetOffset(reinterpret_cast<uint8_t*>(t)));
-
-        // convert string pointers to offsets
-        vector<SlotDescriptor*>::const_iterator slot = (*desc)->string_slots().begin();
-        for (; slot != (*desc)->string_slots().end(); ++slot) {
-          DCHECK_EQ((*slot)->type(), TYPE_STRING);
-          StringValue* string_val = t->GetStringSlot((*slot)->tuple_offset());
-          string_val->ptr = reinterpret_cast<char*>(tuple_data_pool_->GetOffset(
-                  reinterpret_cast<uint8_t*>(string_val->ptr)));
-        }
-      } else  {
-        // record offset before creating copy
-        output_batch->tuple_offsets.push_back(output_pool.GetCurrentOffset());
-        t = row->GetTuple(j)->DeepCopy(**desc, &output_pool, /* convert_ptrs */ true);
-      }
+  // Copy all tuples, including their strings, into a single chunk, converting string
+  // pointers into offsets into that chunk in the process.  The receiver adopts the
+  // chunk as its tuple data without copying it (see RowBatch(TRowBatch*)).
+  const vector<TupleDescriptor*>& tuple_descs = row_desc_.tuple_descriptors();
+  int size = 0;
+  for (int i = 0; i < num_rows; ++i) {
+    TupleRow* row = GetActiveRow(i);
+    for (int j = 0; j < tuple_descs.size(); ++j) {
+      Tuple* t = row->GetTuple(j);
+      if (t == NULL) continue;
+      size = AlignTupleOffset(size) + t->TotalByteSize(*tuple_descs[j]);
     }
   }
 
-  if (is_self_contained_) {
-    output_pool.AcquireData(tuple_data_pool_.get(), false);
-    Reset();  // we passed on all data
+  char* data = NULL;
+  if (size > 0) {
+    output_batch->tuple_data.resize(1);
+    output_batch->tuple_data[0].resize(size);
+    data = &output_batch->tuple_data[0][0];
   }
-
-  vector<pair<uint8_t*, int> > chunk_info;
-  output_pool.GetChunkInfo(&chunk_info);
-  output_batch->tuple_data.reserve(chunk_info.size());
-  for (int i = 0; i < chunk_info.size(); ++i) {
-    // TODO: this creates yet another data copy, figure out how to avoid that
-    // (Thrift should introduce something like StringPieces, that can hold
-    // references to data/length pairs)
-    string data(reinterpret_cast<char*>(chunk_info[i].first), chunk_info[i].second);
-    output_batch->tuple_data.push_back(string());
-    output_batch->tuple_data.back().swap(data);
-    DCHECK(data.empty());
+  int offset = 0;
+  for (int i = 0; i < num_rows; ++i) {
+    TupleRow* row = GetActiveRow(i);
+    for (int j = 0; j < tuple_descs.size(); ++j) {
+      Tuple* t = row->GetTuple(j);
+      if (t == NULL) {
+        // NULLs are encoded as -1
+        output_batch->tuple_offsets.push_back(-1);
+        continue;
+      }
+      int aligned_offset = AlignTupleOffset(offset);
+      data += aligned_offset - offset;
+      offset = aligned_offset;
+      output_batch->tuple_offsets.push_back(offset);
+      t->DeepCopy(*tuple_descs[j], &data, &offset, /* convert_ptrs */ true);
+    }
   }
+  DCHECK_EQ(offset, size);
 }
 
-// TODO: we want our input_batch's tuple_data to come from our (not yet implemented)
-// global runtime memory segment; how do we get thrift to allocate it from there?
-// maybe change line (in Data_types.cc generated from Data.thrift)
-//              xfer += iprot->readString(this->tuple_data[_i9]);
-// to allocated string data in special mempool
-// (change via python script that runs over Data_types.cc)
-RowBatch::RowBatch(const RowDescriptor& row_desc, const TRowBatch& input_batch)
+RowBatch::RowBatch(const RowDescriptor& row_desc, TRowBatch* input_batch,
+    MemTracker* mem_tracker)
   : has_in_flight_row_(false),
     is_self_contained_(true),
-    num_rows_(input_batch.num_rows),
+    num_rows_(input_batch->num_rows),
     capacity_(num_rows_),
-    num_tuples_per_row_(input_batch.row_tuples.size()),
+    num_tuples_per_row_(input_batch->row_tuples.size()),
     row_desc_(row_desc),
-    tuple_ptrs_(new Tuple*[num_rows_ * input_batch.row_tuples.size()]),
-    tuple_data_pool_(new MemPool(input_batch.tuple_data)) {
-  // convert input_batch.tuple_offsets into pointers
+    tuple_ptrs_(new Tuple*[num_rows_ * input_batch->row_tuples.size()]),
+    tuple_ptrs_size_(num_rows_ * input_batch->row_tuples.size() * sizeof(Tuple*)),
+    selection_enabled_(false),
+    has_selection_(false),
+    num_selected_(0),
+    mem_tracker_(mem_tracker),
+    tuple_data_pool_(new MemPool(&input_batch->tuple_data, mem_tracker)) {
+  if (mem_tracker_ != NULL) mem_tracker_->Consume(tuple_ptrs_size_);
+  // convert input_batch->tuple_offsets into pointers
   int tuple_idx = 0;
-  for (vector<int32_t>::const_iterator offset = input_batch.tuple_offsets.begin();
-       offset != input_batch.tuple_offsets.end(); ++offset) {
+  for (vector<int32_t>::const_iterator offset = input_batch->tuple_offsets.begin();
+       offset != input_batch->tuple_offsets.end(); ++offset) {
     if (*offset == -1) {
       tuple_ptrs_[tuple_idx++] = NULL;
     } else {
@@ -170,8 +164,35 @@ void RowBatch::Swap(RowBatch* other) {
   std::swap(num_rows_, other->num_rows_);
   std::swap(capacity_, other->capacity_);
   std::swap(tuple_ptrs_, other->tuple_ptrs_);
+  std::swap(mem_tracker_, other->mem_tracker_);
   std::swap(io_buffers_, other->io_buffers_);
+  std::swap(has_selection_, other->has_selection_);
+  std::swap(num_selected_, other->num_selected_);
+  selection_.swap(other->selection_);
   tuple_data_pool_.swap(other->tuple_data_pool_);
 }
 
+void RowBatch::InitSelection() {
+  DCHECK(selection_enabled_);
+  if (selection_.get() == NULL) {
+    selection_.reset(new int[capacity_]);
+    if (mem_tracker_ != NULL) mem_tracker_->Consume(capacity_ * sizeof(int));
+  }
+  for (int i = 0; i < num_rows_; ++i) {
+    selection_[i] = i;
+  }
+  num_selected_ = num_rows_;
+  has_selection_ = true;
+}
+
+void RowBatch::Compact() {
+  if (!has_selection_) return;
+  for (int i = 0; i < num_selected_; ++i) {
+    if (selection_[i] != i) CopyRow(GetRow(selection_[i]), GetRow(i));
+  }
+  num_rows_ = num_selected_;
+  has_selection_ = false;
+  num_selected_ = 0;
+}
+
 }
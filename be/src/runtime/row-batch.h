@@ -5,12 +5,15 @@
 
 #include <vector>
 #include <cstring>
+#include <boost/scoped_array.hpp>
 #include <boost/scoped_ptr.hpp>
 
+#include "common/compiler-util.h"
 #include "common/logging.h"
 #include "runtime/descriptors.h"
 #include "runtime/disk-io-mgr.h"
 #include "runtime/mem-pool.h"
+#include "runtime/mem-tracker.h"
 
 namespace impala {
 
@@ -30,30 +33,45 @@ class TupleDescriptor;
 //      the data is in an io buffer that may not be attached to this row batch.  The
 //      creator of that row batch has to make sure that the io buffer is not recycled
 //      until all batches that reference the memory have been consumed.  
+// The tuple ptrs and the tuple pool are charged to the MemTracker passed in at
+// construction, if any.
+//
+// A row batch can carry a selection vector: the ascending indices of the rows that
+// are still active.  Filters narrow the selection instead of moving the surviving
+// row ptrs to the front of the batch, so a filter costs O(selected rows) and
+// consecutive filters don't copy.  Consumers that iterate over the active rows
+// (num_active_rows()/GetActiveRow()) enable selections on the batches they pass to
+// their child with set_selection_enabled(); producers must Compact() batches for
+// which selections aren't enabled.
 // TODO: stick tuple_ptrs_ into a pool?
 class RowBatch {
  public:
   // Create RowBatch for a maximum of 'capacity' rows of tuples specified
-  // by 'row_desc'.
-  RowBatch(const RowDescriptor& row_desc, int capacity)
+  // by 'row_desc'.  'mem_tracker' may be NULL.
+  RowBatch(const RowDescriptor& row_desc, int capacity, MemTracker* mem_tracker = NULL)
     : has_in_flight_row_(false),
       is_self_contained_(false),
       num_rows_(0),
       capacity_(capacity),
       num_tuples_per_row_(row_desc.tuple_descriptors().size()),
       row_desc_(row_desc),
-      tuple_data_pool_(new MemPool()) {
+      selection_enabled_(false),
+      has_selection_(false),
+      num_selected_(0),
+      mem_tracker_(mem_tracker),
+      tuple_data_pool_(new MemPool(mem_tracker)) {
     tuple_ptrs_size_ = capacity_ * num_tuples_per_row_ * sizeof(Tuple*);
     tuple_ptrs_ = new Tuple*[capacity_ * num_tuples_per_row_];
+    if (mem_tracker_ != NULL) mem_tracker_->Consume(tuple_ptrs_size_);
     DCHECK_GT(capacity, 0);
   }
 
-  // Populate a row batch from input_batch by copying input_batch's
-  // tuple_data into the row batch's mempool and converting all offsets
-  // in the data back into pointers. The row batch will be self-contained after the call.
-  // TODO: figure out how to transfer the data from input_batch to this RowBatch
-  // (so that we don't need to make yet another copy)
-  RowBatch(const RowDescriptor& row_desc, const TRowBatch& input_batch);
+  // Populate a row batch from input_batch by taking over input_batch's tuple_data
+  // as the chunks of the row batch's mempool (without copying it) and converting all
+  // offsets in the data back into pointers. input_batch->tuple_data is empty and the
+  // row batch is self-contained after the call.
+  RowBatch(const RowDescriptor& row_desc, TRowBatch* input_batch,
+      MemTracker* mem_tracker = NULL);
 
   // Releases all resources accumulated at this row batch.  This includes
   //  - tuple_ptrs
@@ -76,8 +94,14 @@ class RowBatch {
 
   int AddRow() { return AddRows(1); }
 
+  // Committed rows are active: if there is a selection, they are appended to it.
   void CommitRows(int n) {
     DCHECK_LE(num_rows_ + n, capacity_);
+    if (UNLIKELY(has_selection_)) {
+      for (int i = 0; i < n; ++i) {
+        selection_[num_selected_++] = num_rows_ + i;
+      }
+    }
     num_rows_ += n;
     has_in_flight_row_ = false;
   }
@@ -89,6 +113,11 @@ class RowBatch {
   void set_num_rows(int num_rows) {
     DCHECK_LE(num_rows, num_rows_);
     num_rows_ = num_rows;
+    if (UNLIKELY(has_selection_)) {
+      while (num_selected_ > 0 && selection_[num_selected_ - 1] >= num_rows) {
+        --num_selected_;
+      }
+    }
   }
 
   // Returns true if row_batch has reached capacity or there are io buffers attached to
@@ -109,10 +138,50 @@ class RowBatch {
     return reinterpret_cast<TupleRow*>(tuple_ptrs_ + row_idx * num_tuples_per_row_);
   }
 
+  // Returns the number of active rows, i.e. the number of selected rows if there is
+  // a selection and the number of committed rows otherwise.
+  int num_active_rows() const { return has_selection_ ? num_selected_ : num_rows_; }
+
+  // Returns the i-th active row.
+  TupleRow* GetActiveRow(int i) {
+    return GetRow(has_selection_ ? selection_[i] : i);
+  }
+
+  // Selections may only be set on batches whose consumer iterates over the active
+  // rows.  This is a property of the batch object: it's not changed by Reset() or
+  // Swap().
+  bool selection_enabled() const { return selection_enabled_; }
+  void set_selection_enabled(bool enabled) { selection_enabled_ = enabled; }
+
+  bool has_selection() const { return has_selection_; }
+
+  // Starts a selection containing all committed rows.
+  void InitSelection();
+
+  // The selected row indices, in ascending order.  Only valid if has_selection().
+  int* selection() {
+    DCHECK(has_selection_);
+    return selection_.get();
+  }
+  int num_selected() const { return num_selected_; }
+
+  // Reduces the selection to its first 'num_selected' entries.
+  void set_num_selected(int num_selected) {
+    DCHECK(has_selection_);
+    DCHECK_LE(num_selected, num_selected_);
+    num_selected_ = num_selected;
+  }
+
+  // Moves the selected rows to the front of the batch and drops the selection.
+  // No-op if there is no selection.
+  void Compact();
+
   void Reset() {
     num_rows_ = 0;
     has_in_flight_row_ = false;
-    tuple_data_pool_.reset(new MemPool());
+    has_selection_ = false;
+    num_selected_ = 0;
+    tuple_data_pool_.reset(new MemPool(mem_tracker_));
     for (int i = 0; i < io_buffers_.size(); ++i) {
       io_buffers_[i]->Return();
     }
@@ -164,12 +233,11 @@ class RowBatch {
   // this up.
   void Swap(RowBatch* other);
 
-  // Create a serialized version of this row batch in output_batch, attaching
-  // all of the data it references (TRowBatch::tuple_data) to output_batch.tuple_data.
-  // If an in-flight row is present in this row batch, it is ignored.
-  // If this batch is self-contained, it simply does an in-place conversion of the
-  // string pointers contained in the tuple data into offsets and resets the batch
-  // after copying the data to TRowBatch.
+  // Create a serialized version of this row batch in output_batch, copying
+  // all of the data it references into a single chunk in output_batch.tuple_data,
+  // with the tuple and string pointers converted into offsets into that chunk.
+  // If an in-flight row is present in this row batch, it is ignored.  Only the active
+  // rows are serialized.  This batch is not modified.
   void Serialize(TRowBatch* output_batch);
 
   // utility function: return total tuple data size of 'batch'.
@@ -203,6 +271,19 @@ class RowBatch {
   Tuple** tuple_ptrs_;
   int tuple_ptrs_size_;
 
+  // not swapped, see set_selection_enabled()
+  bool selection_enabled_;
+
+  // if true, only the rows in selection_[0, num_selected_) are active
+  bool has_selection_;
+  int num_selected_;
+
+  // capacity_ elements, allocated by the first InitSelection()
+  boost::scoped_array<int> selection_;
+
+  // Tracker for tuple_ptrs_ and tuple_data_pool_; may be NULL.
+  MemTracker* mem_tracker_;
+
   // holding (some of the) data referenced by rows
   boost::scoped_ptr<MemPool> tuple_data_pool_;
 
@@ -0,0 +1,99 @@
+// Copyright (c) 2012 Cloudera, Inc. All rights reserved.
+
+#include "runtime/runtime-filter.h"
+
+#include <limits>
+
+#include "gen-cpp/ImpalaInternalService_types.h"
+
+using namespace std;
+
+namespace impala {
+
+RuntimeFilter::RuntimeFilter(int src_node_id, int expr_idx, const SlotDescriptor* slot,
+    int64_t num_bits)
+  : src_node_id_(src_node_id),
+    expr_idx_(expr_idx),
+    slot_(slot),
+    bloom_filter_(num_bits),
+    num_values_(0),
+    always_true_(false) {
+  InitRange();
+}
+
+RuntimeFilter::RuntimeFilter(const TRuntimeFilter& tfilter, const SlotDescriptor* slot)
+  : src_node_id_(tfilter.src_node_id),
+    expr_idx_(tfilter.expr_idx),
+    slot_(slot),
+    bloom_filter_(tfilter.bloom_filter),
+    num_values_(0),
+    always_true_(false) {
+  DCHECK_EQ(slot->id(), tfilter.target_slot_id);
+  DCHECK(!tfilter.__isset.always_true || !tfilter.always_true);
+  InitRange();
+  if (has_range_) {
+    DCHECK(tfilter.__isset.min_value && tfilter.__isset.max_value);
+    min_value_ = tfilter.min_value;
+    max_value_ = tfilter.max_value;
+  }
+}
+
+void RuntimeFilter::InitRange() {
+  switch (slot_->type()) {
+    case TYPE_TINYINT:
+    case TYPE_SMALLINT:
+    case TYPE_INT:
+    case TYPE_BIGINT:
+      has_range_ = true;
+      break;
+    default:
+      has_range_ = false;
+  }
+  min_value_ = numeric_limits<int64_t>::max();
+  max_value_ = numeric_limits<int64_t>::min();
+}
+
+void RuntimeFilter::ToThrift(TRuntimeFilter* tfilter) const {
+  tfilter->src_node_id = src_node_id_;
+  tfilter->expr_idx = expr_idx_;
+  tfilter->target_tuple_id = slot_->parent();
+  tfilter->target_slot_id = slot_->id();
+  if (always_true_) {
+    tfilter->__set_always_true(true);
+    return;
+  }
+  tfilter->bloom_filter = bloom_filter_.bits();
+  if (has_range_) {
+    tfilter->__set_min_value(min_value_);
+    tfilter->__set_max_value(max_value_);
+  }
+}
+
+void RuntimeFilter::Merge(const TRuntimeFilter& src, TRuntimeFilter* dst) {
+  DCHECK_EQ(src.src_node_id, dst->src_node_id);
+  DCHECK_EQ(src.expr_idx, dst->expr_idx);
+  if (dst->__isset.always_true && dst->always_true) return;
+  if (src.__isset.always_true && src.always_true) {
+    dst->__set_always_true(true);
+    dst->bloom_filter.clear();
+    dst->__isset.min_value = false;
+    dst->__isset.max_value = false;
+    return;
+  }
+  BloomFilter dst_filter(dst->bloom_filter);
+  BloomFilter src_filter(src.bloom_filter);
+  if (dst_filter.num_bits() > src_filter.num_bits()) {
+    dst_filter.Fold(src_filter.num_bits());
+  } else {
+    src_filter.Fold(dst_filter.num_bits());
+  }
+  dst_filter.Or(src_filter);
+  dst->bloom_filter = dst_filter.bits();
+  if (src.__isset.min_value) {
+    DCHECK(dst->__isset.min_value);
+    dst->__set_min_value(min(src.min_value, dst->min_value));
+    dst->__set_max_value(max(src.max_value, dst->max_value));
+  }
+}
+
+}
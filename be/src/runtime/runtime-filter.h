@@ -0,0 +1,125 @@
+// Copyright (c) 2012 Cloudera, Inc. All rights reserved.
+
+#ifndef IMPALA_RUNTIME_RUNTIME_FILTER_H
+#define IMPALA_RUNTIME_RUNTIME_FILTER_H
+
+#include <boost/cstdint.hpp>
+
+#include "runtime/descriptors.h"
+#include "runtime/raw-value.h"
+#include "runtime/tuple.h"
+#include "util/bloom-filter.h"
+
+namespace impala {
+
+class TRuntimeFilter;
+
+// A filter on the values of a single slot that is computed from the build side of a
+// hash join and evaluated by the scans on the probe side, so that probe rows which
+// cannot have a join partner are dropped before they are materialized and shipped to
+// the join.
+// The filter consists of a Bloom filter over the hashes of the build values and, for
+// integer slots, the min/max of the build values.  NULLs never match an equi-join
+// conjunct, so they are never inserted and always fail the filter.
+// Filters are built by a single thread and are immutable once they have been handed
+// to the scan nodes, so Eval() may be called concurrently.
+class RuntimeFilter {
+ public:
+  // Creates an empty filter for conjunct 'expr_idx' of join 'src_node_id' that will be
+  // applied to 'slot'.  The Bloom filter has 'num_bits' bits.
+  RuntimeFilter(int src_node_id, int expr_idx, const SlotDescriptor* slot,
+      int64_t num_bits);
+
+  // Creates a filter from its thrift representation.
+  RuntimeFilter(const TRuntimeFilter& tfilter, const SlotDescriptor* slot);
+
+  // Adds 'value' (of the slot's type) to the filter.  NULL values are ignored.
+  void Insert(const void* value) {
+    if (value == NULL) return;
+    bloom_filter_.Insert(RawValue::GetHashValue(value, slot_->type(), HASH_SEED));
+    if (has_range_) UpdateRange(value);
+    ++num_values_;
+  }
+
+  // Returns false if the slot value of 'tuple' cannot match any inserted value.
+  bool Eval(const Tuple* tuple) const {
+    if (tuple == NULL || tuple->IsNull(slot_->null_indicator_offset())) return false;
+    const void* value = tuple->GetSlot(slot_->tuple_offset());
+    if (has_range_ && !InRange(value)) return false;
+    return bloom_filter_.Find(RawValue::GetHashValue(value, slot_->type(), HASH_SEED));
+  }
+
+  // Shrinks the Bloom filter to at most 'num_bits' bits.
+  void Fold(int64_t num_bits) { bloom_filter_.Fold(num_bits); }
+
+  // Marks the filter as passing all values, e.g. because too many values were
+  // inserted for it to be selective.  Such a filter must not be evaluated, but is
+  // still sent to the coordinator so that it knows this instance is done.
+  void SetAlwaysTrue() { always_true_ = true; }
+  bool always_true() const { return always_true_; }
+
+  void ToThrift(TRuntimeFilter* tfilter) const;
+
+  // Merges 'src' into 'dst', so that 'dst' passes all values that pass either filter.
+  // Both filters must be for the same join conjunct.  If the Bloom filters differ in
+  // size, the larger one is folded first.
+  static void Merge(const TRuntimeFilter& src, TRuntimeFilter* dst);
+
+  int src_node_id() const { return src_node_id_; }
+  int expr_idx() const { return expr_idx_; }
+  const SlotDescriptor* slot() const { return slot_; }
+  int64_t num_values() const { return num_values_; }
+  int64_t num_bits() const { return bloom_filter_.num_bits(); }
+
+ private:
+  // Seed for hashing the values.  Must be the same on all backends and differ from
+  // the seed used by the join's hash table, so that the two are uncorrelated.
+  static const uint32_t HASH_SEED = 0x6a09e667;
+
+  // Returns the value of an integer slot as an int64_t.
+  int64_t GetIntValue(const void* value) const {
+    switch (slot_->type()) {
+      case TYPE_TINYINT: return *reinterpret_cast<const int8_t*>(value);
+      case TYPE_SMALLINT: return *reinterpret_cast<const int16_t*>(value);
+      case TYPE_INT: return *reinterpret_cast<const int32_t*>(value);
+      case TYPE_BIGINT: return *reinterpret_cast<const int64_t*>(value);
+      default:
+        DCHECK(false);
+        return 0;
+    }
+  }
+
+  void UpdateRange(const void* value) {
+    int64_t v = GetIntValue(value);
+    if (v < min_value_) min_value_ = v;
+    if (v > max_value_) max_value_ = v;
+  }
+
+  bool InRange(const void* value) const {
+    int64_t v = GetIntValue(value);
+    return v >= min_value_ && v <= max_value_;
+  }
+
+  void InitRange();
+
+  int src_node_id_;
+  int expr_idx_;
+  const SlotDescriptor* slot_;
+
+  BloomFilter bloom_filter_;
+
+  // True if the slot is an integer type and min_value_/max_value_ are maintained.
+  // If no value has been inserted, min_value_ > max_value_ and InRange() fails.
+  bool has_range_;
+  int64_t min_value_;
+  int64_t max_value_;
+
+  // Number of values inserted into this filter (not including merged filters).
+  int64_t num_values_;
+
+  bool always_true_;
+};
+
+}
+
+#endif
@@ -5,6 +5,7 @@
 
 #include "common/logging.h"
 #include <boost/algorithm/string/join.hpp>
+#include <boost/bind.hpp>
 
 #include "codegen/llvm-codegen.h"
 #include "common/object-pool.h"
@@ -79,6 +80,26 @@ Status RuntimeState::Init(
   return Status::OK;
 }
 
+void RuntimeState::InitMemTrackers(const TUniqueId& query_id) {
+  int64_t limit = query_options_.mem_limit > 0 ? query_options_.mem_limit : -1;
+  MemTracker* process_tracker = exec_env_ != NULL ? exec_env_->mem_tracker() : NULL;
+  query_mem_tracker_ = MemTracker::GetQueryMemTracker(query_id, limit, process_tracker);
+  instance_mem_tracker_.reset(new MemTracker(-1, profile_.name(),
+      query_mem_tracker_.get()));
+  // The instance tracker outlives the counters in obj_pool_, so report it through
+  // derived counters rather than having it update counters in the profile.
+  profile_.AddDerivedCounter("MemoryUsage", TCounterType::BYTES,
+      bind<int64_t>(&MemTracker::consumption, instance_mem_tracker_.get()));
+  profile_.AddDerivedCounter("PeakMemoryUsage", TCounterType::BYTES,
+      bind<int64_t>(&MemTracker::peak_consumption, instance_mem_tracker_.get()));
+}
+
+Status RuntimeState::MemLimitExceeded() {
+  stringstream ss;
+  ss << "Memory limit exceeded: " << instance_mem_tracker_->DebugString();
+  return Status(ss.str());
+}
+
 void RuntimeState::set_now(const TimestampValue* now) {
   now_.reset(new TimestampValue(*now));
 }
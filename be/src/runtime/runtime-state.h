@@ -6,7 +6,9 @@
 // needed for scoped_ptr to work on ObjectPool
 #include "common/object-pool.h"
 
+#include <boost/function.hpp>
 #include <boost/scoped_ptr.hpp>
+#include <boost/shared_ptr.hpp>
 #include <boost/thread/locks.hpp>
 #include <boost/thread/mutex.hpp>
 #include <vector>
@@ -14,7 +16,9 @@
 // stringstream is a typedef, so can't forward declare it.
 #include <sstream>
 
+#include "common/status.h"
 #include "runtime/exec-env.h"
+#include "runtime/mem-tracker.h"
 #include "gen-cpp/Types_types.h"  // for TUniqueId
 #include "gen-cpp/ImpalaInternalService_types.h"  // for TQueryOptions
 #include "util/runtime-profile.h"
@@ -45,6 +49,10 @@ typedef std::map<std::string, std::string> FileMoveMap;
 // query and shared across all execution nodes of that query.
 class RuntimeState {
  public:
+  // Callback to send a runtime filter produced by this fragment instance to the
+  // coordinator.
+  typedef boost::function<void (const TRuntimeFilter&)> RuntimeFilterCallback;
+
   RuntimeState(const TUniqueId& fragment_instance_id,
                const TQueryOptions& query_options,
                const std::string& now, ExecEnv* exec_env);
@@ -86,6 +94,37 @@ class RuntimeState {
   // Returns runtime state profile
   RuntimeProfile* runtime_profile() { return &profile_; }
 
+  // Creates the memory trackers for this fragment instance: the instance tracker
+  // is a child of the (shared) tracker of query 'query_id', which is limited by
+  // the mem_limit query option and is itself a child of the process tracker.
+  // Must be called before the exec nodes are prepared.
+  void InitMemTrackers(const TUniqueId& query_id);
+
+  // Returns the memory tracker of the query or of this fragment instance.
+  // NULL if InitMemTrackers() has not been called.
+  MemTracker* query_mem_tracker() { return query_mem_tracker_.get(); }
+  MemTracker* instance_mem_tracker() { return instance_mem_tracker_.get(); }
+
+  // Returns an error if this fragment instance, its query or the process is over
+  // its memory limit.  Called by the execution threads at points where they can
+  // stop cleanly.
+  Status CheckMemLimit() {
+    if (instance_mem_tracker_.get() == NULL ||
+        !instance_mem_tracker_->AnyLimitExceeded()) {
+      return Status::OK;
+    }
+    return MemLimitExceeded();
+  }
+
+  void set_runtime_filter_cb(const RuntimeFilterCallback& cb) { runtime_filter_cb_ = cb; }
+
+  // Sends 'filter' to the coordinator, which merges the filters of all instances of
+  // the join and distributes the result to the scans of the other fragments.
+  // No-op if no callback was set (e.g. single-node execution).
+  void SendRuntimeFilter(const TRuntimeFilter& filter) {
+    if (!runtime_filter_cb_.empty()) runtime_filter_cb_(filter);
+  }
+
   // Returns CodeGen object.  Returns NULL if codegen is disabled.
   LlvmCodeGen* llvm_codegen() { return codegen_.get(); }
 
@@ -126,6 +165,12 @@ class RuntimeState {
   static const int DEFAULT_MAX_IO_BUFFERS = 5;
 
   DescriptorTbl* desc_tbl_;
+
+  // The memory trackers are declared before obj_pool_ so that they outlive the
+  // exec nodes (and their trackers) in obj_pool_.
+  boost::shared_ptr<MemTracker> query_mem_tracker_;
+  boost::scoped_ptr<MemTracker> instance_mem_tracker_;
+
   boost::scoped_ptr<ObjectPool> obj_pool_;
 
   // Lock protecting error_log_ and unreported_error_idx_
@@ -161,11 +206,16 @@ class RuntimeState {
   // if true, execution should stop with a CANCELLED status
   bool is_cancelled_;
 
+  RuntimeFilterCallback runtime_filter_cb_;
+
   // prohibit copies
   RuntimeState(const RuntimeState&);
 
   // set codegen_
   Status CreateCodegen();
+
+  // Returns the error status for CheckMemLimit().
+  Status MemLimitExceeded();
 };
 
 #define RETURN_IF_CANCELLED(state) \
@@ -0,0 +1,84 @@
+// Copyright (c) 2012 Cloudera, Inc. All rights reserved.
+
+#include <unistd.h>
+#include <boost/scoped_ptr.hpp>
+#include <gtest/gtest.h>
+
+#include "runtime/row-batch.h"
+#include "runtime/spill-stream.h"
+#include "testutil/bigint-row-test.h"
+
+using namespace boost;
+using namespace std;
+
+namespace impala {
+
+class SpillStreamTest : public BigIntRowTest {
+ protected:
+  static const int BATCH_CAPACITY = 100;
+
+  // Returns a batch with BATCH_CAPACITY rows containing the values starting at
+  // 'start_val'.
+  RowBatch* CreateBatch(int64_t start_val) {
+    RowBatch* batch = new RowBatch(*row_desc_, BATCH_CAPACITY);
+    AddRows(batch, BATCH_CAPACITY, start_val);
+    return batch;
+  }
+};
+
+TEST_F(SpillStreamTest, RoundTrip) {
+  const int NUM_BATCHES = 10;
+  SpillStream stream(*row_desc_);
+  ASSERT_TRUE(stream.Init().ok());
+  for (int i = 0; i < NUM_BATCHES; ++i) {
+    scoped_ptr<RowBatch> batch(CreateBatch(i * BATCH_CAPACITY));
+    // Alternate between self-contained and external batches; both must be left
+    // unmodified.
+    batch->set_is_self_contained(i % 2 == 0);
+    ASSERT_TRUE(stream.AddBatch(batch.get()).ok());
+    EXPECT_EQ(batch->num_rows(), BATCH_CAPACITY);
+    EXPECT_EQ(GetValue(batch->GetRow(0)), i * BATCH_CAPACITY);
+  }
+  EXPECT_EQ(stream.num_batches(), NUM_BATCHES);
+  EXPECT_EQ(stream.num_rows(), NUM_BATCHES * BATCH_CAPACITY);
+  EXPECT_GT(stream.bytes_written(), NUM_BATCHES * BATCH_CAPACITY * 8);
+
+  // Read the stream twice to make sure it can be rewound.
+  for (int pass = 0; pass < 2; ++pass) {
+    ASSERT_TRUE(stream.PrepareForRead().ok());
+    int64_t expected_val = 0;
+    RowBatch* raw_batch;
+    while (true) {
+      ASSERT_TRUE(stream.GetNext(&raw_batch).ok());
+      if (raw_batch == NULL) break;
+      scoped_ptr<RowBatch> batch(raw_batch);
+      EXPECT_TRUE(batch->is_self_contained());
+      for (int i = 0; i < batch->num_rows(); ++i) {
+        EXPECT_EQ(GetValue(batch->GetRow(i)), expected_val++);
+      }
+    }
+    EXPECT_EQ(expected_val, NUM_BATCHES * BATCH_CAPACITY);
+  }
+
+  string path = stream.path();
+  EXPECT_EQ(access(path.c_str(), F_OK), 0);
+  stream.Close();
+  EXPECT_NE(access(path.c_str(), F_OK), 0);
+}
+
+TEST_F(SpillStreamTest, Empty) {
+  SpillStream stream(*row_desc_);
+  ASSERT_TRUE(stream.Init().ok());
+  ASSERT_TRUE(stream.PrepareForRead().ok());
+  RowBatch* batch;
+  ASSERT_TRUE(stream.GetNext(&batch).ok());
+  EXPECT_TRUE(batch == NULL);
+}
+
+}
+
+int main(int argc, char **argv) {
+  google::InitGoogleLogging(argv[0]);
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,169 @@
+// Copyright (c) 2012 Cloudera, Inc. All rights reserved.
+
+#include "runtime/spill-stream.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sstream>
+#include <boost/algorithm/string.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/mutex.hpp>
+#include <protocol/TBinaryProtocol.h>
+#include <transport/TBufferTransports.h>
+
+#include "common/logging.h"
+#include "runtime/row-batch.h"
+#include "gen-cpp/Data_types.h"
+
+using namespace boost;
+using namespace std;
+using namespace apache::thrift;
+using namespace apache::thrift::protocol;
+using namespace apache::thrift::transport;
+
+DEFINE_string(scratch_dirs, "/tmp",
+    "Comma-separated list of local directories used to spill intermediate results "
+    "of operators that exceed their memory budget.");
+
+namespace impala {
+
+static mutex scratch_dir_lock;
+static int next_scratch_dir = 0;
+
+string SpillStream::GetScratchDir() {
+  vector<string> dirs;
+  split(dirs, FLAGS_scratch_dirs, is_any_of(","), token_compress_on);
+  if (dirs.empty() || dirs[0].empty()) return "/tmp";
+  lock_guard<mutex> l(scratch_dir_lock);
+  next_scratch_dir = (next_scratch_dir + 1) % dirs.size();
+  return dirs[next_scratch_dir];
+}
+
+SpillStream::SpillStream(const RowDescriptor& row_desc)
+  : row_desc_(row_desc),
+    file_(NULL),
+    num_rows_(0),
+    bytes_written_(0),
+    num_batches_(0),
+    num_batches_read_(0) {
+}
+
+SpillStream::~SpillStream() {
+  Close();
+}
+
+Status SpillStream::Init() {
+  DCHECK(file_ == NULL);
+  string path = GetScratchDir() + "/impala-spill-XXXXXX";
+  vector<char> path_buf(path.begin(), path.end());
+  path_buf.push_back('\0');
+  int fd = mkstemp(&path_buf[0]);
+  if (fd == -1) {
+    stringstream ss;
+    ss << "Could not create spill file in " << path << ": " << strerror(errno);
+    return Status(ss.str());
+  }
+  path_ = &path_buf[0];
+  file_ = fdopen(fd, "w+");
+  if (file_ == NULL) {
+    stringstream ss;
+    ss << "Could not open spill file " << path_ << ": " << strerror(errno);
+    close(fd);
+    unlink(path_.c_str());
+    return Status(ss.str());
+  }
+  VLOG_FILE << "Created spill file " << path_;
+  return Status::OK;
+}
+
+Status SpillStream::AddBatch(RowBatch* batch) {
+  DCHECK(file_ != NULL);
+  if (batch->num_rows() == 0) return Status::OK;
+
+  TRowBatch thrift_batch;
+  batch->Serialize(&thrift_batch);
+
+  shared_ptr<TMemoryBuffer> mem_buffer(new TMemoryBuffer());
+  TBinaryProtocol protocol(mem_buffer);
+  try {
+    thrift_batch.write(&protocol);
+  } catch (TException& e) {
+    stringstream ss;
+    ss << "Could not serialize row batch for spilling: " << e.what();
+    return Status(ss.str());
+  }
+  uint8_t* data;
+  uint32_t len;
+  mem_buffer->getBuffer(&data, &len);
+
+  if (fwrite(&len, sizeof(len), 1, file_) != 1 || fwrite(data, 1, len, file_) != len) {
+    stringstream ss;
+    ss << "Could not write " << len << " bytes to spill file " << path_ << ": "
+       << strerror(errno);
+    return Status(ss.str());
+  }
+  num_rows_ += batch->num_rows();
+  bytes_written_ += len + sizeof(len);
+  ++num_batches_;
+  return Status::OK;
+}
+
+Status SpillStream::PrepareForRead() {
+  DCHECK(file_ != NULL);
+  if (fflush(file_) != 0 || fseek(file_, 0, SEEK_SET) != 0) {
+    stringstream ss;
+    ss << "Could not rewind spill file " << path_ << ": " << strerror(errno);
+    return Status(ss.str());
+  }
+  num_batches_read_ = 0;
+  return Status::OK;
+}
+
+Status SpillStream::GetNext(RowBatch** batch) {
+  DCHECK(file_ != NULL);
+  *batch = NULL;
+  if (num_batches_read_ == num_batches_) return Status::OK;
+
+  uint32_t len;
+  if (fread(&len, sizeof(len), 1, file_) != 1) {
+    stringstream ss;
+    ss << "Could not read batch header from spill file " << path_ << ": "
+       << strerror(errno);
+    return Status(ss.str());
+  }
+  if (read_buffer_.size() < len) read_buffer_.resize(len);
+  if (fread(&read_buffer_[0], 1, len, file_) != len) {
+    stringstream ss;
+    ss << "Could not read " << len << " bytes from spill file " << path_ << ": "
+       << strerror(errno);
+    return Status(ss.str());
+  }
+
+  shared_ptr<TMemoryBuffer> mem_buffer(new TMemoryBuffer(&read_buffer_[0], len));
+  TBinaryProtocol protocol(mem_buffer);
+  TRowBatch thrift_batch;
+  try {
+    thrift_batch.read(&protocol);
+  } catch (TException& e) {
+    stringstream ss;
+    ss << "Could not deserialize row batch from spill file " << path_ << ": "
+       << e.what();
+    return Status(ss.str());
+  }
+  *batch = new RowBatch(row_desc_, &thrift_batch);
+  ++num_batches_read_;
+  return Status::OK;
+}
+
+void SpillStream::Close() {
+  if (file_ == NULL) return;
+  fclose(file_);
+  file_ = NULL;
+  if (unlink(path_.c_str()) != 0) {
+    LOG(WARNING) << "Could not delete spill file " << path_ << ": " << strerror(errno);
+  }
+}
+
+}
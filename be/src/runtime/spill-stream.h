@@ -0,0 +1,76 @@
+// Copyright (c) 2012 Cloudera, Inc. All rights reserved.
+
+#ifndef IMPALA_RUNTIME_SPILL_STREAM_H
+#define IMPALA_RUNTIME_SPILL_STREAM_H
+
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <boost/cstdint.hpp>
+
+#include "common/status.h"
+#include "runtime/descriptors.h"
+
+namespace impala {
+
+class RowBatch;
+
+// A SpillStream is an append-only sequence of row batches backed by a file in one
+// of the local scratch directories (--scratch_dirs).  It is used by exec nodes that
+// need to move intermediate results out of memory (e.g. the sort runs of SortNode).
+// Batches are written in the same serialized form that is sent over the network
+// (TRowBatch), prefixed with their length.  After all batches have been added,
+// the stream is rewound with PrepareForRead() and the batches are returned in the
+// order in which they were added.
+// The backing file is unlinked when the stream is closed or destroyed.
+// This class is not thread-safe.
+class SpillStream {
+ public:
+  SpillStream(const RowDescriptor& row_desc);
+
+  // Closes the stream and deletes the backing file.
+  ~SpillStream();
+
+  // Creates the backing file.  Must be called before any other function.
+  Status Init();
+
+  // Appends the committed rows in 'batch' to the stream.  'batch' is not modified,
+  // regardless of whether it is self-contained.
+  Status AddBatch(RowBatch* batch);
+
+  // Finishes writing and rewinds the stream to the first batch.
+  Status PrepareForRead();
+
+  // Returns the next batch in the stream in *batch or NULL if the end of the stream
+  // has been reached.  The returned batch is self-contained and owned by the caller.
+  Status GetNext(RowBatch** batch);
+
+  // Closes and deletes the backing file.  Idempotent.
+  void Close();
+
+  const std::string& path() const { return path_; }
+  int64_t num_rows() const { return num_rows_; }
+  int64_t bytes_written() const { return bytes_written_; }
+  int num_batches() const { return num_batches_; }
+
+ private:
+  // Returns the next scratch directory to place a spill file in.  Directories from
+  // --scratch_dirs are used round robin across all streams in the process.
+  static std::string GetScratchDir();
+
+  RowDescriptor row_desc_;
+  std::string path_;
+  FILE* file_;
+
+  int64_t num_rows_;
+  int64_t bytes_written_;
+  int num_batches_;
+  int num_batches_read_;
+
+  // Reused buffer for deserializing a single batch.
+  std::vector<uint8_t> read_buffer_;
+};
+
+}
+
+#endif
@@ -0,0 +1,90 @@
+// Copyright (c) 2012 Cloudera, Inc. All rights reserved.
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+#include <gtest/gtest.h>
+#include <boost/bind.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+
+#include "runtime/thread-pool.h"
+
+using namespace boost;
+using namespace std;
+
+namespace impala {
+
+class ThreadPoolTest : public testing::Test {
+ protected:
+  ThreadPoolTest() : num_running_(0), max_running_(0), num_done_(0) { }
+
+  void Work(int idx) {
+    {
+      unique_lock<mutex> l(lock_);
+      ++num_running_;
+      max_running_ = max(max_running_, num_running_);
+    }
+    // Run something to keep this cpu a little busy
+    double result = 0;
+    for (int i = 0; i < 1000; ++i) {
+      for (int j = 0; j < 200; ++j) {
+        result += sin(i) + cos(j);
+      }
+    }
+    unique_lock<mutex> l(lock_);
+    EXPECT_FALSE(done_[idx]);
+    done_[idx] = true;
+    --num_running_;
+    ++num_done_;
+    done_cv_.notify_all();
+  }
+
+  mutex lock_;
+  condition_variable done_cv_;
+  vector<bool> done_;
+  int num_running_;
+  int max_running_;
+  int num_done_;
+};
+
+// All work items are run once, by no more threads than the pool has.
+TEST_F(ThreadPoolTest, Basic) {
+  const int num_work_items = 100;
+  const int num_threads = 4;
+  done_.resize(num_work_items);
+  ThreadPool pool(num_threads);
+  EXPECT_EQ(pool.num_threads(), num_threads);
+  for (int i = 0; i < num_work_items; ++i) {
+    pool.Offer(bind(&ThreadPoolTest::Work, this, i));
+  }
+  {
+    unique_lock<mutex> l(lock_);
+    while (num_done_ < num_work_items) done_cv_.wait(l);
+  }
+  for (int i = 0; i < num_work_items; ++i) {
+    EXPECT_TRUE(done_[i]);
+  }
+  EXPECT_GT(max_running_, 0);
+  EXPECT_LE(max_running_, num_threads);
+}
+
+// Destroying the pool runs the work that is still queued.
+TEST_F(ThreadPoolTest, Shutdown) {
+  const int num_work_items = 20;
+  done_.resize(num_work_items);
+  {
+    ThreadPool pool(1);
+    for (int i = 0; i < num_work_items; ++i) {
+      pool.Offer(bind(&ThreadPoolTest::Work, this, i));
+    }
+  }
+  EXPECT_EQ(num_done_, num_work_items);
+}
+
+}
+
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
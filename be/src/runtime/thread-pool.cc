@@ -0,0 +1,51 @@
+// Copyright (c) 2012 Cloudera, Inc. All rights reserved.
+
+#include "runtime/thread-pool.h"
+
+#include "common/logging.h"
+
+using namespace boost;
+using namespace impala;
+using namespace std;
+
+ThreadPool::ThreadPool(int num_threads)
+  : num_threads_(num_threads),
+    shutdown_(false) {
+  DCHECK_GT(num_threads, 0);
+  for (int i = 0; i < num_threads; ++i) {
+    threads_.add_thread(new thread(&ThreadPool::WorkerThread, this));
+  }
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    unique_lock<mutex> l(lock_);
+    shutdown_ = true;
+  }
+  work_available_cv_.notify_all();
+  threads_.join_all();
+  DCHECK(queue_.empty());
+}
+
+void ThreadPool::Offer(const WorkFunction& work) {
+  {
+    unique_lock<mutex> l(lock_);
+    DCHECK(!shutdown_);
+    queue_.push_back(work);
+  }
+  work_available_cv_.notify_one();
+}
+
+void ThreadPool::WorkerThread() {
+  while (true) {
+    WorkFunction work;
+    {
+      unique_lock<mutex> l(lock_);
+      while (queue_.empty() && !shutdown_) work_available_cv_.wait(l);
+      if (queue_.empty()) return;
+      work = queue_.front();
+      queue_.pop_front();
+    }
+    work();
+  }
+}
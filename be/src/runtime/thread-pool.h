@@ -0,0 +1,55 @@
+// Copyright (c) 2012 Cloudera, Inc. All rights reserved.
+
+#ifndef IMPALA_RUNTIME_THREAD_POOL_H
+#define IMPALA_RUNTIME_THREAD_POOL_H
+
+#include <deque>
+#include <boost/function.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+
+namespace impala {
+
+// Fixed number of worker threads that run work items in the order they were offered.
+// Unlike ParallelExecutor, the threads are started once and shared by all callers,
+// so the number of threads doing work for the pool is bounded no matter how many
+// callers offer work.  Callers that need to wait for their work items have to
+// synchronize with them themselves.  Thread safe.
+class ThreadPool {
+ public:
+  typedef boost::function<void ()> WorkFunction;
+
+  // Starts 'num_threads' worker threads.
+  ThreadPool(int num_threads);
+
+  // Runs the work that is still queued and joins the worker threads.
+  ~ThreadPool();
+
+  // Queues 'work' to be run by one of the worker threads.  'work' must not block on
+  // other work items of the pool.
+  void Offer(const WorkFunction& work);
+
+  int num_threads() const { return num_threads_; }
+
+ private:
+  // Runs queued work items until the pool is shut down and the queue is empty.
+  void WorkerThread();
+
+  const int num_threads_;
+
+  // Protects queue_ and shutdown_.
+  boost::mutex lock_;
+
+  // Signalled when work is queued or the pool is shut down.
+  boost::condition_variable work_available_cv_;
+
+  std::deque<WorkFunction> queue_;
+  bool shutdown_;
+
+  boost::thread_group threads_;
+};
+
+}
+
+#endif
@@ -56,6 +56,16 @@ class Tuple {
   void DeepCopy(Tuple* dst, const TupleDescriptor& desc, MemPool* pool,
                 bool convert_ptrs = false);
 
+  // Create a copy of 'this', including all its referenced string data, at *data,
+  // which must have room for TotalByteSize() bytes.  *data and *offset are advanced
+  // past the copy.  If 'convert_ptrs' is true, converts pointers that are part of the
+  // tuple into offsets relative to the start of the buffer that *offset counts from.
+  void DeepCopy(const TupleDescriptor& desc, char** data, int* offset,
+                bool convert_ptrs = false);
+
+  // Returns the size of the tuple plus the size of its referenced string data.
+  int TotalByteSize(const TupleDescriptor& desc);
+
   // Turn null indicator bit on.
   void SetNull(const NullIndicatorOffset& offset) {
     DCHECK(offset.bit_mask != 0);
@@ -478,6 +478,11 @@ class ImpalaServer::FragmentExecState {
   // Main loop of plan fragment execution. Blocks until execution finishes.
   void Exec();
 
+  // Applies a runtime filter sent by the coordinator to this fragment's scans.
+  void PublishFilter(const TRuntimeFilter& filter) {
+    executor_.PublishRuntimeFilter(filter);
+  }
+
   const TUniqueId& query_id() const { return query_id_; }
   const TUniqueId& fragment_instance_id() const { return fragment_instance_id_; }
 
@@ -512,6 +517,10 @@ class ImpalaServer::FragmentExecState {
   // Update exec_status_ w/ status, if the former isn't already an error.
   // Returns current exec_status_.
   Status UpdateStatus(const Status& status);
+
+  // Callback for the runtime state; sends a runtime filter computed by this fragment
+  // to the coordinator.
+  void UpdateFilterCb(const TRuntimeFilter& filter);
 };
 
 Status ImpalaServer::FragmentExecState::UpdateStatus(const Status& status) {
@@ -531,6 +540,8 @@ Status ImpalaServer::FragmentExecState::Prepare(
     const TExecPlanFragmentParams& exec_params) {
   exec_params_ = exec_params;
   RETURN_IF_ERROR(executor_.Prepare(exec_params));
+  executor_.runtime_state()->set_runtime_filter_cb(
+      bind<void>(mem_fn(&ImpalaServer::FragmentExecState::UpdateFilterCb), this, _1));
   return Status::OK;
 }
 
@@ -609,6 +620,30 @@ void ImpalaServer::FragmentExecState::ReportStatusCb(
   }
 }
 
+// Runtime filters are an optimization, so failures to send them are only logged.
+void ImpalaServer::FragmentExecState::UpdateFilterCb(const TRuntimeFilter& filter) {
+  ImpalaInternalServiceClient* coord;
+  if (!client_cache_->GetClient(coord_hostport_, &coord).ok()) {
+    VLOG_QUERY << "UpdateFilter(): couldn't get a client for " << coord_hostport_.first
+               << ":" << coord_hostport_.second;
+    return;
+  }
+  DCHECK(coord != NULL);
+
+  TUpdateFilterParams params;
+  params.protocol_version = ImpalaInternalServiceVersion::V1;
+  params.__set_query_id(query_id_);
+  params.__set_filter(filter);
+  TUpdateFilterResult res;
+  try {
+    coord->UpdateFilter(res, params);
+  } catch (TException& e) {
+    VLOG_QUERY << "UpdateFilter() to " << coord_hostport_.first << ":"
+               << coord_hostport_.second << " failed:\n" << e.what();
+  }
+  client_cache_->ReleaseClient(coord);
+}
+
 const char* ImpalaServer::SQLSTATE_SYNTAX_ERROR_OR_ACCESS_VIOLATION = "42000";
 const char* ImpalaServer::SQLSTATE_GENERAL_ERROR = "HY000";
 const char* ImpalaServer::SQLSTATE_OPTIONAL_FEATURE_NOT_IMPLEMENTED = "HYC00";
@@ -1512,6 +1547,13 @@ void ImpalaServer::QueryToTClientRequest(const Query& query,
             request->queryOptions.allow_unsupported_formats =
                 iequals(key_value[1], "true") || iequals(key_value[1], "1");
             break;
+          case TImpalaQueryOptions::MEM_LIMIT:
+            request->queryOptions.mem_limit = atol(key_value[1].c_str());
+            break;
+          case TImpalaQueryOptions::PARTITION_JOIN:
+            request->queryOptions.partition_join =
+                iequals(key_value[1], "true") || iequals(key_value[1], "1");
+            break;
           default:
             // We hit this DCHECK(false) if we forgot to add the corresponding entry here
             // when we add a new query option.
@@ -1636,11 +1678,13 @@ void ImpalaServer::TransmitData(
            << " node_id=" << params.dest_node_id
            << " #rows=" << params.row_batch.num_rows
            << " eos=" << (params.eos ? "true" : "false");
-  // TODO: fix Thrift so we can simply take ownership of thrift_batch instead
-  // of having to copy its data
   if (params.row_batch.num_rows > 0) {
+    // The stream takes over the batch's tuple data instead of copying it.  params is
+    // owned by the Thrift processor, which discards it after this call.
+    TRowBatch* row_batch = const_cast<TRowBatch*>(&params.row_batch);
     Status status = exec_env_->stream_mgr()->AddData(
-        params.dest_fragment_instance_id, params.dest_node_id, params.row_batch);
+        params.dest_fragment_instance_id, params.dest_node_id,
+        params.src_fragment_instance_id, row_batch);
     status.SetTStatus(&return_val);
     if (!status.ok()) {
       // should we close the channel here as well?
@@ -1654,6 +1698,39 @@ void ImpalaServer::TransmitData(
   }
 }
 
+void ImpalaServer::UpdateFilter(
+    TUpdateFilterResult& return_val, const TUpdateFilterParams& params) {
+  VLOG_QUERY << "UpdateFilter(): query_id=" << params.query_id
+             << " src_node=" << params.filter.src_node_id;
+  shared_ptr<QueryExecState> exec_state = GetQueryExecState(params.query_id, false);
+  if (exec_state.get() == NULL) {
+    // the query may have finished already
+    stringstream str;
+    str << "unknown query id: " << params.query_id;
+    Status(TStatusCode::INTERNAL_ERROR, str.str()).SetTStatus(&return_val);
+    return;
+  }
+  if (exec_state->coord() != NULL) exec_state->coord()->UpdateFilter(params.filter);
+  Status::OK.SetTStatus(&return_val);
+}
+
+void ImpalaServer::PublishFilter(
+    TPublishFilterResult& return_val, const TPublishFilterParams& params) {
+  VLOG_QUERY << "PublishFilter(): instance_id=" << params.dst_fragment_instance_id
+             << " src_node=" << params.filter.src_node_id;
+  shared_ptr<FragmentExecState> exec_state =
+      GetFragmentExecState(params.dst_fragment_instance_id);
+  if (exec_state.get() == NULL) {
+    // the fragment may have finished already
+    stringstream str;
+    str << "unknown fragment id: " << params.dst_fragment_instance_id;
+    Status(TStatusCode::INTERNAL_ERROR, str.str()).SetTStatus(&return_val);
+    return;
+  }
+  exec_state->PublishFilter(params.filter);
+  Status::OK.SetTStatus(&return_val);
+}
+
 Status ImpalaServer::StartPlanFragmentExecution(
     const TExecPlanFragmentParams& exec_params) {
   if (!exec_params.fragment.__isset.output_sink) {
@@ -1751,6 +1828,12 @@ void ImpalaServer::InitializeConfigVariables() {
       case TImpalaQueryOptions::ALLOW_UNSUPPORTED_FORMATS:
         value << default_options.allow_unsupported_formats;
         break;
+      case TImpalaQueryOptions::MEM_LIMIT:
+        value << default_options.mem_limit;
+        break;
+      case TImpalaQueryOptions::PARTITION_JOIN:
+        value << default_options.partition_join;
+        break;
       default:
         // We hit this DCHECK(false) if we forgot to add the corresponding entry here
         // when we add a new query option.
@@ -108,6 +108,10 @@ class ImpalaServer : public ImpalaServiceIf, public ImpalaInternalServiceIf,
       TCancelPlanFragmentResult& return_val, const TCancelPlanFragmentParams& params);
   virtual void TransmitData(
       TTransmitDataResult& return_val, const TTransmitDataParams& params);
+  virtual void UpdateFilter(
+      TUpdateFilterResult& return_val, const TUpdateFilterParams& params);
+  virtual void PublishFilter(
+      TPublishFilterResult& return_val, const TPublishFilterParams& params);
 
   // Returns the ImpalaQueryOptions enum for the given "key". Input is case in-sensitive.
   // Return -1 if the input is an invalid option.
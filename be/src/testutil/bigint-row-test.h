@@ -0,0 +1,71 @@
+// Copyright (c) 2012 Cloudera, Inc. All rights reserved.
+
+#ifndef IMPALA_TESTUTIL_BIGINT_ROW_TEST_H
+#define IMPALA_TESTUTIL_BIGINT_ROW_TEST_H
+
+#include <vector>
+#include <gtest/gtest.h>
+
+#include "common/object-pool.h"
+#include "runtime/descriptors.h"
+#include "runtime/row-batch.h"
+#include "runtime/tuple-row.h"
+#include "gen-cpp/Descriptors_types.h"
+
+namespace impala {
+
+// Test fixture for tests of row batch handling that only need rows with a single,
+// non-nullable bigint slot.
+class BigIntRowTest : public testing::Test {
+ protected:
+  virtual void SetUp() {
+    TTupleDescriptor tuple_desc;
+    tuple_desc.__set_id(0);
+    tuple_desc.__set_byteSize(8);
+    tuple_desc.__set_numNullBytes(0);
+    TDescriptorTable thrift_desc_tbl;
+    thrift_desc_tbl.tupleDescriptors.push_back(tuple_desc);
+    TSlotDescriptor slot_desc;
+    slot_desc.__set_id(0);
+    slot_desc.__set_parent(0);
+    slot_desc.__set_slotType(TPrimitiveType::BIGINT);
+    slot_desc.__set_columnPos(0);
+    slot_desc.__set_byteOffset(0);
+    slot_desc.__set_nullIndicatorByte(-1);
+    slot_desc.__set_nullIndicatorBit(-1);
+    slot_desc.__set_slotIdx(0);
+    slot_desc.__set_isMaterialized(true);
+    thrift_desc_tbl.slotDescriptors.push_back(slot_desc);
+    EXPECT_TRUE(DescriptorTbl::Create(&obj_pool_, thrift_desc_tbl, &desc_tbl_).ok());
+
+    std::vector<TTupleId> row_tids;
+    row_tids.push_back(0);
+    std::vector<bool> nullable_tuples;
+    nullable_tuples.push_back(false);
+    row_desc_ = obj_pool_.Add(new RowDescriptor(*desc_tbl_, row_tids, nullable_tuples));
+  }
+
+  // Adds 'num_rows' rows with the values starting at 'start_val' to 'batch'.
+  static void AddRows(RowBatch* batch, int num_rows, int64_t start_val) {
+    int64_t* tuple_mem = reinterpret_cast<int64_t*>(
+        batch->tuple_data_pool()->Allocate(num_rows * 8));
+    for (int i = 0; i < num_rows; ++i) {
+      tuple_mem[i] = start_val + i;
+      int idx = batch->AddRow();
+      batch->GetRow(idx)->SetTuple(0, reinterpret_cast<Tuple*>(&tuple_mem[i]));
+      batch->CommitLastRow();
+    }
+  }
+
+  static int64_t GetValue(TupleRow* row) {
+    return *reinterpret_cast<int64_t*>(row->GetTuple(0)->GetSlot(0));
+  }
+
+  ObjectPool obj_pool_;
+  DescriptorTbl* desc_tbl_;
+  const RowDescriptor* row_desc_;
+};
+
+}
+
+#endif
@@ -0,0 +1,91 @@
+// Copyright (c) 2012 Cloudera, Inc. All rights reserved.
+
+#include "util/aio-context.h"
+
+#include <errno.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/aio_abi.h>
+#include <sstream>
+
+#include "common/logging.h"
+
+using namespace impala;
+using namespace std;
+
+AioContext::AioContext(int max_outstanding)
+  : max_outstanding_(max_outstanding),
+    context_(0) {
+  DCHECK_GT(max_outstanding_, 0);
+}
+
+AioContext::~AioContext() {
+  if (context_ != 0) syscall(__NR_io_destroy, static_cast<aio_context_t>(context_));
+}
+
+Status AioContext::Init() {
+  DCHECK_EQ(context_, 0);
+  aio_context_t context = 0;
+  if (syscall(__NR_io_setup, max_outstanding_, &context) != 0) {
+    stringstream ss;
+    ss << "Could not create async io context with " << max_outstanding_
+       << " events: " << strerror(errno);
+    return Status(ss.str());
+  }
+  context_ = context;
+  return Status::OK;
+}
+
+Status AioContext::SubmitRead(int fd, char* buffer, int64_t len, int64_t offset,
+    void* cookie) {
+  DCHECK_NE(context_, 0);
+  // The kernel copies the control block during io_submit() so it does not need to
+  // outlive this call.
+  iocb cb;
+  memset(&cb, 0, sizeof(cb));
+  cb.aio_data = reinterpret_cast<uint64_t>(cookie);
+  cb.aio_lio_opcode = IOCB_CMD_PREAD;
+  cb.aio_fildes = fd;
+  cb.aio_buf = reinterpret_cast<uint64_t>(buffer);
+  cb.aio_nbytes = len;
+  cb.aio_offset = offset;
+  iocb* cbs[1] = { &cb };
+
+  int ret;
+  do {
+    ret = syscall(__NR_io_submit, static_cast<aio_context_t>(context_), 1, cbs);
+  } while (ret < 0 && errno == EINTR);
+  if (ret != 1) {
+    stringstream ss;
+    ss << "Could not submit async read of " << len << " bytes at offset " << offset
+       << ": " << (ret < 0 ? strerror(errno) : "no reads submitted");
+    return Status(ss.str());
+  }
+  return Status::OK;
+}
+
+Status AioContext::GetCompletions(int timeout_ms, vector<Completion>* completions) {
+  DCHECK_NE(context_, 0);
+  vector<io_event> events(max_outstanding_);
+  timespec timeout;
+  timeout.tv_sec = timeout_ms / 1000;
+  timeout.tv_nsec = (timeout_ms % 1000) * 1000L * 1000L;
+
+  int ret = syscall(__NR_io_getevents, static_cast<aio_context_t>(context_), 1,
+      max_outstanding_, &events[0], &timeout);
+  if (ret < 0) {
+    if (errno == EINTR) return Status::OK;
+    stringstream ss;
+    ss << "Could not get async io completions: " << strerror(errno);
+    return Status(ss.str());
+  }
+  for (int i = 0; i < ret; ++i) {
+    Completion completion;
+    completion.cookie = reinterpret_cast<void*>(events[i].data);
+    completion.result = events[i].res;
+    completions->push_back(completion);
+  }
+  return Status::OK;
+}
@@ -0,0 +1,59 @@
+// Copyright (c) 2012 Cloudera, Inc. All rights reserved.
+
+#ifndef IMPALA_UTIL_AIO_CONTEXT_H
+#define IMPALA_UTIL_AIO_CONTEXT_H
+
+#include <vector>
+#include <boost/cstdint.hpp>
+
+#include "common/status.h"
+
+namespace impala {
+
+// Wrapper around the linux native async io interface (io_setup/io_submit/
+// io_getevents).  The syscalls are issued directly so there is no dependency on
+// libaio.  Reads submitted to a context are serviced by the kernel without a thread
+// blocked per read and a single thread can reap the completions for all of them.
+// The kernel only services reads asynchronously for files opened with O_DIRECT; for
+// buffered files, io_submit() does the read before returning.
+// SubmitRead() and GetCompletions() can be called concurrently from different threads.
+class AioContext {
+ public:
+  struct Completion {
+    // The cookie passed to SubmitRead() for this read.
+    void* cookie;
+
+    // Number of bytes read or, if negative, -errno for the failed read.
+    int64_t result;
+  };
+
+  // max_outstanding: maximum number of reads that can be in flight at once.  The
+  // caller must not submit more than this.
+  AioContext(int max_outstanding);
+
+  ~AioContext();
+
+  // Creates the kernel context.  Must be called before any other function.
+  Status Init();
+
+  // Submits a read of 'len' bytes at 'offset' in 'fd' into 'buffer'.  For fds opened
+  // with O_DIRECT, 'buffer', 'len' and 'offset' must be aligned to the logical block
+  // size of the device.  This call is non-blocking for O_DIRECT fds.
+  Status SubmitRead(int fd, char* buffer, int64_t len, int64_t offset, void* cookie);
+
+  // Waits up to timeout_ms for at least one submitted read to complete.  Completed
+  // reads are appended to 'completions'.  Returns OK (with no completions) on timeout.
+  Status GetCompletions(int timeout_ms, std::vector<Completion>* completions);
+
+  int max_outstanding() const { return max_outstanding_; }
+
+ private:
+  int max_outstanding_;
+
+  // Kernel context handle (aio_context_t).  0 if not initialized.
+  unsigned long context_;
+};
+
+}
+
+#endif
@@ -0,0 +1,81 @@
+// Copyright (c) 2012 Cloudera, Inc. All rights reserved.
+
+#include <gtest/gtest.h>
+
+#include "util/bloom-filter.h"
+#include "util/hash-util.h"
+
+using namespace std;
+
+namespace impala {
+
+static uint32_t Hash(int i) {
+  return HashUtil::FvnHash(&i, sizeof(i), HashUtil::FVN_SEED);
+}
+
+TEST(BloomFilterTest, Size) {
+  EXPECT_EQ(BloomFilter(1).num_bits(), 64);
+  EXPECT_EQ(BloomFilter(64).num_bits(), 64);
+  EXPECT_EQ(BloomFilter(65).num_bits(), 128);
+  EXPECT_EQ(BloomFilter(1000).num_bits(), 1024);
+}
+
+TEST(BloomFilterTest, NoFalseNegatives) {
+  BloomFilter filter(1 << 16);
+  for (int i = 0; i < 1000; ++i) {
+    filter.Insert(Hash(i));
+  }
+  for (int i = 0; i < 1000; ++i) {
+    EXPECT_TRUE(filter.Find(Hash(i)));
+  }
+  // With 64 bits per value, the false positive rate is tiny.
+  int false_positives = 0;
+  for (int i = 1000; i < 11000; ++i) {
+    if (filter.Find(Hash(i))) ++false_positives;
+  }
+  EXPECT_LT(false_positives, 10);
+}
+
+TEST(BloomFilterTest, Fold) {
+  BloomFilter big(1 << 16);
+  BloomFilter small(1 << 12);
+  for (int i = 0; i < 500; ++i) {
+    big.Insert(Hash(i));
+    small.Insert(Hash(i));
+  }
+  big.Fold(1 << 12);
+  EXPECT_EQ(big.num_bits(), 1 << 12);
+  // Folding yields exactly the filter built at the smaller size.
+  EXPECT_EQ(big.bits(), small.bits());
+  for (int i = 0; i < 500; ++i) {
+    EXPECT_TRUE(big.Find(Hash(i)));
+  }
+  // Never folds below the minimum size.
+  big.Fold(1);
+  EXPECT_EQ(big.num_bits(), 64);
+  for (int i = 0; i < 500; ++i) {
+    EXPECT_TRUE(big.Find(Hash(i)));
+  }
+}
+
+TEST(BloomFilterTest, OrAndSerialize) {
+  BloomFilter f1(1024);
+  BloomFilter f2(1024);
+  for (int i = 0; i < 50; ++i) {
+    f1.Insert(Hash(i));
+    f2.Insert(Hash(i + 50));
+  }
+  BloomFilter copy(f1.bits());
+  EXPECT_EQ(copy.num_bits(), 1024);
+  copy.Or(f2);
+  for (int i = 0; i < 100; ++i) {
+    EXPECT_TRUE(copy.Find(Hash(i)));
+  }
+}
+
+}
+
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
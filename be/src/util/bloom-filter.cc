@@ -0,0 +1,53 @@
+// Copyright (c) 2012 Cloudera, Inc. All rights reserved.
+
+#include "util/bloom-filter.h"
+
+#include <string.h>
+
+using namespace std;
+
+namespace impala {
+
+static const int64_t MIN_NUM_BITS = 64;
+static const int64_t MAX_NUM_BITS = 1LL << 32;
+
+BloomFilter::BloomFilter(int64_t num_bits) {
+  int64_t size = MIN_NUM_BITS;
+  while (size < num_bits && size < MAX_NUM_BITS) size *= 2;
+  bits_.resize(size / 64, 0);
+  bit_mask_ = size - 1;
+}
+
+BloomFilter::BloomFilter(const string& bits) {
+  DCHECK_EQ(bits.size() % sizeof(uint64_t), 0);
+  int64_t num_words = bits.size() / sizeof(uint64_t);
+  DCHECK_GT(num_words, 0);
+  DCHECK_EQ(num_words & (num_words - 1), 0) << "size must be a power of two";
+  bits_.resize(num_words);
+  memcpy(&bits_[0], bits.data(), bits.size());
+  bit_mask_ = num_words * 64 - 1;
+}
+
+void BloomFilter::Or(const BloomFilter& other) {
+  DCHECK_EQ(bits_.size(), other.bits_.size());
+  for (int i = 0; i < bits_.size(); ++i) {
+    bits_[i] |= other.bits_[i];
+  }
+}
+
+void BloomFilter::Fold(int64_t num_bits) {
+  while (this->num_bits() > num_bits && this->num_bits() > MIN_NUM_BITS) {
+    int half = bits_.size() / 2;
+    for (int i = 0; i < half; ++i) {
+      bits_[i] |= bits_[i + half];
+    }
+    bits_.resize(half);
+    bit_mask_ >>= 1;
+  }
+}
+
+string BloomFilter::bits() const {
+  return string(reinterpret_cast<const char*>(&bits_[0]), bits_.size() * sizeof(uint64_t));
+}
+
+}
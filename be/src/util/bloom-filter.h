@@ -0,0 +1,82 @@
+// Copyright (c) 2012 Cloudera, Inc. All rights reserved.
+
+#ifndef IMPALA_UTIL_BLOOM_FILTER_H
+#define IMPALA_UTIL_BLOOM_FILTER_H
+
+#include <string>
+#include <vector>
+#include <boost/cstdint.hpp>
+
+#include "common/logging.h"
+
+namespace impala {
+
+// A Bloom filter over 32-bit hash values.  The caller hashes the values; the filter
+// derives NUM_HASH_FUNCTIONS bit positions from each hash by double hashing, with
+// the second hash obtained by rotating the first.
+// The number of bits is always a power of two, which makes it cheap to map a hash to
+// a bit and allows the filter to be shrunk after it has been populated (Fold()):
+// this lets callers build the filter at a generous size before they know how many
+// values it will hold and then trim it before shipping it to other nodes.
+// Not thread-safe.
+class BloomFilter {
+ public:
+  static const int NUM_HASH_FUNCTIONS = 3;
+
+  // Creates an empty filter with at least 'num_bits' bits (rounded up to a power of
+  // two, minimum 64).
+  BloomFilter(int64_t num_bits);
+
+  // Creates a filter from the serialized bits produced by bits().  The size of
+  // 'bits' must be a power of two.
+  BloomFilter(const std::string& bits);
+
+  // Adds a value with hash 'hash' to the filter.
+  void Insert(uint32_t hash) {
+    uint32_t h1 = hash;
+    uint32_t h2 = (hash >> 17) | (hash << 15);
+    for (int i = 0; i < NUM_HASH_FUNCTIONS; ++i) {
+      uint32_t bit = h1 & bit_mask_;
+      bits_[bit >> 6] |= (1ULL << (bit & 63));
+      h1 += h2;
+    }
+  }
+
+  // Returns false if no value with hash 'hash' was inserted.  May return true even if
+  // no such value was inserted.
+  bool Find(uint32_t hash) const {
+    uint32_t h1 = hash;
+    uint32_t h2 = (hash >> 17) | (hash << 15);
+    for (int i = 0; i < NUM_HASH_FUNCTIONS; ++i) {
+      uint32_t bit = h1 & bit_mask_;
+      if ((bits_[bit >> 6] & (1ULL << (bit & 63))) == 0) return false;
+      h1 += h2;
+    }
+    return true;
+  }
+
+  // Adds all values of 'other' to this filter.  Both filters must be the same size.
+  void Or(const BloomFilter& other);
+
+  // Halves the size of the filter until it has at most 'num_bits' bits (but at least
+  // 64).  Folding ORs the upper half of the bit array into the lower half, which is
+  // exactly the filter that would have resulted from inserting the same hashes into a
+  // filter of half the size.
+  void Fold(int64_t num_bits);
+
+  int64_t num_bits() const { return bits_.size() * 64; }
+
+  // Returns the serialized bits of the filter.
+  std::string bits() const;
+
+ private:
+  // The bit array, in 64-bit words.
+  std::vector<uint64_t> bits_;
+
+  // num_bits() - 1
+  uint32_t bit_mask_;
+};
+
+}
+
+#endif
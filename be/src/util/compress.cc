@@ -182,9 +182,12 @@ Status SnappyCompressor::ProcessBlock(int input_length, uint8_t* input,
   if (*output_length != 0) {
     buffer_length_ = *output_length;
     out_buffer_ = *output;
-  } else if (!reuse_buffer_ || out_buffer_ == NULL || buffer_length_ < length) {
-    buffer_length_ = length;
-    out_buffer_ = memory_pool_->Allocate(buffer_length_);
+  } else {
+    if (!reuse_buffer_ || out_buffer_ == NULL || buffer_length_ < length) {
+      buffer_length_ = length;
+      out_buffer_ = memory_pool_->Allocate(buffer_length_);
+    }
+    // also needed if we reuse the previous buffer
     *output = out_buffer_;
   }
 
@@ -65,6 +65,44 @@ class HashUtil {
     return hash;
   }
 
+  static const uint64_t MURMUR_PRIME = 0xc6a4a7935bd1e995ULL;
+  static const int MURMUR_R = 47;
+
+  // 64-bit MurmurHash2 (MurmurHash64A by Austin Appleby).  Used where 32 bits of hash
+  // are not enough, e.g. for distinct value estimation over billions of values.
+  static uint64_t MurmurHash2_64(const void* input, int len, uint64_t seed) {
+    uint64_t h = seed ^ (len * MURMUR_PRIME);
+
+    const uint64_t* data = reinterpret_cast<const uint64_t*>(input);
+    const uint64_t* end = data + (len / sizeof(uint64_t));
+    while (data != end) {
+      uint64_t k = *data++;
+      k *= MURMUR_PRIME;
+      k ^= k >> MURMUR_R;
+      k *= MURMUR_PRIME;
+      h ^= k;
+      h *= MURMUR_PRIME;
+    }
+
+    const uint8_t* data2 = reinterpret_cast<const uint8_t*>(data);
+    switch (len & 7) {
+      case 7: h ^= uint64_t(data2[6]) << 48;
+      case 6: h ^= uint64_t(data2[5]) << 40;
+      case 5: h ^= uint64_t(data2[4]) << 32;
+      case 4: h ^= uint64_t(data2[3]) << 24;
+      case 3: h ^= uint64_t(data2[2]) << 16;
+      case 2: h ^= uint64_t(data2[1]) << 8;
+      case 1:
+        h ^= uint64_t(data2[0]);
+        h *= MURMUR_PRIME;
+    }
+
+    h ^= h >> MURMUR_R;
+    h *= MURMUR_PRIME;
+    h ^= h >> MURMUR_R;
+    return h;
+  }
+
   // Computes the hash value for data.  Will call either CrcHash or FvnHash
   // depending on hardware capabilities.
   static uint32_t Hash(const void* data, int32_t bytes, uint32_t hash) {
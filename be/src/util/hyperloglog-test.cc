@@ -0,0 +1,112 @@
+// Copyright (c) 2012 Cloudera, Inc. All rights reserved.
+
+#include <math.h>
+#include <vector>
+#include <gtest/gtest.h>
+
+#include "util/hash-util.h"
+#include "util/hyperloglog.h"
+
+using namespace std;
+
+namespace impala {
+
+static uint64_t Hash(int64_t i) {
+  return HashUtil::MurmurHash2_64(&i, sizeof(i), 0);
+}
+
+// Wraps a state buffer of the maximum size.
+struct Hll {
+  vector<uint8_t> state;
+  int len;
+
+  Hll() : state(HyperLogLog::DENSE_SIZE) {
+    len = HyperLogLog::Init(&state[0]);
+  }
+
+  void Insert(int64_t i) {
+    int max_len = HyperLogLog::MaxSizeAfterInsert(&state[0], len);
+    len = HyperLogLog::Insert(&state[0], len, Hash(i));
+    EXPECT_LE(len, max_len);
+  }
+
+  void Merge(const Hll& src) {
+    int max_len = HyperLogLog::MaxSizeAfterMerge(&state[0], len, &src.state[0], src.len);
+    len = HyperLogLog::Merge(&state[0], len, &src.state[0], src.len);
+    EXPECT_LE(len, max_len);
+  }
+
+  int64_t Estimate() const { return HyperLogLog::Estimate(&state[0], len); }
+};
+
+TEST(HyperLogLogTest, Empty) {
+  Hll hll;
+  EXPECT_EQ(hll.len, HyperLogLog::EMPTY_SIZE);
+  EXPECT_EQ(hll.Estimate(), 0);
+}
+
+TEST(HyperLogLogTest, SmallCardinalities) {
+  Hll hll;
+  for (int i = 0; i < 100; ++i) {
+    // Duplicates don't change the estimate.
+    hll.Insert(i);
+    hll.Insert(i);
+  }
+  // Few values are stored sparsely and counted almost exactly.
+  EXPECT_LT(hll.len, HyperLogLog::DENSE_SIZE);
+  EXPECT_NEAR(hll.Estimate(), 100, 2);
+}
+
+TEST(HyperLogLogTest, Accuracy) {
+  int64_t num_values[] = { 1000, 10000, 100000, 1000000 };
+  for (int i = 0; i < sizeof(num_values) / sizeof(int64_t); ++i) {
+    Hll hll;
+    for (int64_t j = 0; j < num_values[i]; ++j) {
+      hll.Insert(j);
+    }
+    EXPECT_EQ(hll.len, HyperLogLog::DENSE_SIZE);
+    // Within 3 standard errors.
+    double error = fabs(hll.Estimate() - num_values[i]) / num_values[i];
+    EXPECT_LT(error, 3 * 1.04 / sqrt(HyperLogLog::NUM_REGISTERS)) << num_values[i];
+  }
+}
+
+TEST(HyperLogLogTest, ConversionToDense) {
+  Hll hll;
+  int64_t last_estimate = 0;
+  for (int i = 0; hll.len < HyperLogLog::DENSE_SIZE; ++i) {
+    last_estimate = hll.Estimate();
+    hll.Insert(i);
+  }
+  // Converting doesn't change the registers; the last value adds at most one.
+  EXPECT_NEAR(hll.Estimate(), last_estimate, 1);
+}
+
+TEST(HyperLogLogTest, Merge) {
+  // Merge all combinations of sparse and dense states.
+  int sizes[] = { 10, 300, 5000 };
+  for (int i = 0; i < 3; ++i) {
+    for (int j = 0; j < 3; ++j) {
+      Hll a, b, expected;
+      // Overlapping value ranges.
+      for (int k = 0; k < sizes[i]; ++k) {
+        a.Insert(k);
+        expected.Insert(k);
+      }
+      for (int k = sizes[i] / 2; k < sizes[i] / 2 + sizes[j]; ++k) {
+        b.Insert(k);
+        expected.Insert(k);
+      }
+      a.Merge(b);
+      // The merged registers are the registers of the union.
+      EXPECT_EQ(a.Estimate(), expected.Estimate()) << sizes[i] << " " << sizes[j];
+    }
+  }
+}
+
+}
+
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,183 @@
+// Copyright (c) 2012 Cloudera, Inc. All rights reserved.
+
+#include "util/hyperloglog.h"
+
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+
+#include "common/logging.h"
+
+using namespace std;
+
+namespace impala {
+
+const int HyperLogLog::PRECISION;
+const int HyperLogLog::NUM_REGISTERS;
+const int HyperLogLog::MAX_SPARSE_ENTRIES;
+const int HyperLogLog::HEADER_SIZE;
+const int HyperLogLog::EMPTY_SIZE;
+const int HyperLogLog::DENSE_SIZE;
+
+// Returns the register index and value for 'hash'.  The index is taken from the top
+// PRECISION bits, the value is the position of the first 1 bit in the remaining bits
+// (between 1 and 64 - PRECISION + 1).
+static inline void GetRegister(uint64_t hash, uint32_t* idx, uint8_t* value) {
+  *idx = hash >> (64 - HyperLogLog::PRECISION);
+  uint64_t w = (hash << HyperLogLog::PRECISION) | (1ULL << (HyperLogLog::PRECISION - 1));
+  *value = __builtin_clzll(w) + 1;
+}
+
+static inline uint32_t* SparseEntries(uint8_t* state) {
+  return reinterpret_cast<uint32_t*>(state + HyperLogLog::HEADER_SIZE);
+}
+
+static inline const uint32_t* SparseEntries(const uint8_t* state) {
+  return reinterpret_cast<const uint32_t*>(state + HyperLogLog::HEADER_SIZE);
+}
+
+int HyperLogLog::Init(uint8_t* state) {
+  *reinterpret_cast<uint32_t*>(state) = SPARSE;
+  return EMPTY_SIZE;
+}
+
+int HyperLogLog::MaxSizeAfterInsert(const uint8_t* state, int len) {
+  if (GetFormat(state) == DENSE) return DENSE_SIZE;
+  if (NumSparseEntries(len) < MAX_SPARSE_ENTRIES) return len + sizeof(uint32_t);
+  return DENSE_SIZE;
+}
+
+int HyperLogLog::Insert(uint8_t* state, int len, uint64_t hash) {
+  uint32_t idx;
+  uint8_t value;
+  GetRegister(hash, &idx, &value);
+
+  if (GetFormat(state) == SPARSE) {
+    uint32_t* entries = SparseEntries(state);
+    int num_entries = NumSparseEntries(len);
+    // Entries are ordered by register index, which is in the high bits.
+    uint32_t* entry = lower_bound(entries, entries + num_entries, idx << 8);
+    if (entry != entries + num_entries && (*entry >> 8) == idx) {
+      if ((*entry & 0xff) < value) *entry = (idx << 8) | value;
+      return len;
+    }
+    if (num_entries < MAX_SPARSE_ENTRIES) {
+      memmove(entry + 1, entry, (entries + num_entries - entry) * sizeof(uint32_t));
+      *entry = (idx << 8) | value;
+      return len + sizeof(uint32_t);
+    }
+    len = ConvertToDense(state, len);
+  }
+
+  DCHECK_EQ(len, DENSE_SIZE);
+  uint8_t* registers = state + HEADER_SIZE;
+  if (registers[idx] < value) registers[idx] = value;
+  return len;
+}
+
+int HyperLogLog::MaxSizeAfterMerge(const uint8_t* dst, int dst_len, const uint8_t* src,
+    int src_len) {
+  if (GetFormat(dst) == DENSE || GetFormat(src) == DENSE) return DENSE_SIZE;
+  int num_entries = NumSparseEntries(dst_len) + NumSparseEntries(src_len);
+  if (num_entries <= MAX_SPARSE_ENTRIES) return HEADER_SIZE + num_entries * sizeof(uint32_t);
+  return DENSE_SIZE;
+}
+
+int HyperLogLog::Merge(uint8_t* dst, int dst_len, const uint8_t* src, int src_len) {
+  DCHECK_GE(src_len, EMPTY_SIZE);
+  if (GetFormat(dst) == SPARSE && GetFormat(src) == SPARSE) {
+    uint32_t* dst_entries = SparseEntries(dst);
+    const uint32_t* src_entries = SparseEntries(src);
+    int num_dst_entries = NumSparseEntries(dst_len);
+    int num_src_entries = NumSparseEntries(src_len);
+    if (num_dst_entries + num_src_entries <= MAX_SPARSE_ENTRIES) {
+      // Merge the sorted entries, keeping the larger value for registers in both.
+      uint32_t merged[MAX_SPARSE_ENTRIES];
+      int i = 0, j = 0, n = 0;
+      while (i < num_dst_entries && j < num_src_entries) {
+        uint32_t dst_idx = dst_entries[i] >> 8;
+        uint32_t src_idx = src_entries[j] >> 8;
+        if (dst_idx < src_idx) {
+          merged[n++] = dst_entries[i++];
+        } else if (src_idx < dst_idx) {
+          merged[n++] = src_entries[j++];
+        } else {
+          merged[n++] = max(dst_entries[i++], src_entries[j++]);
+        }
+      }
+      while (i < num_dst_entries) merged[n++] = dst_entries[i++];
+      while (j < num_src_entries) merged[n++] = src_entries[j++];
+      memcpy(dst_entries, merged, n * sizeof(uint32_t));
+      return HEADER_SIZE + n * sizeof(uint32_t);
+    }
+  }
+
+  if (GetFormat(dst) == SPARSE) dst_len = ConvertToDense(dst, dst_len);
+  uint8_t* registers = dst + HEADER_SIZE;
+  if (GetFormat(src) == SPARSE) {
+    const uint32_t* src_entries = SparseEntries(src);
+    int num_src_entries = NumSparseEntries(src_len);
+    for (int i = 0; i < num_src_entries; ++i) {
+      uint32_t idx = src_entries[i] >> 8;
+      uint8_t value = src_entries[i] & 0xff;
+      if (registers[idx] < value) registers[idx] = value;
+    }
+  } else {
+    DCHECK_EQ(src_len, DENSE_SIZE);
+    const uint8_t* src_registers = src + HEADER_SIZE;
+    for (int i = 0; i < NUM_REGISTERS; ++i) {
+      registers[i] = max(registers[i], src_registers[i]);
+    }
+  }
+  return dst_len;
+}
+
+int HyperLogLog::ConvertToDense(uint8_t* state, int len) {
+  DCHECK_EQ(GetFormat(state), SPARSE);
+  int num_entries = NumSparseEntries(len);
+  uint32_t entries[MAX_SPARSE_ENTRIES];
+  memcpy(entries, SparseEntries(state), num_entries * sizeof(uint32_t));
+
+  *reinterpret_cast<uint32_t*>(state) = DENSE;
+  uint8_t* registers = state + HEADER_SIZE;
+  memset(registers, 0, NUM_REGISTERS);
+  for (int i = 0; i < num_entries; ++i) {
+    registers[entries[i] >> 8] = entries[i] & 0xff;
+  }
+  return DENSE_SIZE;
+}
+
+int64_t HyperLogLog::Estimate(const uint8_t* state, int len) {
+  // The harmonic mean of 2^register over all registers, and the number of empty
+  // registers.
+  double sum = 0;
+  int num_zero_registers = 0;
+  if (GetFormat(state) == SPARSE) {
+    const uint32_t* entries = SparseEntries(state);
+    int num_entries = NumSparseEntries(len);
+    for (int i = 0; i < num_entries; ++i) {
+      sum += 1.0 / (1ULL << (entries[i] & 0xff));
+    }
+    num_zero_registers = NUM_REGISTERS - num_entries;
+    sum += num_zero_registers;
+  } else {
+    DCHECK_EQ(len, DENSE_SIZE);
+    const uint8_t* registers = state + HEADER_SIZE;
+    for (int i = 0; i < NUM_REGISTERS; ++i) {
+      sum += 1.0 / (1ULL << registers[i]);
+      if (registers[i] == 0) ++num_zero_registers;
+    }
+  }
+
+  const double m = NUM_REGISTERS;
+  const double alpha = 0.7213 / (1 + 1.079 / m);
+  double estimate = alpha * m * m / sum;
+  // Small range correction: linear counting is more accurate while there are empty
+  // registers.
+  if (estimate <= 2.5 * m && num_zero_registers > 0) {
+    estimate = m * log(m / num_zero_registers);
+  }
+  return static_cast<int64_t>(estimate + 0.5);
+}
+
+}
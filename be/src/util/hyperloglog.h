@@ -0,0 +1,76 @@
+// Copyright (c) 2012 Cloudera, Inc. All rights reserved.
+
+#ifndef IMPALA_UTIL_HYPERLOGLOG_H
+#define IMPALA_UTIL_HYPERLOGLOG_H
+
+#include <boost/cstdint.hpp>
+
+namespace impala {
+
+// HyperLogLog distinct value estimator (Flajolet et al., "HyperLogLog: the analysis of
+// a near-optimal cardinality estimation algorithm") over 64-bit hash values.
+// The estimator does not own its state: the state is a flat buffer supplied by the
+// caller, so that it can be kept in a string slot and shipped to other nodes as is.
+// The state starts with a 4-byte header holding its format:
+//   - SPARSE: followed by a sorted array of uint32_t entries, one per non-zero
+//     register, each holding (register index << 8) | register value.  Sets with
+//     few distinct values only take a few bytes.
+//   - DENSE: followed by one byte per register.
+// A sparse state is converted to a dense one when it would exceed MAX_SPARSE_ENTRIES
+// entries.  Both formats hold the same registers, so the estimate doesn't depend on the
+// format.
+// With NUM_REGISTERS = 4096 the standard error of the estimate is 1.04 / sqrt(4096),
+// i.e. 1.6%, and a dense state takes 4KB.  No large range correction is needed with
+// 64-bit hashes.
+// The caller must ensure the buffer is large enough (see MaxSizeAfterInsert() and
+// MaxSizeAfterMerge()); the functions return the new size of the state.
+class HyperLogLog {
+ public:
+  static const int PRECISION = 12;
+  static const int NUM_REGISTERS = 1 << PRECISION;
+  static const int MAX_SPARSE_ENTRIES = NUM_REGISTERS / 8;
+
+  static const int HEADER_SIZE = sizeof(uint32_t);
+  // Size of an empty state.
+  static const int EMPTY_SIZE = HEADER_SIZE;
+  // Size of a dense state.  No state is larger than this.
+  static const int DENSE_SIZE = HEADER_SIZE + NUM_REGISTERS;
+
+  // Initializes an empty state in 'state', which must hold EMPTY_SIZE bytes.
+  static int Init(uint8_t* state);
+
+  // Returns the maximum size of 'state', of 'len' bytes, after an Insert().
+  static int MaxSizeAfterInsert(const uint8_t* state, int len);
+
+  // Adds a value with hash 'hash' to 'state'.
+  static int Insert(uint8_t* state, int len, uint64_t hash);
+
+  // Returns the maximum size of 'dst' after merging 'src' into it.
+  static int MaxSizeAfterMerge(const uint8_t* dst, int dst_len, const uint8_t* src,
+      int src_len);
+
+  // Merges 'src' into 'dst', so that 'dst' estimates the union of both sets.
+  static int Merge(uint8_t* dst, int dst_len, const uint8_t* src, int src_len);
+
+  // Returns the estimated number of distinct values added to 'state'.
+  static int64_t Estimate(const uint8_t* state, int len);
+
+ private:
+  enum Format {
+    SPARSE = 0,
+    DENSE = 1,
+  };
+
+  static Format GetFormat(const uint8_t* state) {
+    return static_cast<Format>(*reinterpret_cast<const uint32_t*>(state));
+  }
+
+  static int NumSparseEntries(int len) { return (len - HEADER_SIZE) / sizeof(uint32_t); }
+
+  // Converts the sparse 'state' to a dense one.  'state' must hold DENSE_SIZE bytes.
+  static int ConvertToDense(uint8_t* state, int len);
+};
+
+}
+
+#endif
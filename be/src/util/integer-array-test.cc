@@ -33,6 +33,29 @@ TEST(IntegerArrayTest, Basic) {
     }
   }
 }
+
+// Test that skipping values leaves the array at the same value as reading them.
+TEST(IntegerArrayTest, Skip) { 
+  MemPool mempool;
+  for (int size = 1; size <= 12; ++size) {
+    IntegerArrayBuilder build(size, 1000, &mempool);
+    for (int i = 0; i < 1000; ++i) {
+      EXPECT_TRUE(build.Put(i % (1 << size)));
+    }
+    for (int skip = 1; skip <= 37; skip += 6) {
+      IntegerArray int_array(size, 1000, build.array());
+      int i = 0;
+      while (i < 1000) {
+        EXPECT_EQ(int_array.GetNextValue(), i % (1 << size));
+        ++i;
+        int_array.SkipValues(skip);
+        i += skip;
+      }
+      // Skipping past the end leaves no more values.
+      EXPECT_EQ(int_array.GetNextValue(), 0);
+    }
+  }
+}
 }
 
 int main(int argc, char **argv) {
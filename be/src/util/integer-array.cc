@@ -56,6 +56,7 @@ uint32_t IntegerArray::GetNextValue() {
       // Set the mask and shift for the next integer.
       shift_ = bit_size_ - ((8 * sizeof(uint32_t)) - shift_);
       mask_ = ((1 << bit_size_) - 1) << shift_;
+      --count_;
 
       return value;
     }
@@ -68,6 +69,20 @@ uint32_t IntegerArray::GetNextValue() {
   return value;
 }
 
+void IntegerArray::SkipValues(int num_values) {
+  if (num_values > count_) num_values = count_;
+  // The values are densely packed so the new position can be computed directly.
+  // The current position is the bits consumed in the current word plus all the
+  // words before it.
+  uint32_t* start = reinterpret_cast<uint32_t*>(array_);
+  int64_t bit_offset = (current_ - start) * 8 * sizeof(uint32_t) + shift_;
+  bit_offset += static_cast<int64_t>(num_values) * bit_size_;
+  current_ = start + bit_offset / (8 * sizeof(uint32_t));
+  shift_ = bit_offset % (8 * sizeof(uint32_t));
+  mask_ = ((1 << bit_size_) - 1) << shift_;
+  count_ -= num_values;
+}
+
 IntegerArrayBuilder::IntegerArrayBuilder(int bit_size, int max_count, MemPool* mempool)
   : max_count_(max_count),
     mempool_(mempool) { 
@@ -24,6 +24,9 @@ class IntegerArray {
   // Returns 0 if there are no more values.
   uint32_t GetNextValue();
 
+  // Skips over the next 'num_values' values without decoding them.
+  void SkipValues(int num_values);
+
   // number of bytes needed to store 'count' integers of 'bit_size' bits.
   static int ArraySize(int bit_size, int count);
 
@@ -4,6 +4,7 @@ namespace cpp impala
 namespace java com.cloudera.impala.thrift
 
 include "Types.thrift"
+include "Descriptors.thrift"
 
 // Serialized, self-contained version of a RowBatch (in be/src/runtime/row-batch.h).
 struct TRowBatch {
@@ -18,9 +19,16 @@ struct TRowBatch {
   // An offset of -1 records a NULL.
   3: list<i32> tuple_offsets
 
-  // binary tuple data, broken up into chunks
-  // TODO: figure out how we can avoid copying the data during TRowBatch construction
+  // binary tuple data, broken up into chunks; RowBatch::Serialize() writes a single
+  // chunk, which the receiving RowBatch adopts as its tuple data
   4: list<string> tuple_data
+
+  // if set, tuple_data is a single chunk compressed with this codec
+  // (see RowBatchCompressor)
+  5: optional Descriptors.THdfsCompression compression_type
+
+  // size of tuple_data after decompression; set if compression_type is set
+  6: optional i32 uncompressed_size
 }
 
 // this is a union over all possible return types
@@ -37,6 +37,8 @@ enum TAggregationOp {
   MERGE_PCSA,
   MIN,
   SUM,
+  HLL,
+  MERGE_HLL,
 }
 
 struct TAggregateExpr {
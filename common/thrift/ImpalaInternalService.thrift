@@ -37,6 +37,8 @@ struct TQueryOptions {
   9: required i32 max_io_buffers = 0
   10: required bool allow_unsupported_formats = 0
   11: required bool partition_agg = 0
+  12: required i64 mem_limit = 0
+  13: required bool partition_join = 0
 }
 
 // A scan range plus the parameters needed to execute that scan.
@@ -209,8 +211,8 @@ struct TTransmitDataParams {
   // required in V1
   2: optional Types.TUniqueId dest_fragment_instance_id
 
-  // for debugging purposes; currently ignored
-  //3: optional Types.TUniqueId src_fragment_instance_id
+  // identifies the sender; the receiver limits how much data it buffers per sender
+  3: optional Types.TUniqueId src_fragment_instance_id
 
   // required in V1
   4: optional Types.TPlanNodeId dest_node_id
@@ -229,6 +231,64 @@ struct TTransmitDataResult {
 }
 
 
+// UpdateFilter / PublishFilter
+
+// A runtime filter on the values of a single slot, computed from the build side of a
+// hash join and applied by scans of the probe side.  A row whose slot value fails the
+// filter cannot have a join partner.
+struct TRuntimeFilter {
+  // Join node that produced the filter and the index of the equi-join conjunct it was
+  // computed for.
+  1: required Types.TPlanNodeId src_node_id
+  2: required i32 expr_idx
+
+  // Slot (of a tuple materialized by a scan) that the filter is applied to.
+  3: required Types.TTupleId target_tuple_id
+  4: required Types.TSlotId target_slot_id
+
+  // Bit array of the Bloom filter over the slot values' hashes.
+  5: required binary bloom_filter
+
+  // Range of the build values; only set for integer slots.
+  6: optional i64 min_value
+  7: optional i64 max_value
+
+  // If true, the build side had too many distinct values for the filter to be
+  // selective; the filter passes all values and is not applied.
+  8: optional bool always_true
+}
+
+struct TUpdateFilterParams {
+  1: required ImpalaInternalServiceVersion protocol_version
+
+  // required in V1
+  2: optional Types.TUniqueId query_id
+
+  // required in V1
+  3: optional TRuntimeFilter filter
+}
+
+struct TUpdateFilterResult {
+  // required in V1
+  1: optional Status.TStatus status
+}
+
+struct TPublishFilterParams {
+  1: required ImpalaInternalServiceVersion protocol_version
+
+  // required in V1
+  2: optional Types.TUniqueId dst_fragment_instance_id
+
+  // required in V1
+  3: optional TRuntimeFilter filter
+}
+
+struct TPublishFilterResult {
+  // required in V1
+  1: optional Status.TStatus status
+}
+
+
 service ImpalaInternalService {
   // Called by coord to start asynchronous execution of plan fragment in backend.
   // Returns as soon as all incoming data streams have been set up.
@@ -246,4 +306,11 @@ service ImpalaInternalService {
   // Called by sender to transmit single row batch. Returns error indication
   // if params.fragmentId or params.destNodeId are unknown or if data couldn't be read.
   TTransmitDataResult TransmitData(1:TTransmitDataParams params);
+
+  // Called by a backend to send the runtime filter computed by one instance of a join
+  // to the coordinator.
+  TUpdateFilterResult UpdateFilter(1:TUpdateFilterParams params);
+
+  // Called by coord to deliver a (merged) runtime filter to a plan fragment instance.
+  TPublishFilterResult PublishFilter(1:TPublishFilterParams params);
 }
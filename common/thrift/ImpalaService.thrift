@@ -56,7 +56,16 @@ enum TImpalaQueryOptions {
   PARTITION_AGG,
   
   // If true, Impala will try to execute on file formats that are not fully supported yet
-  ALLOW_UNSUPPORTED_FORMATS
+  ALLOW_UNSUPPORTED_FORMATS,
+
+  // Maximum number of bytes a query may use on each backend; the query fails once the
+  // limit is exceeded.  0 means no limit other than the process-wide --mem_limit.
+  MEM_LIMIT,
+
+  // boolean; if true, execute joins of two partitioned inputs by hash-partitioning
+  // both inputs on the join exprs, rather than broadcasting the right input to all
+  // nodes executing the left input
+  PARTITION_JOIN
 }
 
 // The summary of an insert.
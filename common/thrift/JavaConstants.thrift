@@ -44,4 +44,6 @@ const map<ImpalaService.TImpalaQueryOptions, string> DEFAULT_QUERY_OPTIONS = {
   ImpalaService.TImpalaQueryOptions.NUM_SCANNER_THREADS : "0"
   ImpalaService.TImpalaQueryOptions.PARTITION_AGG : "false"
   ImpalaService.TImpalaQueryOptions.ALLOW_UNSUPPORTED_FORMATS : "false"
+  ImpalaService.TImpalaQueryOptions.MEM_LIMIT : "0"
+  ImpalaService.TImpalaQueryOptions.PARTITION_JOIN : "false"
 }
@@ -137,7 +137,7 @@ terminal KW_AND, KW_ALL, KW_AS, KW_ASC, KW_AVG, KW_BETWEEN, KW_BIGINT, KW_BOOLEA
   KW_DISTINCT, KW_DISTINCTPC, KW_DISTINCTPCSA,
   KW_DIV, KW_DOUBLE, KW_ELSE, KW_END, KW_FALSE, KW_FLOAT, KW_FROM, KW_FULL, KW_GROUP,
   KW_HAVING, KW_IS, KW_IN, KW_INNER, KW_JOIN, KW_INT, KW_LEFT, KW_LIKE, KW_LIMIT, KW_MIN,
-  KW_MAX, KW_NOT, KW_NULL, KW_ON, KW_OR, KW_ORDER, KW_OUTER, KW_REGEXP,
+  KW_MAX, KW_NDV, KW_NOT, KW_NULL, KW_ON, KW_OR, KW_ORDER, KW_OUTER, KW_REGEXP,
   KW_RLIKE, KW_RIGHT, KW_SCHEMAS, KW_SELECT, KW_SHOW, KW_SEMI, KW_SMALLINT, KW_STRING, 
   KW_SUM, KW_TABLES, KW_TINYINT, KW_TRUE, KW_UNION, KW_USE, KW_USING, KW_WHEN, KW_WHERE, 
   KW_THEN, KW_TIMESTAMP, KW_INSERT, KW_INTO, KW_OVERWRITE, KW_TABLE, KW_PARTITION, 
@@ -904,6 +904,8 @@ aggregate_operator ::=
   {: RESULT = AggregateExpr.Operator.SUM; :}
   | KW_AVG
   {: RESULT = AggregateExpr.Operator.AVG; :}
+  | KW_NDV
+  {: RESULT = AggregateExpr.Operator.HLL; :}
   ;
 
 aggregate_param_list ::=
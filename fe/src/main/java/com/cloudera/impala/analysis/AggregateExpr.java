@@ -23,6 +23,8 @@ public class AggregateExpr extends Expr {
     DISTINCT_PCSA("DISTINC_PCSA", TAggregationOp.DISTINCT_PCSA,true),
     MERGE_PCSA("MERGE_PCSA", TAggregationOp.MERGE_PCSA, true),
     SUM("SUM", TAggregationOp.SUM, false),
+    HLL("NDV", TAggregationOp.HLL, true),
+    MERGE_HLL("MERGE_HLL", TAggregationOp.MERGE_HLL, true),
     AVG("AVG", TAggregationOp.INVALID, false);
 
     private final String description;
@@ -166,17 +168,19 @@ public class AggregateExpr extends Expr {
                     "AVG requires a numeric or timestamp parameter: " + this.toSql());
     }
 
-    if ((op == Operator.MERGE_PC || op == Operator.MERGE_PCSA)
-        && !arg.type.isStringType()) {
+    if ((op == Operator.MERGE_PC || op == Operator.MERGE_PCSA
+        || op == Operator.MERGE_HLL) && !arg.type.isStringType()) {
       Preconditions.checkState(false,
-          "MERGEPC(SA) expects string type input but gets " +
+          op.toString() + " expects string type input but gets " +
           arg.type.toString());
     }
 
     if (op == Operator.DISTINCT_PC ||
         op == Operator.MERGE_PC ||
         op == Operator.DISTINCT_PCSA ||
-        op == Operator.MERGE_PCSA) {
+        op == Operator.MERGE_PCSA ||
+        op == Operator.HLL ||
+        op == Operator.MERGE_HLL) {
       // Distinct/Merge Estimate is a string type.
       // Although the number of distinct value is a number, we're using string as return
       // type. This is because the distinct estimation algorithm uses a bitmap as an
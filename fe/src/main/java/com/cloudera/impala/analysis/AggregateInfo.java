@@ -323,6 +323,11 @@ public class AggregateInfo {
         aggExpr =
             new AggregateExpr(AggregateExpr.Operator.MERGE_PCSA, false, false,
                 aggExprParamList);
+      } else if (inputExpr.getOp() == AggregateExpr.Operator.HLL) {
+        // Merge local HyperLogLog registers
+        aggExpr =
+            new AggregateExpr(AggregateExpr.Operator.MERGE_HLL, false, false,
+                aggExprParamList);
       } else {
         aggExpr = new AggregateExpr(inputExpr.getOp(), false, false, aggExprParamList);
       }
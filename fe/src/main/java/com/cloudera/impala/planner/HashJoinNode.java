@@ -60,6 +60,10 @@ public class HashJoinNode extends PlanNode {
     }
   }
 
+  public List<Pair<Expr, Expr> > getEqJoinConjuncts() {
+    return eqJoinConjuncts;
+  }
+
   @Override
   protected String debugString() {
     return Objects.toStringHelper(this)
@@ -89,7 +89,7 @@ public class Planner {
       // pass it back to the client
       createPlanFragments(
           singleNodePlan, analysisResult.isInsertStmt(), queryOptions.partition_agg,
-          fragments);
+          queryOptions.partition_join, fragments);
     }
 
     PlanFragment rootFragment = fragments.get(fragments.size() - 1);
@@ -138,15 +138,18 @@ public class Planner {
    * partitioned; the partitioning function is derived from the inputs.
    * If partitionAgg is true, AggregationNodes that do grouping are partitioned
    * on their grouping exprs and placed in a separate fragment.
+   * If partitionJoin is true, HashJoinNodes with partitioned inputs are executed
+   * in a separate fragment that is partitioned on the join exprs.
    */
   private PlanFragment createPlanFragments(
       PlanNode root, boolean isPartitioned, boolean partitionAgg,
-      ArrayList<PlanFragment> fragments)
+      boolean partitionJoin, ArrayList<PlanFragment> fragments)
       throws InternalException, NotImplementedException {
     ArrayList<PlanFragment> childFragments = Lists.newArrayList();
     for (PlanNode child: root.getChildren()) {
       // allow child fragments to be partitioned; merge later if needed
-      childFragments.add(createPlanFragments(child, true, partitionAgg, fragments));
+      childFragments.add(
+          createPlanFragments(child, true, partitionAgg, partitionJoin, fragments));
     }
 
     PlanFragment result = null;
@@ -156,7 +159,8 @@ public class Planner {
     } else if (root instanceof HashJoinNode) {
       Preconditions.checkState(childFragments.size() == 2);
       result = createHashJoinFragment(
-          (HashJoinNode) root, childFragments.get(1), childFragments.get(0), fragments);
+          (HashJoinNode) root, childFragments.get(1), childFragments.get(0),
+          partitionJoin, fragments);
     } else if (root instanceof MergeNode) {
       result = createMergeNodeFragment((MergeNode) root, childFragments);
     } else if (root instanceof AggregationNode) {
@@ -219,8 +223,11 @@ public class Planner {
   }
 
   /**
-   * Doesn't create a new fragment, but modifies leftChildFragment to execute
-   * a hash join:
+   * Returns a fragment that executes a hash join. If partitionJoin is true and both
+   * inputs are partitioned, this is a new fragment that is hash-partitioned on the
+   * join exprs (see createPartitionedHashJoinFragment()).
+   * Otherwise, doesn't create a new fragment, but modifies leftChildFragment to
+   * execute the hash join:
    * - the output of the right child fragment is broadcast to the left child fragment
    * - if the output of the right child fragment is partitioned and an aggregation
    *   result (either from TopN- or AggregationNode), creates a merge fragment
@@ -229,7 +236,8 @@ public class Planner {
    */
   private PlanFragment createHashJoinFragment(
       HashJoinNode node, PlanFragment rightChildFragment,
-      PlanFragment leftChildFragment, ArrayList<PlanFragment> fragments) {
+      PlanFragment leftChildFragment, boolean partitionJoin,
+      ArrayList<PlanFragment> fragments) {
     PlanNode rightChildRoot = rightChildFragment.getPlanRoot();
     if (rightChildFragment.isPartitioned()
         && (rightChildRoot instanceof AggregationNode
@@ -237,11 +245,58 @@ public class Planner {
       rightChildFragment = createMergeFragment(rightChildFragment);
       fragments.add(rightChildFragment);
     }
+    if (partitionJoin && leftChildFragment.isPartitioned()
+        && rightChildFragment.isPartitioned() && hasPartitionableJoinExprs(node)) {
+      return createPartitionedHashJoinFragment(
+          node, rightChildFragment, leftChildFragment);
+    }
     connectChildFragment(node, 1, leftChildFragment, rightChildFragment);
     leftChildFragment.setPlanRoot(node);
     return leftChildFragment;
   }
 
+  /**
+   * Returns true if both sides of each of node's equi-join conjuncts have the same
+   * type, so that equal values of the lhs and rhs exprs hash to the same partition.
+   */
+  private boolean hasPartitionableJoinExprs(HashJoinNode node) {
+    for (Pair<Expr, Expr> entry: node.getEqJoinConjuncts()) {
+      if (entry.first.getType() != entry.second.getType()) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  /**
+   * Creates a new fragment that executes a partitioned ("shuffle") hash join:
+   * the outputs of both child fragments are hash-partitioned on their respective
+   * join exprs, so that each instance of the join fragment only needs to build a
+   * hash table over its partition of the right input. This scales with the number
+   * of nodes, unlike broadcasting the entire right input to every node.
+   */
+  private PlanFragment createPartitionedHashJoinFragment(
+      HashJoinNode node, PlanFragment rightChildFragment,
+      PlanFragment leftChildFragment) {
+    List<Expr> lhsJoinExprs = Lists.newArrayList();
+    List<Expr> rhsJoinExprs = Lists.newArrayList();
+    for (Pair<Expr, Expr> entry: node.getEqJoinConjuncts()) {
+      lhsJoinExprs.add(entry.first);
+      rhsJoinExprs.add(entry.second);
+    }
+    DataPartition lhsPartition =
+        new DataPartition(TPartitionType.HASH_PARTITIONED, lhsJoinExprs);
+    DataPartition rhsPartition =
+        new DataPartition(TPartitionType.HASH_PARTITIONED, rhsJoinExprs);
+
+    PlanFragment joinFragment = new PlanFragment(node, lhsPartition);
+    connectChildFragment(node, 0, joinFragment, leftChildFragment);
+    leftChildFragment.setOutputPartition(lhsPartition);
+    connectChildFragment(node, 1, joinFragment, rightChildFragment);
+    rightChildFragment.setOutputPartition(rhsPartition);
+    return joinFragment;
+  }
+
   /**
    * Creates an unpartitioned fragment that merges the outputs of all of its children
    * (with a single ExchangeNode), corresponding to the 'mergeNode' of the
@@ -303,6 +358,7 @@ public class Planner {
   /**
    * Create a new fragment containing a single ExchangeNode that consumes the output
    * of childFragment, and set the destination of childFragment to the new parent.
+   * childFragment's output is partitioned like the new parent.
    */
   private PlanFragment createParentFragment(
       PlanFragment childFragment, DataPartition partition) {
@@ -310,6 +366,7 @@ public class Planner {
         new PlanNodeId(nodeIdGenerator), childFragment.getPlanRoot(), false);
     PlanFragment parentFragment = new PlanFragment(exchangeNode, partition);
     childFragment.setDestination(parentFragment, exchangeNode.getId());
+    childFragment.setOutputPartition(partition);
     return parentFragment;
   }
 
@@ -346,18 +403,25 @@ public class Planner {
       partitionAgg = false;
     }
 
+    // is 'node' the 2nd phase of a DISTINCT aggregation?
+    boolean is2ndPhaseDistinctAgg =
+        node.getChild(0) instanceof AggregationNode
+          && ((AggregationNode)(node.getChild(0))).getAggInfo().isDistinctAgg();
+
     DataPartition partition = null;
     if (partitionAgg) {
-      partition = new DataPartition(TPartitionType.HASH_PARTITIONED, groupingExprs);
+      // the new fragment receives the output of the (1st-phase) aggregation in
+      // childFragment, so the partitioning exprs need to reference that output
+      // rather than the input of 'node'
+      ArrayList<Expr> partitionExprs =
+          is2ndPhaseDistinctAgg
+            ? groupingExprs
+            : node.getAggInfo().getMergeAggInfo().getGroupingExprs();
+      partition = new DataPartition(TPartitionType.HASH_PARTITIONED, partitionExprs);
     } else {
       partition = DataPartition.UNPARTITIONED;
     }
 
-    // is 'node' the 2nd phase of a DISTINCT aggregation?
-    boolean is2ndPhaseDistinctAgg =
-        node.getChild(0) instanceof AggregationNode
-          && ((AggregationNode)(node.getChild(0))).getAggInfo().isDistinctAgg();
-
     if (is2ndPhaseDistinctAgg) {
       Preconditions.checkState(node.getChild(0) == childFragment.getPlanRoot());
       // place a merge aggregation step for the 1st phase in a new fragment
@@ -444,7 +508,6 @@ public class Planner {
   /**
    * Create tree of PlanNodes that implements the Select/Project/Join/Group by/Having
    * of the selectStmt query block.
-   * @throws NotImplementedException if selectStmt contains Order By clause w/o Limit
    */
   private PlanNode createSelectPlan(SelectStmt selectStmt, Analyzer analyzer)
       throws NotImplementedException, InternalException {
@@ -472,13 +535,6 @@ public class Planner {
       root.getChildren().get(1).setCompactData(true);
     }
 
-    if (selectStmt.getSortInfo() != null && selectStmt.getLimit() == -1) {
-      // TODO: only use topN if the memory footprint is expected to be low;
-      // how to account for strings?
-      throw new NotImplementedException(
-          "ORDER BY without LIMIT currently not supported");
-    }
-
     // add aggregation, if required
     AggregateInfo aggInfo = selectStmt.getAggInfo();
     if (aggInfo != null) {
@@ -501,8 +557,10 @@ public class Planner {
     // add order by and limit
     SortInfo sortInfo = selectStmt.getSortInfo();
     if (sortInfo != null) {
-      Preconditions.checkState(selectStmt.getLimit() != -1);
-      root = new SortNode(new PlanNodeId(nodeIdGenerator), root, sortInfo, true);
+      // TODO: only use topN if the memory footprint is expected to be low;
+      // how to account for strings?
+      boolean useTopN = selectStmt.getLimit() != -1;
+      root = new SortNode(new PlanNodeId(nodeIdGenerator), root, sortInfo, useTopN);
     }
     root.setLimit(selectStmt.getLimit());
 
@@ -853,11 +911,8 @@ public class Planner {
     // Add order by and limit if present.
     SortInfo sortInfo = unionStmt.getSortInfo();
     if (sortInfo != null) {
-      if (unionStmt.getLimit() == -1) {
-        throw new NotImplementedException(
-            "ORDER BY without LIMIT currently not supported");
-      }
-      result = new SortNode(new PlanNodeId(nodeIdGenerator), result, sortInfo, true);
+      boolean useTopN = unionStmt.getLimit() != -1;
+      result = new SortNode(new PlanNodeId(nodeIdGenerator), result, sortInfo, useTopN);
     }
     result.setLimit(unionStmt.getLimit());
 